@@ -28,11 +28,10 @@
 
 #include "trihlavHttpClient.hpp"
 
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
-#include <boost/log/expressions.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
+#include <cstdlib>
 #include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include "trihlavLib/trihlavConstants.hpp"
 
@@ -66,11 +65,11 @@ namespace trihlav {
                         + K_HTTPS + K_DIV + ".");
             } else {
                 m_Mode = HTTPS;
-                BOOST_LOG_TRIVIAL(debug) << "mode \"" << K_HTTPS << "\"";
+                TRIHLAV_LOG(debug) << "mode \"" << K_HTTPS << "\"";
             }
         } else {
             m_Mode = HTTP;
-            BOOST_LOG_TRIVIAL(debug) << "mode \"" << K_HTTP << "\"";
+            TRIHLAV_LOG(debug) << "mode \"" << K_HTTP << "\"";
         }
         myIt = pServer.find("://");
         const size_t myIt3 = myIt + 3;
@@ -80,7 +79,7 @@ namespace trihlav {
                             "server definition.");
         }
         const string myServer{pServer.substr(myIt3, pServer.size())};
-        BOOST_LOG_TRIVIAL(debug) << "server and port " << myServer;
+        TRIHLAV_LOG(debug) << "server and port " << myServer;
         myIt = myServer.find_first_of(':');
         if (myIt == -1) {
             m_Server = myServer;
@@ -93,8 +92,8 @@ namespace trihlav {
                 m_Port = "";
             }
         }
-        BOOST_LOG_TRIVIAL(debug) << "server \"" << m_Server << "\" port \""
-                                 << m_Port << "\"";
+        TRIHLAV_LOG(debug) << "server \"" << m_Server << "\" port \""
+                           << m_Port << "\"";
     }
 
 /**
@@ -102,9 +101,10 @@ namespace trihlav {
  */
     HttpClient::HttpClient(io_service &io_service, context &context,
                            const string &pServer, const string &pUsername,
-                           const Passwords &pPasswords) :
+                           const Passwords &pPasswords, const string &pNonce) :
             m_Resolver(io_service), m_SslSocket(io_service, context), m_HttpSocket(
             io_service) {
+        reached(EStart);
         parseModeHostAndPort(pServer);
         // Form the request. We specify the "Connection: close" header so that the
         // server will close the socket after transmitting the response. This will
@@ -116,7 +116,10 @@ namespace trihlav {
              myPswdPtr != pPasswords.end(); ++myPswdPtr) {
             myUrl += (K_SP + *myPswdPtr);
         }
-        BOOST_LOG_TRIVIAL(debug) << myUrl;
+        if (!pNonce.empty()) {
+            myUrl += "&" + K_NONCE + "=" + pNonce;
+        }
+        TRIHLAV_LOG(debug) << myUrl;
         request_stream << "GET " << myUrl << " HTTP/1.0\r\n";
         request_stream << "Host: " << m_Server << "\r\n";
         request_stream << "Accept: */*\r\n";
@@ -124,7 +127,7 @@ namespace trihlav {
 
         // Start an asynchronous resolve to translate the server and service names
         // into a list of endpoints.
-        BOOST_LOG_TRIVIAL(debug) << "Resolving " << m_Server;
+        TRIHLAV_LOG(debug) << "Resolving " << m_Server;
         tcp::resolver::query query(m_Server,
                                    m_Port.empty() ? getProtocol() : m_Port);    ///"http" "https"
         m_Resolver.async_resolve(query,
@@ -136,7 +139,8 @@ namespace trihlav {
     void HttpClient::handleResolve(const boost::system::error_code &err,
                                    tcp::resolver::iterator endpoint_iterator) {
         if (!err) {
-            BOOST_LOG_TRIVIAL(info) << "Resolve OK";
+            reached(EResolved);
+            TRIHLAV_LOG(info) << "Resolve OK";
             m_ResponseStr = "";
             m_SslSocket.set_verify_mode(boost::asio::ssl::verify_peer);
             m_SslSocket.set_verify_callback(
@@ -152,7 +156,7 @@ namespace trihlav {
                                                        boost::asio::placeholders::error));
             }
         } else {
-            BOOST_LOG_TRIVIAL(error) << "Error resolve: " << err.message();
+            TRIHLAV_LOG(error) << "Error resolve: " << err.message();
         }
     }
 
@@ -169,14 +173,15 @@ namespace trihlav {
         char subject_name[256];
         X509 *cert = X509_STORE_CTX_get_current_cert(ctx.native_handle());
         X509_NAME_oneline(X509_get_subject_name(cert), subject_name, 256);
-        BOOST_LOG_TRIVIAL(info) << "Verifying " << subject_name;
+        TRIHLAV_LOG(info) << "Verifying " << subject_name;
 
         return preverified;
     }
 
     void HttpClient::handleConnect(const boost::system::error_code &err) {
         if (!err) {
-            BOOST_LOG_TRIVIAL(info) << "Connect OK ";
+            reached(EConnected);
+            TRIHLAV_LOG(info) << "Connect OK ";
             if (getMode() == HTTPS) {
                 m_SslSocket.async_handshake(boost::asio::ssl::stream_base::client,
                                             boost::bind(&HttpClient::handleHandshake, this,
@@ -187,24 +192,25 @@ namespace trihlav {
                                                      boost::asio::placeholders::error));
             }
         } else {
-            BOOST_LOG_TRIVIAL(error) << "Connect failed: " << err.message();
+            TRIHLAV_LOG(error) << "Connect failed: " << err.message();
         }
     }
 
     void HttpClient::handleHandshake(const boost::system::error_code &error) {
         if (!error) {
-            BOOST_LOG_TRIVIAL(info) << "Handshake OK ";
-            BOOST_LOG_TRIVIAL(debug) << "Request: ";
+            reached(EHandshaken);
+            TRIHLAV_LOG(info) << "Handshake OK ";
+            TRIHLAV_LOG(debug) << "Request: ";
             const char *header = boost::asio::buffer_cast<const char *>(
                     m_Request.data());
-            BOOST_LOG_TRIVIAL(debug) << header;
+            TRIHLAV_LOG(debug) << header;
 
             // The handshake was successful. Send the request.
             boost::asio::async_write(m_SslSocket, m_Request,
                                      boost::bind(&HttpClient::handleWriteRequest, this,
                                                  boost::asio::placeholders::error));
         } else {
-            BOOST_LOG_TRIVIAL(error) << "Handshake failed: " << error.message();
+            TRIHLAV_LOG(error) << "Handshake failed: " << error.message();
         }
     }
 
@@ -223,7 +229,7 @@ namespace trihlav {
                                                           boost::asio::placeholders::error));
             }
         } else {
-            BOOST_LOG_TRIVIAL(error) << "Error write req: " << err.message();
+            TRIHLAV_LOG(error) << "Error write req: " << err.message();
         }
     }
 
@@ -242,11 +248,11 @@ namespace trihlav {
                 return;
             }
             if (status_code != 200) {
-                BOOST_LOG_TRIVIAL(error) << "Response returned with status code ";
-                BOOST_LOG_TRIVIAL(error) << status_code;
+                TRIHLAV_LOG(error) << "Response returned with status code ";
+                TRIHLAV_LOG(error) << status_code;
                 return;
             }
-            BOOST_LOG_TRIVIAL(error) << status_code;
+            TRIHLAV_LOG(debug) << "Status " << status_code;
 
             // Read the response headers, which are terminated by a blank line.
             if (getMode() == HTTPS) {
@@ -260,7 +266,7 @@ namespace trihlav {
                                                           boost::asio::placeholders::error));
             }
         } else {
-            BOOST_LOG_TRIVIAL(error) << "Error reading status line: " << err.message();
+            TRIHLAV_LOG(error) << "Error reading status line: " << err.message();
         }
     }
 
@@ -269,8 +275,10 @@ namespace trihlav {
             // Process the response headers.
             std::istream response_stream(&m_Response);
             std::string header;
-            while (std::getline(response_stream, header) && header != "\r")
-                BOOST_LOG_TRIVIAL(debug) << header;
+            while (std::getline(response_stream, header) && header != "\r") {
+                TRIHLAV_LOG(debug) << header;
+                parseServerTiming(header);
+            }
 
             // Write whatever content we already have to output.
             if (m_Response.size() > 0)
@@ -290,7 +298,7 @@ namespace trihlav {
                                                     boost::asio::placeholders::error));
             }
         } else {
-            BOOST_LOG_TRIVIAL(error) << "Error reading headers: " << err;
+            TRIHLAV_LOG(error) << "Error reading headers: " << err;
         }
     }
 
@@ -298,12 +306,14 @@ namespace trihlav {
         // Write all of the data that has been read so far.
         m_ResponseStr += string {buffers_begin(m_Response.data()), buffers_end(
                 m_Response.data())};
-        BOOST_LOG_TRIVIAL(debug) << m_ResponseStr;
+        TRIHLAV_LOG(debug) << m_ResponseStr;
         if (m_ResponseStr.find("Fail!") != -1) {
             m_AuthOk = false;
+            reached(EAnswered);
             return true;
         } else if (m_ResponseStr.find("ok!") != -1) {
             m_AuthOk = true;
+            reached(EAnswered);
             return true;
         }
         return false;
@@ -326,7 +336,34 @@ namespace trihlav {
                                                     boost::asio::placeholders::error));
             }
         } else if (err != boost::asio::error::eof) {
-            BOOST_LOG_TRIVIAL(error) << "Error reading content: " << err;
+            TRIHLAV_LOG(error) << "Error reading content: " << err;
+        }
+    }
+
+    /**
+     * Later phases take over the time, so phases skipped (TLS for HTTP) or
+     * never reached account for zero.
+     */
+    void HttpClient::reached(const EPhase pPhase) {
+        const Clock::time_point myNow = Clock::now();
+        for (int myPhase = pPhase; myPhase < EPhaseCnt; ++myPhase) {
+            m_TimePoints[myPhase] = myNow;
+        }
+    }
+
+    /**
+     * Picks the "validate" metric of a "Server-Timing: validate;dur=<ms>"
+     * header, which the auth resource sends.
+     */
+    void HttpClient::parseServerTiming(const std::string &pHeader) {
+        static const string K_SERVER_TIMING("Server-Timing:");
+        static const string K_VALIDATE_DUR("validate;dur=");
+        if (!boost::algorithm::istarts_with(pHeader, K_SERVER_TIMING)) {
+            return;
+        }
+        const size_t myPos = pHeader.find(K_VALIDATE_DUR, K_SERVER_TIMING.size());
+        if (myPos != string::npos) {
+            m_ServerValidateMs = std::strtod(pHeader.c_str() + myPos + K_VALIDATE_DUR.size(), 0);
         }
     }
 
@@ -335,8 +372,8 @@ namespace trihlav {
             return K_HTTP;
         if (m_Mode == HTTPS)
             return K_HTTPS;
-        BOOST_LOG_TRIVIAL(error) << "Unknown protocol " << m_Mode
-                                 << " returning " + K_HTTPS;
+        TRIHLAV_LOG(error) << "Unknown protocol " << m_Mode
+                           << " returning " + K_HTTPS;
         return K_HTTPS;
     }
 
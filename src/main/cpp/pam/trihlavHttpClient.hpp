@@ -33,7 +33,8 @@
 #include <iostream>
 #include <istream>
 #include <ostream>
-#include <string>
+#include <array>
+#include <chrono>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/asio/ssl.hpp>
@@ -48,9 +49,17 @@ namespace trihlav {
             HTTP = 1, HTTPS = 2, INVALID = 0
         };
 
+        /// @brief Steps of one request, a step not reached keeps the time of the previous one.
+        enum EPhase {
+            EStart, EResolved, EConnected, EHandshaken, EAnswered, EPhaseCnt
+        };
+
+        using Clock = std::chrono::steady_clock;
+
         HttpClient(boost::asio::io_service &io_service,
                    boost::asio::ssl::context &context, const std::string &server,
-                   const std::string &pUsername, const Passwords &pPasswords);
+                   const std::string &pUsername, const Passwords &pPasswords,
+                   const std::string &pNonce = "");
 
         virtual ~HttpClient();
 
@@ -78,6 +87,16 @@ namespace trihlav {
 
         bool foundResponseStr();
 
+        /// @brief When pPhase was finished, HTTP connections are "handshaken" on connect.
+        const Clock::time_point &getTimePoint(const EPhase pPhase) const {
+            return m_TimePoints[pPhase];
+        }
+
+        /// @brief Validation time the server reported in "Server-Timing", negative when missing.
+        double getServerValidateMs() const {
+            return m_ServerValidateMs;
+        }
+
     private:
         void handleResolve(const boost::system::error_code &err,
                            boost::asio::ip::tcp::resolver::iterator endpoint_iterator);
@@ -99,6 +118,10 @@ namespace trihlav {
 
         const std::string &getProtocol() const;
 
+        void reached(const EPhase pPhase);
+
+        void parseServerTiming(const std::string &pHeader);
+
         boost::asio::ip::tcp::resolver m_Resolver;
         boost::asio::ssl::stream<boost::asio::ip::tcp::socket> m_SslSocket;
         boost::asio::ip::tcp::socket m_HttpSocket;
@@ -107,6 +130,8 @@ namespace trihlav {
         std::string m_Server, m_Port, m_ResponseStr;
         Mode m_Mode = INVALID;
         bool m_AuthOk = false;
+        std::array<Clock::time_point, EPhaseCnt> m_TimePoints;
+        double m_ServerValidateMs = -1.0;
     };
 
 } /* namespace trihlav */
@@ -31,6 +31,9 @@
 #include <cstdarg>
 #include <cstring>
 #include <cctype>
+#include <random>
+#include <sstream>
+#include <iomanip>
 
 /* Libtool defines PIC for shared objects */
 #ifndef PIC
@@ -62,13 +65,13 @@
 /* expected hook */
 PAM_EXTERN int pam_sm_setcred(pam_handle_t *pamh, int flags, int argc,
                               const char **argv) {
-    BOOST_LOG_TRIVIAL(debug) << "pam_sm_setcred";
+    TRIHLAV_LOG(debug) << "pam_sm_setcred";
     return PAM_SUCCESS;
 }
 
 PAM_EXTERN int pam_sm_acct_mgmt(pam_handle_t *pamh, int flags, int argc,
                                 const char **argv) {
-    BOOST_LOG_TRIVIAL(debug) << "Acct mgmt\n";
+    TRIHLAV_LOG(debug) << "Acct mgmt\n";
     return PAM_SUCCESS;
 }
 
@@ -80,7 +83,7 @@ PAM_EXTERN int pam_sm_authenticate(pam_handle_t *pamh, int flags, int argc,
     const char *pUsername;
     retval = pam_get_user(pamh, &pUsername, "Username: ");
 
-    BOOST_LOG_TRIVIAL(info) << "Welcome " << pUsername;
+    TRIHLAV_LOG(info) << "Welcome " << pUsername;
 
     if (retval != PAM_SUCCESS) {
         return retval;
@@ -94,14 +97,58 @@ PAM_EXTERN int pam_sm_authenticate(pam_handle_t *pamh, int flags, int argc,
 }
 
 namespace trihlav {
+
+    /// @brief How often an authentication without any answer is tried.
+    static const int K_AUTH_ATTEMPTS = 3;
+
+    /// @brief Random hex string, identifies the retries of one authentication.
+    static std::string makeNonce() {
+        std::random_device myRnd;
+        std::ostringstream myOut;
+        myOut << std::hex << std::setfill('0');
+        for (int myI = 0; myI < 4; ++myI) {
+            myOut << std::setw(8) << myRnd();
+        }
+        return myOut.str();
+    }
+
+/**
+ * All attempts carry the same nonce, so the server answers a retry of an
+ * already accepted request with "ok!" instead of rejecting a replay.
+ */
     AuthResult checkOtps(const std::string &pServer, const std::string &pUsername,
-                         const Passwords &pPasswords) {
+                         const Passwords &pPasswords, LoginTimings *pTimings) {
+        const HttpClient::Clock::time_point myStart = HttpClient::Clock::now();
         boost::asio::ssl::context ctx(boost::asio::ssl::context::sslv23);
         ctx.set_default_verify_paths();
 
-        boost::asio::io_service myIoSvc;
-        HttpClient myClt(myIoSvc, ctx, pServer, pUsername, pPasswords);
-        myIoSvc.run();
-        return AuthResult(myClt.isAuthOk(), myClt.getResponse());
+        const std::string myNonce{makeNonce()};
+        AuthResult myRetVal(false, "");
+        for (int myAttempt = 0; myAttempt < K_AUTH_ATTEMPTS; ++myAttempt) {
+            boost::asio::io_service myIoSvc;
+            HttpClient myClt(myIoSvc, ctx, pServer, pUsername, pPasswords, myNonce);
+            myIoSvc.run();
+            myRetVal = AuthResult(myClt.isAuthOk(), myClt.getResponse());
+            if (pTimings != 0) {
+                if (myAttempt == 0) {
+                    pTimings->m_Setup += myClt.getTimePoint(HttpClient::EStart) - myStart;
+                }
+                pTimings->m_Resolve += myClt.getTimePoint(HttpClient::EResolved)
+                                       - myClt.getTimePoint(HttpClient::EStart);
+                pTimings->m_Connect += myClt.getTimePoint(HttpClient::EConnected)
+                                       - myClt.getTimePoint(HttpClient::EResolved);
+                pTimings->m_Handshake += myClt.getTimePoint(HttpClient::EHandshaken)
+                                         - myClt.getTimePoint(HttpClient::EConnected);
+                pTimings->m_Request += myClt.getTimePoint(HttpClient::EAnswered)
+                                       - myClt.getTimePoint(HttpClient::EHandshaken);
+                pTimings->m_ValidateMs = myClt.getServerValidateMs();
+                pTimings->m_Attempts = myAttempt + 1;
+            }
+            if (!myClt.getResponse().empty()) {
+                break;
+            }
+            TRIHLAV_LOG(warning) << "No answer from " << pServer << ", attempt " << myAttempt + 1 << ".";
+        }
+        return myRetVal;
     }
 }
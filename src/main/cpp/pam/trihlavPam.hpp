@@ -31,6 +31,7 @@
 
 #include <tuple>
 #include <list>
+#include <chrono>
 #include <string>
 
 namespace trihlav {
@@ -38,8 +39,25 @@ namespace trihlav {
     using AuthResult = std::tuple<bool, std::string>;
     using Passwords = std::list<std::string>;
 
+    /// @brief Where the time of one checkOtps() call went, summed over its attempts.
+    struct LoginTimings {
+        using Duration = std::chrono::steady_clock::duration;
+        Duration m_Setup = Duration::zero();     //< SSL context, io_service and request
+        Duration m_Resolve = Duration::zero();
+        Duration m_Connect = Duration::zero();
+        Duration m_Handshake = Duration::zero(); //< zero for HTTP
+        Duration m_Request = Duration::zero();   //< request sent until answer read
+        double m_ValidateMs = -1.0;              //< server side, from "Server-Timing", negative when unknown
+        int m_Attempts = 0;
+    };
+
+    /**
+     * Ask the server pServer ("http[s]://host[:port]") whether all pPasswords
+     * are valid OTPs of pUsername.
+     * @param pTimings when not null receives the latency break down.
+     */
     AuthResult checkOtps(const std::string &pServer, const std::string &pUsername,
-                         const Passwords &pPasswords);
+                         const Passwords &pPasswords, LoginTimings *pTimings = 0);
 
 }  // namespace trihlav
 
@@ -0,0 +1,142 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Converts the keys of the key store in use into another key store, fe.
+ * the JSON key files into the memory mapped keystore, @see KeyStore.
+ * The key files replace keystore records with the same public ID, the
+ * converted key files are renamed to "converted-..." unless --keep is
+ * given. The settings are switched over to the new key store.
+ *
+ * Stop trihlavsrv first, a running server keeps using the old key store.
+ */
+
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <boost/program_options.hpp>
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavVersion.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavKeyStore.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+
+namespace {
+    const char *const K_OPT_HELP = "help";
+    const char *const K_OPT_CONFIG = "config";
+    const char *const K_OPT_KEEP = "keep";
+    const char *const K_OPT_TO = "to";
+}
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+using std::unique_ptr;
+using trihlav::Version;
+using trihlav::Settings;
+using trihlav::KeyManager;
+using trihlav::KeyStore;
+using trihlav::YubikoOtpKeyConfig;
+
+namespace po = boost::program_options;
+
+int main(int pArgC, char *pArgV[]) {
+    cout << pArgV[0] << " version " << Version::getVersion() << endl;
+    trihlav::initLog();
+    trihlav::setLogLevel(boost::log::trivial::warning);
+
+    po::options_description myOpts("Allowed options");
+    myOpts.add_options()
+            ((K_OPT_HELP + string(",h")).c_str(), "produce help message")
+            ((K_OPT_CONFIG + string(",c")).c_str(), po::value<string>(), "keystore directory")
+            ((K_OPT_TO + string(",t")).c_str(), po::value<string>()->default_value(
+                    Settings::getKeyStoreStr(Settings::EMmapFile)), "new key store: json-dir, mmap or sqlite")
+            ((K_OPT_KEEP + string(",k")).c_str(), "keep the key files");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(pArgC, pArgV, myOpts), vm);
+    po::notify(vm);
+
+    if (vm.count(K_OPT_HELP)) {
+        cout << myOpts << "\n";
+        return 1;
+    }
+    unique_ptr<Settings> mySettings(vm.count(K_OPT_CONFIG) ? new Settings(vm[K_OPT_CONFIG].as<string>())
+                                                           : new Settings());
+    mySettings->load();
+    Settings::EKeyStore myTo;
+    try {
+        myTo = Settings::parseKeyStore(vm[K_OPT_TO].as<string>());
+    } catch (std::exception &myExc) {
+        cerr << myExc.what() << endl;
+        return 2;
+    }
+    if (myTo == mySettings->getKeyStore()) {
+        cerr << "The keys are in the " << Settings::getKeyStoreStr(myTo) << " key store already." << endl;
+        return 2;
+    }
+    const auto myStart = std::chrono::steady_clock::now();
+    // read only, the journal stays until the server folds it into the new key store
+    KeyManager myKeyMan(*mySettings, KeyManager::EReadOnly);
+    myKeyMan.loadKeys();
+    const KeyManager::KeyIndexPtr_t myIndex = myKeyMan.getLoadedIndex();
+    vector<const YubikoOtpKeyConfig *> myKeys;
+    vector<const YubikoOtpKeyConfig *> myKeyFiles;
+    for (const auto &myKey : myIndex->m_KeyList) {
+        myKeys.push_back(myKey.get());
+        if (!myKey->getFilename().empty()) {
+            myKeyFiles.push_back(myKey.get());
+        }
+    }
+    size_t myWritten = 0;
+    // the journal of a writable key manager is opened by loadKeys() only
+    KeyManager myTargetMan(*mySettings, KeyManager::EReadWrite);
+    const unique_ptr<KeyStore> myTarget{KeyStore::create(myTargetMan, myTo)};
+    try {
+        myWritten = myTarget->write(myKeys);
+        mySettings->getKeyStore() = myTo;
+        mySettings->save();
+    } catch (std::exception &myExc) {
+        cerr << myExc.what() << endl;
+        return 3;
+    }
+    if (!vm.count(K_OPT_KEEP)) {
+        for (const YubikoOtpKeyConfig *myKey : myKeyFiles) {
+            myKeyMan.prefixKeyFile(myKey->getFilename(), "converted");
+        }
+    }
+    const std::chrono::duration<double> myElapsed = std::chrono::steady_clock::now() - myStart;
+    cout << "Wrote " << myWritten << " keys, " << myKeyFiles.size() << " of them from key files, into "
+         << myTarget->getLocation() << " in " << myElapsed.count() << " s." << endl;
+    return 0;
+}
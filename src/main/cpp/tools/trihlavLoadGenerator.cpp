@@ -0,0 +1,543 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ */
+
+#include <deque>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <ostream>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavConstants.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+
+#include "trihlavLoadGenerator.hpp"
+
+using std::string;
+using std::vector;
+using std::deque;
+using std::ostream;
+using std::runtime_error;
+using std::chrono::duration;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::milliseconds;
+using boost::format;
+using boost::asio::io_service;
+using boost::asio::steady_timer;
+using boost::asio::ip::tcp;
+using boost::system::error_code;
+
+namespace trihlav {
+
+    using Clock_t = Histogram::Clock_t;
+
+    static const string K_KIND_VALID("valid");
+    static const string K_KIND_REPLAY("replay");
+    static const string K_KIND_INVALID("invalid");
+    static const string K_STATUS_PFX("status: ");
+    static const string K_MODHEX("cbdefghijklnrtuv");
+
+    /// @brief Time to finish answers in flight after the run ended.
+    static constexpr milliseconds K_GRACE{10000};
+
+    /// @brief Pause before reconnecting a broken connection.
+    static constexpr milliseconds K_RECONNECT_DELAY{100};
+
+    static constexpr size_t K_READ_SIZE = 4096;
+
+    const string &LoadGenerator::getKindStr(const EKind pKind) {
+        switch (pKind) {
+            case EValid:
+                return K_KIND_VALID;
+            case EReplay:
+                return K_KIND_REPLAY;
+            case EInvalid:
+            default:
+                return K_KIND_INVALID;
+        }
+    }
+
+    /**
+     * One keep-alive connection with its share of the keys.
+     *
+     * All handlers run on the thread of its io_service, so there is no
+     * locking, the results go to the atomic counters of the LoadGenerator.
+     */
+    class LoadConnection {
+    public:
+        LoadConnection(LoadGenerator &pGen, io_service &pService, const tcp::endpoint &pEndpoint,
+                       const uint64_t pSeed, const double pRate) :
+                m_Gen(pGen), m_Endpoint(pEndpoint), m_Socket(pService), m_Arrivals(pService), m_Retry(pService),
+                m_Deadline(pService), m_Rnd(pSeed), m_Gaps(pRate > 0 ? pRate : 1), m_OpenLoop(pRate > 0) {
+        }
+
+        void addKey(LoadGenerator::Key &pKey) {
+            m_Keys.push_back(&pKey);
+        }
+
+        /// @brief Start sending until pEnd, the answers in flight then get K_GRACE more.
+        void start(const Clock_t::time_point pEnd) {
+            m_End = pEnd;
+            m_Deadline.expires_at(pEnd + K_GRACE);
+            m_Deadline.async_wait([this](const error_code &pErr) {
+                if (!pErr) {
+                    finish();
+                }
+            });
+            if (m_OpenLoop) {
+                m_NextArrival = Clock_t::now();
+                scheduleArrival();
+            }
+            connect();
+        }
+
+    private:
+        bool isRunning() const {
+            return Clock_t::now() < m_End;
+        }
+
+        /// @brief Are there requests left to send, now or later?
+        bool hasWork() const {
+            return m_OpenLoop ? !m_ArrivalsDone || !m_Queue.empty() : isRunning();
+        }
+
+        void connect() {
+            m_Socket.async_connect(m_Endpoint, [this](const error_code &pErr) {
+                if (m_Finished) {
+                    return;
+                }
+                if (pErr) {
+                    TRIHLAV_LOG_LIMITED(error, 10) << "Connect failed: " << pErr.message();
+                    fail();
+                    return;
+                }
+                m_Socket.set_option(tcp::no_delay(true));
+                m_Connected = true;
+                sendNext();
+            });
+        }
+
+        void scheduleArrival() {
+            m_NextArrival += duration_cast<Clock_t::duration>(duration<double>(m_Gaps(m_Rnd)));
+            if (m_NextArrival >= m_End) {
+                m_ArrivalsDone = true;
+                if (!m_Busy && m_Queue.empty()) {
+                    finish();
+                }
+                return;
+            }
+            m_Arrivals.expires_at(m_NextArrival);
+            m_Arrivals.async_wait([this](const error_code &pErr) {
+                if (pErr || m_Finished) {
+                    return;
+                }
+                if (m_Queue.size() < m_Gen.getOptions().m_MaxQueued) {
+                    m_Queue.push_back(m_NextArrival);
+                } else {
+                    m_Gen.recordMissed();
+                }
+                if (m_Connected && !m_Busy) {
+                    sendNext();
+                }
+                scheduleArrival();
+            });
+        }
+
+        /// @brief Send the next request when there is one, otherwise finish after the end.
+        void sendNext() {
+            if (!hasWork()) {
+                finish();
+            } else if (!m_OpenLoop) {
+                send(Clock_t::now());
+            } else if (!m_Queue.empty()) {
+                const Clock_t::time_point myArrival = m_Queue.front();
+                m_Queue.pop_front();
+                send(myArrival);
+            }
+        }
+
+        /// @brief Pick the next key and password, @return the URL.
+        const string makeUrl() {
+            LoadGenerator::Key &myKey = *m_Keys[m_NextKey];
+            m_NextKey = (m_NextKey + 1) % m_Keys.size();
+            const LoadGenerator::Options &myOpts = m_Gen.getOptions();
+            const double myPick = std::uniform_real_distribution<double>(0, 1)(m_Rnd);
+            string myOtp;
+            if (myPick < myOpts.m_ReplayRatio && !myKey.m_LastOtp.empty()) {
+                m_Kind = LoadGenerator::EReplay;
+                myOtp = myKey.m_LastOtp;
+            } else if (myPick >= myOpts.m_ReplayRatio && myPick < myOpts.m_ReplayRatio + myOpts.m_InvalidRatio) {
+                m_Kind = LoadGenerator::EInvalid;
+                myOtp.resize(YUBIKEY_OTP_SIZE);
+                for (char &myChar : myOtp) {
+                    myChar = K_MODHEX[m_Rnd() % K_MODHEX.size()];
+                }
+            } else {
+                m_Kind = LoadGenerator::EValid;
+                myOtp = YubikoOtpKeyConfig::generateOtp(myKey.m_Token, myKey.m_SecretKey);
+                myKey.m_LastOtp = myOtp;
+            }
+            string myUrl{K_AUTH_URL + "?"};
+            if (!myKey.m_SysUser.empty()) {
+                myUrl += K_USER_NM + "=" + myKey.m_SysUser + "&";
+            }
+            return myUrl + K_PSWD + "=" + myKey.m_PublicId + myOtp;
+        }
+
+        void send(const Clock_t::time_point pArrival) {
+            m_Busy = true;
+            m_Arrival = pArrival;
+            m_Request = "GET " + makeUrl() + " HTTP/1.1\r\nHost: " + m_Gen.getOptions().m_Host + "\r\n\r\n";
+            boost::asio::async_write(m_Socket, boost::asio::buffer(m_Request),
+                                     [this](const error_code &pErr, size_t) {
+                                         if (m_Finished) {
+                                             return;
+                                         }
+                                         if (pErr) {
+                                             TRIHLAV_LOG_LIMITED(error, 10) << "Write failed: " << pErr.message();
+                                             fail();
+                                             return;
+                                         }
+                                         read();
+                                     });
+        }
+
+        void read() {
+            m_Socket.async_read_some(boost::asio::buffer(m_ReadBuf), [this](const error_code &pErr, size_t pLen) {
+                if (m_Finished) {
+                    return;
+                }
+                if (pErr) {
+                    TRIHLAV_LOG_LIMITED(error, 10) << "Read failed: " << pErr.message();
+                    fail();
+                    return;
+                }
+                m_Response.append(m_ReadBuf.data(), pLen);
+                int myCode = 0;
+                string myBody;
+                bool myClose = false;
+                size_t myLen = 0;
+                try {
+                    myLen = LoadGenerator::parseResponse(m_Response, myCode, myBody, myClose);
+                } catch (std::exception &myExc) {
+                    TRIHLAV_LOG_LIMITED(error, 10) << "Bad answer: " << myExc.what();
+                    fail();
+                    return;
+                }
+                if (myLen == 0) {
+                    read();
+                    return;
+                }
+                m_Response.erase(0, myLen);
+                if (myCode != 200) {
+                    TRIHLAV_LOG_LIMITED(error, 10) << "Answer with HTTP status " << myCode << ".";
+                    m_Gen.recordError();
+                } else {
+                    const Clock_t::duration myLatency = Clock_t::now() - m_Arrival;
+                    m_Gen.recordAnswer(m_Kind, OtpValidator::EStatus(LoadGenerator::parseStatus(myBody)),
+                                       uint64_t(duration_cast<nanoseconds>(myLatency).count()));
+                }
+                m_Busy = false;
+                if (myClose) {
+                    m_Connected = false;
+                    m_Socket.close();
+                    m_Response.clear();
+                    if (hasWork()) {
+                        connect();
+                    } else {
+                        finish();
+                    }
+                    return;
+                }
+                sendNext();
+            });
+        }
+
+        /// @brief Drop the connection and try again later while running.
+        void fail() {
+            m_Gen.recordError();
+            m_Busy = false;
+            m_Connected = false;
+            error_code myIgnored;
+            m_Socket.close(myIgnored);
+            m_Response.clear();
+            if (!hasWork() || !isRunning()) {
+                finish();
+                return;
+            }
+            m_Retry.expires_after(K_RECONNECT_DELAY);
+            m_Retry.async_wait([this](const error_code &pErr) {
+                if (!pErr && !m_Finished) {
+                    connect();
+                }
+            });
+        }
+
+        /// @brief Stop all activity, the io_service runs out of work when all connections finished.
+        void finish() {
+            if (m_Finished) {
+                return;
+            }
+            m_Finished = true;
+            if (!m_Queue.empty()) {
+                for (size_t myI = 0; myI < m_Queue.size(); ++myI) {
+                    m_Gen.recordMissed();
+                }
+                m_Queue.clear();
+            }
+            error_code myIgnored;
+            m_Socket.close(myIgnored);
+            m_Arrivals.cancel();
+            m_Retry.cancel();
+            m_Deadline.cancel();
+        }
+
+        LoadGenerator &m_Gen;
+        const tcp::endpoint m_Endpoint;
+        tcp::socket m_Socket;
+        steady_timer m_Arrivals;
+        steady_timer m_Retry;
+        steady_timer m_Deadline;
+        std::mt19937_64 m_Rnd;
+        std::exponential_distribution<double> m_Gaps; //< seconds between arrivals
+        const bool m_OpenLoop;
+        vector<LoadGenerator::Key *> m_Keys;
+        size_t m_NextKey = 0;
+        deque<Clock_t::time_point> m_Queue;  //< arrivals not sent yet
+        Clock_t::time_point m_End;
+        Clock_t::time_point m_NextArrival;
+        Clock_t::time_point m_Arrival;       //< of the request in flight
+        LoadGenerator::EKind m_Kind = LoadGenerator::EValid;
+        bool m_Connected = false;
+        bool m_Busy = false;
+        bool m_Finished = false;
+        bool m_ArrivalsDone = false;
+        string m_Request;
+        string m_Response;
+        std::array<char, K_READ_SIZE> m_ReadBuf;
+    };
+
+    LoadGenerator::LoadGenerator(const Options &pOptions, const KeyManager &pKeyMan, const size_t pCount) :
+            m_Options(pOptions), m_Errors(0), m_Missed(0), m_LastAnswerNs(0) {
+        const KeyManager::KeyIndexPtr_t myIndex = pKeyMan.getLoadedIndex();
+        for (const auto &myCfg : myIndex->m_KeyList) {
+            if (myCfg->getPublicId().empty()) {
+                continue;
+            }
+            Key myKey;
+            myKey.m_PublicId = myCfg->getPublicId();
+            myKey.m_SysUser = myCfg->getSysUser();
+            myKey.m_Token = myCfg->getToken();
+            myKey.m_SecretKey = myCfg->getSecretKeyArray();
+            m_Keys.push_back(myKey);
+            if (m_Keys.size() == pCount) {
+                break;
+            }
+        }
+        for (auto &myKind : m_Answers) {
+            for (auto &myCount : myKind) {
+                myCount.store(0);
+            }
+        }
+    }
+
+    LoadGenerator::~LoadGenerator() {
+    }
+
+    uint64_t LoadGenerator::run() {
+        if (m_Keys.empty()) {
+            throw runtime_error("There are no keys with a public ID to generate passwords for.");
+        }
+        const size_t myConnCnt = std::min(m_Options.m_Connections, m_Keys.size());
+        const size_t myThreadCnt = std::max<size_t>(1, std::min(m_Options.m_Threads, myConnCnt));
+        if (myConnCnt < m_Options.m_Connections) {
+            TRIHLAV_LOG(warning) << "Only " << myConnCnt << " connections, a key is never shared by two.";
+        }
+        for (size_t myI = 0; myI < myThreadCnt; ++myI) {
+            m_Services.emplace_back(new io_service());
+        }
+        tcp::resolver myResolver(*m_Services.front());
+        const tcp::endpoint myEndpoint = *myResolver.resolve(tcp::resolver::query(m_Options.m_Host, m_Options.m_Port));
+        for (size_t myI = 0; myI < myConnCnt; ++myI) {
+            m_Connections.emplace_back(new LoadConnection(*this, *m_Services[myI % myThreadCnt], myEndpoint,
+                                                          m_Options.m_Seed + myI, m_Options.m_Rps / myConnCnt));
+        }
+        for (size_t myI = 0; myI < m_Keys.size(); ++myI) {
+            m_Connections[myI % myConnCnt]->addKey(m_Keys[myI]);
+        }
+        m_Start = Clock_t::now();
+        const Clock_t::time_point myEnd = m_Start + duration_cast<Clock_t::duration>(
+                duration<double>(m_Options.m_DurationS));
+        for (auto &myConn : m_Connections) {
+            myConn->start(myEnd);
+        }
+        vector<std::thread> myThreads;
+        for (auto &myService : m_Services) {
+            io_service *myPtr = myService.get();
+            myThreads.emplace_back([myPtr]() {
+                myPtr->run();
+            });
+        }
+        for (std::thread &myThread : myThreads) {
+            myThread.join();
+        }
+        return m_Latency.getSnapshot().m_Count;
+    }
+
+    void LoadGenerator::recordAnswer(const EKind pKind, const OtpValidator::EStatus pStatus,
+                                     const uint64_t pLatencyNs) {
+        m_Latency.record(pLatencyNs);
+        m_Answers[pKind][pStatus].fetch_add(1, std::memory_order_relaxed);
+        const uint64_t myNow = uint64_t(duration_cast<nanoseconds>(Clock_t::now() - m_Start).count());
+        uint64_t myLast = m_LastAnswerNs.load(std::memory_order_relaxed);
+        while (myLast < myNow && !m_LastAnswerNs.compare_exchange_weak(myLast, myNow, std::memory_order_relaxed)) {
+        }
+    }
+
+    void LoadGenerator::recordError() {
+        m_Errors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void LoadGenerator::recordMissed() {
+        m_Missed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void LoadGenerator::writeReport(std::ostream &pOut) const {
+        const Histogram::Snapshot mySnap = m_Latency.getSnapshot();
+        const double myElapsedS = std::max(1e-9, m_LastAnswerNs.load() * 1e-9);
+        const size_t myConnCnt = m_Connections.size();
+        if (m_Options.m_Rps > 0) {
+            pOut << format("open loop at %1% requests/s") % m_Options.m_Rps;
+        } else {
+            pOut << "closed loop";
+        }
+        pOut << format(", %1% connections on %2% threads, %3% keys, %4% s\n") % myConnCnt % m_Services.size()
+                % m_Keys.size() % m_Options.m_DurationS;
+        pOut << format("answered %1% requests, %2$.1f requests/s, %3% errors, %4% arrivals missed\n")
+                % mySnap.m_Count % (mySnap.m_Count / myElapsedS) % m_Errors.load() % m_Missed.load();
+        if (mySnap.m_Count > 0) {
+            pOut << format("latency us: mean %1$.1f p50 %2$.1f p99 %3$.1f p999 %4$.1f\n")
+                    % (mySnap.m_SumNs / 1e3 / mySnap.m_Count) % (mySnap.getQuantileNs(0.5) / 1e3)
+                    % (mySnap.getQuantileNs(0.99) / 1e3) % (mySnap.getQuantileNs(0.999) / 1e3);
+        }
+        for (int myKind = EValid; myKind <= EInvalid; ++myKind) {
+            string myLine;
+            for (int myStatus = 0; myStatus <= K_STATUS_CNT; ++myStatus) {
+                const uint64_t myCount = m_Answers[myKind][myStatus].load();
+                if (myCount > 0) {
+                    myLine += " " + (myStatus < K_STATUS_CNT ? OtpValidator::getStatusStr(OtpValidator::EStatus(myStatus))
+                                                             : string("unknown")) + "=" + std::to_string(myCount);
+                }
+            }
+            if (!myLine.empty()) {
+                pOut << format("%-8s") % getKindStr(EKind(myKind)) << myLine << "\n";
+            }
+        }
+    }
+
+    size_t LoadGenerator::parseResponse(const string &pBuf, int &pCode, string &pBody, bool &pClose) {
+        const size_t myHdrEnd = pBuf.find("\r\n\r\n");
+        if (myHdrEnd == string::npos) {
+            return 0;
+        }
+        if (pBuf.compare(0, 5, "HTTP/") != 0 || pBuf.size() < 12) {
+            throw runtime_error("Not a HTTP response.");
+        }
+        pCode = std::atoi(pBuf.c_str() + 9);
+        pClose = pBuf.compare(0, 8, "HTTP/1.0") == 0;
+        bool myChunked = false;
+        size_t myLength = string::npos;
+        size_t myPos = pBuf.find("\r\n") + 2;
+        while (myPos < myHdrEnd) {
+            const size_t myEol = pBuf.find("\r\n", myPos);
+            const string myLine{pBuf.substr(myPos, myEol - myPos)};
+            myPos = myEol + 2;
+            const size_t myColon = myLine.find(':');
+            if (myColon == string::npos) {
+                continue;
+            }
+            const string myName{boost::to_lower_copy(myLine.substr(0, myColon))};
+            const string myValue{boost::to_lower_copy(boost::trim_copy(myLine.substr(myColon + 1)))};
+            if (myName == "content-length") {
+                myLength = size_t(std::stoul(myValue));
+            } else if (myName == "transfer-encoding") {
+                myChunked = myValue.find("chunked") != string::npos;
+            } else if (myName == "connection") {
+                pClose = myValue == "close" ? true : myValue == "keep-alive" ? false : pClose;
+            }
+        }
+        const size_t myBodyStart = myHdrEnd + 4;
+        if (myChunked) {
+            pBody.clear();
+            size_t myChunk = myBodyStart;
+            for (;;) {
+                const size_t myEol = pBuf.find("\r\n", myChunk);
+                if (myEol == string::npos) {
+                    return 0;
+                }
+                const size_t mySize = size_t(std::stoul(pBuf.substr(myChunk, myEol - myChunk), 0, 16));
+                if (mySize == 0) {
+                    const size_t myEnd = pBuf.find("\r\n\r\n", myEol);
+                    return myEnd == string::npos ? 0 : myEnd + 4;
+                }
+                if (pBuf.size() < myEol + 2 + mySize + 2) {
+                    return 0;
+                }
+                pBody.append(pBuf, myEol + 2, mySize);
+                myChunk = myEol + 2 + mySize + 2;
+            }
+        }
+        if (myLength == string::npos) {
+            throw runtime_error("Neither content length nor chunked, can not keep the connection.");
+        }
+        if (pBuf.size() < myBodyStart + myLength) {
+            return 0;
+        }
+        pBody = pBuf.substr(myBodyStart, myLength);
+        return myBodyStart + myLength;
+    }
+
+    int LoadGenerator::parseStatus(const string &pBody) {
+        const size_t myPos = pBody.find(K_STATUS_PFX);
+        if (myPos != string::npos) {
+            const size_t myStart = myPos + K_STATUS_PFX.size();
+            const string myStatus{pBody.substr(myStart, pBody.find_first_of("\r\n", myStart) - myStart)};
+            for (int myI = 0; myI < K_STATUS_CNT; ++myI) {
+                if (OtpValidator::getStatusStr(OtpValidator::EStatus(myI)) == myStatus) {
+                    return myI;
+                }
+            }
+        }
+        return K_STATUS_CNT;
+    }
+
+} /* namespace trihlav */
@@ -0,0 +1,154 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRIHLAV_LOAD_GENERATOR_HPP_
+#define TRIHLAV_LOAD_GENERATOR_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <yubikey.h>
+#include <boost/asio.hpp>
+
+#include "trihlavLib/trihlavMetrics.hpp"
+#include "trihlavLib/trihlavOtpValidator.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+
+namespace trihlav {
+
+    class KeyManager;
+
+    class LoadConnection;
+
+    /**
+     * Drives the /auth resource of a server with OTPs of known keys.
+     *
+     * Valid OTPs are synthesized from the stored tokens by advancing them,
+     * @see YubikoOtpKeyConfig::generateOtp(yubikey_token_st&, const SecretKeyArr&).
+     * The keys are split between the keep-alive connections, every
+     * connection has at most one request in flight, so the OTPs of a key
+     * reach the server in the order they were generated.
+     *
+     * In the closed loop every connection sends its next request as soon as
+     * the answer to the previous one arrived. In the open loop requests
+     * arrive at the target rate regardless of the answers, each connection
+     * gets an even share as a Poisson process. Latency is then measured from
+     * the arrival, so time spent queued behind a slow answer counts too.
+     */
+    class LoadGenerator {
+    public:
+        /// @brief What kind of password a request carries.
+        enum EKind {
+            EValid,   //< next OTP of the key, expected to be accepted
+            EReplay,  //< an OTP of the key which was sent already
+            EInvalid  //< public ID of the key followed by random modhex
+        };
+
+        static const std::string &getKindStr(const EKind pKind);
+
+        struct Options {
+            std::string m_Host{"127.0.0.1"};
+            std::string m_Port{"8080"};
+            size_t m_Connections = 16;
+            size_t m_Threads = 2;
+            double m_Rps = 0;              //< target rate of the open loop, 0 runs the closed loop
+            double m_DurationS = 10;
+            double m_ReplayRatio = 0;      //< share of EReplay requests
+            double m_InvalidRatio = 0;     //< share of EInvalid requests
+            size_t m_MaxQueued = 10000;    //< arrivals waiting per connection in the open loop
+            uint64_t m_Seed = 1;
+        };
+
+        /// @brief A key as the load generator sees it, its token runs ahead of the stored one.
+        struct Key {
+            std::string m_PublicId;
+            std::string m_SysUser;
+            yubikey_token_st m_Token;
+            YubikoOtpKeyConfig::SecretKeyArr m_SecretKey;
+            std::string m_LastOtp; //< for EReplay, empty until the first valid one was sent
+        };
+
+        /// @brief Take the keys with public ID and system user loaded by pKeyMan, at most pCount, 0 for all.
+        LoadGenerator(const Options &pOptions, const KeyManager &pKeyMan, const size_t pCount);
+
+        virtual ~LoadGenerator();
+
+        /// @brief Run for the configured duration, @return the count of answered requests.
+        uint64_t run();
+
+        /// @brief Throughput, latency quantiles and outcomes of the last run().
+        void writeReport(std::ostream &pOut) const;
+
+        const Options &getOptions() const {
+            return m_Options;
+        }
+
+        size_t getKeyCount() const {
+            return m_Keys.size();
+        }
+
+        /// @brief Called by the connections when an answer arrived.
+        void recordAnswer(const EKind pKind, const OtpValidator::EStatus pStatus, const uint64_t pLatencyNs);
+
+        /// @brief Called by the connections on a broken connection or an unparsable answer.
+        void recordError();
+
+        /// @brief Called by the connections when an open loop arrival found the queue full.
+        void recordMissed();
+
+        /**
+         * @brief Split a HTTP/1.1 response off the front of pBuf.
+         * @return the length of the complete response, 0 while it is incomplete.
+         * @throws std::runtime_error when it can not be parsed.
+         */
+        static size_t parseResponse(const std::string &pBuf, int &pCode, std::string &pBody, bool &pClose);
+
+        /// @brief The status line of an /auth answer, ERateLimited + 1 when there is none.
+        static int parseStatus(const std::string &pBody);
+
+    private:
+        static constexpr int K_STATUS_CNT = OtpValidator::ERateLimited + 1;
+
+        const Options m_Options;
+        std::vector<Key> m_Keys;
+        std::vector<std::unique_ptr<boost::asio::io_service> > m_Services;
+        std::vector<std::unique_ptr<LoadConnection> > m_Connections;
+        Histogram m_Latency;
+        std::array<std::array<std::atomic<uint64_t>, K_STATUS_CNT + 1>, EInvalid + 1> m_Answers;
+        std::atomic<uint64_t> m_Errors;
+        std::atomic<uint64_t> m_Missed;
+        std::atomic<uint64_t> m_LastAnswerNs; //< since the start of run()
+        Histogram::Clock_t::time_point m_Start;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_LOAD_GENERATOR_HPP_ */
@@ -0,0 +1,143 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Load generator for the /auth resource of a local trihlavsrv.
+ *
+ * It reads the keystore of the server to know the secret keys and current
+ * counters, so run it as the same user or point --config at the server's
+ * directory. The keystore is opened read only, @see KeyManager::EReadOnly. The server checks the rate of each key and client, raise or
+ * disable (0) its limits in the settings for anything above a few requests
+ * per minute, otherwise most answers are "rate-limited".
+ */
+
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <boost/program_options.hpp>
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavVersion.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+
+#include "trihlavLoadGenerator.hpp"
+
+namespace {
+    const char *const K_OPT_HELP = "help";
+    const char *const K_OPT_URL = "url";
+    const char *const K_OPT_CONFIG = "config";
+    const char *const K_OPT_KEYS = "keys";
+    const char *const K_OPT_CONNS = "connections";
+    const char *const K_OPT_THREADS = "threads";
+    const char *const K_OPT_RPS = "rps";
+    const char *const K_OPT_DURATION = "duration";
+    const char *const K_OPT_REPLAY = "replay";
+    const char *const K_OPT_INVALID = "invalid";
+    const char *const K_OPT_SEED = "seed";
+    const char *const K_HTTP = "http://";
+}
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::unique_ptr;
+using trihlav::Version;
+using trihlav::Settings;
+using trihlav::KeyManager;
+using trihlav::LoadGenerator;
+
+namespace po = boost::program_options;
+
+int main(int pArgC, char *pArgV[]) {
+    cout << pArgV[0] << " version " << Version::getVersion() << endl;
+    trihlav::initLog();
+    trihlav::setLogLevel(boost::log::trivial::warning);
+
+    LoadGenerator::Options myLoad;
+    myLoad.m_Threads = std::max(1U, std::thread::hardware_concurrency() / 2);
+    string myUrl;
+    size_t myKeyCnt = 0;
+    po::options_description myOpts("Allowed options");
+    myOpts.add_options()
+            ((K_OPT_HELP + string(",h")).c_str(), "produce help message")
+            ((K_OPT_URL + string(",u")).c_str(), po::value<string>(&myUrl)->default_value("http://127.0.0.1:8080"),
+             "server, only plain http")
+            ((K_OPT_CONFIG + string(",c")).c_str(), po::value<string>(), "keystore directory of the server")
+            ((K_OPT_KEYS + string(",k")).c_str(), po::value<size_t>(&myKeyCnt)->default_value(0),
+             "use so many keys, 0 for all")
+            ((K_OPT_CONNS + string(",n")).c_str(), po::value<size_t>(&myLoad.m_Connections)->default_value(16),
+             "keep-alive connections, at most one per key")
+            ((K_OPT_THREADS + string(",t")).c_str(), po::value<size_t>(&myLoad.m_Threads), "client threads")
+            ((K_OPT_RPS + string(",r")).c_str(), po::value<double>(&myLoad.m_Rps)->default_value(0),
+             "open loop at so many requests/s, 0 runs the closed loop")
+            ((K_OPT_DURATION + string(",d")).c_str(), po::value<double>(&myLoad.m_DurationS)->default_value(10),
+             "seconds to send requests")
+            (K_OPT_REPLAY, po::value<double>(&myLoad.m_ReplayRatio)->default_value(0),
+             "share of requests replaying an OTP, 0..1")
+            (K_OPT_INVALID, po::value<double>(&myLoad.m_InvalidRatio)->default_value(0),
+             "share of requests with a garbage OTP, 0..1")
+            (K_OPT_SEED, po::value<uint64_t>(&myLoad.m_Seed)->default_value(1), "random seed");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(pArgC, pArgV, myOpts), vm);
+    po::notify(vm);
+
+    if (vm.count(K_OPT_HELP)) {
+        cout << myOpts << "\n";
+        return 1;
+    }
+    if (myUrl.compare(0, string(K_HTTP).size(), K_HTTP) != 0) {
+        cerr << "The url has to start with " << K_HTTP << "." << endl;
+        return 2;
+    }
+    const string myHostPort{myUrl.substr(string(K_HTTP).size())};
+    const size_t myColon = myHostPort.find(':');
+    myLoad.m_Host = myHostPort.substr(0, myColon);
+    myLoad.m_Port = myColon == string::npos ? "80" : myHostPort.substr(myColon + 1);
+    if (myLoad.m_ReplayRatio < 0 || myLoad.m_InvalidRatio < 0 || myLoad.m_ReplayRatio + myLoad.m_InvalidRatio > 1) {
+        cerr << "The replay and invalid shares have to be positive and at most 1 together." << endl;
+        return 2;
+    }
+    unique_ptr<Settings> mySettings(vm.count(K_OPT_CONFIG) ? new Settings(vm[K_OPT_CONFIG].as<string>())
+                                                           : new Settings());
+    KeyManager myKeyMan(*mySettings, KeyManager::EReadOnly);
+    myKeyMan.loadKeys();
+    LoadGenerator myGen(myLoad, myKeyMan, myKeyCnt);
+    cout << "Sending to " << myLoad.m_Host << ":" << myLoad.m_Port << " with " << myGen.getKeyCount() << " keys."
+         << endl;
+    try {
+        myGen.run();
+    } catch (std::exception &myExc) {
+        cerr << myExc.what() << endl;
+        return 3;
+    }
+    myGen.writeReport(cout);
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <chrono>
+#include <boost/log/utility/formatting_ostream.hpp>
+
+#include "trihlavLib/trihlavAsyncLogSink.hpp"
+
+namespace trihlav {
+
+    /// @brief Records written between two flushes of the stream at most.
+    static constexpr uint64_t K_WRITE_BATCH = 256;
+
+    /// @brief Longest sleep of an idle writer, bounds a missed wake up.
+    static constexpr std::chrono::milliseconds K_IDLE_WAIT{100};
+
+    /// @brief Sleep of a logging thread waiting for a free slot.
+    static constexpr std::chrono::microseconds K_FULL_WAIT{50};
+
+    static uint64_t getRingMask(const size_t pCapacity) {
+        uint64_t mySize = 2;
+        while (mySize < pCapacity) {
+            mySize <<= 1;
+        }
+        return mySize - 1;
+    }
+
+    AsyncLogSink::AsyncLogSink(const std::shared_ptr<std::ostream> &pOut,
+                               const boost::log::formatter &pFormatter,
+                               const size_t pCapacity,
+                               const Settings::ELogOverflow pOverflow) //
+            : m_Out(pOut), m_Formatter(pFormatter), m_Overflow(pOverflow), //
+              m_Mask(getRingMask(pCapacity)), m_Slots(new Slot[m_Mask + 1]), //
+              m_Tail(0), m_Head(0), m_Written(0), m_Dropped(0), m_ReportedDrops(0), //
+              m_Sleeping(false), m_Stop(false) //
+    {
+        for (uint64_t mySeq = 0; mySeq <= m_Mask; ++mySeq) {
+            m_Slots[mySeq].m_Seq.store(mySeq, std::memory_order_relaxed);
+        }
+        m_Writer = std::thread(&AsyncLogSink::runWriter, this);
+    }
+
+    AsyncLogSink::~AsyncLogSink() {
+        {
+            std::lock_guard<std::mutex> myLock(m_Mutex);
+            m_Stop = true;
+        }
+        m_WakeCv.notify_all();
+        if (m_Writer.joinable()) {
+            m_Writer.join();
+        }
+    }
+
+    void AsyncLogSink::consume(const boost::log::record_view &pRec) {
+        while (!tryPush(pRec)) {
+            if (m_Overflow == Settings::ELogDrop) {
+                m_Dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            wakeWriter();
+            std::this_thread::sleep_for(K_FULL_WAIT);
+        }
+        wakeWriter();
+    }
+
+    void AsyncLogSink::flush() {
+        const uint64_t myTarget = m_Tail.load(std::memory_order_acquire);
+        while (m_Written.load(std::memory_order_acquire) < myTarget) {
+            wakeWriter();
+            std::this_thread::sleep_for(K_FULL_WAIT);
+        }
+    }
+
+/**
+ * A slot is free for position pos when its sequence equals pos, the
+ * producer which wins the tail claims it and publishes it with pos + 1.
+ */
+    bool AsyncLogSink::tryPush(const boost::log::record_view &pRec) {
+        uint64_t myPos = m_Tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &mySlot = m_Slots[myPos & m_Mask];
+            const uint64_t mySeq = mySlot.m_Seq.load(std::memory_order_acquire);
+            const int64_t myDiff = int64_t(mySeq - myPos);
+            if (myDiff == 0) {
+                if (m_Tail.compare_exchange_weak(myPos, myPos + 1, std::memory_order_relaxed)) {
+                    mySlot.m_Rec = pRec;
+                    mySlot.m_Seq.store(myPos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (myDiff < 0) {
+                return false;
+            } else {
+                myPos = m_Tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool AsyncLogSink::tryPop(boost::log::record_view &pRec) {
+        Slot &mySlot = m_Slots[m_Head & m_Mask];
+        if (mySlot.m_Seq.load(std::memory_order_acquire) != m_Head + 1) {
+            return false;
+        }
+        pRec.swap(mySlot.m_Rec);
+        mySlot.m_Rec = boost::log::record_view();
+        mySlot.m_Seq.store(m_Head + m_Mask + 1, std::memory_order_release);
+        ++m_Head;
+        return true;
+    }
+
+/**
+ * The fence pairs with the one of the writer going to sleep, either the
+ * writer sees the published slot or the logging thread sees it sleeping.
+ */
+    void AsyncLogSink::wakeWriter() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_Sleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> myLock(m_Mutex);
+            m_WakeCv.notify_one();
+        }
+    }
+
+    void AsyncLogSink::runWriter() {
+        boost::log::record_view myRec;
+        std::string myLine;
+        boost::log::formatting_ostream myStrm(myLine);
+        uint64_t myBatch = 0;
+        for (;;) {
+            const bool myPopped = tryPop(myRec);
+            if (myPopped) {
+                m_Formatter(myRec, myStrm);
+                myStrm.flush();
+                *m_Out << myLine << '\n';
+                myLine.clear();
+                myRec = boost::log::record_view();
+                if (++myBatch < K_WRITE_BATCH) {
+                    continue;
+                }
+            }
+            const uint64_t myDropped = m_Dropped.load(std::memory_order_relaxed);
+            if (myDropped != m_ReportedDrops) {
+                *m_Out << myDropped - m_ReportedDrops << " log records dropped, the log queue was full." << '\n';
+                m_ReportedDrops = myDropped;
+            }
+            m_Out->flush();
+            m_Written.fetch_add(myBatch, std::memory_order_release);
+            myBatch = 0;
+            if (myPopped) {
+                continue;
+            }
+            std::unique_lock<std::mutex> myLock(m_Mutex);
+            if (m_Stop) {
+                break;
+            }
+            m_Sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const Slot &mySlot = m_Slots[m_Head & m_Mask];
+            m_WakeCv.wait_for(myLock, K_IDLE_WAIT, [this, &mySlot] {
+                return m_Stop || mySlot.m_Seq.load(std::memory_order_acquire) == m_Head + 1;
+            });
+            m_Sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+} /* namespace trihlav */
@@ -0,0 +1,134 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_ASYNC_LOG_SINK_HPP_
+#define TRIHLAV_ASYNC_LOG_SINK_HPP_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <ostream>
+#include <condition_variable>
+#include <boost/log/core/record_view.hpp>
+#include <boost/log/expressions/formatter.hpp>
+#include <boost/log/sinks/basic_sink_backend.hpp>
+
+#include "trihlavLib/trihlavSettings.hpp"
+
+namespace trihlav {
+
+    /**
+     * Boost.Log sink backend which hands records over to a writer thread.
+     *
+     * The logging thread only stores the record view into a bounded lock
+     * free ring (Vyukov's multi producer queue, one sequence word per slot),
+     * the writer thread formats it and writes it to the stream. When the
+     * ring is full the record is either dropped and counted or the logging
+     * thread waits for a free slot, @see Settings::ELogOverflow . Dropped
+     * records are reported by the writer as one line.
+     *
+     * Meant for boost::log::sinks::unlocked_sink, consume() may be called
+     * concurrently.
+     */
+    class AsyncLogSink
+            : public boost::log::sinks::basic_sink_backend<
+                    boost::log::sinks::combine_requirements<
+                            boost::log::sinks::concurrent_feeding,
+                            boost::log::sinks::flushing>::type> {
+    public:
+        /**
+         * @param pOut stream written by the writer thread only.
+         * @param pFormatter used by the writer thread only.
+         * @param pCapacity ring size, rounded up to a power of two.
+         * @param pOverflow what consume() does when the ring is full.
+         */
+        AsyncLogSink(const std::shared_ptr<std::ostream> &pOut,
+                     const boost::log::formatter &pFormatter,
+                     const size_t pCapacity,
+                     const Settings::ELogOverflow pOverflow = Settings::ELogDrop);
+
+        /// @brief Writes the queued records and stops the writer.
+        virtual ~AsyncLogSink();
+
+        /// @brief Queue the record, never formats or writes.
+        void consume(const boost::log::record_view &pRec);
+
+        /// @brief Wait until the records queued so far are written and the stream is flushed.
+        void flush();
+
+        size_t getCapacity() const {
+            return m_Mask + 1;
+        }
+
+        /// @brief Records dropped because the ring was full.
+        uint64_t getDroppedCount() const {
+            return m_Dropped.load(std::memory_order_relaxed);
+        }
+
+        /// @brief Records written to the stream.
+        uint64_t getWrittenCount() const {
+            return m_Written.load(std::memory_order_acquire);
+        }
+
+    private:
+        struct Slot {
+            std::atomic<uint64_t> m_Seq;  //< position it can be pushed at, or popped at + 1
+            boost::log::record_view m_Rec;
+        };
+
+        /// @return false when the ring is full.
+        bool tryPush(const boost::log::record_view &pRec);
+
+        /// @return false when the ring is empty.
+        bool tryPop(boost::log::record_view &pRec);
+
+        void wakeWriter();
+
+        void runWriter();
+
+        const std::shared_ptr<std::ostream> m_Out;
+        const boost::log::formatter m_Formatter;
+        const Settings::ELogOverflow m_Overflow;
+        const uint64_t m_Mask;
+        std::unique_ptr<Slot[]> m_Slots;
+        std::atomic<uint64_t> m_Tail;      //< next push
+        uint64_t m_Head;                   //< next pop, writer only
+        std::atomic<uint64_t> m_Written;
+        std::atomic<uint64_t> m_Dropped;
+        uint64_t m_ReportedDrops;          //< writer only
+        std::atomic<bool> m_Sleeping;
+        bool m_Stop;
+        std::mutex m_Mutex;
+        std::condition_variable m_WakeCv;
+        std::thread m_Writer;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_ASYNC_LOG_SINK_HPP_ */
@@ -0,0 +1,282 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavBinaryKeystore.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+
+using std::string;
+using std::vector;
+using std::runtime_error;
+using boost::filesystem::path;
+
+namespace trihlav {
+
+    static_assert(sizeof(BinaryKeystore::Header) == 64, "Keystore header layout changed.");
+    static_assert(sizeof(BinaryKeystore::Record) == 64, "Keystore record layout changed.");
+
+    static const char K_KEYSTORE_MAGIC[] = "TRHLVK01";
+
+    constexpr uint32_t BinaryKeystore::K_VERSION;
+
+/**
+ * Checks the header and that records and heap lie within the file, the
+ * string references are checked when they are read.
+ */
+    BinaryKeystore::BinaryKeystore(const path &pFilename, const bool pWritable) //
+            : m_Filename(pFilename), m_Writable(pWritable), m_Fd(-1), m_Size(0), m_Map(0), //
+              m_Header(0), m_Records(0), m_Heap(0) //
+    {
+        TRIHLAV_TRACE_SCOPE("BinaryKeystore::BinaryKeystore");
+        m_Fd = ::open(m_Filename.c_str(), (m_Writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+        if (m_Fd < 0) {
+            throw runtime_error("Failed to open " + m_Filename.string() + ": " + strerror(errno));
+        }
+        struct stat myStat;
+        if (fstat(m_Fd, &myStat) != 0) {
+            const int myErrno = errno;
+            ::close(m_Fd);
+            throw runtime_error("Failed to stat " + m_Filename.string() + ": " + strerror(myErrno));
+        }
+        m_Size = size_t(myStat.st_size);
+        if (m_Size < sizeof(Header)) {
+            ::close(m_Fd);
+            throw runtime_error("Keystore " + m_Filename.string() + " is too short.");
+        }
+        void *myMap = mmap(0, m_Size, PROT_READ | (m_Writable ? PROT_WRITE : 0), MAP_SHARED, m_Fd, 0);
+        if (myMap == MAP_FAILED) {
+            const int myErrno = errno;
+            ::close(m_Fd);
+            throw runtime_error("Failed to map " + m_Filename.string() + ": " + strerror(myErrno));
+        }
+        m_Map = static_cast<char *>(myMap);
+        m_Header = reinterpret_cast<const Header *>(m_Map);
+        const Header &myHdr = *m_Header;
+        string myError;
+        if (memcmp(myHdr.m_Magic, K_KEYSTORE_MAGIC, sizeof(myHdr.m_Magic)) != 0) {
+            myError = "has a wrong magic";
+        } else if (myHdr.m_Version != K_VERSION || myHdr.m_RecordSize != sizeof(Record)) {
+            myError = "has the unknown version " + std::to_string(myHdr.m_Version);
+        } else if (myHdr.m_RecordOffset < sizeof(Header) || myHdr.m_RecordOffset % alignof(Record) != 0
+                   || myHdr.m_RecordOffset > m_Size
+                   || myHdr.m_RecordCount > (m_Size - myHdr.m_RecordOffset) / sizeof(Record)
+                   || myHdr.m_HeapOffset < myHdr.m_RecordOffset + myHdr.m_RecordCount * sizeof(Record)
+                   || myHdr.m_HeapOffset > m_Size || myHdr.m_HeapSize > m_Size - myHdr.m_HeapOffset) {
+            myError = "is truncated or damaged";
+        }
+        if (!myError.empty()) {
+            munmap(m_Map, m_Size);
+            ::close(m_Fd);
+            throw runtime_error("Keystore " + m_Filename.string() + " " + myError + ".");
+        }
+        m_Records = reinterpret_cast<Record *>(m_Map + myHdr.m_RecordOffset);
+        m_Heap = m_Map + myHdr.m_HeapOffset;
+        madvise(m_Map, m_Size, MADV_WILLNEED);
+        TRIHLAV_LOG(info) << "Mapped keystore " << m_Filename << " with " << myHdr.m_RecordCount << " records.";
+    }
+
+    BinaryKeystore::~BinaryKeystore() {
+        munmap(m_Map, m_Size);
+        ::close(m_Fd);
+    }
+
+    const string BinaryKeystore::getString(const StrRef &pRef) const {
+        if (pRef.m_Offset > m_Header->m_HeapSize || pRef.m_Size > m_Header->m_HeapSize - pRef.m_Offset) {
+            throw std::out_of_range("Keystore " + m_Filename.string() + " has a string outside of its heap.");
+        }
+        return string(m_Heap + pRef.m_Offset, pRef.m_Size);
+    }
+
+/**
+ * The records are sorted by write(), a deleted record may be followed by a
+ * live one of the same public ID.
+ */
+    int64_t BinaryKeystore::find(const string &pPubId) const {
+        const Record *myBegin = m_Records;
+        const Record *myEnd = myBegin + getRecordCount();
+        const Record *myIt = std::lower_bound(myBegin, myEnd, pPubId, [this](const Record &pRec, const string &pId) {
+            return getString(pRec.m_PublicId) < pId;
+        });
+        for (; myIt != myEnd && getString(myIt->m_PublicId) == pPubId; ++myIt) {
+            if ((myIt->m_Flags & EDeleted) == 0) {
+                return myIt - myBegin;
+            }
+        }
+        return -1;
+    }
+
+    void BinaryKeystore::checkWritable() const {
+        if (!m_Writable) {
+            throw std::logic_error("Keystore " + m_Filename.string() + " is mapped read only.");
+        }
+    }
+
+/**
+ * The caller holds the key mutex of the record.
+ */
+    void BinaryKeystore::saveCounters(const size_t pIdx, const yubikey_token_st &pToken) {
+        checkWritable();
+        yubikey_token_st &myToken = m_Records[pIdx].m_Token;
+        myToken.ctr = pToken.ctr;
+        myToken.use = pToken.use;
+        myToken.tstpl = pToken.tstpl;
+        myToken.tstph = pToken.tstph;
+        myToken.crc = pToken.crc;
+    }
+
+    void BinaryKeystore::erase(const size_t pIdx) {
+        checkWritable();
+        m_Records[pIdx].m_Flags |= EDeleted;
+    }
+
+    void BinaryKeystore::sync() {
+        TRIHLAV_TRACE_SCOPE("BinaryKeystore::sync");
+        checkWritable();
+        if (msync(m_Map, m_Size, MS_SYNC) != 0) {
+            throw runtime_error("Failed to flush " + m_Filename.string() + ": " + strerror(errno));
+        }
+    }
+
+/**
+ * Counters written into a replaced file are lost with it.
+ */
+    bool BinaryKeystore::isReplaced() const {
+        struct stat myMapped;
+        struct stat myCurrent;
+        if (fstat(m_Fd, &myMapped) != 0 || myMapped.st_nlink == 0) {
+            return true;
+        }
+        if (::stat(m_Filename.c_str(), &myCurrent) != 0) {
+            return true;
+        }
+        return myMapped.st_dev != myCurrent.st_dev || myMapped.st_ino != myCurrent.st_ino;
+    }
+
+    static void writeAll(const int pFd, const char *pBuf, size_t pSz, const path &pFilename) {
+        while (pSz > 0) {
+            const ssize_t myWritten = ::write(pFd, pBuf, pSz);
+            if (myWritten < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error("Failed to write to " + pFilename.string() + ": " + strerror(errno));
+            }
+            pBuf += myWritten;
+            pSz -= size_t(myWritten);
+        }
+    }
+
+    static BinaryKeystore::StrRef addString(string &pHeap, const string &pStr) {
+        const BinaryKeystore::StrRef myRetVal{uint32_t(pHeap.size()), uint32_t(pStr.size())};
+        pHeap += pStr;
+        return myRetVal;
+    }
+
+/**
+ * The new keystore is written next to pFilename, flushed and renamed over
+ * it, so a crash leaves either the old or the new one. A running server
+ * keeps the old one mapped, it has to be restarted.
+ */
+    size_t BinaryKeystore::write(const path &pFilename, const vector<const YubikoOtpKeyConfig *> &pKeys) {
+        TRIHLAV_TRACE_SCOPE("BinaryKeystore::write");
+        vector<const YubikoOtpKeyConfig *> myKeys;
+        myKeys.reserve(pKeys.size());
+        for (const YubikoOtpKeyConfig *myKey : pKeys) {
+            if (!myKey->getPublicId().empty()) {
+                myKeys.push_back(myKey);
+            }
+        }
+        std::sort(myKeys.begin(), myKeys.end(), [](const YubikoOtpKeyConfig *pA, const YubikoOtpKeyConfig *pB) {
+            return pA->getPublicId() < pB->getPublicId();
+        });
+        vector<Record> myRecords(myKeys.size());
+        string myHeap;
+        for (size_t myI = 0; myI < myKeys.size(); ++myI) {
+            const YubikoOtpKeyConfig &myKey = *myKeys[myI];
+            Record &myRec = myRecords[myI];
+            memset(&myRec, 0, sizeof(myRec));
+            myRec.m_Token = myKey.getToken();
+            memcpy(myRec.m_Key, myKey.getSecretKeyArray().data(), YUBIKEY_KEY_SIZE);
+            myRec.m_PublicId = addString(myHeap, myKey.getPublicId());
+            myRec.m_Description = addString(myHeap, myKey.getDescription());
+            myRec.m_SysUser = addString(myHeap, myKey.getSysUser());
+        }
+        if (myHeap.size() > UINT32_MAX) {
+            throw runtime_error("Keystore strings exceed 4GiB.");
+        }
+        Header myHdr;
+        memset(&myHdr, 0, sizeof(myHdr));
+        memcpy(myHdr.m_Magic, K_KEYSTORE_MAGIC, sizeof(myHdr.m_Magic));
+        myHdr.m_Version = K_VERSION;
+        myHdr.m_RecordSize = sizeof(Record);
+        myHdr.m_RecordCount = myRecords.size();
+        myHdr.m_RecordOffset = sizeof(Header);
+        myHdr.m_HeapOffset = myHdr.m_RecordOffset + myRecords.size() * sizeof(Record);
+        myHdr.m_HeapSize = myHeap.size();
+
+        path myTmpFile(pFilename);
+        myTmpFile += ".tmp";
+        const int myFd = ::open(myTmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (myFd < 0) {
+            throw runtime_error("Failed to open " + myTmpFile.string() + ": " + strerror(errno));
+        }
+        try {
+            writeAll(myFd, reinterpret_cast<const char *>(&myHdr), sizeof(myHdr), myTmpFile);
+            writeAll(myFd, reinterpret_cast<const char *>(myRecords.data()), myRecords.size() * sizeof(Record),
+                     myTmpFile);
+            writeAll(myFd, myHeap.data(), myHeap.size(), myTmpFile);
+            if (::fsync(myFd) != 0) {
+                throw runtime_error("Failed to flush " + myTmpFile.string() + ": " + strerror(errno));
+            }
+        } catch (...) {
+            ::close(myFd);
+            remove(myTmpFile);
+            throw;
+        }
+        ::close(myFd);
+        rename(myTmpFile, pFilename);
+        const int myDirFd = ::open(pFilename.parent_path().c_str(), O_RDONLY | O_CLOEXEC);
+        if (myDirFd >= 0) {
+            ::fsync(myDirFd);
+            ::close(myDirFd);
+        }
+        TRIHLAV_LOG(info) << "Wrote " << myRecords.size() << " keys into " << pFilename << ".";
+        return myRecords.size();
+    }
+
+} /* namespace trihlav */
@@ -0,0 +1,157 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_BINARY_KEYSTORE_HPP_
+#define TRIHLAV_BINARY_KEYSTORE_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <yubikey.h>
+#include <boost/filesystem.hpp>
+
+namespace trihlav {
+
+    class YubikoOtpKeyConfig;
+
+    /**
+     * All keys in one memory mapped file.
+     *
+     * The file starts with a Header, followed by fixed size Records sorted
+     * by public ID and a heap holding the strings (public ID, description,
+     * system user) the records point to. Loading maps the file and copies
+     * the records, no parsing involved. The counters of a record are
+     * updated in place when the counter journal is compacted, the rest is
+     * written once by write(), fe. by the converter from the JSON key
+     * directory. Numbers are stored in host byte order.
+     */
+    class BinaryKeystore {
+    public:
+        static constexpr uint32_t K_VERSION = 1;
+
+        /// @brief A string in the heap.
+        struct StrRef {
+            uint32_t m_Offset; //< from the start of the heap
+            uint32_t m_Size;
+        };
+
+        struct Header {
+            char m_Magic[8];
+            uint32_t m_Version;
+            uint32_t m_RecordSize;    //< sizeof(Record)
+            uint64_t m_RecordCount;
+            uint64_t m_RecordOffset;  //< from the start of the file
+            uint64_t m_HeapOffset;    //< from the start of the file
+            uint64_t m_HeapSize;
+            uint8_t m_Reserved[16];
+        };
+
+        enum EFlags {
+            EDeleted = 1 //< removed by the key editor, skipped on load
+        };
+
+        struct Record {
+            yubikey_token_st m_Token;       //< private ID, counters, random and CRC
+            uint8_t m_Key[YUBIKEY_KEY_SIZE];
+            StrRef m_PublicId;
+            StrRef m_Description;
+            StrRef m_SysUser;
+            uint32_t m_Flags;               //< EFlags
+            uint32_t m_Reserved;
+        };
+
+        /// @brief Map pFilename, throws std::runtime_error when it is not a valid keystore.
+        BinaryKeystore(const boost::filesystem::path &pFilename, const bool pWritable);
+
+        BinaryKeystore(const BinaryKeystore &) = delete;
+
+        BinaryKeystore &operator=(const BinaryKeystore &) = delete;
+
+        virtual ~BinaryKeystore();
+
+        size_t getRecordCount() const {
+            return m_Header->m_RecordCount;
+        }
+
+        const Record &getRecord(const size_t pIdx) const {
+            return m_Records[pIdx];
+        }
+
+        /// @brief Copy a string out of the heap, throws std::out_of_range when it points outside.
+        const std::string getString(const StrRef &pRef) const;
+
+        bool isDeleted(const size_t pIdx) const {
+            return (m_Records[pIdx].m_Flags & EDeleted) != 0;
+        }
+
+        /// @brief Binary search of the live record of pPubId, @return -1 when there is none.
+        int64_t find(const std::string &pPubId) const;
+
+        /// @brief Overwrite the counters of a record, durable after sync().
+        void saveCounters(const size_t pIdx, const yubikey_token_st &pToken);
+
+        /// @brief Mark a record deleted, durable after sync().
+        void erase(const size_t pIdx);
+
+        /// @brief Flush changed records to disk.
+        void sync();
+
+        /// @brief Was the mapped file deleted or replaced by another one, fe. by write()?
+        bool isReplaced() const;
+
+        const boost::filesystem::path &getFilename() const {
+            return m_Filename;
+        }
+
+        bool isWritable() const {
+            return m_Writable;
+        }
+
+        /**
+         * @brief Write pKeys into a new keystore, replacing pFilename atomically.
+         * @return count of written keys, keys with an empty public ID are skipped.
+         */
+        static size_t write(const boost::filesystem::path &pFilename,
+                            const std::vector<const YubikoOtpKeyConfig *> &pKeys);
+
+    private:
+        void checkWritable() const;
+
+        const boost::filesystem::path m_Filename;
+        const bool m_Writable;
+        int m_Fd;
+        size_t m_Size;
+        char *m_Map;
+        const Header *m_Header;
+        Record *m_Records;
+        const char *m_Heap;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_BINARY_KEYSTORE_HPP_ */
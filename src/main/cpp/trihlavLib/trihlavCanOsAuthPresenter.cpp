@@ -45,23 +45,23 @@ namespace trihlav {
     }
 
     void CanOsAuthPresenter::userAccepted(bool pStatus) {
-        BOOST_LOG_NAMED_SCOPE("CanOsAuthPresenter::userAccepted");
+        TRIHLAV_TRACE_SCOPE("CanOsAuthPresenter::userAccepted");
         doProtectedAction(pStatus);
     }
 
     LoginPresenter &CanOsAuthPresenter::getLoginPresenter() {
         if (!m_LoginPresenter) {
-            BOOST_LOG_TRIVIAL(debug) << "Creating login presenter.";
+            TRIHLAV_LOG(debug) << "Creating login presenter.";
             m_LoginPresenter.reset(new LoginPresenter(getFactory()));
             m_LoginPresenter->sigUserAccepted.connect(
                     [=](bool pStatus) -> void { userAccepted(pStatus); });
         }
-        BOOST_LOG_TRIVIAL(debug) << "returning login presenter.";
+        TRIHLAV_LOG(debug) << "returning login presenter.";
         return *m_LoginPresenter;
     }
 
     void CanOsAuthPresenter::protectedAction() {
-        BOOST_LOG_NAMED_SCOPE("CanOsAuthPresenter::protectedAction");
+        TRIHLAV_TRACE_SCOPE("CanOsAuthPresenter::protectedAction");
         getLoginPresenter().show();
     }
 
@@ -36,7 +36,13 @@ namespace trihlav {
     const std::string K_LOGIN{"login"};
     const std::string K_PSWD{"password"};
     const std::string K_USER_NM{"username"};
+    const std::string K_NONCE{"nonce"};
     const std::string K_AUTH_URL{"/auth"};
+    const std::string K_METRICS_URL{"/metrics"};
+    const std::string K_TRACE_URL{"/trace"};
+    const std::string K_ENABLE{"enable"};
+    /// @brief Environment variable overriding the detected configuration directory.
+    const std::string K_CONFIG_DIR_ENV{"TRIHLAV_CONFIG_DIR"};
 
 }
 
@@ -0,0 +1,436 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavCounterJournal.hpp"
+#include "trihlavLib/trihlavCrc16.hpp"
+
+using std::string;
+using std::vector;
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+using std::runtime_error;
+using boost::filesystem::path;
+
+namespace trihlav {
+
+    static_assert(sizeof(CounterJournal::Record) == 46, "Journal record layout changed.");
+
+    static const char K_JOURNAL_MAGIC[] = "TRHLVJ01";
+    static constexpr size_t K_JOURNAL_HDR_SZ = sizeof(K_JOURNAL_MAGIC) - 1;
+    static constexpr size_t K_RECORD_SZ = sizeof(CounterJournal::Record);
+
+    const string CounterJournal::Record::getPublicId() const {
+        return string(m_PublicId, strnlen(m_PublicId, K_MAX_PUBLIC_ID_LEN));
+    }
+
+    uint16_t CounterJournal::computeCrc(const Record &pRecord) {
+        return ~crc16(reinterpret_cast<const uint8_t *>(&pRecord), sizeof(pRecord) - sizeof(pRecord.m_Crc));
+    }
+
+    /// @brief fdatasync is enough, the file size changes are covered too.
+    static int syncFd(const int pFd) {
+#ifdef __APPLE__
+        return ::fsync(pFd);
+#else
+        return ::fdatasync(pFd);
+#endif
+    }
+
+    CounterJournal::CounterJournal(const path &pFilename, const Settings::EDurability pDurability,
+                                   const std::chrono::microseconds pMaxDelay) //
+            : m_Filename(pFilename), m_Durability(pDurability), m_MaxDelay(pMaxDelay), m_Stop(false), //
+              m_Fd(-1), m_RecordCount(0), m_WrittenSeq(0), m_SyncedSeq(0), m_FailedSeq(0), m_SyncCount(0) //
+    {
+    }
+
+/**
+ * Pending records are flushed before the journal is closed.
+ */
+    CounterJournal::~CounterJournal() {
+        {
+            lock_guard<mutex> myLock(m_Mutex);
+            m_Stop = true;
+        }
+        m_FlushCv.notify_all();
+        if (m_Flusher.joinable()) {
+            m_Flusher.join();
+        }
+        close();
+    }
+
+    static void writeAll(const int pFd, const char *pBuf, size_t pSz, off_t pOffset, const path &pFilename) {
+        while (pSz > 0) {
+            const ssize_t myWritten = ::pwrite(pFd, pBuf, pSz, pOffset);
+            if (myWritten < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw runtime_error("Failed to write to " + pFilename.string() + ": " + strerror(errno));
+            }
+            pBuf += myWritten;
+            pSz -= size_t(myWritten);
+            pOffset += off_t(myWritten);
+        }
+    }
+
+    /// @brief Make the directory entry of a new pFilename durable, failures are only logged.
+    static void syncParentDir(const path &pFilename) {
+        const path myDir = pFilename.has_parent_path() ? pFilename.parent_path() : path(".");
+        const int myDirFd = ::open(myDir.c_str(), O_RDONLY | O_CLOEXEC);
+        if (myDirFd < 0 || ::fsync(myDirFd) != 0) {
+            TRIHLAV_LOG(warning) << "Failed to flush the directory of " << pFilename << ": " << strerror(errno);
+        }
+        if (myDirFd >= 0) {
+            ::close(myDirFd);
+        }
+    }
+
+/**
+ * Opens the journal for appending, creates it when missing. A journal with
+ * an unknown header is moved aside, an incomplete last record is cut off.
+ * Records are written at their offset, not appended, so what a failed
+ * append left behind is overwritten by the next one.
+ */
+    void CounterJournal::open() {
+        TRIHLAV_TRACE_SCOPE("CounterJournal::open");
+        if (m_Fd >= 0) {
+            return;
+        }
+        m_Fd = ::open(m_Filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (m_Fd < 0) {
+            throw runtime_error("Failed to open " + m_Filename.string() + ": " + strerror(errno));
+        }
+        struct stat myStat;
+        if (fstat(m_Fd, &myStat) != 0) {
+            close();
+            throw runtime_error("Failed to stat " + m_Filename.string() + ": " + strerror(errno));
+        }
+        size_t mySz = size_t(myStat.st_size);
+        if (mySz >= K_JOURNAL_HDR_SZ) {
+            char myMagic[K_JOURNAL_HDR_SZ];
+            if (::pread(m_Fd, myMagic, K_JOURNAL_HDR_SZ, 0) != ssize_t(K_JOURNAL_HDR_SZ)
+                || memcmp(myMagic, K_JOURNAL_MAGIC, K_JOURNAL_HDR_SZ) != 0) {
+                TRIHLAV_LOG(error) << "Journal " << m_Filename << " has a wrong header, moving it aside.";
+                close();
+                path myDamaged(m_Filename);
+                myDamaged += ".damaged";
+                boost::filesystem::rename(m_Filename, myDamaged);
+                open();
+                return;
+            }
+        }
+        if (mySz < K_JOURNAL_HDR_SZ) {
+            if (ftruncate(m_Fd, 0) != 0) {
+                throw runtime_error("Failed to truncate " + m_Filename.string() + ": " + strerror(errno));
+            }
+            writeAll(m_Fd, K_JOURNAL_MAGIC, K_JOURNAL_HDR_SZ, 0, m_Filename);
+            if (syncFd(m_Fd) != 0) {
+                throw runtime_error("Failed to flush " + m_Filename.string() + ": " + strerror(errno));
+            }
+            syncParentDir(m_Filename);
+            mySz = K_JOURNAL_HDR_SZ;
+        }
+        const size_t myTail = (mySz - K_JOURNAL_HDR_SZ) % K_RECORD_SZ;
+        if (myTail != 0) {
+            TRIHLAV_LOG(warning) << "Dropping incomplete record at the end of " << m_Filename << ".";
+            mySz -= myTail;
+            if (ftruncate(m_Fd, off_t(mySz)) != 0) {
+                throw runtime_error("Failed to truncate " + m_Filename.string() + ": " + strerror(errno));
+            }
+        }
+        m_RecordCount = (mySz - K_JOURNAL_HDR_SZ) / K_RECORD_SZ;
+        if (m_Durability != Settings::EPerCommit) {
+            m_Flusher = std::thread(&CounterJournal::runFlusher, this);
+        }
+    }
+
+    void CounterJournal::close() {
+        if (m_Fd >= 0) {
+            ::close(m_Fd);
+            m_Fd = -1;
+        }
+    }
+
+    uint64_t CounterJournal::append(const string &pPublicId, const yubikey_token_st &pToken) {
+        if (pPublicId.size() > K_MAX_PUBLIC_ID_LEN) {
+            throw std::invalid_argument("Public ID too long for the journal: \"" + pPublicId + "\"");
+        }
+        Record myRec;
+        memset(&myRec, 0, sizeof(myRec));
+        memcpy(myRec.m_PublicId, pPublicId.data(), pPublicId.size());
+        memcpy(myRec.m_Uid, pToken.uid, YUBIKEY_UID_SIZE);
+        myRec.m_Ctr = pToken.ctr;
+        myRec.m_Tstpl = pToken.tstpl;
+        myRec.m_Tstph = pToken.tstph;
+        myRec.m_Use = pToken.use;
+        myRec.m_Crc = computeCrc(myRec);
+        lock_guard<mutex> myLock(m_Mutex);
+        open();
+        const off_t myEnd = off_t(K_JOURNAL_HDR_SZ + m_RecordCount * K_RECORD_SZ);
+        try {
+            writeAll(m_Fd, reinterpret_cast<const char *>(&myRec), K_RECORD_SZ, myEnd, m_Filename);
+        } catch (const std::exception &) {
+            // Left in place a partial record would hide all later ones from replay.
+            if (ftruncate(m_Fd, myEnd) != 0) {
+                TRIHLAV_LOG(error) << "Failed to cut a partial record off " << m_Filename << ": " << strerror(errno);
+            }
+            throw;
+        }
+        ++m_RecordCount;
+        ++m_WrittenSeq;
+        if (m_Durability == Settings::EPerCommit) {
+            if (syncFd(m_Fd) != 0) {
+                throw runtime_error("Failed to flush " + m_Filename.string() + ": " + strerror(errno));
+            }
+            m_SyncedSeq = m_WrittenSeq;
+            ++m_SyncCount;
+        } else {
+            m_FlushCv.notify_one();
+        }
+        return m_WrittenSeq;
+    }
+
+/**
+ * In per commit mode the record is already durable when append() returns,
+ * in async mode this never blocks.
+ */
+    void CounterJournal::waitDurable(const uint64_t pSeq) {
+        if (m_Durability != Settings::EGroupCommit) {
+            return;
+        }
+        unique_lock<mutex> myLock(m_Mutex);
+        m_DurableCv.wait(myLock, [this, pSeq] {
+            return m_SyncedSeq >= pSeq || m_FailedSeq >= pSeq;
+        });
+        if (m_SyncedSeq < pSeq) {
+            throw runtime_error("Failed to flush " + m_Filename.string() + ": " + m_SyncError);
+        }
+    }
+
+    void CounterJournal::flush(unique_lock<mutex> &pLock) {
+        const uint64_t myTarget = m_WrittenSeq;
+        if (myTarget <= m_SyncedSeq || m_Fd < 0) {
+            return;
+        }
+        const int myFd = m_Fd;
+        pLock.unlock();
+        const int myRet = syncFd(myFd);
+        const int myErrno = errno;
+        pLock.lock();
+        if (myRet == 0) {
+            m_SyncedSeq = std::max(m_SyncedSeq, myTarget);
+            ++m_SyncCount;
+        } else {
+            m_FailedSeq = std::max(m_FailedSeq, myTarget);
+            m_SyncError = strerror(myErrno);
+            TRIHLAV_LOG(error) << "Failed to flush " << m_Filename << ": " << m_SyncError;
+        }
+        m_DurableCv.notify_all();
+    }
+
+/**
+ * Waits for the first not yet flushed record, then up to m_MaxDelay for more
+ * of them, and flushes them all at once.
+ */
+    void CounterJournal::runFlusher() {
+        TRIHLAV_TRACE_SCOPE("CounterJournal::runFlusher");
+        unique_lock<mutex> myLock(m_Mutex);
+        for (;;) {
+            m_FlushCv.wait(myLock, [this] {
+                return m_Stop || m_WrittenSeq > std::max(m_SyncedSeq, m_FailedSeq);
+            });
+            if (!m_Stop && m_MaxDelay.count() > 0) {
+                m_FlushCv.wait_for(myLock, m_MaxDelay, [this] { return m_Stop; });
+            }
+            flush(myLock);
+            if (m_Stop) {
+                break;
+            }
+        }
+    }
+
+    /// @return bytes read from pFd at pOffset, less than pSz at the end of the file.
+    static size_t readAt(const int pFd, char *pBuf, const size_t pSz, const off_t pOffset) {
+        size_t myRead = 0;
+        while (myRead < pSz) {
+            const ssize_t myCnt = ::pread(pFd, pBuf + myRead, pSz - myRead, off_t(pOffset + myRead));
+            if (myCnt < 0 && errno == EINTR) {
+                continue;
+            }
+            if (myCnt <= 0) {
+                break;
+            }
+            myRead += size_t(myCnt);
+        }
+        return myRead;
+    }
+
+/**
+ * Stops at the first record with a wrong CRC, everything behind it was not
+ * completely written.
+ */
+    static size_t applyRecords(const char *pBuf, const size_t pSz, const path &pFilename,
+                               const std::function<void(const CounterJournal::Record &)> &pApply) {
+        size_t myValid = 0;
+        for (size_t myOff = 0; myOff + K_RECORD_SZ <= pSz; myOff += K_RECORD_SZ) {
+            CounterJournal::Record myRec;
+            memcpy(&myRec, pBuf + myOff, K_RECORD_SZ);
+            if (myRec.m_Crc != CounterJournal::computeCrc(myRec)) {
+                TRIHLAV_LOG(warning) << "Record " << myValid << " of " << pFilename
+                                     << " is damaged, ignoring the rest.";
+                break;
+            }
+            pApply(myRec);
+            ++myValid;
+        }
+        return myValid;
+    }
+
+    size_t CounterJournal::replay(const std::function<void(const Record &)> &pApply) {
+        TRIHLAV_TRACE_SCOPE("CounterJournal::replay");
+        lock_guard<mutex> myLock(m_Mutex);
+        open();
+        vector<char> myBuf(m_RecordCount * K_RECORD_SZ);
+        const size_t myRead = readAt(m_Fd, myBuf.data(), myBuf.size(), off_t(K_JOURNAL_HDR_SZ));
+        return applyRecords(myBuf.data(), myRead, m_Filename, pApply);
+    }
+
+/**
+ * A missing journal or one with a wrong header has no records. Records
+ * appended meanwhile by the owner of the journal may be seen or not.
+ */
+    size_t CounterJournal::scan(const path &pFilename, const std::function<void(const Record &)> &pApply) {
+        TRIHLAV_TRACE_SCOPE("CounterJournal::scan");
+        const int myFd = ::open(pFilename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (myFd < 0) {
+            if (errno == ENOENT) {
+                return 0;
+            }
+            throw runtime_error("Failed to open " + pFilename.string() + ": " + strerror(errno));
+        }
+        struct stat myStat;
+        char myMagic[K_JOURNAL_HDR_SZ];
+        if (fstat(myFd, &myStat) != 0 || size_t(myStat.st_size) < K_JOURNAL_HDR_SZ
+            || readAt(myFd, myMagic, K_JOURNAL_HDR_SZ, 0) != K_JOURNAL_HDR_SZ
+            || memcmp(myMagic, K_JOURNAL_MAGIC, K_JOURNAL_HDR_SZ) != 0) {
+            ::close(myFd);
+            return 0;
+        }
+        vector<char> myBuf(size_t(myStat.st_size) - K_JOURNAL_HDR_SZ);
+        const size_t myRead = readAt(myFd, myBuf.data(), myBuf.size(), off_t(K_JOURNAL_HDR_SZ));
+        ::close(myFd);
+        return applyRecords(myBuf.data(), myRead, pFilename, pApply);
+    }
+
+    void CounterJournal::truncate() {
+        truncate(UINT64_MAX);
+    }
+
+/**
+ * The records are in the order of their sequence numbers, so the last
+ * m_WrittenSeq - pUpToSeq of them are kept. They are written into a new
+ * journal which replaces the old one, overwritten in place a torn record
+ * would hide the ones behind it. dup2() keeps the descriptor number, the
+ * flusher may be syncing it meanwhile.
+ */
+    void CounterJournal::truncate(const uint64_t pUpToSeq) {
+        TRIHLAV_TRACE_SCOPE("CounterJournal::truncate");
+        lock_guard<mutex> myLock(m_Mutex);
+        open();
+        const size_t myKeep = size_t(std::min(uint64_t(m_RecordCount), m_WrittenSeq - std::min(pUpToSeq, m_WrittenSeq)));
+        if (myKeep == m_RecordCount) {
+            return;
+        }
+        if (myKeep == 0) {
+            if (ftruncate(m_Fd, off_t(K_JOURNAL_HDR_SZ)) != 0) {
+                throw runtime_error("Failed to truncate " + m_Filename.string() + ": " + strerror(errno));
+            }
+        } else {
+            vector<char> myBuf(K_JOURNAL_HDR_SZ + myKeep * K_RECORD_SZ);
+            memcpy(myBuf.data(), K_JOURNAL_MAGIC, K_JOURNAL_HDR_SZ);
+            const off_t myFrom = off_t(K_JOURNAL_HDR_SZ + (m_RecordCount - myKeep) * K_RECORD_SZ);
+            if (readAt(m_Fd, myBuf.data() + K_JOURNAL_HDR_SZ, myKeep * K_RECORD_SZ, myFrom) != myKeep * K_RECORD_SZ) {
+                throw runtime_error("Failed to read " + m_Filename.string() + ": " + strerror(errno));
+            }
+            path myTmp(m_Filename);
+            myTmp += ".tmp";
+            const int myFd = ::open(myTmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+            if (myFd < 0) {
+                throw runtime_error("Failed to open " + myTmp.string() + ": " + strerror(errno));
+            }
+            try {
+                writeAll(myFd, myBuf.data(), myBuf.size(), 0, myTmp);
+                if (syncFd(myFd) != 0) {
+                    throw runtime_error("Failed to flush " + myTmp.string() + ": " + strerror(errno));
+                }
+                boost::filesystem::rename(myTmp, m_Filename);
+                if (::dup2(myFd, m_Fd) < 0) {
+                    throw runtime_error("Failed to reopen " + m_Filename.string() + ": " + strerror(errno));
+                }
+            } catch (...) {
+                ::close(myFd);
+                throw;
+            }
+            ::close(myFd);
+            syncParentDir(m_Filename);
+        }
+        m_RecordCount = myKeep;
+        // Dropped records were folded into the key files, kept ones are in the flushed copy.
+        m_SyncedSeq = m_WrittenSeq;
+        m_DurableCv.notify_all();
+    }
+
+    size_t CounterJournal::getRecordCount() const {
+        lock_guard<mutex> myLock(m_Mutex);
+        return m_RecordCount;
+    }
+
+    uint64_t CounterJournal::getWrittenSeq() const {
+        lock_guard<mutex> myLock(m_Mutex);
+        return m_WrittenSeq;
+    }
+
+    uint64_t CounterJournal::getSyncCount() const {
+        lock_guard<mutex> myLock(m_Mutex);
+        return m_SyncCount;
+    }
+
+} /* namespace trihlav */
@@ -0,0 +1,160 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_COUNTER_JOURNAL_HPP_
+#define TRIHLAV_COUNTER_JOURNAL_HPP_
+
+#include <string>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <yubikey.h>
+#include <boost/filesystem.hpp>
+
+#include "trihlavLib/trihlavSettings.hpp"
+
+namespace trihlav {
+
+    /**
+     * Append-only binary log of counter advances.
+     *
+     * Every accepted OTP appends one small fixed size record instead of
+     * rewriting the whole key file. The records are replayed over the key
+     * files at load time and folded back into them by KeyManager::compactJournal().
+     * A torn record at the end of the file (crash while writing) is ignored.
+     * Records carry the private ID too, so a key which was re-created under
+     * the same public ID does not inherit the counters of its predecessor.
+     *
+     * Every append gets a sequence number, waitDurable() blocks until the
+     * record reached the disk according to the durability mode. In group
+     * commit mode a flusher thread makes all records written meanwhile
+     * durable with one flush.
+     */
+    class CounterJournal {
+    public:
+        /// @brief Longest public ID which fits into a record, modhex encoded.
+        static constexpr size_t K_MAX_PUBLIC_ID_LEN = 32;
+
+        /// @brief One counter advance as stored on disk.
+        struct Record {
+            char m_PublicId[K_MAX_PUBLIC_ID_LEN]; //< modhex, zero padded
+            uint8_t m_Uid[YUBIKEY_UID_SIZE];      //< private ID of the key
+            uint16_t m_Ctr;                       //< yubikey_token_st.ctr
+            uint16_t m_Tstpl;                     //< yubikey_token_st.tstpl
+            uint8_t m_Tstph;                      //< yubikey_token_st.tstph
+            uint8_t m_Use;                        //< yubikey_token_st.use
+            uint16_t m_Crc;                       //< CRC16 of all fields above
+
+            const std::string getPublicId() const;
+        };
+
+        explicit CounterJournal(const boost::filesystem::path &pFilename,
+                                const Settings::EDurability pDurability = Settings::EPerCommit,
+                                const std::chrono::microseconds pMaxDelay = std::chrono::microseconds(0));
+
+        virtual ~CounterJournal();
+
+        /**
+         * @brief Append the counters of the token, opens the journal when needed.
+         * @return sequence number of the record, @see waitDurable(uint64_t)
+         */
+        uint64_t append(const std::string &pPublicId, const yubikey_token_st &pToken);
+
+        /// @brief Block until the record pSeq is on disk, throws when the flush failed.
+        void waitDurable(const uint64_t pSeq);
+
+        /// @brief Sequence number of the last appended record.
+        uint64_t getWrittenSeq() const;
+
+        /// @brief How many flushes were done, one per commit or batch.
+        uint64_t getSyncCount() const;
+
+        Settings::EDurability getDurability() const {
+            return m_Durability;
+        }
+
+        /**
+         * @brief Pass all valid records in order of their creation to pApply.
+         * @return number of valid records.
+         */
+        size_t replay(const std::function<void(const Record &)> &pApply);
+
+        /**
+         * @brief replay() a journal without opening it for writing, fe. the one of a running server.
+         * @return number of valid records.
+         */
+        static size_t scan(const boost::filesystem::path &pFilename,
+                           const std::function<void(const Record &)> &pApply);
+
+        /// @brief Drop all records, done after they were folded into the key files.
+        void truncate();
+
+        /// @brief Drop the records up to the sequence number pUpToSeq, later ones are kept.
+        void truncate(const uint64_t pUpToSeq);
+
+        /// @brief Records appended since open or last truncate().
+        size_t getRecordCount() const;
+
+        const boost::filesystem::path &getFilename() const {
+            return m_Filename;
+        }
+
+        static uint16_t computeCrc(const Record &pRecord);
+
+    private:
+        void open();
+
+        void close();
+
+        /// @brief Flush all written records, the lock is released meanwhile.
+        void flush(std::unique_lock<std::mutex> &pLock);
+
+        void runFlusher();
+
+        const boost::filesystem::path m_Filename;
+        const Settings::EDurability m_Durability;
+        const std::chrono::microseconds m_MaxDelay; //< gather commits so long
+        mutable std::mutex m_Mutex;
+        std::condition_variable m_FlushCv;   //< wakes the flusher
+        std::condition_variable m_DurableCv; //< wakes waitDurable()
+        std::thread m_Flusher;
+        bool m_Stop;
+        int m_Fd;
+        size_t m_RecordCount;
+        uint64_t m_WrittenSeq;
+        uint64_t m_SyncedSeq;
+        uint64_t m_FailedSeq;
+        uint64_t m_SyncCount;
+        std::string m_SyncError;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_COUNTER_JOURNAL_HPP_ */
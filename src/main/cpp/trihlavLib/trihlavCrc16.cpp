@@ -0,0 +1,60 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include "trihlavLib/trihlavCrc16.hpp"
+
+namespace trihlav {
+
+    namespace {
+        /// @brief Built at compile time, usable during static initialization.
+        struct Crc16Table {
+            uint16_t m_Tbl[256];
+
+            constexpr Crc16Table() : m_Tbl{} {
+                for (unsigned myI = 0; myI < 256; ++myI) {
+                    uint16_t myCrc = static_cast<uint16_t>(myI);
+                    for (int myBit = 0; myBit < 8; ++myBit) {
+                        myCrc = (myCrc & 1) ? (myCrc >> 1) ^ 0x8408 : myCrc >> 1;
+                    }
+                    m_Tbl[myI] = myCrc;
+                }
+            }
+        };
+
+        constexpr Crc16Table K_CRC16_TABLE;
+    }
+
+    uint16_t crc16(const uint8_t *pBuf, size_t pLen) {
+        uint16_t myCrc = 0xffff;
+        while (pLen--) {
+            myCrc = (myCrc >> 8) ^ K_CRC16_TABLE.m_Tbl[(myCrc ^ *pBuf++) & 0xff];
+        }
+        return myCrc;
+    }
+
+} /* namespace trihlav */
@@ -31,6 +31,8 @@
 
 #include <openssl/pem.h>
 
+#include "trihlavLib/trihlavCreateX509.hpp"
+
 namespace trihlav {
 /* Generates a 2048-bit RSA key. */
     EVP_PKEY *generate_key() {
@@ -87,7 +89,7 @@ namespace trihlav {
         X509_set_issuer_name(x509, name);
 
         /* Actually sign the certificate with our key. */
-        if (!X509_sign(x509, pkey, EVP_sha1())) {
+        if (!X509_sign(x509, pkey, EVP_sha256())) {
             std::cerr << "Error signing certificate." << std::endl;
             X509_free(x509);
             return NULL;
@@ -97,10 +99,14 @@ namespace trihlav {
     }
 
     bool write_to_disk(EVP_PKEY *pkey, X509 *x509) {
+        return write_to_disk(pkey, x509, "key.pem", "cert.pem");
+    }
+
+    bool write_to_disk(EVP_PKEY *pkey, X509 *x509, const std::string &pKeyFile, const std::string &pCertFile) {
         /* Open the PEM file for writing the key to disk. */
-        FILE *pkey_file = fopen("key.pem", "wb");
+        FILE *pkey_file = fopen(pKeyFile.c_str(), "wb");
         if (!pkey_file) {
-            std::cerr << "Unable to open \"key.pem\" for writing." << std::endl;
+            std::cerr << "Unable to open \"" << pKeyFile << "\" for writing." << std::endl;
             return false;
         }
 
@@ -114,9 +120,9 @@ namespace trihlav {
         }
 
         /* Open the PEM file for writing the certificate to disk. */
-        FILE *x509_file = fopen("cert.pem", "wb");
+        FILE *x509_file = fopen(pCertFile.c_str(), "wb");
         if (!x509_file) {
-            std::cerr << "Unable to open \"cert.pem\" for writing." << std::endl;
+            std::cerr << "Unable to open \"" << pCertFile << "\" for writing." << std::endl;
             return false;
         }
 
@@ -0,0 +1,52 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_CREATE_X509_HPP_
+#define TRIHLAV_CREATE_X509_HPP_
+
+#include <string>
+
+#include <openssl/pem.h>
+
+namespace trihlav {
+
+    /// @brief Generates a 2048-bit RSA key, NULL on failure.
+    EVP_PKEY *generate_key();
+
+    /// @brief Generates a self-signed x509 certificate for "localhost", NULL on failure.
+    X509 *generate_x509(EVP_PKEY *pkey);
+
+    /// @brief Writes key.pem and cert.pem into the current directory.
+    bool write_to_disk(EVP_PKEY *pkey, X509 *x509);
+
+    /// @brief Writes the key and the certificate in PEM format to the given files.
+    bool write_to_disk(EVP_PKEY *pkey, X509 *x509, const std::string &pKeyFile, const std::string &pCertFile);
+
+}
+
+#endif /* TRIHLAV_CREATE_X509_HPP_ */
@@ -28,14 +28,13 @@
 
 #include "trihlavLib/trihlavFactoryIface.hpp"
 
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
 
 #include "trihlavLib/trihlavKeyListPresenter.hpp"
 #include "trihlavLib/trihlavPswdChckPresenter.hpp"
 #include "trihlavLib/trihlavYubikoOtpKeyPresenter.hpp"
 #include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavOtpValidator.hpp"
 #include "trihlavLib/trihlavOsIface.hpp"
 #include "trihlavLib/trihlavSettings.hpp"
 
@@ -48,7 +47,7 @@ namespace trihlav {
  * @return a reference to the key manager singleton.
  */
     KeyManager &FactoryIface::getKeyManager() {
-        BOOST_LOG_NAMED_SCOPE("IFactory::getKeyManager()");
+        TRIHLAV_TRACE_SCOPE("IFactory::getKeyManager()");
         return *m_KeyManager;
     }
 
@@ -56,12 +55,19 @@ namespace trihlav {
  * @brief A constant variant of  FactoryIface::getKeyManager()
  */
     const KeyManager &FactoryIface::getKeyManager() const {
-        BOOST_LOG_NAMED_SCOPE("IFactory::getKeyManager()");
+        TRIHLAV_TRACE_SCOPE("IFactory::getKeyManager()");
         return *m_KeyManager;
     }
 
+/**
+ * @return the validator shared by all sessions and request threads.
+ */
+    OtpValidator &FactoryIface::getOtpValidator() {
+        return *m_OtpValidator;
+    }
+
     KeyListPresenterIfacePtr FactoryIface::createKeyListPresenter() {
-        BOOST_LOG_NAMED_SCOPE("IFactory::createKeyListPresenter()");
+        TRIHLAV_TRACE_SCOPE("IFactory::createKeyListPresenter()");
         return KeyListPresenterIfacePtr(new KeyListPresenter(*this));
     }
 
@@ -85,7 +91,8 @@ namespace trihlav {
         return theSettings;
     }
 
-    FactoryIface::FactoryIface() : m_KeyManager(new KeyManager(getSettings())) {
+    FactoryIface::FactoryIface() : m_KeyManager(new KeyManager(getSettings())),
+                                   m_OtpValidator(new OtpValidator(*m_KeyManager)) {
 
     }
 
@@ -60,6 +60,8 @@ namespace trihlav {
 
     class KeyManager;
 
+    class OtpValidator;
+
     using SysUserListViewIfacePtr = std::shared_ptr<SysUserListViewIface>;
 
     class FactoryIface {
@@ -87,6 +89,9 @@ namespace trihlav {
 
         virtual KeyManager &getKeyManager();
 
+        /// @brief Validates OTPs against the keys of getKeyManager().
+        virtual OtpValidator &getOtpValidator();
+
         /// @brief OS System interface singleton
         virtual OsIface &getOsIface();
 
@@ -102,6 +107,7 @@ namespace trihlav {
     private:
         std::unique_ptr<OsIface> m_OsIface;
         std::unique_ptr<KeyManager> m_KeyManager;
+        std::unique_ptr<OtpValidator> m_OtpValidator;
     };
 
 }  // namespace trihlav
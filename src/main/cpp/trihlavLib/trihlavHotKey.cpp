@@ -0,0 +1,142 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <new>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+#include "trihlavLib/trihlavHotKey.hpp"
+
+namespace trihlav {
+
+    static_assert(sizeof(HotKey) == 64, "A HotKey has to fill one cache line.");
+
+    constexpr size_t HotKeyTable::K_SLAB_KEYS;
+
+    void HotKey::setKey(const uint8_t *pKey) {
+        memcpy(m_Key.data(), pKey, YUBIKEY_KEY_SIZE);
+        m_Cipher->setKey(m_Key.data());
+    }
+
+    uint32_t HotKey::hashSysUser(const std::string &pSysUser) {
+        if (pSysUser.empty()) {
+            return 0;
+        }
+        const size_t myHash = std::hash<std::string>()(pSysUser);
+        const uint32_t myRetVal = uint32_t(myHash ^ (myHash >> 32));
+        return myRetVal == 0 ? 1 : myRetVal;
+    }
+
+    HotKeyTable::HotKeyTable() //
+            : m_SlabUsed(K_SLAB_KEYS), m_Size(0) //
+    {
+    }
+
+    HotKeyTable::~HotKeyTable() {
+        for (HotKey *mySlab : m_Slabs) {
+            std::free(mySlab);
+        }
+        for (OtpCipher *mySlab : m_CipherSlabs) {
+            std::free(mySlab);
+        }
+    }
+
+    /// @brief posix_memalign() of pSize bytes, throws std::bad_alloc.
+    static void *allocateSlab(const size_t pSize) {
+        void *myRetVal = 0;
+        if (::posix_memalign(&myRetVal, 64, pSize) != 0) {
+            throw std::bad_alloc();
+        }
+        return myRetVal;
+    }
+
+    /// @brief Zero the record, its key schedule becomes the one of the zero key.
+    static void clear(HotKey *pKey) {
+        OtpCipher *const myCipher = pKey->m_Cipher;
+        memset(pKey, 0, sizeof(HotKey));
+        pKey->m_Cipher = myCipher;
+        *myCipher = OtpCipher();
+    }
+
+/**
+ * Records cut from a slab get their schedule constructed here, reused ones
+ * keep it.
+ */
+    HotKey *HotKeyTable::allocate() {
+        HotKey *myRetVal;
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        if (!m_Free.empty()) {
+            myRetVal = m_Free.back();
+            m_Free.pop_back();
+        } else {
+            if (m_SlabUsed == K_SLAB_KEYS) {
+                static_assert(alignof(OtpCipher) <= 64, "Key schedules are cache line aligned.");
+                std::unique_ptr<void, void (*)(void *)> mySlab(allocateSlab(K_SLAB_KEYS * sizeof(HotKey)), std::free);
+                std::unique_ptr<void, void (*)(void *)> myCiphers(allocateSlab(K_SLAB_KEYS * sizeof(OtpCipher)),
+                                                                  std::free);
+                m_Slabs.reserve(m_Slabs.size() + 1);
+                m_CipherSlabs.reserve(m_CipherSlabs.size() + 1);
+                m_Slabs.push_back(static_cast<HotKey *>(mySlab.release()));
+                m_CipherSlabs.push_back(static_cast<OtpCipher *>(myCiphers.release()));
+                m_SlabUsed = 0;
+            }
+            myRetVal = m_Slabs.back() + m_SlabUsed;
+            memset(myRetVal, 0, sizeof(HotKey));
+            myRetVal->m_Cipher = new(m_CipherSlabs.back() + m_SlabUsed) OtpCipher();
+            ++m_SlabUsed;
+        }
+        ++m_Size;
+        return myRetVal;
+    }
+
+    void HotKeyTable::free(HotKey *pKey) {
+        // neither the secret key nor its schedule linger in a free record
+        clear(pKey);
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        m_Free.push_back(pKey);
+        --m_Size;
+    }
+
+    size_t HotKeyTable::getSize() const {
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        return m_Size;
+    }
+
+    size_t HotKeyTable::getMemory() const {
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        return m_Slabs.size() * K_SLAB_KEYS * (sizeof(HotKey) + sizeof(OtpCipher));
+    }
+
+    HotKeyTable &getHotKeys() {
+        static HotKeyTable *theHotKeys = new HotKeyTable();
+        return *theHotKeys;
+    }
+
+} /* namespace trihlav */
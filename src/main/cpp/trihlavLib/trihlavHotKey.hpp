@@ -0,0 +1,123 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_HOT_KEY_HPP_
+#define TRIHLAV_HOT_KEY_HPP_
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <yubikey.h>
+
+#include "trihlavLib/trihlavOtpCipher.hpp"
+
+namespace trihlav {
+
+    class YubikoOtpKeyConfig;
+
+    /**
+     * What validating an OTP needs of a key, in one cache line.
+     *
+     * The private ID, counters and timestamp are in the token, next to the
+     * secret key. The rest of the key, its public ID, description, system
+     * user and filename, stays in the YubikoOtpKeyConfig owning the record.
+     * The expanded AES key schedule does not fit the line, it lies in a side
+     * array of HotKeyTable parallel to the records, expanded by setKey().
+     */
+    struct alignas(64) HotKey {
+        using SecretKeyArr = std::array<uint8_t, YUBIKEY_KEY_SIZE>;
+
+        yubikey_token_st m_Token;   //< private ID, counters, timestamp, random and CRC
+        SecretKeyArr m_Key;
+        YubikoOtpKeyConfig *m_Cold; //< the owning key
+        OtpCipher *m_Cipher;        //< key schedule of m_Key, owned by HotKeyTable
+        uint32_t m_SysUserHash;     //< hashSysUser() of the system user
+        uint8_t m_Reserved[12];
+
+        /// @brief Set the secret key to YUBIKEY_KEY_SIZE bytes at pKey and expand its schedule.
+        void setKey(const uint8_t *pKey);
+
+        /// @brief Decrypts OTPs of this key.
+        const OtpCipher &getCipher() const {
+            return *m_Cipher;
+        }
+
+        /// @brief Hash of pSysUser for a quick compare, 0 only for the empty one.
+        static uint32_t hashSysUser(const std::string &pSysUser);
+    };
+
+    /**
+     * Dense storage of the HotKey records of all keys.
+     *
+     * Records are cut from cache line aligned slabs of K_SLAB_KEYS records,
+     * keys loaded together lie next to each other. Each slab has a parallel
+     * slab of OtpCipher key schedules, a record points to its own one.
+     * Freed records are reused, slabs are kept. Safe to be called from
+     * several threads.
+     */
+    class HotKeyTable {
+    public:
+        static constexpr size_t K_SLAB_KEYS = 1024;
+
+        HotKeyTable();
+
+        HotKeyTable(const HotKeyTable &) = delete;
+
+        HotKeyTable &operator=(const HotKeyTable &) = delete;
+
+        ~HotKeyTable();
+
+        /// @brief A zeroed record with the schedule of the all zero key, throws std::bad_alloc.
+        HotKey *allocate();
+
+        void free(HotKey *pKey);
+
+        /// @brief Records in use.
+        size_t getSize() const;
+
+        /// @brief Bytes taken by the slabs, key schedules included.
+        size_t getMemory() const;
+
+    private:
+        mutable std::mutex m_Mutex;
+        std::vector<HotKey *> m_Slabs;
+        std::vector<OtpCipher *> m_CipherSlabs; //< parallel to m_Slabs
+        std::vector<HotKey *> m_Free;
+        size_t m_SlabUsed; //< records cut from the last slab
+        size_t m_Size;
+    };
+
+    /// @brief The records of all keys, never destroyed, so keys may outlive main().
+    HotKeyTable &getHotKeys();
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_HOT_KEY_HPP_ */
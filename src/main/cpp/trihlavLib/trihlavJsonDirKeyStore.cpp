@@ -0,0 +1,481 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <numeric>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavJsonDirKeyStore.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavKeySnapshot.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+
+using std::string;
+using boost::filesystem::path;
+
+namespace trihlav {
+
+    /// @brief Key files a worker takes at once from the shared list.
+    static constexpr size_t K_FILES_PER_TASK = 64;
+
+    namespace {
+        bool byPublicId(const JsonDirKeyStore::KeyPtr_t &pA, const JsonDirKeyStore::KeyPtr_t &pB) {
+            return pA->getPublicId() < pB->getPublicId();
+        }
+
+        bool isKeyNameChar(const char pChar) {
+            return (pChar >= 'a' && pChar <= 'z') || (pChar >= '0' && pChar <= '9');
+        }
+
+        /**
+         * Runs pWork(shard, file) for all pFiles on up to pThreads threads,
+         * which take K_FILES_PER_TASK files at a time, then pDone(shard) on
+         * each of them. The first error is rethrown.
+         * @return count of the threads used.
+         */
+        template<class Work_t, class Done_t>
+        size_t forEachFile(const std::vector<path> &pFiles, const size_t pThreads, const Work_t &pWork,
+                           const Done_t &pDone) {
+            std::vector<std::exception_ptr> myErrors(pThreads);
+            std::atomic<size_t> myNext(0);
+            const auto myWork = [&](const size_t pShard) {
+                try {
+                    for (size_t myFirst = myNext.fetch_add(K_FILES_PER_TASK); myFirst < pFiles.size();
+                         myFirst = myNext.fetch_add(K_FILES_PER_TASK)) {
+                        const size_t myEnd = std::min(pFiles.size(), myFirst + K_FILES_PER_TASK);
+                        for (size_t myIdx = myFirst; myIdx < myEnd; ++myIdx) {
+                            pWork(pShard, pFiles[myIdx]);
+                        }
+                    }
+                    pDone(pShard);
+                } catch (...) {
+                    myErrors[pShard] = std::current_exception();
+                }
+            };
+            std::vector<std::thread> myWorkers;
+            try {
+                for (size_t myShard = 1; myShard < pThreads; ++myShard) {
+                    myWorkers.emplace_back(myWork, myShard);
+                }
+            } catch (const std::exception &myExc) {
+                // the started workers and this thread take over the files
+                TRIHLAV_LOG(warning) << "Loading keys with " << myWorkers.size() + 1 << " threads only - "
+                                     << myExc.what();
+            }
+            myWork(0);
+            for (std::thread &myWorker : myWorkers) {
+                myWorker.join();
+            }
+            for (const std::exception_ptr &myError : myErrors) {
+                if (myError) {
+                    std::rethrow_exception(myError);
+                }
+            }
+            return myWorkers.size() + 1;
+        }
+    }
+
+    JsonDirKeyStore::JsonDirKeyStore(KeyManager &pKeyManager) //
+            : KeyStore(pKeyManager) //
+    {
+    }
+
+    JsonDirKeyStore::~JsonDirKeyStore() {
+    }
+
+    const string &JsonDirKeyStore::getName() const {
+        return Settings::getKeyStoreStr(Settings::EJsonDir);
+    }
+
+    const path JsonDirKeyStore::getLocation() const {
+        return getKeyManager().getSettings().getConfigDir();
+    }
+
+/**
+ * Matches "[a-z0-9]{2}-[a-z0-9]{2}-[a-z0-9]{2}\.trihlav-key\.json", checked
+ * for every directory entry, so without a regular expression.
+ */
+    bool JsonDirKeyStore::isKeyFilename(const char *pName, const size_t pLen) {
+        static const char K_SUFFIX[] = ".trihlav-key.json";
+        static const size_t K_LEN = 8 + sizeof(K_SUFFIX) - 1;
+        return pLen == K_LEN && isKeyNameChar(pName[0]) && isKeyNameChar(pName[1]) && pName[2] == '-'
+               && isKeyNameChar(pName[3]) && isKeyNameChar(pName[4]) && pName[5] == '-'
+               && isKeyNameChar(pName[6]) && isKeyNameChar(pName[7])
+               && memcmp(pName + 8, K_SUFFIX, sizeof(K_SUFFIX) - 1) == 0;
+    }
+
+    bool JsonDirKeyStore::isKeyFilename(const path &pFilename) {
+        const string myName = pFilename.filename().native();
+        return isKeyFilename(myName.data(), myName.size());
+    }
+
+/**
+ * One readdir() pass per directory, the entry type comes with the name, so
+ * only symbolic links and file systems without it need a stat(). Symbolic
+ * links to directories are not followed.
+ */
+    void JsonDirKeyStore::listKeyFiles(const path &pDir, std::vector<path> &pFiles) {
+        DIR *myDir = ::opendir(pDir.c_str());
+        if (myDir == 0) {
+            throw std::runtime_error("Failed to read the directory " + pDir.string() + ": " + strerror(errno));
+        }
+        std::vector<path> mySubDirs;
+        for (const struct dirent *myEnt = ::readdir(myDir); myEnt != 0; myEnt = ::readdir(myDir)) {
+            const char *myName = myEnt->d_name;
+            if (myName[0] == '.' && (myName[1] == 0 || (myName[1] == '.' && myName[2] == 0))) {
+                continue;
+            }
+            unsigned char myType = myEnt->d_type;
+            if (myType == DT_UNKNOWN || myType == DT_LNK) {
+                struct stat myStat;
+                const path myFName = pDir / myName;
+                if (myType == DT_UNKNOWN && ::lstat(myFName.c_str(), &myStat) == 0 && S_ISDIR(myStat.st_mode)) {
+                    myType = DT_DIR;
+                } else if (::stat(myFName.c_str(), &myStat) == 0 && S_ISREG(myStat.st_mode)) {
+                    myType = DT_REG;
+                }
+            }
+            if (myType == DT_DIR) {
+                mySubDirs.push_back(pDir / myName);
+            } else if (myType == DT_REG && isKeyFilename(myName, strlen(myName))) {
+                pFiles.push_back(pDir / myName);
+            }
+        }
+        ::closedir(myDir);
+        for (const path &mySubDir : mySubDirs) {
+            try {
+                listKeyFiles(mySubDir, pFiles);
+            } catch (const std::exception &myExc) {
+                TRIHLAV_LOG(warning) << myExc.what();
+            }
+        }
+    }
+
+    size_t JsonDirKeyStore::getThreadCount(const size_t pFiles) const {
+        size_t myThreads = size_t(std::max(0, getKeyManager().getSettings().getLoadThreads()));
+        if (myThreads == 0) {
+            myThreads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        return std::max(size_t(1), std::min(myThreads, (pFiles + K_FILES_PER_TASK - 1) / K_FILES_PER_TASK));
+    }
+
+    JsonDirKeyStore::KeyPtr_t JsonDirKeyStore::loadFile(const path &pFilename) {
+        try {
+            KeyPtr_t myKey = std::make_shared<YubikoOtpKeyConfig>(getKeyManager(), pFilename);
+            myKey->load();
+            return myKey;
+        } catch (std::exception &myExc) {
+            TRIHLAV_LOG(error) << "Exception caugh while loading key file " << pFilename << " - " << myExc.what();
+        } catch (...) {
+            TRIHLAV_LOG(error) << "Unknown exception caugh while loading key file " << pFilename << ".";
+        }
+        return KeyPtr_t();
+    }
+
+    void JsonDirKeyStore::renameDamaged(const std::vector<std::vector<path> > &pDamaged) {
+        if (isWritable()) {
+            for (const std::vector<path> &myShard : pDamaged) {
+                for (const path &myFName : myShard) {
+                    getKeyManager().prefixKeyFile(myFName, "damaged");
+                }
+            }
+        }
+    }
+
+    std::unique_ptr<KeySnapshot> JsonDirKeyStore::readSnapshot() const {
+        const path myFilename = getKeyManager().getKeySnapshotFilename();
+        boost::system::error_code myErr;
+        if (!exists(myFilename, myErr)) {
+            return std::unique_ptr<KeySnapshot>();
+        }
+        try {
+            return std::unique_ptr<KeySnapshot>(new KeySnapshot(myFilename));
+        } catch (const std::exception &myExc) {
+            TRIHLAV_LOG(warning) << "Ignoring the key snapshot - " << myExc.what();
+        }
+        return std::unique_ptr<KeySnapshot>();
+    }
+
+    void JsonDirKeyStore::writeSnapshot(std::vector<std::vector<KeySnapshot::Entry> > &pShards) const {
+        if (!isWritable()) {
+            return;
+        }
+        std::vector<KeySnapshot::Entry> myEntries;
+        for (std::vector<KeySnapshot::Entry> &myShard : pShards) {
+            myEntries.insert(myEntries.end(), std::make_move_iterator(myShard.begin()),
+                             std::make_move_iterator(myShard.end()));
+        }
+        try {
+            KeySnapshot::write(getKeyManager().getKeySnapshotFilename(), myEntries);
+        } catch (const std::exception &myExc) {
+            TRIHLAV_LOG(warning) << "Failed to write the key snapshot - " << myExc.what();
+        }
+    }
+
+/**
+ * The key files are listed first, then parsed by getThreadCount() workers
+ * taking K_FILES_PER_TASK files at a time. A file with the same identity
+ * as in the KeySnapshot of the last load is not parsed, its key is taken
+ * from the snapshot. Each worker sorts its keys, the sorted shards are
+ * merged pairwise. Keys sharing a public ID are reported, KeyManager
+ * indexes only one of them. Damaged key files are renamed after all were
+ * read. The snapshot is written again when any file was parsed.
+ */
+    void JsonDirKeyStore::load(KeyList_t &pKeys) {
+        TRIHLAV_TRACE_SCOPE("JsonDirKeyStore::load");
+        std::vector<path> myFiles;
+        listKeyFiles(getLocation(), myFiles);
+        const size_t myThreads = getThreadCount(myFiles.size());
+        const std::unique_ptr<KeySnapshot> mySnapshot = readSnapshot();
+        std::vector<KeyList_t> myShards(myThreads);
+        std::vector<std::vector<path> > myDamaged(myThreads);
+        std::vector<std::vector<KeySnapshot::Entry> > myEntries(myThreads);
+        std::vector<size_t> myHits(myThreads, 0);
+        const size_t myUsed = forEachFile(myFiles, myThreads, [&](const size_t pShard, const path &pFile) {
+            KeySnapshot::Entry myEntry;
+            myEntry.m_Filename = pFile.string();
+            // the identity is taken before the file is read, a later change is seen next time
+            const bool myIdentified = myEntry.m_FileId.read(pFile);
+            const KeySnapshot::Record *myRecord =
+                    mySnapshot && myIdentified ? mySnapshot->find(myEntry.m_Filename, myEntry.m_FileId) : 0;
+            KeyPtr_t myKey;
+            if (myRecord != 0 && (myRecord->m_Flags & KeySnapshot::EWithKey) != 0) {
+                try {
+                    myKey = std::make_shared<YubikoOtpKeyConfig>(getKeyManager(), pFile);
+                    mySnapshot->load(*myKey, *myRecord);
+                    ++myHits[pShard];
+                } catch (const std::exception &myExc) {
+                    TRIHLAV_LOG(warning) << "Key snapshot entry of " << pFile << " is unusable - " << myExc.what();
+                    myKey.reset();
+                }
+            }
+            if (!myKey) {
+                myKey = loadFile(pFile);
+            }
+            if (myKey) {
+                if (myIdentified) {
+                    myEntry.m_Key = myKey.get();
+                    myEntries[pShard].emplace_back(std::move(myEntry));
+                }
+                myShards[pShard].emplace_back(std::move(myKey));
+            } else {
+                myDamaged[pShard].push_back(pFile);
+            }
+        }, [&myShards](const size_t pShard) {
+            std::sort(myShards[pShard].begin(), myShards[pShard].end(), byPublicId);
+        });
+        const size_t myHitCount = std::accumulate(myHits.begin(), myHits.end(), size_t(0));
+        TRIHLAV_LOG(debug) << "Parsed " << myFiles.size() - myHitCount << " of " << myFiles.size()
+                           << " key files with " << myUsed << " threads.";
+        renameDamaged(myDamaged);
+        if (!mySnapshot || myHitCount != myFiles.size() || mySnapshot->getRecordCount() != myFiles.size()) {
+            // the entries point into the loaded keys, they are still alive
+            writeSnapshot(myEntries);
+        }
+        for (size_t myStep = 1; myStep < myShards.size(); myStep *= 2) {
+            for (size_t myShard = 0; myShard + myStep < myShards.size(); myShard += 2 * myStep) {
+                KeyList_t &myLeft = myShards[myShard];
+                KeyList_t &myRight = myShards[myShard + myStep];
+                KeyList_t myMerged;
+                myMerged.reserve(myLeft.size() + myRight.size());
+                std::merge(std::make_move_iterator(myLeft.begin()), std::make_move_iterator(myLeft.end()),
+                           std::make_move_iterator(myRight.begin()), std::make_move_iterator(myRight.end()),
+                           std::back_inserter(myMerged), byPublicId);
+                myLeft.swap(myMerged);
+                KeyList_t().swap(myRight);
+            }
+        }
+        KeyList_t &myKeys = myShards.front();
+        for (size_t myIdx = 1; myIdx < myKeys.size(); ++myIdx) {
+            if (myKeys[myIdx - 1]->getPublicId() == myKeys[myIdx]->getPublicId()) {
+                TRIHLAV_LOG(warning) << "Key files " << myKeys[myIdx - 1]->getFilename() << " and "
+                                     << myKeys[myIdx]->getFilename() << " share the public ID "
+                                     << myKeys[myIdx]->getPublicId() << ".";
+            }
+        }
+        if (pKeys.empty()) {
+            pKeys.swap(myKeys);
+        } else {
+            pKeys.insert(pKeys.end(), std::make_move_iterator(myKeys.begin()), std::make_move_iterator(myKeys.end()));
+        }
+    }
+
+/**
+ * The files are named randomly, all of them are looked at. Damaged ones
+ * are skipped, load() renames them.
+ */
+    JsonDirKeyStore::KeyPtr_t JsonDirKeyStore::get(const string &pPubId) {
+        TRIHLAV_TRACE_SCOPE("JsonDirKeyStore::get");
+        std::vector<path> myFiles;
+        listKeyFiles(getLocation(), myFiles);
+        for (const path &myFName : myFiles) {
+            KeyPtr_t myKey = loadFile(myFName);
+            if (myKey && myKey->getPublicId() == pPubId) {
+                return myKey;
+            }
+        }
+        return KeyPtr_t();
+    }
+
+/**
+ * The files are read like by load(), but only their public IDs are taken,
+ * no key is kept. Unreadable files are renamed like by load(). The public
+ * IDs of unchanged files come from the KeySnapshot, the snapshot written
+ * holds no keys, so the next eager load() parses all files.
+ */
+    void JsonDirKeyStore::loadLocations(std::vector<Location> &pLocations) {
+        TRIHLAV_TRACE_SCOPE("JsonDirKeyStore::loadLocations");
+        std::vector<path> myFiles;
+        listKeyFiles(getLocation(), myFiles);
+        const size_t myThreads = getThreadCount(myFiles.size());
+        const std::unique_ptr<KeySnapshot> mySnapshot = readSnapshot();
+        std::vector<std::vector<Location> > myShards(myThreads);
+        std::vector<std::vector<path> > myDamaged(myThreads);
+        std::vector<std::vector<KeySnapshot::Entry> > myEntries(myThreads);
+        std::vector<size_t> myHits(myThreads, 0);
+        forEachFile(myFiles, myThreads, [&](const size_t pShard, const path &pFile) {
+            try {
+                KeySnapshot::Entry myEntry;
+                myEntry.m_Filename = pFile.string();
+                const bool myIdentified = myEntry.m_FileId.read(pFile);
+                const KeySnapshot::Record *myRecord =
+                        mySnapshot && myIdentified ? mySnapshot->find(myEntry.m_Filename, myEntry.m_FileId) : 0;
+                if (myRecord != 0) {
+                    myEntry.m_PublicId = mySnapshot->getString(myRecord->m_Key.m_PublicId);
+                    ++myHits[pShard];
+                } else {
+                    YubikoOtpKeyConfig myKey(getKeyManager(), pFile);
+                    myEntry.m_PublicId = myKey.loadPublicId();
+                }
+                Location myLocation;
+                myLocation.m_Id = PublicId(myEntry.m_PublicId);
+                myLocation.m_Filename = myEntry.m_Filename;
+                myShards[pShard].emplace_back(std::move(myLocation));
+                if (myIdentified) {
+                    myEntries[pShard].emplace_back(std::move(myEntry));
+                }
+            } catch (std::exception &myExc) {
+                TRIHLAV_LOG(error) << "Exception caugh while reading key file " << pFile << " - " << myExc.what();
+                myDamaged[pShard].push_back(pFile);
+            }
+        }, [](const size_t) {
+        });
+        renameDamaged(myDamaged);
+        const size_t myHitCount = std::accumulate(myHits.begin(), myHits.end(), size_t(0));
+        if (!mySnapshot || myHitCount != myFiles.size() || mySnapshot->getRecordCount() != myFiles.size()) {
+            writeSnapshot(myEntries);
+        }
+        for (std::vector<Location> &myShard : myShards) {
+            pLocations.insert(pLocations.end(), std::make_move_iterator(myShard.begin()),
+                              std::make_move_iterator(myShard.end()));
+        }
+    }
+
+    JsonDirKeyStore::KeyPtr_t JsonDirKeyStore::loadKey(const Location &pLocation) {
+        KeyPtr_t myKey = loadFile(pLocation.m_Filename);
+        if (myKey && PublicId(myKey->getPublicId()) != pLocation.m_Id) {
+            TRIHLAV_LOG(warning) << "Key file " << pLocation.m_Filename << " holds the key "
+                                 << myKey->getPublicId() << " instead of " << pLocation.m_Id.toString() << ".";
+            return KeyPtr_t();
+        }
+        return myKey;
+    }
+
+    void JsonDirKeyStore::put(YubikoOtpKeyConfig &pKey) {
+        checkWritable();
+        if (pKey.getFilename().empty()) {
+            pKey.generateFilename();
+        }
+        pKey.saveFile();
+    }
+
+    void JsonDirKeyStore::erase(YubikoOtpKeyConfig &pKey) {
+        checkWritable();
+        const path myFilename = pKey.getFilename();
+        if (!myFilename.empty() && exists(myFilename)) {
+            getKeyManager().prefixKeyFile(myFilename, "deleted");
+        } else {
+            TRIHLAV_LOG(warning) << "Filename " << myFilename << " does not exist.";
+        }
+    }
+
+    bool JsonDirKeyStore::saveCounters(const YubikoOtpKeyConfig &pKey) {
+        checkWritable();
+        if (pKey.getFilename().empty() || !exists(pKey.getFilename())) {
+            return false;
+        }
+        pKey.saveFileCounters();
+        return true;
+    }
+
+/**
+ * saveCounters() replaces the key file durably already.
+ */
+    void JsonDirKeyStore::sync() {
+    }
+
+    size_t JsonDirKeyStore::write(const std::vector<const YubikoOtpKeyConfig *> &pKeys) {
+        checkWritable();
+        for (const YubikoOtpKeyConfig *myKey : pKeys) {
+            YubikoOtpKeyConfig myCopy(getKeyManager());
+            myCopy.assign(myKey->getPublicId(), myKey->getToken(), myKey->getSecretKeyArray().data(),
+                          myKey->getDescription(), myKey->getSysUser());
+            myCopy.saveFile();
+        }
+        return pKeys.size();
+    }
+
+/**
+ * The files changed since the last load are read, the keys are dropped
+ * again. Lazy key managers snapshot the public IDs only.
+ */
+    void JsonDirKeyStore::saveSnapshot() {
+        TRIHLAV_TRACE_SCOPE("JsonDirKeyStore::saveSnapshot");
+        if (!isWritable()) {
+            return;
+        }
+        if (getKeyManager().getSettings().getLazyKeys()) {
+            std::vector<Location> myLocations;
+            loadLocations(myLocations);
+        } else {
+            KeyList_t myKeys;
+            load(myKeys);
+        }
+    }
+
+} /* namespace trihlav */
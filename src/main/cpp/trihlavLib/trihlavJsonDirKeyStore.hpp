@@ -0,0 +1,108 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_JSON_DIR_KEY_STORE_HPP_
+#define TRIHLAV_JSON_DIR_KEY_STORE_HPP_
+
+#include <memory>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+#include "trihlavLib/trihlavKeyStore.hpp"
+#include "trihlavLib/trihlavKeySnapshot.hpp"
+
+namespace trihlav {
+
+    /**
+     * One JSON key file per key in the configuration directory.
+     *
+     * Easy to edit and to back up, but loading parses every file and get()
+     * has to look at all of them. The files are parsed on several threads,
+     * @see Settings::getLoadThreads(). Files unchanged since the last load
+     * are taken from its KeySnapshot instead. Deleted keys are renamed with
+     * the prefix "deleted".
+     */
+    class JsonDirKeyStore : public KeyStore {
+    public:
+        explicit JsonDirKeyStore(KeyManager &pKeyManager);
+
+        virtual ~JsonDirKeyStore();
+
+        virtual const std::string &getName() const override;
+
+        virtual const boost::filesystem::path getLocation() const override;
+
+        virtual void load(KeyList_t &pKeys) override;
+
+        virtual KeyPtr_t get(const std::string &pPubId) override;
+
+        virtual void loadLocations(std::vector<Location> &pLocations) override;
+
+        virtual KeyPtr_t loadKey(const Location &pLocation) override;
+
+        virtual void put(YubikoOtpKeyConfig &pKey) override;
+
+        virtual void erase(YubikoOtpKeyConfig &pKey) override;
+
+        virtual bool saveCounters(const YubikoOtpKeyConfig &pKey) override;
+
+        virtual void sync() override;
+
+        virtual size_t write(const std::vector<const YubikoOtpKeyConfig *> &pKeys) override;
+
+        virtual void saveSnapshot() override;
+
+        /// @brief Does pFilename look like a key file?
+        static bool isKeyFilename(const boost::filesystem::path &pFilename);
+
+        /// @brief Is the file name pName of pLen characters, without a directory, one of a key file?
+        static bool isKeyFilename(const char *pName, const size_t pLen);
+
+        /// @brief Append the key files in pDir and its subdirectories to pFiles.
+        static void listKeyFiles(const boost::filesystem::path &pDir, std::vector<boost::filesystem::path> &pFiles);
+
+        /// @brief Load the key file pFilename, @return empty when it is damaged.
+        KeyPtr_t loadFile(const boost::filesystem::path &pFilename);
+
+    private:
+        /// @brief Threads to parse pFiles key files with, @see Settings::getLoadThreads()
+        size_t getThreadCount(const size_t pFiles) const;
+
+        /// @brief Rename the damaged key files found by the workers, unless read only.
+        void renameDamaged(const std::vector<std::vector<boost::filesystem::path> > &pDamaged);
+
+        /// @brief The snapshot of the last load, empty when there is none or it is damaged.
+        std::unique_ptr<KeySnapshot> readSnapshot() const;
+
+        /// @brief Replace the snapshot by the entries of all pShards unless read only, failures are logged only.
+        void writeSnapshot(std::vector<std::vector<KeySnapshot::Entry> > &pShards) const;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_JSON_DIR_KEY_STORE_HPP_ */
@@ -0,0 +1,235 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#endif
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavKeyDirWatcher.hpp"
+
+using std::string;
+using std::runtime_error;
+using boost::filesystem::path;
+using boost::filesystem::recursive_directory_iterator;
+using std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+namespace trihlav {
+
+    constexpr milliseconds KeyDirWatcher::K_QUIET;
+    constexpr milliseconds KeyDirWatcher::K_MAX_DELAY;
+
+#ifdef __linux__
+
+    /// @brief Files are reported when they were written and closed, moved or deleted.
+    static const uint32_t K_WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE
+                                         | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+    bool KeyDirWatcher::isSupported() {
+        return true;
+    }
+
+    KeyDirWatcher::KeyDirWatcher(const path &pDir, const Callback_t &pCallback, const milliseconds pQuiet,
+                                 const milliseconds pMaxDelay) //
+            : m_Dir(pDir), m_Callback(pCallback), m_Quiet(pQuiet), m_MaxDelay(pMaxDelay), m_Fd(-1) //
+    {
+        m_StopPipe[0] = m_StopPipe[1] = -1;
+        m_Fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_Fd < 0) {
+            throw runtime_error(string("Failed to initialize inotify: ") + strerror(errno));
+        }
+        if (::pipe2(m_StopPipe, O_CLOEXEC) != 0) {
+            const int myErrno = errno;
+            ::close(m_Fd);
+            throw runtime_error(string("Failed to create a pipe: ") + strerror(myErrno));
+        }
+        try {
+            addWatches(m_Dir);
+        } catch (...) {
+            ::close(m_Fd);
+            ::close(m_StopPipe[0]);
+            ::close(m_StopPipe[1]);
+            throw;
+        }
+        TRIHLAV_LOG(info) << "Watching " << m_Dirs.size() << " directories under " << m_Dir << ".";
+        m_Thread = std::thread(&KeyDirWatcher::run, this);
+    }
+
+    KeyDirWatcher::~KeyDirWatcher() {
+        const char myStop = 0;
+        if (::write(m_StopPipe[1], &myStop, 1) != 1) {
+            TRIHLAV_LOG(error) << "Failed to stop the watcher of " << m_Dir << ": " << strerror(errno);
+        }
+        if (m_Thread.joinable()) {
+            m_Thread.join();
+        }
+        ::close(m_Fd);
+        ::close(m_StopPipe[0]);
+        ::close(m_StopPipe[1]);
+    }
+
+/**
+ * Only the top directory has to exist, subdirectories which vanished
+ * meanwhile are skipped.
+ */
+    void KeyDirWatcher::addWatches(const path &pDir) {
+        const int myWd = ::inotify_add_watch(m_Fd, pDir.c_str(), K_WATCH_MASK);
+        if (myWd < 0) {
+            if (pDir == m_Dir) {
+                throw runtime_error("Failed to watch " + pDir.string() + ": " + strerror(errno));
+            }
+            TRIHLAV_LOG(warning) << "Failed to watch " << pDir << ": " << strerror(errno);
+            return;
+        }
+        m_Dirs[myWd] = pDir;
+        boost::system::error_code myErr;
+        for (recursive_directory_iterator myIt(pDir, myErr), myEnd; !myErr && myIt != myEnd; myIt.increment(myErr)) {
+            if (is_directory(myIt->status())) {
+                const int mySubWd = ::inotify_add_watch(m_Fd, myIt->path().c_str(), K_WATCH_MASK);
+                if (mySubWd >= 0) {
+                    m_Dirs[mySubWd] = myIt->path();
+                }
+            }
+        }
+    }
+
+/**
+ * Waits for events, the stop pipe or the end of the quiet period. The
+ * changes are handed over once the quiet period or the maximal delay since
+ * the first of them passed, also when events keep arriving. The callback
+ * runs without the inotify queue being read, events arriving meanwhile are
+ * queued by the kernel.
+ */
+    void KeyDirWatcher::run() {
+        alignas(struct inotify_event) char myBuf[16 * 1024];
+        Files_t myPending;
+        bool myRescan = false;
+        steady_clock::time_point myFirst, myLast;
+        for (;;) {
+            int myTimeout = -1;
+            if (!myPending.empty() || myRescan) {
+                const steady_clock::time_point myNow = steady_clock::now();
+                const steady_clock::time_point myDue = std::min(myLast + m_Quiet, myFirst + m_MaxDelay);
+                myTimeout = myDue <= myNow ? 0 : int(std::chrono::duration_cast<milliseconds>(myDue - myNow).count()) + 1;
+            }
+            pollfd myFds[2] = {{m_Fd, POLLIN, 0}, {m_StopPipe[0], POLLIN, 0}};
+            const int myReady = ::poll(myFds, 2, myTimeout);
+            if (myReady < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                TRIHLAV_LOG(error) << "Watching " << m_Dir << " failed: " << strerror(errno);
+                return;
+            }
+            if (myFds[1].revents != 0) {
+                return;
+            }
+            const ssize_t myLen = myFds[0].revents != 0 ? ::read(m_Fd, myBuf, sizeof(myBuf)) : 0;
+            if (myLen > 0) {
+                if (myPending.empty() && !myRescan) {
+                    myFirst = steady_clock::now();
+                }
+                myLast = steady_clock::now();
+            }
+            const char *const myEnd = myBuf + (myLen > 0 ? myLen : 0);
+            for (const char *myPtr = myBuf; myPtr < myEnd;) {
+                const struct inotify_event *myEvt = reinterpret_cast<const struct inotify_event *>(myPtr);
+                myPtr += sizeof(struct inotify_event) + myEvt->len;
+                if (myEvt->mask & IN_Q_OVERFLOW) {
+                    TRIHLAV_LOG(warning) << "Missed changes in " << m_Dir << ", rescanning.";
+                    myRescan = true;
+                    continue;
+                }
+                if (myEvt->mask & IN_IGNORED) {
+                    m_Dirs.erase(myEvt->wd);
+                    continue;
+                }
+                const auto myDir = m_Dirs.find(myEvt->wd);
+                if (myDir == m_Dirs.end() || myEvt->len == 0) {
+                    continue;
+                }
+                const path myFile = myDir->second / myEvt->name;
+                if (myEvt->mask & IN_ISDIR) {
+                    if (myEvt->mask & (IN_CREATE | IN_MOVED_TO)) {
+                        // files may have been put there before the watch was added
+                        addWatches(myFile);
+                    }
+                    myRescan = true;
+                } else if (!(myEvt->mask & IN_CREATE)) {
+                    myPending.insert(myFile);
+                }
+            }
+            if ((myPending.empty() && !myRescan)
+                || steady_clock::now() < std::min(myLast + m_Quiet, myFirst + m_MaxDelay)) {
+                continue;
+            }
+            try {
+                m_Callback(myPending, myRescan);
+            } catch (const std::exception &myExc) {
+                TRIHLAV_LOG(error) << "Failed to apply the changes in " << m_Dir << " - " << myExc.what();
+            }
+            myPending.clear();
+            myRescan = false;
+        }
+    }
+
+#else
+
+    bool KeyDirWatcher::isSupported() {
+        return false;
+    }
+
+    KeyDirWatcher::KeyDirWatcher(const path &pDir, const Callback_t &pCallback, const milliseconds pQuiet,
+                                 const milliseconds pMaxDelay) //
+            : m_Dir(pDir), m_Callback(pCallback), m_Quiet(pQuiet), m_MaxDelay(pMaxDelay), m_Fd(-1) //
+    {
+        m_StopPipe[0] = m_StopPipe[1] = -1;
+        throw runtime_error("Watching directories is not supported on this platform.");
+    }
+
+    KeyDirWatcher::~KeyDirWatcher() {
+    }
+
+    void KeyDirWatcher::addWatches(const path &) {
+    }
+
+    void KeyDirWatcher::run() {
+    }
+
+#endif
+
+} /* namespace trihlav */
@@ -0,0 +1,102 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_KEY_DIR_WATCHER_HPP_
+#define TRIHLAV_KEY_DIR_WATCHER_HPP_
+
+#include <set>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <boost/filesystem.hpp>
+
+namespace trihlav {
+
+    /**
+     * Follows the files in a directory tree with inotify, Linux only.
+     *
+     * A watcher thread collects the names of files written, moved in, moved
+     * away or deleted and hands them over in one call once the directory
+     * was quiet for the quiet period, so a burst of changes, fe. a journal
+     * compaction rewriting many key files, is applied at once. A steady
+     * stream of changes is handed over at least every max delay. When the
+     * kernel dropped events or a directory was added, the callback is asked
+     * to rescan everything.
+     */
+    class KeyDirWatcher {
+    public:
+        using Files_t = std::set<boost::filesystem::path>;
+
+        /// @brief Called on the watcher thread with the changed files, pRescan when they may be incomplete.
+        using Callback_t = std::function<void(const Files_t &pFiles, const bool pRescan)>;
+
+        /// @brief Default time without events after which the changes are handed over.
+        static constexpr std::chrono::milliseconds K_QUIET{50};
+
+        /// @brief Default longest time a change waits for the directory to become quiet.
+        static constexpr std::chrono::milliseconds K_MAX_DELAY{500};
+
+        /// @brief Starts watching pDir and its subdirectories, throws std::runtime_error on failure.
+        KeyDirWatcher(const boost::filesystem::path &pDir, const Callback_t &pCallback,
+                      const std::chrono::milliseconds pQuiet = K_QUIET,
+                      const std::chrono::milliseconds pMaxDelay = K_MAX_DELAY);
+
+        KeyDirWatcher(const KeyDirWatcher &) = delete;
+
+        KeyDirWatcher &operator=(const KeyDirWatcher &) = delete;
+
+        /// @brief Stops the watcher thread, pending changes are dropped.
+        virtual ~KeyDirWatcher();
+
+        /// @brief Can directories be watched on this platform?
+        static bool isSupported();
+
+        const boost::filesystem::path &getDir() const {
+            return m_Dir;
+        }
+
+    private:
+        /// @brief Watch pDir and its subdirectories.
+        void addWatches(const boost::filesystem::path &pDir);
+
+        void run();
+
+        const boost::filesystem::path m_Dir;
+        const Callback_t m_Callback;
+        const std::chrono::milliseconds m_Quiet;
+        const std::chrono::milliseconds m_MaxDelay;
+        int m_Fd;                        //< inotify instance
+        int m_StopPipe[2];               //< the destructor writes into [1]
+        std::map<int, boost::filesystem::path> m_Dirs; //< by watch descriptor, watcher thread only after start
+        std::thread m_Thread;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_KEY_DIR_WATCHER_HPP_ */
@@ -0,0 +1,409 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <algorithm>
+
+#include "trihlavLib/trihlavKeyFileJson.hpp"
+
+namespace {
+
+    using trihlav::KeyFileJson;
+
+    const char *const K_NAMES[KeyFileJson::EFieldCount] = {"privateId", "publicId", "secretKey", "timestamp",
+                                                           "counter", "crc", "random", "use", "description",
+                                                           "sysUser", "version"};
+    const char K_DOC[] = "yubikey";
+    const char K_HEX[] = "0123456789abcdef";
+    const char K_HEX_UPPER[] = "0123456789ABCDEF";
+
+    /// @return Value of the lower case hex digit pC, -1 for anything else, as yubikey_hex_decode() takes no other.
+    int hexDigit(const char pC) {
+        if (pC >= '0' && pC <= '9') {
+            return pC - '0';
+        }
+        if (pC >= 'a' && pC <= 'f') {
+            return pC - 'a' + 10;
+        }
+        return -1;
+    }
+
+    /// @return Trailing bytes of the UTF-8 lead byte pC, -1 when it can't lead, the same check as read_json().
+    int utf8Trail(const unsigned char pC) {
+        if (pC < 0xC0) {
+            return -1;
+        }
+        if (pC < 0xE0) {
+            return 1;
+        }
+        if (pC < 0xF0) {
+            return 2;
+        }
+        return pC < 0xF8 ? 3 : -1;
+    }
+
+    /// @brief Cursor over the document, strings are unescaped in place, the result is never longer.
+    class Parser {
+    public:
+        Parser(char *pBegin, const size_t pSize) : m_Cur(pBegin), m_End(pBegin + pSize) {}
+
+        void skipSpace() {
+            while (m_Cur < m_End && (*m_Cur == ' ' || *m_Cur == '\t' || *m_Cur == '\n' || *m_Cur == '\r')) {
+                ++m_Cur;
+            }
+        }
+
+        /// @brief Skip white space, @return true and step over pC when it comes next.
+        bool take(const char pC) {
+            skipSpace();
+            if (m_Cur < m_End && *m_Cur == pC) {
+                ++m_Cur;
+                return true;
+            }
+            return false;
+        }
+
+        bool atEnd() {
+            skipSpace();
+            return m_Cur == m_End;
+        }
+
+        /// @brief Next is a string or an unsigned integer.
+        bool value(KeyFileJson::Value &pValue) {
+            skipSpace();
+            return m_Cur < m_End && *m_Cur == '"' ? string(pValue) : number(pValue);
+        }
+
+        bool string(KeyFileJson::Value &pValue) {
+            if (!take('"')) {
+                return false;
+            }
+            char *myOut = m_Cur;
+            pValue.m_Data = myOut;
+            while (m_Cur < m_End) {
+                const unsigned char myC = static_cast<unsigned char>(*m_Cur++);
+                if (myC == '"') {
+                    pValue.m_Size = size_t(myOut - pValue.m_Data);
+                    return true;
+                } else if (myC < 0x20) {
+                    return false;
+                } else if (myC == '\\') {
+                    if (m_Cur == m_End) {
+                        return false;
+                    }
+                    switch (*m_Cur++) {
+                        case '"':
+                        case '\\':
+                        case '/':
+                            *myOut++ = m_Cur[-1];
+                            break;
+                        case 'b':
+                            *myOut++ = '\b';
+                            break;
+                        case 'f':
+                            *myOut++ = '\f';
+                            break;
+                        case 'n':
+                            *myOut++ = '\n';
+                            break;
+                        case 'r':
+                            *myOut++ = '\r';
+                            break;
+                        case 't':
+                            *myOut++ = '\t';
+                            break;
+                        case 'u': {
+                            // write_json() escapes only control characters this way
+                            unsigned myCp = 0;
+                            for (int myI = 0; myI < 4; ++myI, ++m_Cur) {
+                                const char myHex = m_Cur < m_End ? *m_Cur : 'x';
+                                const int myDigit = myHex >= 'A' && myHex <= 'F' ? myHex - 'A' + 10 : hexDigit(myHex);
+                                if (myDigit < 0) {
+                                    return false;
+                                }
+                                myCp = myCp * 16 + unsigned(myDigit);
+                            }
+                            if (myCp >= 0x80) {
+                                return false;
+                            }
+                            *myOut++ = char(myCp);
+                            break;
+                        }
+                        default:
+                            return false;
+                    }
+                } else if (myC < 0x80) {
+                    *myOut++ = char(myC);
+                } else {
+                    const int myTrail = utf8Trail(myC);
+                    if (myTrail < 0 || m_End - m_Cur < myTrail) {
+                        return false;
+                    }
+                    *myOut++ = char(myC);
+                    for (int myI = 0; myI < myTrail; ++myI) {
+                        if ((*m_Cur & 0xC0) != 0x80) {
+                            return false;
+                        }
+                        *myOut++ = *m_Cur++;
+                    }
+                }
+            }
+            return false;
+        }
+
+        /// @brief JSON integer without sign, fraction or exponent.
+        bool number(KeyFileJson::Value &pValue) {
+            pValue.m_Data = m_Cur;
+            while (m_Cur < m_End && *m_Cur >= '0' && *m_Cur <= '9') {
+                ++m_Cur;
+            }
+            pValue.m_Size = size_t(m_Cur - pValue.m_Data);
+            if (pValue.m_Size == 0 || (pValue.m_Size > 1 && *pValue.m_Data == '0')) {
+                return false;
+            }
+            return m_Cur == m_End || (*m_Cur != '.' && *m_Cur != 'e' && *m_Cur != 'E');
+        }
+
+    private:
+        char *m_Cur;
+        char *const m_End;
+    };
+
+    /// @brief Collects the output, counts what does not fit.
+    class Writer {
+    public:
+        Writer(char *pBuf, const size_t pCapacity) : m_Buf(pBuf), m_Capacity(pCapacity), m_Size(0) {}
+
+        void put(const char pC) {
+            if (m_Size < m_Capacity) {
+                m_Buf[m_Size] = pC;
+            }
+            ++m_Size;
+        }
+
+        void put(const char *pText, const size_t pSize) {
+            if (m_Size < m_Capacity) {
+                memcpy(m_Buf + m_Size, pText, std::min(pSize, m_Capacity - m_Size));
+            }
+            m_Size += pSize;
+        }
+
+        template<size_t N>
+        void put(const char (&pText)[N]) {
+            put(pText, N - 1);
+        }
+
+        /// @brief pValue escaped like create_escapes() of property_tree does it.
+        void escaped(const KeyFileJson::Value &pValue) {
+            for (size_t myI = 0; myI < pValue.m_Size; ++myI) {
+                const unsigned char myC = static_cast<unsigned char>(pValue.m_Data[myI]);
+                if (myC == 0x20 || myC == 0x21 || (myC >= 0x23 && myC <= 0x2E) || (myC >= 0x30 && myC <= 0x5B)
+                    || myC >= 0x5D) {
+                    put(char(myC));
+                    continue;
+                }
+                put('\\');
+                switch (myC) {
+                    case '\b':
+                        put('b');
+                        break;
+                    case '\f':
+                        put('f');
+                        break;
+                    case '\n':
+                        put('n');
+                        break;
+                    case '\r':
+                        put('r');
+                        break;
+                    case '\t':
+                        put('t');
+                        break;
+                    case '/':
+                    case '"':
+                    case '\\':
+                        put(char(myC));
+                        break;
+                    default:
+                        put("u00");
+                        put(K_HEX_UPPER[myC >> 4]);
+                        put(K_HEX_UPPER[myC & 0xF]);
+                }
+            }
+        }
+
+        size_t getSize() const {
+            return m_Size;
+        }
+
+    private:
+        char *const m_Buf;
+        const size_t m_Capacity;
+        size_t m_Size;
+    };
+
+}
+
+namespace trihlav {
+
+    bool KeyFileJson::Value::operator==(const char *pText) const {
+        return isSet() && strlen(pText) == m_Size && memcmp(m_Data, pText, m_Size) == 0;
+    }
+
+    void KeyFileJson::Document::put(const EField pField, const Value &pValue) {
+        if (!m_Values[pField].isSet()) {
+            m_Order[m_Count++] = pField;
+        }
+        m_Values[pField] = pValue;
+    }
+
+    const char *KeyFileJson::getName(const EField pField) {
+        return K_NAMES[pField];
+    }
+
+/**
+ * The document is a single object "yubikey", its members are the known
+ * fields, each at most once, with strings or unsigned integers as values.
+ */
+    bool KeyFileJson::parse(char *pJson, const size_t pSize, Document &pDoc) {
+        pDoc = Document();
+        Parser myIn(pJson, pSize);
+        Value myName;
+        if (!myIn.take('{') || !myIn.string(myName) || !(myName == K_DOC) || !myIn.take(':') || !myIn.take('{')) {
+            return false;
+        }
+        if (!myIn.take('}')) {
+            do {
+                if (!myIn.string(myName) || !myIn.take(':')) {
+                    return false;
+                }
+                size_t myField = 0;
+                while (myField < EFieldCount && !(myName == K_NAMES[myField])) {
+                    ++myField;
+                }
+                Value myValue;
+                if (myField == EFieldCount || pDoc.m_Values[myField].isSet() || !myIn.value(myValue)) {
+                    return false;
+                }
+                pDoc.put(EField(myField), myValue);
+            } while (myIn.take(','));
+            if (!myIn.take('}')) {
+                return false;
+            }
+        }
+        return myIn.take('}') && myIn.atEnd();
+    }
+
+    bool KeyFileJson::isHex(const Value &pValue, const size_t pBytes) {
+        if (pValue.m_Size != 2 * pBytes) {
+            return false;
+        }
+        for (size_t myI = 0; myI < pValue.m_Size; ++myI) {
+            if (hexDigit(pValue.m_Data[myI]) < 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void KeyFileJson::decodeHex(const Value &pValue, uint8_t *pOut) {
+        for (size_t myI = 0; myI + 1 < pValue.m_Size; myI += 2) {
+            *pOut++ = uint8_t(hexDigit(pValue.m_Data[myI]) << 4 | hexDigit(pValue.m_Data[myI + 1]));
+        }
+    }
+
+    bool KeyFileJson::decodeUnsigned(const Value &pValue, const uint64_t pMax, uint64_t &pOut) {
+        if (pValue.m_Size == 0) {
+            return false;
+        }
+        uint64_t myVal = 0;
+        for (size_t myI = 0; myI < pValue.m_Size; ++myI) {
+            const char myC = pValue.m_Data[myI];
+            if (myC < '0' || myC > '9' || myVal > (pMax - unsigned(myC - '0')) / 10) {
+                return false;
+            }
+            myVal = myVal * 10 + unsigned(myC - '0');
+        }
+        pOut = myVal;
+        return true;
+    }
+
+    KeyFileJson::Value KeyFileJson::encodeHex(const uint8_t *pData, const size_t pSize, char *pBuf) {
+        for (size_t myI = 0; myI < pSize; ++myI) {
+            pBuf[2 * myI] = K_HEX[pData[myI] >> 4];
+            pBuf[2 * myI + 1] = K_HEX[pData[myI] & 0xF];
+        }
+        Value myRetVal;
+        myRetVal.m_Data = pBuf;
+        myRetVal.m_Size = 2 * pSize;
+        return myRetVal;
+    }
+
+/**
+ * The digits are written at the end of pBuf, the value points at the first.
+ */
+    KeyFileJson::Value KeyFileJson::encodeUnsigned(uint64_t pVal, char *pBuf) {
+        char *myBegin = pBuf + K_MAX_DIGITS;
+        do {
+            *--myBegin = char('0' + pVal % 10);
+            pVal /= 10;
+        } while (pVal != 0);
+        Value myRetVal;
+        myRetVal.m_Data = myBegin;
+        myRetVal.m_Size = size_t(pBuf + K_MAX_DIGITS - myBegin);
+        return myRetVal;
+    }
+
+/**
+ * write_json() writes every value as a string, an object without members
+ * is written as an empty string.
+ */
+    size_t KeyFileJson::write(const Document &pDoc, char *pBuf, const size_t pCapacity) {
+        Writer myOut(pBuf, pCapacity);
+        if (pDoc.m_Count == 0) {
+            myOut.put("{\n    \"yubikey\": \"\"\n}\n");
+            return myOut.getSize();
+        }
+        myOut.put("{\n    \"yubikey\": {\n");
+        for (size_t myI = 0; myI < pDoc.m_Count; ++myI) {
+            const EField myField = pDoc.m_Order[myI];
+            myOut.put("        \"");
+            myOut.put(K_NAMES[myField], strlen(K_NAMES[myField]));
+            myOut.put("\": \"");
+            myOut.escaped(pDoc.m_Values[myField]);
+            myOut.put('"');
+            if (myI + 1 < pDoc.m_Count) {
+                myOut.put(',');
+            }
+            myOut.put('\n');
+        }
+        myOut.put("    }\n}\n");
+        return myOut.getSize();
+    }
+
+} /* namespace trihlav */
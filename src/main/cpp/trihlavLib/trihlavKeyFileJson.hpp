@@ -0,0 +1,123 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_KEY_FILE_JSON_HPP_
+#define TRIHLAV_KEY_FILE_JSON_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace trihlav {
+
+    /**
+     * Reads and writes the key file JSON, schema versions 0.0.1 and 0.0.2,
+     * without property_tree and without allocating.
+     *
+     * parse() works in place on the buffer the file was read into, strings
+     * are unescaped where they stand. write() lays the document out byte for
+     * byte like boost::property_tree::write_json() does. Documents beyond
+     * the plain schema, fe. with unknown keys, nested values, numbers other
+     * than unsigned integers or non-ASCII escapes, are rejected, the caller
+     * hands them to property_tree then.
+     */
+    class KeyFileJson {
+    public:
+        /// @brief The members of "yubikey", in the order YubikoOtpKeyConfig::saveFile() writes them.
+        enum EField {
+            EPrivateId,
+            EPublicId,
+            ESecretKey,
+            ETimestamp,
+            ECounter,
+            ECrc,
+            ERandom,
+            EUse,
+            EDescription,
+            ESysUser,
+            EVersion,
+            EFieldCount
+        };
+
+        /// @brief Unescaped text of a field, points into the parsed buffer.
+        struct Value {
+            const char *m_Data = nullptr;
+            size_t m_Size = 0;
+
+            bool isSet() const {
+                return m_Data != nullptr;
+            }
+
+            bool operator==(const char *pText) const;
+        };
+
+        /// @brief The fields of a key file and the order they came in.
+        struct Document {
+            Value m_Values[EFieldCount];
+            EField m_Order[EFieldCount];
+            size_t m_Count = 0;
+
+            /// @brief Set pField, it is appended to the order when it was not there, like ptree::put() does.
+            void put(const EField pField, const Value &pValue);
+        };
+
+        /// @brief The name of pField in the file.
+        static const char *getName(const EField pField);
+
+        /**
+         * @brief Parse the key file in pJson, its strings are unescaped in place.
+         * @return false when the document is not a plain key file.
+         */
+        static bool parse(char *pJson, const size_t pSize, Document &pDoc);
+
+        /// @brief Does pValue hold exactly pBytes bytes as hex digits?
+        static bool isHex(const Value &pValue, const size_t pBytes);
+
+        /// @brief Decode a value checked by isHex() into pOut.
+        static void decodeHex(const Value &pValue, uint8_t *pOut);
+
+        /// @brief Decode pValue, decimal digits without a leading zero, @return false unless it is at most pMax.
+        static bool decodeUnsigned(const Value &pValue, const uint64_t pMax, uint64_t &pOut);
+
+        /// @brief Lower case hex of pSize bytes into pBuf of 2 * pSize chars.
+        static Value encodeHex(const uint8_t *pData, const size_t pSize, char *pBuf);
+
+        /// @brief Decimal digits of pVal into pBuf of K_MAX_DIGITS chars.
+        static Value encodeUnsigned(uint64_t pVal, char *pBuf);
+
+        static constexpr size_t K_MAX_DIGITS = 20;
+
+        /**
+         * @brief Lay out pDoc like write_json() does, pretty printed.
+         * @return Size of the whole document, pBuf is filled only up to pCapacity.
+         */
+        static size_t write(const Document &pDoc, char *pBuf, const size_t pCapacity);
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_KEY_FILE_JSON_HPP_ */
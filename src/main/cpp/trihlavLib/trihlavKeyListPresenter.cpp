@@ -26,10 +26,9 @@
  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
  */
 
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
-#include <boost/log/expressions.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
+#include <stdexcept>
+#include <boost/format.hpp>
 #include <boost/locale/message.hpp>
 
 #include "trihlavLib/trihlavKeyListPresenter.hpp"
@@ -87,19 +86,30 @@ namespace trihlav {
     YubikoOtpKeyPresenter &KeyListPresenter::getYubikoOtpKeyPresenter() {
         if (m_YubikoOtpKeyPresenter == 0) {
             m_YubikoOtpKeyPresenter = new YubikoOtpKeyPresenter(getFactory());
-            m_YubikoOtpKeyPresenter->saved.connect([=] { reloadKeyList(); });
+            m_YubikoOtpKeyPresenter->saved.connect([=] { showKeyList(); });
         }
         return *m_YubikoOtpKeyPresenter;
     }
 
+/**
+ * A watching key manager has the changes applied already, the keys are
+ * loaded again only without it.
+ */
     void KeyListPresenter::reloadKeyList() {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyPresenter::reloadKeyList");
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyPresenter::reloadKeyList");
         KeyManager &myKeyMan(getFactory().getKeyManager());
-        const size_t myKeySz = myKeyMan.loadKeys();
+        if (!myKeyMan.isWatching()) {
+            myKeyMan.loadKeys();
+        }
+        showKeyList();
+    }
+
+    void KeyListPresenter::showKeyList() {
+        TRIHLAV_TRACE_SCOPE("KeyListPresenter::showKeyList");
+        m_ShownKeys = getFactory().getKeyManager().getLoadedIndex();
         getView().clear();
-        for (int myRow = 0; myRow < myKeySz; ++myRow) {
-            const auto &myKey = myKeyMan.getKey(myRow);
-            getView().addRow(getView().createRow(myRow, myKey));
+        for (size_t myRow = 0; myRow < m_ShownKeys->m_KeyList.size(); ++myRow) {
+            getView().addRow(getView().createRow(static_cast<int>(myRow), *m_ShownKeys->m_KeyList[myRow]));
         }
         getView().addedAllRows();
         getView().selectionChangedSig(-1);
@@ -120,31 +130,45 @@ namespace trihlav {
 
     bool KeyListPresenter::checkSelection() const {
         if (m_SelectedKey == -1) {
-            BOOST_LOG_TRIVIAL(warning) << "KeyListPresenter edit/delete "
+            TRIHLAV_LOG(warning) << "KeyListPresenter edit/delete "
                         "called without proper selection.";
             return false;
         }
         return true;
     }
 
+/**
+ * The row refers to the keys shown last, the current ones when none were
+ * shown yet.
+ */
+    const YubikoOtpKeyConfig &KeyListPresenter::getSelectedKey() {
+        if (!m_ShownKeys) {
+            m_ShownKeys = getFactory().getKeyManager().getLoadedIndex();
+        }
+        if (m_SelectedKey < 0 || size_t(m_SelectedKey) >= m_ShownKeys->m_KeyList.size()) {
+            throw std::range_error(
+                    (boost::format("Key index %1% is out of range <0,%2%>.") % m_SelectedKey
+                     % m_ShownKeys->m_KeyList.size()).str());
+        }
+        return *m_ShownKeys->m_KeyList[m_SelectedKey];
+    }
+
     void KeyListPresenter::editKey() {
-        BOOST_LOG_NAMED_SCOPE("KeyListPresenter::editKey");
+        TRIHLAV_TRACE_SCOPE("KeyListPresenter::editKey");
         if (checkSelection()) {
-            KeyManager &myKeyMan(getFactory().getKeyManager());
-            getYubikoOtpKeyPresenter().editKey(myKeyMan.getKey(m_SelectedKey));
+            getYubikoOtpKeyPresenter().editKey(getSelectedKey());
         }
     }
 
     void KeyListPresenter::deleteKey() {
-        BOOST_LOG_NAMED_SCOPE("KeyListPresenter::deleteKey");
+        TRIHLAV_TRACE_SCOPE("KeyListPresenter::deleteKey");
         if (checkSelection()) {
-            KeyManager &myKeyMan(getFactory().getKeyManager());
-            getYubikoOtpKeyPresenter().deleteKey(myKeyMan.getKey(m_SelectedKey));
+            getYubikoOtpKeyPresenter().deleteKey(getSelectedKey());
         }
     }
 
     void KeyListPresenter::selectionChanged(int pIdx) {
-        BOOST_LOG_NAMED_SCOPE("KeyListPresenter::selectionChange");
+        TRIHLAV_TRACE_SCOPE("KeyListPresenter::selectionChange");
         if (pIdx == -1) {
             getView().getBtnDelKey().setEnabled(false);
             getView().getBtnEditKey().setEnabled(false);
@@ -153,7 +177,7 @@ namespace trihlav {
             getView().getBtnEditKey().setEnabled(true);
         }
         m_SelectedKey = pIdx;
-        BOOST_LOG_TRIVIAL(debug) << "Curently selected " << m_SelectedKey;
+        TRIHLAV_LOG(debug) << "Curently selected " << m_SelectedKey;
     }
 
 }
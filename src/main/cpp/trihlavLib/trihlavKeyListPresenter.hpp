@@ -33,6 +33,7 @@
 
 #include "trihlavLib/trihlavKeyListPresenterIface.hpp"
 #include "trihlavLib/trihlavGlobals.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
 
 namespace trihlav {
 
@@ -63,6 +64,9 @@ namespace trihlav {
         /// @brief reload current key list
         void reloadKeyList();
 
+        /// @brief show the loaded keys, changes are applied by the key manager already
+        void showKeyList();
+
         YubikoOtpKeyPresenter &getYubikoOtpKeyPresenter();
 
         void disableKeyListBtns();
@@ -76,8 +80,11 @@ namespace trihlav {
 
         bool checkSelection() const;
 
+        const YubikoOtpKeyConfig &getSelectedKey();
+
         KeyListViewIfacePtr m_KeyListView = 0;
         YubikoOtpKeyPresenter *m_YubikoOtpKeyPresenter;
+        KeyManager::KeyIndexPtr_t m_ShownKeys; //< the rows refer to them
         int m_SelectedKey = -1;
     };
 
@@ -10,15 +10,15 @@
 #include <iostream>
 #include <fstream>
 #include <memory>
-#include <list>
+#include <algorithm>
+#include <map>
+#include <unordered_set>
+#include <cstring>
+#include <stdexcept>
 #include <boost/format.hpp>
-#include <boost/regex.hpp>
 #include <boost/filesystem.hpp>
 
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
-#include <boost/log/expressions.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
 
 #if defined _WIN32 || defined _WIN64
 #include <windows.h>
@@ -29,156 +29,727 @@
 #include "trihlavLib/trihlavKeyManager.hpp"
 #include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
 #include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavCounterJournal.hpp"
+#include "trihlavLib/trihlavKeyStore.hpp"
+#include "trihlavLib/trihlavJsonDirKeyStore.hpp"
+#include "trihlavLib/trihlavKeyDirWatcher.hpp"
+#include "trihlavLib/trihlavLazyKeys.hpp"
+#include "trihlavLib/trihlavMetrics.hpp"
 
 using std::string;
-using std::list;
 using boost::filesystem::path;
-using boost::filesystem::recursive_directory_iterator;
 using boost::filesystem::perms;
-using boost::regex_match;
 using boost::format;
 
 namespace trihlav {
 
     using YubikoOtpKeyConfigPtr= std::shared_ptr<YubikoOtpKeyConfig>;
 
+    namespace {
+        /// @brief Holds all key mutexes, always locked in the same order.
+        class AllKeysLock {
+        public:
+            explicit AllKeysLock(std::array<std::mutex, KeyManager::K_KEY_LOCK_STRIPES> &pMutexes) //
+                    : m_Mutexes(pMutexes) //
+            {
+                for (auto &myMutex : m_Mutexes) {
+                    myMutex.lock();
+                }
+            }
+
+            ~AllKeysLock() {
+                for (auto myIt = m_Mutexes.rbegin(); myIt != m_Mutexes.rend(); ++myIt) {
+                    myIt->unlock();
+                }
+            }
+
+        private:
+            std::array<std::mutex, KeyManager::K_KEY_LOCK_STRIPES> &m_Mutexes;
+        };
+
+        /// @brief Was pNew read from the file pOld was saved to, maybe with older counters?
+        bool isUnchanged(const YubikoOtpKeyConfig &pOld, const YubikoOtpKeyConfig &pNew) {
+            const yubikey_token_st &myOld = pOld.getToken();
+            const yubikey_token_st &myNew = pNew.getToken();
+            return pOld.getPublicId() == pNew.getPublicId()
+                   && memcmp(myOld.uid, myNew.uid, YUBIKEY_UID_SIZE) == 0
+                   && pOld.getSecretKeyArray() == pNew.getSecretKeyArray()
+                   && pOld.getDescription() == pNew.getDescription()
+                   && pOld.getSysUser() == pNew.getSysUser()
+                   && (myNew.ctr < myOld.ctr || (myNew.ctr == myOld.ctr && myNew.use <= myOld.use));
+        }
+
+        bool byPublicId(const YubikoOtpKeyConfigPtr &pA, const YubikoOtpKeyConfigPtr &pB) {
+            return pA->getPublicId() < pB->getPublicId();
+        }
+
+        /// @brief Fill pIndex.m_ByPublicId from the sorted pIndex.m_KeyList.
+        void indexKeys(KeyManager::KeyIndex &pIndex) {
+            pIndex.m_ByPublicId.reserve(pIndex.m_KeyList.size());
+            for (const auto &myKey : pIndex.m_KeyList) {
+                if (!pIndex.m_ByPublicId.insert(PublicId(myKey->getPublicId()), &myKey->getHotKey())
+                    && !myKey->getPublicId().empty()) {
+                    TRIHLAV_LOG(warning) << "Key " << myKey->getFilename() << " is not indexed, its public ID "
+                                         << myKey->getPublicId() << " is too long or used twice.";
+                }
+            }
+        }
+    }
+
 /**
  *  @param pConfigDir The directory where to store the key configuration data.
  */
-    KeyManager::KeyManager(const Settings &pSettings) //
-            : m_Settings(pSettings) //
+    KeyManager::KeyManager(const Settings &pSettings, const EAccess pAccess) //
+            : m_Settings(pSettings), m_Access(pAccess), m_Index(std::make_shared<KeyIndex>()), m_Generation(0), //
+              m_CompactRequested(false), m_StopCompactor(false) //
     {
-        BOOST_LOG_NAMED_SCOPE("KeyManager::KeyManager");
+        TRIHLAV_TRACE_SCOPE("KeyManager::KeyManager");
     }
 
     KeyManager::~KeyManager() {
-        BOOST_LOG_NAMED_SCOPE("KeyManager::~KeyManager");
+        TRIHLAV_TRACE_SCOPE("KeyManager::~KeyManager");
+        m_Watcher.reset();
+        {
+            std::lock_guard<std::mutex> myLock(m_CompactorMutex);
+            m_StopCompactor = true;
+            m_CompactorCv.notify_one();
+        }
+        if (m_Compactor.joinable()) {
+            m_Compactor.join();
+        }
+        if (m_Journal) {
+            try {
+                compactJournal();
+            } catch (const std::exception &myExc) {
+                TRIHLAV_LOG(error) << "Failed to compact the counter journal - " << myExc.what();
+            }
+        }
+    }
+
+    constexpr size_t KeyManager::K_JOURNAL_COMPACT_THRESHOLD;
+    constexpr size_t KeyManager::K_KEY_LOCK_STRIPES;
+
+    std::mutex &KeyManager::getKeyMutex(const PublicId &pPubId) {
+        return m_KeyMutexes[pPubId.hash() % K_KEY_LOCK_STRIPES];
+    }
+
+    std::mutex &KeyManager::getKeyMutex(const std::string &pPubId) {
+        return getKeyMutex(PublicId(pPubId));
+    }
+
+    const path KeyManager::getJournalFilename() const {
+        return getSettings().getConfigDir() / "counters.trihlav-journal";
+    }
+
+    const path KeyManager::getKeystoreFilename() const {
+        return getSettings().getConfigDir() / "keys.trihlav-keystore";
+    }
+
+    const path KeyManager::getKeySnapshotFilename() const {
+        return getSettings().getConfigDir() / "keys.trihlav-snapshot";
+    }
+
+    void KeyManager::saveKeySnapshot() {
+        TRIHLAV_TRACE_SCOPE("KeyManager::saveKeySnapshot");
+        if (m_Access == EReadOnly) {
+            return;
+        }
+        try {
+            getKeyStore().saveSnapshot();
+        } catch (const std::exception &myExc) {
+            TRIHLAV_LOG(error) << "Failed to save the key snapshot - " << myExc.what();
+        }
+    }
+
+    KeyStore &KeyManager::getKeyStore() {
+        std::call_once(m_KeyStoreOnce, [this] {
+            m_KeyStore = KeyStore::create(*this, getSettings().getKeyStore());
+            TRIHLAV_LOG(info) << "Key store: " << m_KeyStore->getName() << " in " << m_KeyStore->getLocation()
+                              << ".";
+        });
+        return *m_KeyStore;
+    }
+
+    CounterJournal &KeyManager::getJournal() {
+        if (m_Access == EReadOnly) {
+            throw std::logic_error("The key manager is read only, it has no journal to write.");
+        }
+        std::call_once(m_JournalOnce, [this] {
+            TRIHLAV_LOG(info) << "Counter journal durability: "
+                              << Settings::getDurabilityStr(getSettings().getDurability()) << ".";
+            m_Journal.reset(new CounterJournal(getJournalFilename(),
+                                               getSettings().getDurability(),
+                                               std::chrono::microseconds(getSettings().getGroupCommitDelayUs())));
+        });
+        return *m_Journal;
     }
 
+/**
+ * Called instead of saving the whole key file, the caller holds the key
+ * mutex. The key is marked dirty before its record is appended, so a
+ * compaction which saw the record also saw the key, @see compactJournal().
+ */
+    void KeyManager::journalCounters(const YubikoOtpKeyConfig &pKey) {
+        TRIHLAV_TRACE_SCOPE("KeyManager::journalCounters");
+        {
+            std::lock_guard<std::mutex> myLock(m_DirtyMutex);
+            m_DirtyKeys.insert(pKey.getPublicId());
+        }
+        getJournal().append(pKey.getPublicId(), pKey.getToken());
+    }
+
+/**
+ * Only wakes the compactor thread, started on the first call. Validations
+ * never wait for the key files to be written.
+ */
+    void KeyManager::compactJournalIfFull() {
+        if (getJournal().getRecordCount() < K_JOURNAL_COMPACT_THRESHOLD) {
+            return;
+        }
+        std::lock_guard<std::mutex> myLock(m_CompactorMutex);
+        if (m_StopCompactor) {
+            return;
+        }
+        if (!m_Compactor.joinable()) {
+            m_Compactor = std::thread(&KeyManager::runCompactor, this);
+        }
+        m_CompactRequested = true;
+        m_CompactorCv.notify_one();
+    }
+
+/**
+ * Failures are only logged, the counters stay in the journal and the keys
+ * stay dirty for the next request.
+ */
+    void KeyManager::runCompactor() {
+        TRIHLAV_TRACE_SCOPE("KeyManager::runCompactor");
+        std::unique_lock<std::mutex> myLock(m_CompactorMutex);
+        for (;;) {
+            m_CompactorCv.wait(myLock, [this] {
+                return m_StopCompactor || m_CompactRequested;
+            });
+            if (m_StopCompactor) {
+                break;
+            }
+            m_CompactRequested = false;
+            myLock.unlock();
+            try {
+                if (getJournal().getRecordCount() >= K_JOURNAL_COMPACT_THRESHOLD) {
+                    compactJournal();
+                }
+            } catch (const std::exception &myExc) {
+                TRIHLAV_LOG(error) << "Failed to compact the counter journal - " << myExc.what();
+            }
+            myLock.lock();
+        }
+    }
+
+/**
+ * Needs no lock of the caller. The sequence number of the journal is taken
+ * before the dirty keys, and journalCounters() marks a key dirty before it
+ * appends, so every record up to it belongs to a key taken here. Each key
+ * is copied under its own mutex and written from the copy without any key
+ * mutex held, so validations go on meanwhile. Records appended meanwhile
+ * stay in the journal.
+ *
+ * Keys which are not loaded or were deleted meanwhile are dropped. Keys
+ * whose counters could not be written stay dirty, and the journal is
+ * truncated only when the key store made the counters of all other keys
+ * durable.
+ */
+    bool KeyManager::compactJournal() {
+        TRIHLAV_TRACE_SCOPE("KeyManager::compactJournal");
+        std::lock_guard<std::mutex> myCompactLock(m_CompactMutex);
+        const uint64_t mySeq = getJournal().getWrittenSeq();
+        std::set<std::string> myDirty;
+        {
+            std::lock_guard<std::mutex> myLock(m_DirtyMutex);
+            myDirty.swap(m_DirtyKeys);
+        }
+        std::vector<std::string> myFailed;
+        try {
+            for (const std::string &myId : myDirty) {
+                std::unique_ptr<YubikoOtpKeyConfig> myCopy;
+                withLockedKey(PublicId(myId), [&myCopy](YubikoOtpKeyConfig &pKey) {
+                    myCopy.reset(new YubikoOtpKeyConfig(pKey));
+                });
+                try {
+                    if (!myCopy || !getKeyStore().saveCounters(*myCopy)) {
+                        TRIHLAV_LOG(debug) << "Key " << myId << " is gone, dropping its journaled counters.";
+                    }
+                } catch (const std::exception &myExc) {
+                    myFailed.push_back(myId);
+                    TRIHLAV_LOG_LIMITED(error, 60) << "Failed to write the counters of key " << myId << " - "
+                                                   << myExc.what();
+                }
+            }
+            getKeyStore().sync();
+        } catch (...) {
+            std::lock_guard<std::mutex> myLock(m_DirtyMutex);
+            m_DirtyKeys.insert(myDirty.begin(), myDirty.end());
+            throw;
+        }
+        if (!myFailed.empty()) {
+            {
+                std::lock_guard<std::mutex> myLock(m_DirtyMutex);
+                m_DirtyKeys.insert(myFailed.begin(), myFailed.end());
+            }
+            TRIHLAV_LOG(warning) << "Keeping the counter journal, counters of " << myFailed.size()
+                                 << " keys were not written.";
+            return false;
+        }
+        getJournal().truncate(mySeq);
+        return true;
+    }
 
     void KeyManager::prefixKeyFile(const path &pKeyFileFName, const std::string &pPrefix) const {
-        BOOST_LOG_NAMED_SCOPE("KeyManager::renameMallformedKeyFile");
+        TRIHLAV_TRACE_SCOPE("KeyManager::renameMallformedKeyFile");
         path myNewFName;
         try {
             if (exists(pKeyFileFName)) {
                 path myPath = pKeyFileFName.parent_path();
                 path myFName = pKeyFileFName.filename();
                 myNewFName = myPath / (path(pPrefix + "-") += myFName);
-                BOOST_LOG_TRIVIAL(debug) << "Going to rename " << pKeyFileFName << " into " << myNewFName << ".";
+                TRIHLAV_LOG(debug) << "Going to rename " << pKeyFileFName << " into " << myNewFName << ".";
                 rename(pKeyFileFName, myNewFName);
             } else {
-                BOOST_LOG_TRIVIAL(debug) << "File " << pKeyFileFName << " does not exist.";
+                TRIHLAV_LOG(debug) << "File " << pKeyFileFName << " does not exist.";
             }
         } catch (const std::exception &myExc) {
-            BOOST_LOG_TRIVIAL(error) << "Failed to rename " << pKeyFileFName << " into " << myNewFName << "because - "
-                                     << myExc.what();
+            TRIHLAV_LOG(error) << "Failed to rename " << pKeyFileFName << " into " << myNewFName << "because - "
+                               << myExc.what();
         } catch (...) {
-            BOOST_LOG_TRIVIAL(error) << "Failed to rename " << pKeyFileFName << " into " << myNewFName << ".";
+            TRIHLAV_LOG(error) << "Failed to rename " << pKeyFileFName << " into " << myNewFName << ".";
         }
     }
 
 
-    const boost::regex K_KEY_FILTER("[a-z0-9]{2,2}-[a-z0-9]{2,2}-[a-z0-9]{2,2}\\.trihlav-key\\.json");
-
 /**
+ * The new index is built without blocking validations. The counters of
+ * each loaded key with the same private ID are taken over while all key
+ * mutexes are held, just before the new index is published, so a key file
+ * read before compactJournal() wrote it does not move a key back. A lazy
+ * index loads the journaled keys and the keys loaded by the old index up
+ * front.
+ *
  * @return the loaded keys count.
  */
     size_t KeyManager::loadKeys() {
-        BOOST_LOG_NAMED_SCOPE("KeyManager::loadKeys");
-        m_KeyList.resize(0);
-        m_KeyMapByPublicId.clear();
-        list<path> myDamagedFiles;
-        for (auto it = recursive_directory_iterator(getSettings().getConfigDir());
-             it != recursive_directory_iterator(); it++) {
-            boost::smatch matchProd;
-            const path myFNameWithPath(it->path().native());
-            const path myFName(it->path().filename().native());
-            if (!is_directory(it->path())
-                && regex_match(myFName.string(), matchProd, K_KEY_FILTER)) {
-                BOOST_LOG_TRIVIAL(debug) << "Found key file " << myFName << ".";
-                try {
-                    YubikoOtpKeyConfig *myCfg = new YubikoOtpKeyConfig(*this, myFNameWithPath);
-                    myCfg->load();
-                    YubikoOtpKeyConfigPtr myKey{myCfg};
-                    m_KeyList.emplace_back(myKey);
-                    string myId(myKey->getPublicId());
-                    if (myId.empty()) {
-                        (myId += "generated:") += myKey->getFilename().string();
-                    }
-                    m_KeyMapByPublicId.emplace(KeyMap_t::value_type {myId, myKey.get()});
-                } catch (std::exception &myExc) {
-                    BOOST_LOG_TRIVIAL(error) << "Exception caugh while loading key file \"" << myFName << "\" - "
-                                             << myExc.what();
-                    myDamagedFiles.push_back(myFNameWithPath);
-                } catch (...) {
-                    BOOST_LOG_TRIVIAL(error) << "Unknown exception caugh while loading key file \"" << myFName << "\".";
-                    myDamagedFiles.push_back(myFNameWithPath);
+        TRIHLAV_TRACE_SCOPE("KeyManager::loadKeys");
+        static Histogram &theLatency = getMetrics().getHistogram("trihlav_load_keys_seconds",
+                                                                 "Loading of all keys from the key store.");
+        const ScopedLatency myLatency(theLatency);
+        std::lock_guard<std::mutex> myReloadLock(m_ReloadMutex);
+        std::shared_ptr<KeyIndex> myIndex = std::make_shared<KeyIndex>();
+        if (getSettings().getLazyKeys()) {
+            std::vector<KeyStore::Location> myLocations;
+            getKeyStore().loadLocations(myLocations);
+            myIndex->m_Lazy = std::make_shared<LazyKeys>(getKeyStore(), std::move(myLocations));
+        } else {
+            getKeyStore().load(myIndex->m_KeyList);
+            if (!std::is_sorted(myIndex->m_KeyList.begin(), myIndex->m_KeyList.end(), byPublicId)) {
+                std::sort(myIndex->m_KeyList.begin(), myIndex->m_KeyList.end(), byPublicId);
+            }
+            indexKeys(*myIndex);
+        }
+        std::set<string> myReplayedKeys;
+        const auto myApply = [&myIndex, &myReplayedKeys](const CounterJournal::Record &pRec) {
+            const string myPubId(pRec.getPublicId());
+            YubikoOtpKeyConfig *myKey = myIndex->getKeyByPublicId(PublicId(myPubId));
+            if (myKey == 0 || memcmp(myKey->getToken().uid, pRec.m_Uid, YUBIKEY_UID_SIZE) != 0) {
+                return;
+            }
+            yubikey_token_st myToken;
+            memset(&myToken, 0, sizeof(myToken));
+            myToken.ctr = pRec.m_Ctr;
+            myToken.use = pRec.m_Use;
+            myToken.tstpl = pRec.m_Tstpl;
+            myToken.tstph = pRec.m_Tstph;
+            if (myKey->advanceCounters(myToken)) {
+                myReplayedKeys.insert(myPubId);
+            }
+        };
+        const size_t myReplayed = m_Access == EReadOnly ? CounterJournal::scan(getJournalFilename(), myApply)
+                                                        : getJournal().replay(myApply);
+        if (myReplayed > 0) {
+            TRIHLAV_LOG(info) << "Replayed " << myReplayed << " journaled counter records.";
+        }
+        KeyIndexPtr_t myOldIndex = getIndex();
+        // pair the keys before validations are blocked, a lazy index loads the keys in use now
+        std::vector<std::pair<const YubikoOtpKeyConfig *, YubikoOtpKeyConfig *> > myCarried;
+        const KeyList_t myOldKeys = myOldIndex->m_Lazy ? myOldIndex->m_Lazy->getLoaded() : KeyList_t();
+        for (const YubikoOtpKeyConfigPtr &myOld : myOldIndex->m_Lazy ? myOldKeys : myOldIndex->m_KeyList) {
+            YubikoOtpKeyConfig *myNew = myIndex->getKeyByPublicId(PublicId(myOld->getPublicId()));
+            if (myNew != 0 && getPrivateId(myOld->getToken()) == getPrivateId(myNew->getToken())) {
+                myCarried.emplace_back(myOld.get(), myNew);
+            }
+        }
+        {
+            AllKeysLock myLock(m_KeyMutexes);
+            std::lock_guard<std::mutex> myDirtyLock(m_DirtyMutex);
+            for (const auto &myPair : myCarried) {
+                myPair.second->advanceCounters(myPair.first->getToken());
+            }
+            // keys loaded by the old lazy index after the pairing
+            for (const string &myPubId : m_DirtyKeys) {
+                const PublicId myId(myPubId);
+                const YubikoOtpKeyConfig *myOld = myOldIndex->getKeyByPublicId(myId);
+                YubikoOtpKeyConfig *myNew = myIndex->getKeyByPublicId(myId);
+                if (myOld != 0 && myNew != 0
+                    && getPrivateId(myOld->getToken()) == getPrivateId(myNew->getToken())) {
+                    myNew->advanceCounters(myOld->getToken());
+                }
+            }
+            m_DirtyKeys.insert(myReplayedKeys.begin(), myReplayedKeys.end());
+            publish(myIndex);
+        }
+        if (m_Access == EReadWrite && getJournal().getRecordCount() > 0) {
+            compactJournal();
+        }
+        // Validations still using the old index free it with their last reference.
+        return myIndex->getKeyCount();
+    }
+
+/**
+ * Only the given files are read, the cost grows with the count of changes.
+ * Building the new index still copies the key pointers and the public ID
+ * index, so files passed meanwhile by other threads are queued and applied
+ * in one go, like the group commit of the journal.
+ * The loaded keys are copied into the new index by pointer: keys of files
+ * which are gone are left out, changed files replace their keys. Files read
+ * back unchanged, fe. rewritten by compactJournal(), keep their loaded key.
+ * A key file which became damaged keeps its loaded key until the next
+ * loadKeys(). Counters advanced meanwhile are taken over like by loadKeys().
+ * A lazy index is built anew by loadKeys(), it reads only the public IDs.
+ *
+ * @return the loaded keys count.
+ */
+    size_t KeyManager::reloadKeyFiles(const std::set<path> &pFilenames) {
+        TRIHLAV_TRACE_SCOPE("KeyManager::reloadKeyFiles");
+        JsonDirKeyStore *myStore = dynamic_cast<JsonDirKeyStore *>(&getKeyStore());
+        if (myStore == 0 || getSettings().getLazyKeys()) {
+            return loadKeys();
+        }
+        {
+            std::lock_guard<std::mutex> myLock(m_PendingMutex);
+            for (const path &myFName : pFilenames) {
+                if (JsonDirKeyStore::isKeyFilename(myFName)) {
+                    m_PendingKeyFiles.insert(myFName);
+                }
+            }
+        }
+        static Histogram &theLatency = getMetrics().getHistogram("trihlav_reload_key_files_seconds",
+                                                                 "Applying changed key files to the loaded keys.");
+        const ScopedLatency myLatency(theLatency);
+        std::lock_guard<std::mutex> myReloadLock(m_ReloadMutex);
+        std::set<path> myPending;
+        {
+            std::lock_guard<std::mutex> myLock(m_PendingMutex);
+            myPending.swap(m_PendingKeyFiles);
+        }
+        try {
+            return applyKeyFiles(*myStore, myPending);
+        } catch (...) {
+            std::lock_guard<std::mutex> myLock(m_PendingMutex);
+            m_PendingKeyFiles.insert(myPending.begin(), myPending.end());
+            throw;
+        }
+    }
+
+/**
+ * The caller holds m_ReloadMutex.
+ */
+    size_t KeyManager::applyKeyFiles(JsonDirKeyStore &pStore, const std::set<path> &pFilenames) {
+        const KeyIndexPtr_t myOldIndex = getIndex();
+        std::set<string> myChanged;
+        for (const path &myFName : pFilenames) {
+            myChanged.insert(myFName.string());
+        }
+        std::map<string, YubikoOtpKeyConfigPtr> myOldKeys;
+        if (!myChanged.empty()) {
+            for (const YubikoOtpKeyConfigPtr &myKey : myOldIndex->m_KeyList) {
+                if (myChanged.count(myKey->getFilename().string()) != 0) {
+                    myOldKeys[myKey->getFilename().string()] = myKey;
+                }
+            }
+        }
+        KeyList_t myLoaded;
+        for (auto myIt = myChanged.begin(); myIt != myChanged.end();) {
+            const auto myOld = myOldKeys.find(*myIt);
+            boost::system::error_code myErr;
+            if (is_regular_file(path(*myIt), myErr)) {
+                const YubikoOtpKeyConfigPtr myKey = pStore.loadFile(*myIt);
+                if (!myKey) {
+                    TRIHLAV_LOG(warning) << "Keeping the loaded key of the damaged key file " << *myIt << ".";
+                    myIt = myChanged.erase(myIt);
+                    continue;
+                }
+                if (myOld != myOldKeys.end() && isUnchanged(*myOld->second, *myKey)) {
+                    myIt = myChanged.erase(myIt);
+                    continue;
                 }
+                TRIHLAV_LOG(debug) << "Key file " << *myIt << " changed.";
+                myLoaded.emplace_back(myKey);
+            } else if (myOld == myOldKeys.end()) {
+                myIt = myChanged.erase(myIt);
+                continue;
             } else {
-                BOOST_LOG_TRIVIAL(debug) << "Skipping file  " << myFName << ".";
+                TRIHLAV_LOG(debug) << "Key file " << *myIt << " is gone.";
+            }
+            ++myIt;
+        }
+        if (myChanged.empty()) {
+            return myOldIndex->m_KeyList.size();
+        }
+        std::sort(myLoaded.begin(), myLoaded.end(), byPublicId);
+        std::unordered_set<const YubikoOtpKeyConfig *> myReplaced;
+        for (const auto &myOld : myOldKeys) {
+            if (myChanged.count(myOld.first) != 0) {
+                myReplaced.insert(myOld.second.get());
             }
         }
-        for (path myFName : myDamagedFiles) {
-            prefixKeyFile(myFName, "damaged");
+        std::shared_ptr<KeyIndex> myIndex = std::make_shared<KeyIndex>();
+        myIndex->m_KeyList.reserve(myOldIndex->m_KeyList.size() + myLoaded.size());
+        auto myNew = myLoaded.begin();
+        for (const YubikoOtpKeyConfigPtr &myKey : myOldIndex->m_KeyList) {
+            if (myReplaced.count(myKey.get()) != 0) {
+                continue;
+            }
+            for (; myNew != myLoaded.end() && byPublicId(*myNew, myKey); ++myNew) {
+                myIndex->m_KeyList.emplace_back(*myNew);
+            }
+            myIndex->m_KeyList.emplace_back(myKey);
+        }
+        myIndex->m_KeyList.insert(myIndex->m_KeyList.end(), myNew, myLoaded.end());
+        myIndex->m_ByPublicId = myOldIndex->m_ByPublicId;
+        for (const YubikoOtpKeyConfig *myOld : myReplaced) {
+            const PublicId myId(myOld->getPublicId());
+            if (myIndex->m_ByPublicId.find(myId) == &myOld->getHotKey()) {
+                myIndex->m_ByPublicId.erase(myId);
+            }
+        }
+        for (const YubikoOtpKeyConfigPtr &myKey : myLoaded) {
+            if (!myIndex->m_ByPublicId.insert(PublicId(myKey->getPublicId()), &myKey->getHotKey())
+                && !myKey->getPublicId().empty()) {
+                TRIHLAV_LOG(error) << "Key " << myKey->getFilename() << " is not indexed, its public ID "
+                                   << myKey->getPublicId() << " is too long or used twice.";
+            }
+        }
+        {
+            AllKeysLock myLock(m_KeyMutexes);
+            for (const YubikoOtpKeyConfigPtr &myKey : myLoaded) {
+                const HotKey *myOld = myOldIndex->m_ByPublicId.find(PublicId(myKey->getPublicId()));
+                if (myOld != 0 && getPrivateId(myOld->m_Token) == getPrivateId(myKey->getToken())) {
+                    myKey->advanceCounters(myOld->m_Token);
+                }
+            }
+            publish(myIndex);
+        }
+        TRIHLAV_LOG(info) << "Applied " << myChanged.size() << " changed key files, " << myIndex->m_KeyList.size()
+                          << " keys loaded.";
+        return myIndex->m_KeyList.size();
+    }
+
+/**
+ * The JSON directory and the key file overlay of the mmap key store are
+ * watched. Replacing the keystore file, fe. by trihlavConvertKeys, reloads
+ * all keys. Changes of the SQLite database are not followed.
+ */
+    bool KeyManager::watchKeys() {
+        TRIHLAV_TRACE_SCOPE("KeyManager::watchKeys");
+        if (!KeyDirWatcher::isSupported()) {
+            TRIHLAV_LOG(info) << "Changes of the keys are not followed on this platform.";
+            return false;
+        }
+        if (getSettings().getKeyStore() == Settings::ESqlite) {
+            TRIHLAV_LOG(info) << "Changes of the " << getKeyStore().getName() << " key store are not followed.";
+            return false;
         }
-        return m_KeyList.size();
+        const path myStoreFile = getKeyStore().getLocation();
+        m_Watcher.reset(new KeyDirWatcher(getSettings().getConfigDir(),
+                                          [this, myStoreFile](const KeyDirWatcher::Files_t &pFiles, const bool pRescan) {
+            std::set<path> myKeyFiles;
+            bool myReload = pRescan;
+            for (const path &myFile : pFiles) {
+                if (JsonDirKeyStore::isKeyFilename(myFile)) {
+                    myKeyFiles.insert(myFile);
+                } else if (myFile == myStoreFile) {
+                    myReload = true;
+                }
+            }
+            if (myReload) {
+                loadKeys();
+            } else if (!myKeyFiles.empty()) {
+                reloadKeyFiles(myKeyFiles);
+            }
+        }));
+        return true;
+    }
+
+/**
+ * The caller holds all key mutexes.
+ */
+    void KeyManager::publish(const std::shared_ptr<KeyIndex> &pIndex) {
+        pIndex->m_Generation = m_Generation.load() + 1;
+        std::atomic_store(&m_Index, KeyIndexPtr_t(pIndex));
+        m_Generation.store(pIndex->m_Generation);
+        static Gauge &theKeyCount = getMetrics().getGauge("trihlav_keys_loaded", "Keys in the published index.");
+        theKeyCount.set(int64_t(pIndex->getKeyCount()));
+    }
+
+    KeyManager::KeyIndexPtr_t KeyManager::getIndex() const {
+        return std::atomic_load(&m_Index);
+    }
+
+/**
+ * The loaded index is not published, validations keep the lazy one. Both
+ * share the keys, so counters advanced meanwhile are seen in both.
+ */
+    KeyManager::KeyIndexPtr_t KeyManager::getLoadedIndex() const {
+        const KeyIndexPtr_t myIndex = getIndex();
+        if (!myIndex->m_Lazy) {
+            return myIndex;
+        }
+        std::shared_ptr<KeyIndex> myLoaded = std::make_shared<KeyIndex>();
+        myLoaded->m_KeyList = myIndex->m_Lazy->loadAll();
+        indexKeys(*myLoaded);
+        myLoaded->m_Generation = myIndex->m_Generation;
+        return myLoaded;
     }
 
     const size_t KeyManager::getKeyCount() const {
-        return m_KeyList.size();
+        return getIndex()->getKeyCount();
     }
 
+/**
+ * The reference is valid until the next reload.
+ */
     const YubikoOtpKeyConfig &KeyManager::getKey(const size_t pIdx) const {
-        if (pIdx < 0 || m_KeyList.size() < pIdx) {
+        const KeyIndexPtr_t myIndex = getIndex();
+        const KeyList_t &myKeys = myIndex->m_Lazy ? myIndex->m_Lazy->loadAll() : myIndex->m_KeyList;
+        if (pIdx >= myKeys.size()) {
             throw std::range_error(
                     (format("Key index %1% is out of range <0,%2%>.") % pIdx
-                     % m_KeyList.size()).str());
+                     % myKeys.size()).str());
+        }
+        return *(myKeys[pIdx]);
+    }
+
+    HotKey *KeyManager::KeyIndex::getHotKeyByPublicId(const PublicId &pPubId) const {
+        HotKey *myKey = m_ByPublicId.find(pPubId);
+        if (myKey == 0 && m_Lazy) {
+            YubikoOtpKeyConfig *myLoaded = m_Lazy->get(pPubId);
+            if (myLoaded != 0) {
+                myKey = &myLoaded->getHotKey();
+            }
+        }
+        return myKey;
+    }
+
+    YubikoOtpKeyConfig *KeyManager::KeyIndex::getKeyByPublicId(const PublicId &pPubId) const {
+        HotKey *myKey = getHotKeyByPublicId(pPubId);
+        return myKey != 0 ? myKey->m_Cold : 0;
+    }
+
+    size_t KeyManager::KeyIndex::getKeyCount() const {
+        return m_Lazy ? m_Lazy->getKeyCount() : m_KeyList.size();
+    }
+
+/**
+ * An ID which was already missing from this snapshot is rejected without
+ * probing the index again. A lazy key which failed to load is not
+ * remembered, the next look up tries to load it again.
+ */
+    HotKey *KeyManager::findHotKey(const KeyIndex &pIndex, const PublicId &pPubId) const {
+        if (m_UnknownIds.isUnknown(pPubId, pIndex.m_Generation)) {
+            return 0;
         }
-        return *(m_KeyList[pIdx]);
+        HotKey *myKey = pIndex.getHotKeyByPublicId(pPubId);
+        if (myKey == 0 && !(pIndex.m_Lazy && pIndex.m_Lazy->isIndexed(pPubId))) {
+            m_UnknownIds.addUnknown(pPubId, pIndex.m_Generation);
+        }
+        return myKey;
+    }
+
+    YubikoOtpKeyConfig *KeyManager::findKey(const KeyIndex &pIndex, const PublicId &pPubId) const {
+        HotKey *myKey = findHotKey(pIndex, pPubId);
+        return myKey != 0 ? myKey->m_Cold : 0;
     }
 
 /**
+ * The pointer is valid until the next reload, concurrent callers use
+ * withLockedKey().
+ *
  * @param pPubId modhex encoded public id prefix.
  */
     const YubikoOtpKeyConfig *KeyManager::getKeyByPublicId(
             const string &pPubId) const {
-        BOOST_LOG_NAMED_SCOPE("KeyManager::getKeyByPublicId const");
-        auto myKey = m_KeyMapByPublicId.find(pPubId);
-        if (myKey == m_KeyMapByPublicId.end()) {
-            BOOST_LOG_TRIVIAL(warning) << "Key prefixed " << pPubId << " has not been found.";
-            return 0;
-        }
-        return myKey->second;
+        return findKey(*getIndex(), PublicId(pPubId));
     }
 
 /**
  * @see getKeyByPublicId(const string& pPubId) const
  */
     YubikoOtpKeyConfig *KeyManager::getKeyByPublicId(const string &pPubId) {
-        BOOST_LOG_NAMED_SCOPE("KeyManager::getKeyByPublicId");
-        auto myKey = m_KeyMapByPublicId.find(pPubId);
-        if (myKey == m_KeyMapByPublicId.end()) {
-            BOOST_LOG_TRIVIAL(warning) << "Key prefixed " << pPubId << " has not been found.";
-            return 0;
+        return findKey(*getIndex(), PublicId(pPubId));
+    }
+
+/**
+ * When a reload published a new index between the look up and the key
+ * mutex, the key may be a stale copy, so it is looked up again.
+ */
+    bool KeyManager::withLockedHotKey(const PublicId &pPubId, const std::function<void(HotKey &)> &pAction) {
+        for (;;) {
+            const KeyIndexPtr_t myIndex = getIndex();
+            HotKey *myKey = findHotKey(*myIndex, pPubId);
+            if (myKey == 0) {
+                return false;
+            }
+            std::lock_guard<std::mutex> myLock(getKeyMutex(pPubId));
+            if (m_Generation.load() != myIndex->m_Generation) {
+                continue;
+            }
+            pAction(*myKey);
+            return true;
         }
-        return myKey->second;
     }
 
+    bool KeyManager::withLockedKey(const PublicId &pPubId, const std::function<void(YubikoOtpKeyConfig &)> &pAction) {
+        return withLockedHotKey(pPubId, [&pAction](HotKey &pKey) {
+            pAction(*pKey.m_Cold);
+        });
+    }
+
+    bool KeyManager::withLockedKey(const string &pPubId, const std::function<void(YubikoOtpKeyConfig &)> &pAction) {
+        return withLockedKey(PublicId(pPubId), pAction);
+    }
+
+/**
+ * Only keys owned by the current index are re-indexed. Copies, fe. in the
+ * key editor, and keys of a lazy index are picked up by the next loadKeys().
+ *
+ * @param pPubId the public ID before the change.
+ */
     void KeyManager::update(const std::string &pPubId, YubikoOtpKeyConfig &pKey) {
-        if (!pPubId.empty()) {
-            const auto myIt = m_KeyMapByPublicId.find(pPubId);
-            if (myIt != m_KeyMapByPublicId.end()) {
-                if (myIt->second->getPrivateId().compare(pKey.getPrivateId())
-                    == 0) {
-                    m_KeyMapByPublicId.erase(myIt);
-                }
-            } else {
-                BOOST_LOG_TRIVIAL(debug) << "Public id " << pPubId << " has not been found.";
-            }
-            m_KeyMapByPublicId[pKey.getPublicId()] = &pKey;
-        } else {
-            BOOST_LOG_TRIVIAL(debug) << "Public id is empty.";
+        if (pPubId.empty()) {
+            TRIHLAV_LOG(debug) << "Public id is empty.";
+            return;
+        }
+        std::lock_guard<std::mutex> myReloadLock(m_ReloadMutex);
+        const KeyIndexPtr_t myOldIndex = getIndex();
+        const PublicId myOldId(pPubId);
+        if (myOldIndex->m_ByPublicId.find(myOldId) != &pKey.getHotKey()) {
+            TRIHLAV_LOG(debug) << "Public id " << pPubId << " is not loaded.";
+            return;
+        }
+        std::shared_ptr<KeyIndex> myIndex = std::make_shared<KeyIndex>(*myOldIndex);
+        myIndex->m_ByPublicId.erase(myOldId);
+        if (!myIndex->m_ByPublicId.insert(PublicId(pKey.getPublicId()), &pKey.getHotKey())) {
+            throw std::invalid_argument("Public id " + pKey.getPublicId() + " is invalid or used by another key.");
         }
+        std::sort(myIndex->m_KeyList.begin(), myIndex->m_KeyList.end(), byPublicId);
+        AllKeysLock myLock(m_KeyMutexes);
+        publish(myIndex);
     }
 
     const Settings &KeyManager::getSettings() const {
@@ -8,28 +8,90 @@
 #ifndef TRIHLAV_KEY_MANAGER_HPP_
 #define TRIHLAV_KEY_MANAGER_HPP_
 
-#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <array>
+#include <functional>
 #include <vector>
 #include <string>
 #include <boost/filesystem.hpp>
 
+#include "trihlavLib/trihlavPublicIdIndex.hpp"
+#include "trihlavLib/trihlavUnknownIdCache.hpp"
+
 namespace trihlav {
 
     class YubikoOtpKeyConfig;
 
     class Settings;
 
+    class CounterJournal;
+
+    class KeyStore;
+
+    class JsonDirKeyStore;
+
+    class KeyDirWatcher;
+
+    class LazyKeys;
+
 /**
  * Manage key operations, fe. their persistence.
+ *
+ * The loaded keys are published as an immutable KeyIndex snapshot. Readers
+ * take the current snapshot without locking, loadKeys() builds a new one
+ * off to the side and swaps it in atomically. The counters of a key are
+ * guarded by its key mutex, @see withLockedKey().
+ *
+ * Keys are loaded from and saved into the KeyStore selected by
+ * Settings::getKeyStore(). After watchKeys() changes of the key files are
+ * applied as they happen, @see reloadKeyFiles(). With
+ * Settings::getLazyKeys() only the public IDs are indexed, each key is
+ * loaded on its first use, @see LazyKeys.
  */
     class KeyManager {
     public:
         using path = boost::filesystem::path;
         using KeyList_t = std::vector<std::shared_ptr<YubikoOtpKeyConfig> >;
-        using KeyMap_t = std::map<std::string, YubikoOtpKeyConfig *>;
+
+        /// @brief Snapshot of the loaded keys, never changed once published.
+        struct KeyIndex {
+            KeyList_t m_KeyList;              //< sorted by public ID, empty for a lazy index
+            PublicIdIndex m_ByPublicId;       //< points to the HotKey records of m_KeyList
+            std::shared_ptr<LazyKeys> m_Lazy; //< keys loaded on first use, @see Settings::getLazyKeys()
+            uint64_t m_Generation = 0;        //< incremented by each publish
+
+            /**
+             * @brief Plain look up, neither logged nor counted, @see KeyManager::findKey().
+             *
+             * A key of a lazy index is loaded on the first look up.
+             */
+            YubikoOtpKeyConfig *getKeyByPublicId(const PublicId &pPubId) const;
+
+            /// @brief getKeyByPublicId() without touching the rest of the key.
+            HotKey *getHotKeyByPublicId(const PublicId &pPubId) const;
+
+            /// @brief Count of the keys, of a lazy index loaded or not.
+            size_t getKeyCount() const;
+        };
+
+        using KeyIndexPtr_t = std::shared_ptr<const KeyIndex>;
+
+        /**
+         * @brief EReadOnly leaves the keystore as it is, fe. for tools looking at the
+         * keystore of a running server. Counters can not be journaled then.
+         */
+        enum EAccess {
+            EReadWrite,
+            EReadOnly
+        };
 
         /// Lazy initialization constructor.
-        KeyManager(const Settings &pSettings);
+        KeyManager(const Settings &pSettings, const EAccess pAccess = EReadWrite);
 
         const Settings &getSettings() const;
 
@@ -38,26 +100,169 @@ namespace trihlav {
         /// @brief Load or reload all keys.
         size_t loadKeys();
 
+        /**
+         * @brief Apply the changed, added or deleted key files pFilenames to the loaded keys.
+         *
+         * Only the JSON directory key store follows single files, the others
+         * reload all keys. Files passed while another call applies its own
+         * are applied together by one of the waiting calls.
+         * @return the loaded keys count.
+         */
+        size_t reloadKeyFiles(const std::set<path> &pFilenames);
+
+        /**
+         * @brief Follow the changes of the key store in a watcher thread, @see KeyDirWatcher.
+         * @return false when the platform or the key store does not support it.
+         */
+        bool watchKeys();
+
+        /// @brief Are changes of the key store applied as they happen?
+        bool isWatching() const {
+            return bool(m_Watcher);
+        }
+
+        /// @brief The current snapshot of loaded keys, keeps them alive.
+        KeyIndexPtr_t getIndex() const;
+
+        /**
+         * @brief The current snapshot with all keys in KeyIndex::m_KeyList, fe. to list them.
+         *
+         * The keys of a lazy index are loaded, the returned index shares them.
+         */
+        KeyIndexPtr_t getLoadedIndex() const;
+
         /// @brief How many keys are currently loaded?
         const size_t getKeyCount() const;
 
-        /// @brief Access an loaded key.
+        /// @brief Access an loaded key, all keys of a lazy index are loaded.
         const YubikoOtpKeyConfig &getKey(const size_t pIdx) const;
 
+        /**
+         * @brief Look a key up in a snapshot, misses are counted and cached.
+         * @see getUnknownIds()
+         */
+        YubikoOtpKeyConfig *findKey(const KeyIndex &pIndex, const PublicId &pPubId) const;
+
+        /// @brief findKey() of only the HotKey record, the rest of the key is HotKey::m_Cold.
+        HotKey *findHotKey(const KeyIndex &pIndex, const PublicId &pPubId) const;
+
+        /// @brief Public IDs recently looked up in vain, with miss counters.
+        const UnknownIdCache &getUnknownIds() const {
+            return m_UnknownIds;
+        }
+
         /// @brief Access an loaded key.
         const YubikoOtpKeyConfig *getKeyByPublicId(const std::string &pPubId) const;
 
         /// @brief Access an loaded key.
         YubikoOtpKeyConfig *getKeyByPublicId(const std::string &pPubId);
 
+        /**
+         * @brief Run pAction on the loaded key with its key mutex held.
+         * @return false when no such key is loaded.
+         */
+        bool withLockedKey(const PublicId &pPubId, const std::function<void(YubikoOtpKeyConfig &)> &pAction);
+
+        /// @see withLockedKey(const PublicId&, const std::function<void(YubikoOtpKeyConfig &)>&)
+        bool withLockedKey(const std::string &pPubId, const std::function<void(YubikoOtpKeyConfig &)> &pAction);
+
+        /// @brief withLockedKey() passing the HotKey record, fe. to validate an OTP.
+        bool withLockedHotKey(const PublicId &pPubId, const std::function<void(HotKey &)> &pAction);
+
+        /**
+         * @brief Re-index a loaded key after its public ID changed from pPubId.
+         * @throw std::invalid_argument when another loaded key has the new public ID.
+         */
         void update(const std::string &pPubId, YubikoOtpKeyConfig &pKey);
 
         void prefixKeyFile(const path &pKyFileFName, const std::string &pPrefix) const;
 
+        /**
+         * @brief Serializes the counter check and advance of one key.
+         *
+         * Keys are spread over K_KEY_LOCK_STRIPES mutexes by their public ID,
+         * so different keys validate in parallel.
+         */
+        std::mutex &getKeyMutex(const PublicId &pPubId);
+
+        /// @see getKeyMutex(const PublicId&)
+        std::mutex &getKeyMutex(const std::string &pPubId);
+
+        /// @brief Record the advanced counters of an accepted OTP in the journal.
+        void journalCounters(const YubikoOtpKeyConfig &pKey);
+
+        /// @brief Have the compactor thread run compactJournal() when the journal is too long.
+        void compactJournalIfFull();
+
+        /// @brief The counter journal, opened on first use, throws std::logic_error when read only.
+        CounterJournal &getJournal();
+
+        const path getJournalFilename() const;
+
+        /// @brief The file of the memory mapped key store.
+        const path getKeystoreFilename() const;
+
+        /// @brief The KeySnapshot of the key files.
+        const path getKeySnapshotFilename() const;
+
+        /**
+         * @brief Bring the key snapshot up to date, fe. before a restart, errors are logged.
+         *
+         * Key files changed since they were loaded are read now instead of
+         * on the next start, @see KeyStore::saveSnapshot().
+         */
+        void saveKeySnapshot();
+
+        /// @brief Where the keys are stored, created on first use according to the settings.
+        KeyStore &getKeyStore();
+
+        EAccess getAccess() const {
+            return m_Access;
+        }
+
+        /// @brief Journal records which trigger compactJournal().
+        static constexpr size_t K_JOURNAL_COMPACT_THRESHOLD = 4096;
+
+        /// @brief Count of key mutexes.
+        static constexpr size_t K_KEY_LOCK_STRIPES = 64;
+
     private:
-        KeyList_t m_KeyList;
-        KeyMap_t m_KeyMapByPublicId;
+        /**
+         * @brief Write journaled counters into the key files and drop their records from the journal.
+         * @return false when some counters could not be written, the journal is kept then.
+         */
+        bool compactJournal();
+
+        /// @brief Body of the compactor thread, @see compactJournalIfFull().
+        void runCompactor();
+
+        /// @brief Apply pFilenames of reloadKeyFiles() to a new index and publish it.
+        size_t applyKeyFiles(JsonDirKeyStore &pStore, const std::set<path> &pFilenames);
+
+        void publish(const std::shared_ptr<KeyIndex> &pIndex);
+
         const Settings &m_Settings;
+        const EAccess m_Access;
+        KeyIndexPtr_t m_Index;               //< accessed by std::atomic_load/store only
+        std::atomic<uint64_t> m_Generation;  //< of m_Index, changes with all key mutexes held
+        std::mutex m_ReloadMutex;            //< serializes loadKeys(), reloadKeyFiles() and update()
+        std::array<std::mutex, K_KEY_LOCK_STRIPES> m_KeyMutexes;
+        std::once_flag m_JournalOnce;
+        std::unique_ptr<CounterJournal> m_Journal;
+        std::once_flag m_KeyStoreOnce;
+        std::unique_ptr<KeyStore> m_KeyStore;
+        std::unique_ptr<KeyDirWatcher> m_Watcher;
+        std::mutex m_DirtyMutex;
+        std::set<std::string> m_DirtyKeys; //< public IDs with journaled counters
+        std::mutex m_CompactMutex;           //< serializes compactJournal()
+        std::mutex m_CompactorMutex;
+        std::condition_variable m_CompactorCv; //< wakes the compactor thread
+        std::thread m_Compactor;
+        bool m_CompactRequested;
+        bool m_StopCompactor;
+        std::mutex m_PendingMutex;
+        std::set<path> m_PendingKeyFiles;  //< passed to reloadKeyFiles(), not applied yet
+        mutable UnknownIdCache m_UnknownIds;
     };
 
 } /* namespace trihlav */
@@ -0,0 +1,277 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctime>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavKeySnapshot.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+
+using std::string;
+using std::vector;
+using std::runtime_error;
+using boost::filesystem::path;
+
+namespace trihlav {
+
+    static_assert(sizeof(KeySnapshot::Header) == 64, "Key snapshot header layout changed.");
+    static_assert(sizeof(KeySnapshot::Record) == 128, "Key snapshot record layout changed.");
+    static_assert(std::is_trivially_copyable<KeySnapshot::Record>::value, "Key snapshot records are written as is.");
+
+    static const char K_SNAPSHOT_MAGIC[] = "TRHLVS01";
+
+    constexpr uint32_t KeySnapshot::K_VERSION;
+    constexpr int64_t KeySnapshot::K_RACY_NS;
+
+    namespace {
+        void readAll(const int pFd, char *pBuf, size_t pSz, const path &pFilename) {
+            while (pSz > 0) {
+                const ssize_t myRead = ::read(pFd, pBuf, pSz);
+                if (myRead < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (myRead <= 0) {
+                    throw runtime_error("Failed to read " + pFilename.string() + ": "
+                                        + (myRead == 0 ? "unexpected end of file" : strerror(errno)));
+                }
+                pBuf += myRead;
+                pSz -= size_t(myRead);
+            }
+        }
+
+        void writeAll(const int pFd, const char *pBuf, size_t pSz, const path &pFilename) {
+            while (pSz > 0) {
+                const ssize_t myWritten = ::write(pFd, pBuf, pSz);
+                if (myWritten < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw runtime_error("Failed to write to " + pFilename.string() + ": " + strerror(errno));
+                }
+                pBuf += myWritten;
+                pSz -= size_t(myWritten);
+            }
+        }
+
+        bool isInHeap(const KeySnapshot::StrRef &pRef, const size_t pHeapSize) {
+            return pRef.m_Offset <= pHeapSize && pRef.m_Size <= pHeapSize - pRef.m_Offset;
+        }
+
+        KeySnapshot::StrRef addString(string &pHeap, const string &pStr) {
+            const KeySnapshot::StrRef myRetVal{uint32_t(pHeap.size()), uint32_t(pStr.size())};
+            pHeap += pStr;
+            return myRetVal;
+        }
+
+        int64_t toNs(const struct timespec &pTime) {
+            return int64_t(pTime.tv_sec) * 1000000000 + pTime.tv_nsec;
+        }
+    }
+
+    bool KeySnapshot::FileId::read(const path &pFilename) {
+        struct stat myStat;
+        if (::stat(pFilename.c_str(), &myStat) != 0 || !S_ISREG(myStat.st_mode)) {
+            return false;
+        }
+        m_Dev = uint64_t(myStat.st_dev);
+        m_Ino = uint64_t(myStat.st_ino);
+        m_Size = uint64_t(myStat.st_size);
+        m_MtimeNs = toNs(myStat.st_mtim);
+        m_CtimeNs = toNs(myStat.st_ctim);
+        return true;
+    }
+
+/**
+ * The whole file is read, all string references are checked, so the look
+ * ups need no checks.
+ */
+    KeySnapshot::KeySnapshot(const path &pFilename) //
+            : m_WrittenNs(0) //
+    {
+        TRIHLAV_TRACE_SCOPE("KeySnapshot::KeySnapshot");
+        const int myFd = ::open(pFilename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (myFd < 0) {
+            throw runtime_error("Failed to open " + pFilename.string() + ": " + strerror(errno));
+        }
+        try {
+            struct stat myStat;
+            if (::fstat(myFd, &myStat) != 0) {
+                throw runtime_error("Failed to stat " + pFilename.string() + ": " + strerror(errno));
+            }
+            const uint64_t mySize = uint64_t(myStat.st_size);
+            Header myHdr;
+            if (mySize < sizeof(myHdr)) {
+                throw runtime_error("Key snapshot " + pFilename.string() + " is too short.");
+            }
+            readAll(myFd, reinterpret_cast<char *>(&myHdr), sizeof(myHdr), pFilename);
+            if (memcmp(myHdr.m_Magic, K_SNAPSHOT_MAGIC, sizeof(myHdr.m_Magic)) != 0) {
+                throw runtime_error("Key snapshot " + pFilename.string() + " has a wrong magic.");
+            }
+            if (myHdr.m_Version != K_VERSION || myHdr.m_RecordSize != sizeof(Record)) {
+                throw runtime_error("Key snapshot " + pFilename.string() + " has the unknown version "
+                                    + std::to_string(myHdr.m_Version) + ".");
+            }
+            if (myHdr.m_RecordOffset != sizeof(Header)
+                || myHdr.m_RecordCount > (mySize - sizeof(Header)) / sizeof(Record)
+                || myHdr.m_HeapOffset != myHdr.m_RecordOffset + myHdr.m_RecordCount * sizeof(Record)
+                || myHdr.m_HeapSize != mySize - myHdr.m_HeapOffset) {
+                throw runtime_error("Key snapshot " + pFilename.string() + " is truncated or damaged.");
+            }
+            m_Records.resize(size_t(myHdr.m_RecordCount));
+            readAll(myFd, reinterpret_cast<char *>(m_Records.data()), m_Records.size() * sizeof(Record), pFilename);
+            m_Heap.resize(size_t(myHdr.m_HeapSize));
+            readAll(myFd, &m_Heap[0], m_Heap.size(), pFilename);
+            m_WrittenNs = myHdr.m_WrittenNs;
+        } catch (...) {
+            ::close(myFd);
+            throw;
+        }
+        ::close(myFd);
+        for (const Record &myRec : m_Records) {
+            if (!isInHeap(myRec.m_Filename, m_Heap.size()) || !isInHeap(myRec.m_Key.m_PublicId, m_Heap.size())
+                || !isInHeap(myRec.m_Key.m_Description, m_Heap.size())
+                || !isInHeap(myRec.m_Key.m_SysUser, m_Heap.size())) {
+                throw runtime_error("Key snapshot " + pFilename.string() + " has a string outside of its heap.");
+            }
+        }
+        TRIHLAV_LOG(debug) << "Read key snapshot " << pFilename << " with " << m_Records.size() << " entries.";
+    }
+
+/**
+ * A file changed shortly before the snapshot was written could change
+ * again without a new mtime, it is not trusted.
+ */
+    const KeySnapshot::Record *KeySnapshot::find(const string &pFilename, const FileId &pFileId) const {
+        const auto myIt = std::lower_bound(m_Records.begin(), m_Records.end(), pFilename,
+                                           [this](const Record &pRec, const string &pName) {
+                                               const int myCmp = memcmp(m_Heap.data() + pRec.m_Filename.m_Offset,
+                                                                        pName.data(),
+                                                                        std::min<size_t>(pRec.m_Filename.m_Size,
+                                                                                         pName.size()));
+                                               return myCmp < 0 || (myCmp == 0 && pRec.m_Filename.m_Size < pName.size());
+                                           });
+        if (myIt == m_Records.end() || myIt->m_Filename.m_Size != pFilename.size()
+            || memcmp(m_Heap.data() + myIt->m_Filename.m_Offset, pFilename.data(), pFilename.size()) != 0
+            || !(myIt->m_FileId == pFileId)
+            || std::max(pFileId.m_MtimeNs, pFileId.m_CtimeNs) + K_RACY_NS > m_WrittenNs) {
+            return 0;
+        }
+        return &*myIt;
+    }
+
+    void KeySnapshot::load(YubikoOtpKeyConfig &pKey, const Record &pRecord) const {
+        const BinaryKeystore::Record &myRec = pRecord.m_Key;
+        pKey.assign(getString(myRec.m_PublicId), myRec.m_Token, myRec.m_Key, getString(myRec.m_Description),
+                    getString(myRec.m_SysUser));
+    }
+
+/**
+ * Written next to pFilename, flushed and renamed over it like a keystore,
+ * a torn snapshot would hand out wrong keys.
+ */
+    void KeySnapshot::write(const path &pFilename, vector<Entry> &pEntries) {
+        TRIHLAV_TRACE_SCOPE("KeySnapshot::write");
+        std::sort(pEntries.begin(), pEntries.end(), [](const Entry &pA, const Entry &pB) {
+            return pA.m_Filename < pB.m_Filename;
+        });
+        // Value initialized, so unused fields and padding are written as zeros.
+        vector<Record> myRecords(pEntries.size());
+        string myHeap;
+        for (size_t myI = 0; myI < pEntries.size(); ++myI) {
+            const Entry &myEntry = pEntries[myI];
+            Record &myRec = myRecords[myI];
+            myRec.m_FileId = myEntry.m_FileId;
+            myRec.m_Filename = addString(myHeap, myEntry.m_Filename);
+            if (myEntry.m_Key != nullptr) {
+                const YubikoOtpKeyConfig &myKey = *myEntry.m_Key;
+                myRec.m_Key.m_Token = myKey.getToken();
+                memcpy(myRec.m_Key.m_Key, myKey.getSecretKeyArray().data(), YUBIKEY_KEY_SIZE);
+                myRec.m_Key.m_PublicId = addString(myHeap, myKey.getPublicId());
+                myRec.m_Key.m_Description = addString(myHeap, myKey.getDescription());
+                myRec.m_Key.m_SysUser = addString(myHeap, myKey.getSysUser());
+                myRec.m_Flags = EWithKey;
+            } else {
+                myRec.m_Key.m_PublicId = addString(myHeap, myEntry.m_PublicId);
+            }
+        }
+        if (myHeap.size() > UINT32_MAX) {
+            throw runtime_error("Key snapshot strings exceed 4GiB.");
+        }
+        struct timespec myNow;
+        clock_gettime(CLOCK_REALTIME, &myNow);
+        Header myHdr;
+        memset(&myHdr, 0, sizeof(myHdr));
+        memcpy(myHdr.m_Magic, K_SNAPSHOT_MAGIC, sizeof(myHdr.m_Magic));
+        myHdr.m_Version = K_VERSION;
+        myHdr.m_RecordSize = sizeof(Record);
+        myHdr.m_RecordCount = myRecords.size();
+        myHdr.m_RecordOffset = sizeof(Header);
+        myHdr.m_HeapOffset = myHdr.m_RecordOffset + myRecords.size() * sizeof(Record);
+        myHdr.m_HeapSize = myHeap.size();
+        myHdr.m_WrittenNs = toNs(myNow);
+
+        // several key managers may write it at once, fe. tools next to the server
+        path myTmpFile(pFilename);
+        myTmpFile += boost::filesystem::unique_path(".%%%%-%%%%.tmp");
+        const int myFd = ::open(myTmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (myFd < 0) {
+            throw runtime_error("Failed to open " + myTmpFile.string() + ": " + strerror(errno));
+        }
+        try {
+            writeAll(myFd, reinterpret_cast<const char *>(&myHdr), sizeof(myHdr), myTmpFile);
+            writeAll(myFd, reinterpret_cast<const char *>(myRecords.data()), myRecords.size() * sizeof(Record),
+                     myTmpFile);
+            writeAll(myFd, myHeap.data(), myHeap.size(), myTmpFile);
+            if (::fsync(myFd) != 0) {
+                throw runtime_error("Failed to flush " + myTmpFile.string() + ": " + strerror(errno));
+            }
+        } catch (...) {
+            ::close(myFd);
+            remove(myTmpFile);
+            throw;
+        }
+        ::close(myFd);
+        rename(myTmpFile, pFilename);
+        const int myDirFd = ::open(pFilename.parent_path().c_str(), O_RDONLY | O_CLOEXEC);
+        if (myDirFd >= 0) {
+            ::fsync(myDirFd);
+            ::close(myDirFd);
+        }
+        TRIHLAV_LOG(debug) << "Wrote key snapshot " << pFilename << " with " << myRecords.size() << " entries.";
+    }
+
+} /* namespace trihlav */
@@ -0,0 +1,149 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_KEY_SNAPSHOT_HPP_
+#define TRIHLAV_KEY_SNAPSHOT_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+#include "trihlavLib/trihlavBinaryKeystore.hpp"
+
+namespace trihlav {
+
+    class YubikoOtpKeyConfig;
+
+    /**
+     * What the JSON key directory looked like when its keys were loaded last.
+     *
+     * One entry per key file: its name, its identity (inode, size, mtime
+     * and ctime) and its public ID, in eager mode its values too. A key
+     * file whose identity did not change since is taken from the snapshot
+     * instead of being read, so a restart reads only the changed files.
+     * The layout follows BinaryKeystore: a Header, fixed size Records
+     * sorted by filename and a heap of strings, numbers in host byte order.
+     * The snapshot is a cache, a damaged one is ignored.
+     */
+    class KeySnapshot {
+    public:
+        static constexpr uint32_t K_VERSION = 1;
+
+        /// @brief Files changed less than this before the snapshot was written are read again.
+        static constexpr int64_t K_RACY_NS = 1000000000;
+
+        using StrRef = BinaryKeystore::StrRef;
+
+        /// @brief Identity of a file, changes with each write of it.
+        struct FileId {
+            uint64_t m_Dev = 0;
+            uint64_t m_Ino = 0;
+            uint64_t m_Size = 0;
+            int64_t m_MtimeNs = 0;
+            int64_t m_CtimeNs = 0;
+
+            /// @brief stat() pFilename, @return false when it is not a regular file.
+            bool read(const boost::filesystem::path &pFilename);
+
+            bool operator==(const FileId &pOther) const {
+                return m_Dev == pOther.m_Dev && m_Ino == pOther.m_Ino && m_Size == pOther.m_Size
+                       && m_MtimeNs == pOther.m_MtimeNs && m_CtimeNs == pOther.m_CtimeNs;
+            }
+        };
+
+        struct Header {
+            char m_Magic[8];
+            uint32_t m_Version;
+            uint32_t m_RecordSize;    //< sizeof(Record)
+            uint64_t m_RecordCount;
+            uint64_t m_RecordOffset;  //< from the start of the file
+            uint64_t m_HeapOffset;    //< from the start of the file
+            uint64_t m_HeapSize;
+            int64_t m_WrittenNs;      //< wall clock when it was written
+            uint8_t m_Reserved[8];
+        };
+
+        enum EFlags {
+            EWithKey = 1 //< m_Key holds the values of the key, not only its public ID
+        };
+
+        struct Record {
+            BinaryKeystore::Record m_Key;
+            FileId m_FileId;
+            StrRef m_Filename;
+            uint32_t m_Flags;         //< EFlags
+            uint32_t m_Reserved[3];
+        };
+
+        /// @brief A key file to write, @see write().
+        struct Entry {
+            std::string m_Filename;
+            FileId m_FileId;
+            std::string m_PublicId;
+            const YubikoOtpKeyConfig *m_Key = nullptr; //< its values are written too when set
+        };
+
+        /// @brief Read pFilename, throws std::runtime_error when it is not a valid snapshot.
+        explicit KeySnapshot(const boost::filesystem::path &pFilename);
+
+        KeySnapshot(const KeySnapshot &) = delete;
+
+        KeySnapshot &operator=(const KeySnapshot &) = delete;
+
+        size_t getRecordCount() const {
+            return m_Records.size();
+        }
+
+        /// @brief The entry of the file pFilename, @return 0 unless it is still pFileId.
+        const Record *find(const std::string &pFilename, const FileId &pFileId) const;
+
+        /// @brief Copy a string out of the heap, the references were checked on reading.
+        const std::string getString(const StrRef &pRef) const {
+            return std::string(m_Heap.data() + pRef.m_Offset, pRef.m_Size);
+        }
+
+        /// @brief Take over the values of pRecord, which has to be EWithKey.
+        void load(YubikoOtpKeyConfig &pKey, const Record &pRecord) const;
+
+        /**
+         * @brief Write pEntries into a new snapshot, replacing pFilename atomically.
+         *
+         * The file is readable by its owner only, it may hold secret keys.
+         */
+        static void write(const boost::filesystem::path &pFilename, std::vector<Entry> &pEntries);
+
+    private:
+        std::vector<Record> m_Records; //< sorted by filename
+        std::string m_Heap;
+        int64_t m_WrittenNs;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_KEY_SNAPSHOT_HPP_ */
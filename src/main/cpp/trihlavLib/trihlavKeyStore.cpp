@@ -0,0 +1,86 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdexcept>
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavKeyStore.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavJsonDirKeyStore.hpp"
+#include "trihlavLib/trihlavMmapKeyStore.hpp"
+#include "trihlavLib/trihlavSqliteKeyStore.hpp"
+
+namespace trihlav {
+
+    KeyStore::KeyStore(KeyManager &pKeyManager) //
+            : m_KeyManager(pKeyManager) //
+    {
+    }
+
+    KeyStore::~KeyStore() {
+    }
+
+    bool KeyStore::isWritable() const {
+        return m_KeyManager.getAccess() == KeyManager::EReadWrite;
+    }
+
+    void KeyStore::checkWritable() const {
+        if (!isWritable()) {
+            throw std::logic_error("The key manager is read only, the " + getName() + " key store can not be written.");
+        }
+    }
+
+/**
+ * Errors are logged, the key is taken for damaged.
+ */
+    KeyStore::KeyPtr_t KeyStore::loadKey(const Location &pLocation) {
+        try {
+            return get(pLocation.m_Id.toString());
+        } catch (const std::exception &myExc) {
+            TRIHLAV_LOG(error) << "Failed to load the key " << pLocation.m_Id.toString() << " from " << getLocation()
+                               << " - " << myExc.what();
+        }
+        return KeyPtr_t();
+    }
+
+    void KeyStore::saveSnapshot() {
+    }
+
+    std::unique_ptr<KeyStore> KeyStore::create(KeyManager &pKeyManager, const Settings::EKeyStore pKeyStore) {
+        switch (pKeyStore) {
+            case Settings::EMmapFile:
+                return std::unique_ptr<KeyStore>(new MmapKeyStore(pKeyManager));
+            case Settings::ESqlite:
+                return std::unique_ptr<KeyStore>(new SqliteKeyStore(pKeyManager));
+            case Settings::EJsonDir:
+            default:
+                return std::unique_ptr<KeyStore>(new JsonDirKeyStore(pKeyManager));
+        }
+    }
+
+} /* namespace trihlav */
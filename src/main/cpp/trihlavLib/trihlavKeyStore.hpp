@@ -0,0 +1,160 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_KEY_STORE_HPP_
+#define TRIHLAV_KEY_STORE_HPP_
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavPublicId.hpp"
+
+namespace trihlav {
+
+    class KeyManager;
+
+    class YubikoOtpKeyConfig;
+
+    /**
+     * Persistence of the keys, KeyManager keeps them in memory.
+     *
+     * The backend is chosen by Settings::getKeyStore(): one JSON file per
+     * key, a memory mapped keystore or a SQLite database. Keys remember
+     * where they are stored, their filename or YubikoOtpKeyConfig::getStoreRecord(),
+     * so they are updated in place. The caller serializes the writes of one
+     * key, the store itself is safe to be called from several threads.
+     */
+    class KeyStore {
+    public:
+        using KeyPtr_t = std::shared_ptr<YubikoOtpKeyConfig>;
+        using KeyList_t = std::vector<KeyPtr_t>;
+
+        /// @brief Where a key is stored, enough to load it again, @see loadLocations()
+        struct Location {
+            PublicId m_Id;
+            int64_t m_Record = -1;   //< YubikoOtpKeyConfig::getStoreRecord(), -1 for a key file
+            std::string m_Filename;  //< of a key file, empty for a record
+        };
+
+        explicit KeyStore(KeyManager &pKeyManager);
+
+        KeyStore(const KeyStore &) = delete;
+
+        KeyStore &operator=(const KeyStore &) = delete;
+
+        virtual ~KeyStore();
+
+        /// @brief Name of the backend, @see Settings::getKeyStoreStr()
+        virtual const std::string &getName() const = 0;
+
+        /// @brief The directory or the file holding the keys.
+        virtual const boost::filesystem::path getLocation() const = 0;
+
+        /**
+         * @brief Append all stored keys to pKeys, sorted by public ID.
+         *
+         * Damaged keys are logged and skipped, damaged files are renamed
+         * with the prefix "damaged" unless the key manager is read only.
+         */
+        virtual void load(KeyList_t &pKeys) = 0;
+
+        /// @brief Load the key of pPubId, empty when there is none.
+        virtual KeyPtr_t get(const std::string &pPubId) = 0;
+
+        /**
+         * @brief Append where the stored keys are to pLocations, in no particular order.
+         *
+         * Much cheaper than load(), only the public IDs are read. A key which
+         * turns out to be damaged is found by loadKey().
+         */
+        virtual void loadLocations(std::vector<Location> &pLocations) = 0;
+
+        /**
+         * @brief Load the key at pLocation, empty when it is damaged or gone.
+         *
+         * The location may be outdated, a key with another public ID is never
+         * returned. By default the key is looked up by its public ID.
+         */
+        virtual KeyPtr_t loadKey(const Location &pLocation);
+
+        /// @brief Insert or replace pKey, durable when it returns.
+        virtual void put(YubikoOtpKeyConfig &pKey) = 0;
+
+        /// @brief Remove pKey, durable when it returns.
+        virtual void erase(YubikoOtpKeyConfig &pKey) = 0;
+
+        /**
+         * @brief Write the counters of pKey, durable after sync().
+         * @return false when the key is not stored any more.
+         */
+        virtual bool saveCounters(const YubikoOtpKeyConfig &pKey) = 0;
+
+        /// @brief Make the counters written by saveCounters() durable.
+        virtual void sync() = 0;
+
+        /**
+         * @brief Write many keys in one go, much faster than put() for each.
+         *
+         * The keystore file and the SQLite table are replaced as a whole,
+         * the JSON directory gets a new key file per key.
+         * @return count of written keys.
+         */
+        virtual size_t write(const std::vector<const YubikoOtpKeyConfig *> &pKeys) = 0;
+
+        /**
+         * @brief Bring the snapshot of the stored keys up to date, fe. before a restart.
+         *
+         * Only the JSON directory keeps one, @see KeySnapshot. By default
+         * nothing is done.
+         */
+        virtual void saveSnapshot();
+
+        /// @brief Create the backend pKeyStore for pKeyManager.
+        static std::unique_ptr<KeyStore> create(KeyManager &pKeyManager, const Settings::EKeyStore pKeyStore);
+
+    protected:
+        KeyManager &getKeyManager() const {
+            return m_KeyManager;
+        }
+
+        /// @brief Is the key manager read write?
+        bool isWritable() const;
+
+        /// @brief Throws std::logic_error when the key manager is read only.
+        void checkWritable() const;
+
+    private:
+        KeyManager &m_KeyManager;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_KEY_STORE_HPP_ */
@@ -0,0 +1,161 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavLazyKeys.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+#include "trihlavLib/trihlavMetrics.hpp"
+
+namespace trihlav {
+
+    namespace {
+        Gauge &getLoadedGauge() {
+            static Gauge &theLoaded = getMetrics().getGauge("trihlav_lazy_keys_loaded",
+                                                            "Keys loaded on first use, held by lazy indexes.");
+            return theLoaded;
+        }
+    }
+
+/**
+ * The locations are sorted once, a key is found by binary search.
+ */
+    LazyKeys::LazyKeys(KeyStore &pStore, std::vector<KeyStore::Location> &&pLocations) //
+            : m_Store(pStore), m_Locations(std::move(pLocations)), m_LoadedCount(0), m_AllLoaded(false) //
+    {
+        TRIHLAV_TRACE_SCOPE("LazyKeys::LazyKeys");
+        std::stable_sort(m_Locations.begin(), m_Locations.end(),
+                         [](const KeyStore::Location &pA, const KeyStore::Location &pB) {
+                             return pA.m_Id < pB.m_Id;
+                         });
+        auto myOut = m_Locations.begin();
+        for (auto myIt = m_Locations.begin(); myIt != m_Locations.end(); ++myIt) {
+            if (myIt->m_Id.isEmpty() || !myIt->m_Id.isValid()
+                || (myOut != m_Locations.begin() && (myOut - 1)->m_Id == myIt->m_Id)) {
+                if (!myIt->m_Id.isEmpty()) {
+                    TRIHLAV_LOG(warning) << "Key " << myIt->m_Filename << " is not indexed, its public ID "
+                                         << myIt->m_Id.toString() << " is too long or used twice.";
+                }
+                continue;
+            }
+            if (myOut != myIt) {
+                *myOut = std::move(*myIt);
+            }
+            ++myOut;
+        }
+        m_Locations.erase(myOut, m_Locations.end());
+        m_Locations.shrink_to_fit();
+        m_Loaded.reset(new std::atomic<YubikoOtpKeyConfig *>[m_Locations.size()]);
+        for (size_t myIdx = 0; myIdx < m_Locations.size(); ++myIdx) {
+            m_Loaded[myIdx].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    LazyKeys::~LazyKeys() {
+        getLoadedGauge().add(-int64_t(m_LoadedCount.load()));
+    }
+
+    std::vector<KeyStore::Location>::const_iterator LazyKeys::find(const PublicId &pPubId) const {
+        const auto myIt = std::lower_bound(m_Locations.begin(), m_Locations.end(), pPubId,
+                                           [](const KeyStore::Location &pLocation, const PublicId &pId) {
+                                               return pLocation.m_Id < pId;
+                                           });
+        if (myIt == m_Locations.end() || myIt->m_Id != pPubId) {
+            return m_Locations.end();
+        }
+        return myIt;
+    }
+
+    YubikoOtpKeyConfig *LazyKeys::get(const PublicId &pPubId) {
+        const auto myIt = find(pPubId);
+        if (myIt == m_Locations.end()) {
+            return 0;
+        }
+        return get(size_t(myIt - m_Locations.begin()));
+    }
+
+    bool LazyKeys::isIndexed(const PublicId &pPubId) const {
+        return find(pPubId) != m_Locations.end();
+    }
+
+/**
+ * The key is read without a lock held, when two threads load the same key
+ * the first one wins and the other copy is dropped. A key which failed to
+ * load is tried again by the next look up.
+ */
+    YubikoOtpKeyConfig *LazyKeys::get(const size_t pIdx) {
+        YubikoOtpKeyConfig *myKey = m_Loaded[pIdx].load(std::memory_order_acquire);
+        if (myKey != 0) {
+            return myKey;
+        }
+        TRIHLAV_TRACE_SCOPE("LazyKeys::load");
+        const KeyStore::KeyPtr_t myLoaded = m_Store.loadKey(m_Locations[pIdx]);
+        if (!myLoaded) {
+            return 0;
+        }
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        myKey = m_Loaded[pIdx].load(std::memory_order_relaxed);
+        if (myKey == 0) {
+            m_Keys.push_back(myLoaded);
+            myKey = myLoaded.get();
+            m_Loaded[pIdx].store(myKey, std::memory_order_release);
+            m_LoadedCount.fetch_add(1);
+            getLoadedGauge().add(1);
+        }
+        return myKey;
+    }
+
+    const LazyKeys::KeyList_t &LazyKeys::loadAll() {
+        TRIHLAV_TRACE_SCOPE("LazyKeys::loadAll");
+        {
+            std::lock_guard<std::mutex> myLock(m_Mutex);
+            if (m_AllLoaded) {
+                return m_All;
+            }
+        }
+        for (size_t myIdx = 0; myIdx < m_Locations.size(); ++myIdx) {
+            get(myIdx);
+        }
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        if (!m_AllLoaded) {
+            m_All = m_Keys;
+            std::sort(m_All.begin(), m_All.end(), [](const KeyStore::KeyPtr_t &pA, const KeyStore::KeyPtr_t &pB) {
+                return pA->getPublicId() < pB->getPublicId();
+            });
+            m_AllLoaded = true;
+        }
+        return m_All;
+    }
+
+    LazyKeys::KeyList_t LazyKeys::getLoaded() {
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        return m_Keys;
+    }
+
+} /* namespace trihlav */
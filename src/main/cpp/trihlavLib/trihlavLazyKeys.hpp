@@ -0,0 +1,113 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_LAZY_KEYS_HPP_
+#define TRIHLAV_LAZY_KEYS_HPP_
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "trihlavLib/trihlavKeyStore.hpp"
+#include "trihlavLib/trihlavPublicId.hpp"
+
+namespace trihlav {
+
+    class YubikoOtpKeyConfig;
+
+    /**
+     * Keys of a KeyStore loaded on first use, @see Settings::getLazyKeys().
+     *
+     * Only the locations of the keys are indexed up front, sorted by their
+     * public ID, @see KeyStore::loadLocations(). A key is loaded from the
+     * store when it is looked up the first time and kept as long as the
+     * index lives. Loaded keys are looked up without a lock, different keys
+     * load in parallel.
+     */
+    class LazyKeys {
+    public:
+        using KeyList_t = KeyStore::KeyList_t;
+
+        /// @brief Index pLocations of pStore, empty, too long and repeated public IDs are left out.
+        LazyKeys(KeyStore &pStore, std::vector<KeyStore::Location> &&pLocations);
+
+        LazyKeys(const LazyKeys &) = delete;
+
+        LazyKeys &operator=(const LazyKeys &) = delete;
+
+        ~LazyKeys();
+
+        /// @brief Count of the indexed keys, loaded or not.
+        size_t getKeyCount() const {
+            return m_Locations.size();
+        }
+
+        /// @brief Count of the keys loaded so far.
+        size_t getLoadedCount() const {
+            return m_LoadedCount.load();
+        }
+
+        /**
+         * @brief The key of pPubId, loaded on first use.
+         * @return 0 when it is not indexed or failed to load.
+         */
+        YubikoOtpKeyConfig *get(const PublicId &pPubId);
+
+        /// @brief Is pPubId indexed, whether its key loaded or not?
+        bool isIndexed(const PublicId &pPubId) const;
+
+        /**
+         * @brief Load all keys which are not loaded yet, once.
+         * @return the loaded keys sorted by public ID, like KeyStore::load() does.
+         */
+        const KeyList_t &loadAll();
+
+        /// @brief The keys loaded so far, in the order they were loaded.
+        KeyList_t getLoaded();
+
+    private:
+        /// @brief The location of pPubId in m_Locations, end() when it is not indexed.
+        std::vector<KeyStore::Location>::const_iterator find(const PublicId &pPubId) const;
+
+        /// @brief The key at pIdx of m_Locations, loaded on first use.
+        YubikoOtpKeyConfig *get(const size_t pIdx);
+
+        KeyStore &m_Store;
+        std::vector<KeyStore::Location> m_Locations;                   //< sorted by m_Id
+        std::unique_ptr<std::atomic<YubikoOtpKeyConfig *>[]> m_Loaded; //< per location, 0 until loaded
+        std::atomic<size_t> m_LoadedCount;
+        std::mutex m_Mutex;                                            //< guards the members below
+        KeyList_t m_Keys;                                              //< owns the loaded keys
+        bool m_AllLoaded;
+        KeyList_t m_All;                                               //< of loadAll(), never changed once set
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_LAZY_KEYS_HPP_ */
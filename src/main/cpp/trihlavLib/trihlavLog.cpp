@@ -5,8 +5,15 @@
 #include <boost/log/expressions.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/utility/setup/console.hpp>
+#include <boost/log/sinks/unlocked_frontend.hpp>
+#include <boost/core/null_deleter.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/log/support/date_time.hpp>
 
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavAsyncLogSink.hpp"
+
 namespace trihlav {
 
     namespace attrs = boost::log::attributes;
@@ -15,10 +22,13 @@ namespace trihlav {
     namespace src = boost::log::sources;
 
 
-    void initLog() {
+    static void initAttributes() {
         boost::log::add_common_attributes();
         boost::shared_ptr<boost::log::core> p_core = boost::log::core::get();
         p_core->add_global_attribute("Scope", attrs::named_scope());
+    }
+
+    static boost::log::formatter getFormatter() {
         /* log formatter:
          * [TimeStamp] [ThreadId] [Severity Level] [Scope] Log message
          */
@@ -32,27 +42,55 @@ namespace trihlav {
                                                                     boost::log::keywords::format = "%n",
                                                                     boost::log::keywords::iteration = boost::log::expressions::reverse,
                                                                     boost::log::keywords::depth = 2);
-        boost::log::formatter logFmt = boost::log::expressions::format(
+        return boost::log::expressions::format(
                 "[%1%] (%2%) [%3% \t] [%4%] %5%") % fmtTimeStamp % fmtThreadId
-                                       % fmtSeverity % fmtScope % boost::log::expressions::smessage;
+               % fmtSeverity % fmtScope % boost::log::expressions::smessage;
+    }
+
+    void initLog() {
+        initAttributes();
         /* console sink */
         auto consoleSink = boost::log::add_console_log(std::clog);
-        consoleSink->set_formatter(logFmt);
+        consoleSink->set_formatter(getFormatter());
     }
 
-    void logDebug_token(const yubikey_token_st &pToken) {
-        BOOST_LOG_NAMED_SCOPE("logDebug_token");
-        std::__cxx11::string myUid(YUBIKEY_UID_SIZE * 2 + 1, ' ');
+    void initLog(const Settings &pSettings) {
+        if (pSettings.getLogQueueSize() <= 0) {
+            initLog();
+            return;
+        }
+        initAttributes();
+        /* console sink fed by the writer thread */
+        boost::shared_ptr<AsyncLogSink> myBackend = boost::make_shared<AsyncLogSink>(
+                std::shared_ptr<std::ostream>(&std::clog, boost::null_deleter()), getFormatter(),
+                size_t(pSettings.getLogQueueSize()), pSettings.getLogOverflow());
+        boost::log::core::get()->add_sink(
+                boost::make_shared<boost::log::sinks::unlocked_sink<AsyncLogSink> >(myBackend));
+        TRIHLAV_LOG(info) << "Asynchronous log, queue of " << myBackend->getCapacity() << " records, "
+                          << Settings::getLogOverflowStr(pSettings.getLogOverflow()) << " on overflow.";
+    }
+
+    void setLogLevel(const boost::log::trivial::severity_level pLevel) {
+        boost::log::core::get()->set_filter(boost::log::trivial::severity >= pLevel);
+    }
+
+    /// @brief Hex encoded private ID of the token.
+    static const std::string getUidHex(const yubikey_token_st &pToken) {
+        std::string myUid(YUBIKEY_UID_SIZE * 2 + 1, ' ');
         yubikey_hex_encode(&myUid[0], reinterpret_cast<const char *>(&pToken.uid),
                            YUBIKEY_UID_SIZE);
-        BOOST_LOG_TRIVIAL(debug) << "yubikey_token_st:{";
-        BOOST_LOG_TRIVIAL(debug) << "   uid  :\"" << myUid.c_str() << "\"";
-        BOOST_LOG_TRIVIAL(debug) << "   ctr  :\"" << int(pToken.ctr) << "\"";
-        BOOST_LOG_TRIVIAL(debug) << "   use  :\"" << int(pToken.use) << "\"";
-        BOOST_LOG_TRIVIAL(debug) << "   rnd  :\"" << int(pToken.rnd) << "\"";
-        BOOST_LOG_TRIVIAL(debug) << "   tstpl:\"" << int(pToken.tstpl) << "\"";
-        BOOST_LOG_TRIVIAL(debug) << "   tstph:\"" << int(pToken.tstph) << "\"";
-        BOOST_LOG_TRIVIAL(debug) << "   crc  :\"" << int(pToken.crc) << "\"";
-        BOOST_LOG_TRIVIAL(debug) << "}";
+        myUid.resize(YUBIKEY_UID_SIZE * 2);
+        return myUid;
+    }
+
+    void logDebug_token(const yubikey_token_st &pToken) {
+        TRIHLAV_LOG(debug) << "yubikey_token_st:{"
+                           << "uid:\"" << getUidHex(pToken) << "\""
+                           << ", ctr:" << int(pToken.ctr)
+                           << ", use:" << int(pToken.use)
+                           << ", rnd:" << int(pToken.rnd)
+                           << ", tstpl:" << int(pToken.tstpl)
+                           << ", tstph:" << int(pToken.tstph)
+                           << ", crc:" << int(pToken.crc) << "}";
     }
 }
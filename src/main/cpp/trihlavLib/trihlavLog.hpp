@@ -2,6 +2,9 @@
 #define TRIHLAV_LOG_HPP_
 
 #include <yubikey.h>
+#include <boost/log/trivial.hpp>
+
+#include "trihlavLib/trihlavSettings.hpp"
 
 /**
  * Miscelanous logging related functionality is declared here.
@@ -10,6 +13,14 @@ namespace trihlav {
     /// Initialize logging library.
     void initLog();
 
+    /// Initialize logging library, the records are written by a writer thread
+    /// when Settings::getLogQueueSize() is not 0.
+    void initLog(const Settings &pSettings);
+
+    /// Drop records below pLevel at runtime.
+    void setLogLevel(const boost::log::trivial::severity_level pLevel);
+
+    /// Log the token as one debug record, nothing is formatted when debug is off.
     void logDebug_token(const yubikey_token_st &pToken);
 
 }
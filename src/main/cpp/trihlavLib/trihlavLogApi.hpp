@@ -30,9 +30,118 @@
 #ifndef TRIHLAV_TRIHLAVLOGAPI_HPP
 #define TRIHLAV_TRIHLAVLOGAPI_HPP
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/attributes.hpp>
 #include <boost/log/expressions.hpp>
 
+#include "trihlavLib/trihlavTrace.hpp"
+
+/**
+ * Lowest severity compiled in, 0 (trace) up to 5 (fatal), set by the CMake
+ * option TRIHLAV_LOG_MIN_LEVEL. Records below it are removed by the compiler
+ * together with the evaluation of their arguments, the runtime filter,
+ * @see trihlav::setLogLevel(), works above it.
+ */
+#ifndef TRIHLAV_LOG_MIN_LEVEL
+#define TRIHLAV_LOG_MIN_LEVEL 0
+#endif
+
+namespace trihlav {
+
+    /// @brief Are records of pLevel compiled in?
+    constexpr bool isLogCompiled(const boost::log::trivial::severity_level pLevel) {
+        return int(pLevel) >= TRIHLAV_LOG_MIN_LEVEL;
+    }
+
+    /**
+     * Rate limit of one log statement, @see TRIHLAV_LOG_LIMITED . At most
+     * m_PerMinute records pass in a minute, the first one passing after a
+     * suppression tells how many were suppressed.
+     */
+    class LogSiteLimit {
+    public:
+        static constexpr int64_t K_WINDOW_MS = 60000;
+
+        explicit LogSiteLimit(const uint32_t pPerMinute) //
+                : m_PerMinute(pPerMinute), m_WindowMs(-K_WINDOW_MS), m_Count(0), m_Suppressed(0) {
+        }
+
+        /// @return records suppressed since the last one passed, -1 when this one is suppressed.
+        int64_t admit(const int64_t pNowMs) {
+            int64_t myWindow = m_WindowMs.load(std::memory_order_relaxed);
+            if (pNowMs - myWindow >= K_WINDOW_MS && m_WindowMs.compare_exchange_strong(myWindow, pNowMs)) {
+                m_Count.store(0, std::memory_order_relaxed);
+            }
+            if (m_Count.fetch_add(1, std::memory_order_relaxed) < m_PerMinute) {
+                return int64_t(m_Suppressed.exchange(0, std::memory_order_relaxed));
+            }
+            m_Suppressed.fetch_add(1, std::memory_order_relaxed);
+            return -1;
+        }
+
+        int64_t admit() {
+            return admit(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+    private:
+        const uint32_t m_PerMinute;
+        std::atomic<int64_t> m_WindowMs;
+        std::atomic<uint32_t> m_Count;
+        std::atomic<uint64_t> m_Suppressed;
+    };
+
+    /// @brief Prefix of a record which passed a LogSiteLimit.
+    struct LogSuppressed {
+        const int64_t m_Count;
+    };
+
+    inline std::ostream &operator<<(std::ostream &pStrm, const LogSuppressed &pSuppressed) {
+        if (pSuppressed.m_Count > 0) {
+            pStrm << "(" << pSuppressed.m_Count << " similar suppressed) ";
+        }
+        return pStrm;
+    }
+
+}
+
+/// @brief BOOST_LOG_TRIVIAL which is compiled out below TRIHLAV_LOG_MIN_LEVEL.
+#define TRIHLAV_LOG(pLevel) \
+    if (!::trihlav::isLogCompiled(::boost::log::trivial::pLevel)) {} else BOOST_LOG_TRIVIAL(pLevel)
+
+/**
+ * @brief TRIHLAV_LOG passing at most pPerMinute records a minute.
+ *
+ * For repetitive messages, each expansion has its own LogSiteLimit. The
+ * arguments of suppressed records are not evaluated.
+ */
+#define TRIHLAV_LOG_LIMITED(pLevel, pPerMinute) \
+    if (!::trihlav::isLogCompiled(::boost::log::trivial::pLevel)) {} else \
+    for (int64_t trihlavSuppressed_ = []() -> ::trihlav::LogSiteLimit & { \
+            static ::trihlav::LogSiteLimit theSite(pPerMinute); return theSite; }().admit(); \
+         trihlavSuppressed_ >= 0; trihlavSuppressed_ = -1) \
+        BOOST_LOG_TRIVIAL(pLevel) << ::trihlav::LogSuppressed{trihlavSuppressed_}
+
+#define TRIHLAV_TRACE_CAT_(pA, pB) pA ## pB
+#define TRIHLAV_TRACE_CAT(pA, pB) TRIHLAV_TRACE_CAT_(pA, pB)
+
+/**
+ * @brief Trace span of the enclosing block, pName has to be a literal.
+ *
+ * Recorded only while trihlav::Trace is enabled. Builds compiling debug
+ * records in also push pName as BOOST_LOG_NAMED_SCOPE for the log format.
+ */
+#if TRIHLAV_LOG_MIN_LEVEL <= 1
+#define TRIHLAV_TRACE_SCOPE(pName) \
+    const ::trihlav::TraceSpan TRIHLAV_TRACE_CAT(trihlavSpan_, __LINE__)(pName); BOOST_LOG_NAMED_SCOPE(pName)
+#else
+#define TRIHLAV_TRACE_SCOPE(pName) \
+    const ::trihlav::TraceSpan TRIHLAV_TRACE_CAT(trihlavSpan_, __LINE__)(pName)
+#endif
+
 #endif //TRIHLAV_TRIHLAVLOGAPI_HPP
@@ -27,10 +27,7 @@
  */
 
 #include <boost/locale.hpp>
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
-#include <boost/log/expressions.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
 
 #include "trihlavLib/trihlavEditIface.hpp"
 #include "trihlavLib/trihlavMessageViewIface.hpp"
@@ -53,13 +50,13 @@ namespace trihlav {
     }
 
     void LoginPresenter::show() {
-        BOOST_LOG_NAMED_SCOPE("LoginPresenter::show");
+        TRIHLAV_TRACE_SCOPE("LoginPresenter::show");
         if (m_Status != SHOWING) {
             getView().sigDialogFinished.connect( ///< connect start
                     [=](bool pStatus) -> void { dialogClosed(pStatus); } ///< lambda 2 b called
             );///< end connect
             getView().show();
-            BOOST_LOG_TRIVIAL(debug) << "Showing login dialog ...";
+            TRIHLAV_LOG(debug) << "Showing login dialog ...";
         }
         getView().getEdtPassword().setPasswordMode(true);
     }
@@ -72,7 +69,7 @@ namespace trihlav {
     }
 
     void LoginPresenter::dialogClosed(bool pStatus) {
-        BOOST_LOG_NAMED_SCOPE("trihlav::LoginPresenter::dialogClosed");
+        TRIHLAV_TRACE_SCOPE("trihlav::LoginPresenter::dialogClosed");
         if (pStatus) {
             const string myUserName{getView().getEdtUserName().getValue()};
             const string myPassword{getView().getEdtPassword().getValue()};
@@ -90,9 +87,9 @@ namespace trihlav {
             } else {
                 m_LoggedInUser = myUserName;
             }
-            BOOST_LOG_TRIVIAL(info) << "User " << myUserName << " accepted.";
+            TRIHLAV_LOG(info) << "User " << myUserName << " accepted.";
         } else {
-            BOOST_LOG_TRIVIAL(debug) << "Password check canceled.";
+            TRIHLAV_LOG(debug) << "Password check canceled.";
         }
         sigUserAccepted(pStatus);
         m_Status = HIDING;
@@ -52,11 +52,11 @@ namespace trihlav {
             m_MainPanelView(pFactory.createMainPanelView()),
             m_isAthentificated(false) //
     {
-        BOOST_LOG_TRIVIAL(debug) << "MainPanelPresenter()";
+        TRIHLAV_LOG(debug) << "MainPanelPresenter()";
     }
 
     MainPanelPresenter::~MainPanelPresenter() {
-        BOOST_LOG_TRIVIAL(debug) << "~MainPanelPresenter()";
+        TRIHLAV_LOG(debug) << "~MainPanelPresenter()";
     }
 
     ViewIface &MainPanelPresenter::getView() {
@@ -73,7 +73,7 @@ namespace trihlav {
     }
 
     void MainPanelPresenter::showedPanel(const PanelName pPanel) {
-        BOOST_LOG_NAMED_SCOPE("MainPanelPresenter::showedPanel");
+        TRIHLAV_TRACE_SCOPE("MainPanelPresenter::showedPanel");
 
         if (pPanel == PanelName::KeyList) {
             m_KeyListPresenter->protectedAction();
@@ -91,7 +91,7 @@ namespace trihlav {
         list<string> myAllowedHosts{"localhost", "127.0.0.1"};
         for (const string &myAllowedHost : myAllowedHosts) {
             if (pHostName.find(myAllowedHost) == 0) {
-                BOOST_LOG_TRIVIAL(debug) << "found " << myAllowedHost << ".";
+                TRIHLAV_LOG(debug) << "found " << myAllowedHost << ".";
                 return true;
             }
         }
@@ -25,16 +25,14 @@
 	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
 	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
 */
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
 
 #include "trihlavMessageViewIface.hpp"
 
 namespace trihlav {
 
     MessageViewIface::~MessageViewIface() {
-        BOOST_LOG_NAMED_SCOPE("MessageViewIface::~MessageViewIface");
+        TRIHLAV_TRACE_SCOPE("MessageViewIface::~MessageViewIface");
     }
 
 } /* namespace trihlav */
@@ -0,0 +1,261 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <new>
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "trihlavLib/trihlavMetrics.hpp"
+
+using std::string;
+
+namespace trihlav {
+
+    constexpr size_t Counter::K_SHARDS;
+    constexpr unsigned Histogram::K_SUB_BITS;
+    constexpr unsigned Histogram::K_MAX_EXP;
+    constexpr size_t Histogram::K_BUCKETS;
+    constexpr size_t Histogram::K_SHARDS;
+
+    /// @brief Histogram buckets written, le from 2^K_FIRST_LE_EXP ns (~1us) up to 2^K_LAST_LE_EXP ns (~69s).
+    static constexpr unsigned K_FIRST_LE_EXP = 10;
+    static constexpr unsigned K_LAST_LE_EXP = 36;
+
+    static const string K_TYPE_COUNTER("counter");
+    static const string K_TYPE_GAUGE("gauge");
+    static const string K_TYPE_HISTOGRAM("histogram");
+
+    /// @brief posix_memalign() of pSize bytes on a cache line, throws std::bad_alloc.
+    static void *allocateAligned(const size_t pSize) {
+        void *myRetVal = 0;
+        if (::posix_memalign(&myRetVal, 64, pSize) != 0) {
+            throw std::bad_alloc();
+        }
+        return myRetVal;
+    }
+
+    void *Counter::operator new(const size_t pSize) {
+        return allocateAligned(pSize);
+    }
+
+    void Counter::operator delete(void *pPtr) {
+        std::free(pPtr);
+    }
+
+    Counter::Counter() {
+        for (Cell &myCell : m_Shards) {
+            myCell.m_Value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t Counter::getValue() const {
+        uint64_t mySum = 0;
+        for (const Cell &myCell : m_Shards) {
+            mySum += myCell.m_Value.load(std::memory_order_relaxed);
+        }
+        return mySum;
+    }
+
+    Histogram::Histogram()
+            : m_Shards(static_cast<Shard *>(allocateAligned(K_SHARDS * sizeof(Shard))), std::free) {
+        static_assert(std::is_trivially_destructible<Shard>::value, "Shards are freed without a destructor.");
+        for (size_t myS = 0; myS < K_SHARDS; ++myS) {
+            new(&m_Shards[myS]) Shard;
+            for (std::atomic<uint64_t> &myBucket : m_Shards[myS].m_Buckets) {
+                myBucket.store(0, std::memory_order_relaxed);
+            }
+            m_Shards[myS].m_SumNs.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    Histogram::~Histogram() {
+    }
+
+    uint64_t Histogram::getLowerBound(const size_t pBucket) {
+        if (pBucket < (size_t(1) << K_SUB_BITS)) {
+            return pBucket;
+        }
+        const unsigned myShift = unsigned(pBucket >> K_SUB_BITS) - 1;
+        const uint64_t mySub = pBucket & ((1 << K_SUB_BITS) - 1);
+        return ((uint64_t(1) << K_SUB_BITS) + mySub) << myShift;
+    }
+
+    Histogram::Snapshot Histogram::getSnapshot() const {
+        Snapshot myRetVal{std::vector<uint64_t>(K_BUCKETS, 0), 0, 0};
+        for (size_t myS = 0; myS < K_SHARDS; ++myS) {
+            const Shard &myShard = m_Shards[myS];
+            for (size_t myB = 0; myB < K_BUCKETS; ++myB) {
+                const uint64_t myCnt = myShard.m_Buckets[myB].load(std::memory_order_relaxed);
+                myRetVal.m_Buckets[myB] += myCnt;
+                myRetVal.m_Count += myCnt;
+            }
+            myRetVal.m_SumNs += myShard.m_SumNs.load(std::memory_order_relaxed);
+        }
+        return myRetVal;
+    }
+
+    uint64_t Histogram::Snapshot::getQuantileNs(const double pQuantile) const {
+        if (m_Count == 0) {
+            return 0;
+        }
+        const uint64_t myRank = std::max(uint64_t(1), uint64_t(pQuantile * double(m_Count) + 0.5));
+        uint64_t mySeen = 0;
+        for (size_t myB = 0; myB < K_BUCKETS; ++myB) {
+            mySeen += m_Buckets[myB];
+            if (mySeen >= myRank) {
+                return getLowerBound(myB + 1) - 1;
+            }
+        }
+        return getLowerBound(K_BUCKETS) - 1;
+    }
+
+/**
+ * 2^pExp starts the first bucket of its power of two, all buckets before
+ * it hold smaller values.
+ */
+    uint64_t Histogram::Snapshot::getCountBelowPow2(const unsigned pExp) const {
+        const size_t myEnd = pExp <= K_SUB_BITS ? size_t(1) << pExp
+                                                : std::min(K_BUCKETS, size_t(pExp - K_SUB_BITS + 1) << K_SUB_BITS);
+        uint64_t myRetVal = 0;
+        for (size_t myB = 0; myB < myEnd; ++myB) {
+            myRetVal += m_Buckets[myB];
+        }
+        return myRetVal;
+    }
+
+    Metrics::Metrics() {
+    }
+
+    Metrics::~Metrics() {
+    }
+
+    const string &Metrics::getTypeStr(const Metrics::EType pType) {
+        switch (pType) {
+            case ECounter:
+                return K_TYPE_COUNTER;
+            case EGauge:
+                return K_TYPE_GAUGE;
+            case EHistogram:
+            default:
+                return K_TYPE_HISTOGRAM;
+        }
+    }
+
+    Metrics::Family &Metrics::getFamily(const string &pName, const string &pHelp, const Metrics::EType pType) {
+        auto myIt = m_Families.find(pName);
+        if (myIt == m_Families.end()) {
+            myIt = m_Families.emplace(pName, Family()).first;
+            myIt->second.m_Type = pType;
+            myIt->second.m_Help = pHelp;
+        } else if (myIt->second.m_Type != pType) {
+            throw std::invalid_argument("Metric " + pName + " is a " + getTypeStr(myIt->second.m_Type)
+                                        + ", not a " + getTypeStr(pType) + ".");
+        }
+        return myIt->second;
+    }
+
+    Counter &Metrics::getCounter(const string &pName, const string &pHelp, const string &pLabels) {
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        std::unique_ptr<Counter> &myRetVal = getFamily(pName, pHelp, ECounter).m_Counters[pLabels];
+        if (!myRetVal) {
+            myRetVal.reset(new Counter());
+        }
+        return *myRetVal;
+    }
+
+    Gauge &Metrics::getGauge(const string &pName, const string &pHelp, const string &pLabels) {
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        std::unique_ptr<Gauge> &myRetVal = getFamily(pName, pHelp, EGauge).m_Gauges[pLabels];
+        if (!myRetVal) {
+            myRetVal.reset(new Gauge());
+        }
+        return *myRetVal;
+    }
+
+    Histogram &Metrics::getHistogram(const string &pName, const string &pHelp, const string &pLabels) {
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        std::unique_ptr<Histogram> &myRetVal = getFamily(pName, pHelp, EHistogram).m_Histograms[pLabels];
+        if (!myRetVal) {
+            myRetVal.reset(new Histogram());
+        }
+        return *myRetVal;
+    }
+
+    /// @brief pName{pLabels,pExtra} or pName when there are no labels.
+    static void writeSeries(std::ostream &pOut, const string &pName, const string &pLabels,
+                            const string &pExtra = "") {
+        pOut << pName;
+        if (!pLabels.empty() || !pExtra.empty()) {
+            pOut << '{' << pLabels << (pLabels.empty() || pExtra.empty() ? "" : ",") << pExtra << '}';
+        }
+        pOut << ' ';
+    }
+
+    void Metrics::writePrometheus(std::ostream &pOut) const {
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        const std::streamsize myPrecision = pOut.precision(9);
+        for (const auto &myFamily : m_Families) {
+            const string &myName = myFamily.first;
+            pOut << "# HELP " << myName << ' ' << myFamily.second.m_Help << '\n';
+            pOut << "# TYPE " << myName << ' ' << getTypeStr(myFamily.second.m_Type) << '\n';
+            for (const auto &myCounter : myFamily.second.m_Counters) {
+                writeSeries(pOut, myName, myCounter.first);
+                pOut << myCounter.second->getValue() << '\n';
+            }
+            for (const auto &myGauge : myFamily.second.m_Gauges) {
+                writeSeries(pOut, myName, myGauge.first);
+                pOut << myGauge.second->getValue() << '\n';
+            }
+            for (const auto &myHistogram : myFamily.second.m_Histograms) {
+                const Histogram::Snapshot mySnap = myHistogram.second->getSnapshot();
+                for (unsigned myExp = K_FIRST_LE_EXP; myExp <= K_LAST_LE_EXP; ++myExp) {
+                    std::ostringstream myLe;
+                    myLe << "le=\"" << double(uint64_t(1) << myExp) / 1e9 << '"';
+                    writeSeries(pOut, myName + "_bucket", myHistogram.first, myLe.str());
+                    pOut << mySnap.getCountBelowPow2(myExp) << '\n';
+                }
+                writeSeries(pOut, myName + "_bucket", myHistogram.first, "le=\"+Inf\"");
+                pOut << mySnap.m_Count << '\n';
+                writeSeries(pOut, myName + "_sum", myHistogram.first);
+                pOut << double(mySnap.m_SumNs) / 1e9 << '\n';
+                writeSeries(pOut, myName + "_count", myHistogram.first);
+                pOut << mySnap.m_Count << '\n';
+            }
+        }
+        pOut.precision(myPrecision);
+    }
+
+    Metrics &getMetrics() {
+        static Metrics theMetrics;
+        return theMetrics;
+    }
+
+} /* namespace trihlav */
@@ -0,0 +1,248 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_METRICS_HPP_
+#define TRIHLAV_METRICS_HPP_
+
+#include <map>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+namespace trihlav {
+
+    /// @brief Shard of the calling thread, threads are spread round robin.
+    inline size_t getMetricShard() {
+        static std::atomic<size_t> theNext(0);
+        static thread_local const size_t theShard = theNext.fetch_add(1, std::memory_order_relaxed);
+        return theShard;
+    }
+
+    /**
+     * Monotonic counter. Every thread adds to its own cache line, the
+     * shards are summed when read.
+     */
+    class Counter {
+    public:
+        static constexpr size_t K_SHARDS = 16;
+
+        Counter();
+
+        /// @brief Over aligned, so allocated by posix_memalign().
+        static void *operator new(const size_t pSize);
+
+        static void operator delete(void *pPtr);
+
+        void inc(const uint64_t pBy = 1) {
+            m_Shards[getMetricShard() % K_SHARDS].m_Value.fetch_add(pBy, std::memory_order_relaxed);
+        }
+
+        uint64_t getValue() const;
+
+    private:
+        struct alignas(64) Cell {
+            std::atomic<uint64_t> m_Value;
+        };
+
+        std::array<Cell, K_SHARDS> m_Shards;
+    };
+
+    /// @brief Value which goes up and down, fe. the count of loaded keys.
+    class Gauge {
+    public:
+        Gauge() : m_Value(0) {
+        }
+
+        void set(const int64_t pValue) {
+            m_Value.store(pValue, std::memory_order_relaxed);
+        }
+
+        void add(const int64_t pBy) {
+            m_Value.fetch_add(pBy, std::memory_order_relaxed);
+        }
+
+        int64_t getValue() const {
+            return m_Value.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<int64_t> m_Value;
+    };
+
+    /**
+     * Latency histogram in nanoseconds with HDR-like log-linear buckets:
+     * every power of two is split into 2^K_SUB_BITS buckets, so a recorded
+     * value is known within 12.5%. Values below 2^K_SUB_BITS get a bucket
+     * of their own, values from 2^K_MAX_EXP on land in the last one.
+     *
+     * Like Counter, each thread records into its own shard, getSnapshot()
+     * merges them.
+     */
+    class Histogram {
+    public:
+        using Clock_t = std::chrono::steady_clock;
+
+        static constexpr unsigned K_SUB_BITS = 3;
+        static constexpr unsigned K_MAX_EXP = 40;    //< ~18 minutes
+        static constexpr size_t K_BUCKETS = size_t(K_MAX_EXP - K_SUB_BITS + 1) << K_SUB_BITS;
+        static constexpr size_t K_SHARDS = 8;
+
+        /// @brief Merged view of all shards.
+        struct Snapshot {
+            std::vector<uint64_t> m_Buckets;
+            uint64_t m_Count;
+            uint64_t m_SumNs;
+
+            /// @brief Upper bound of the bucket holding the pQuantile (0..1) value.
+            uint64_t getQuantileNs(const double pQuantile) const;
+
+            /// @brief Count of values below 2^pExp ns.
+            uint64_t getCountBelowPow2(const unsigned pExp) const;
+        };
+
+        Histogram();
+
+        virtual ~Histogram();
+
+        void record(const uint64_t pNs) {
+            Shard &myShard = m_Shards[getMetricShard() % K_SHARDS];
+            myShard.m_Buckets[getBucket(pNs)].fetch_add(1, std::memory_order_relaxed);
+            myShard.m_SumNs.fetch_add(pNs, std::memory_order_relaxed);
+        }
+
+        void record(const Clock_t::duration pDuration) {
+            record(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(pDuration).count()));
+        }
+
+        Snapshot getSnapshot() const;
+
+        static size_t getBucket(const uint64_t pNs) {
+            if (pNs < (uint64_t(1) << K_SUB_BITS)) {
+                return size_t(pNs);
+            }
+            if (pNs >= (uint64_t(1) << K_MAX_EXP)) {
+                return K_BUCKETS - 1;
+            }
+            const unsigned myExp = 63 - unsigned(__builtin_clzll(pNs));
+            const unsigned myShift = myExp - K_SUB_BITS;
+            return (size_t(myShift + 1) << K_SUB_BITS) + size_t((pNs >> myShift) & ((1 << K_SUB_BITS) - 1));
+        }
+
+        /// @brief Smallest value of pBucket.
+        static uint64_t getLowerBound(const size_t pBucket);
+
+    private:
+        struct alignas(64) Shard {
+            std::array<std::atomic<uint64_t>, K_BUCKETS> m_Buckets;
+            std::atomic<uint64_t> m_SumNs;
+        };
+
+        /// @brief posix_memalign()ed, the shards need no destructor.
+        std::unique_ptr<Shard[], void (*)(void *)> m_Shards;
+    };
+
+    /// @brief Records the time from its construction to its destruction.
+    class ScopedLatency {
+    public:
+        explicit ScopedLatency(Histogram &pHistogram) //
+                : m_Histogram(pHistogram), m_Start(Histogram::Clock_t::now()) {
+        }
+
+        ~ScopedLatency() {
+            m_Histogram.record(Histogram::Clock_t::now() - m_Start);
+        }
+
+    private:
+        Histogram &m_Histogram;
+        const Histogram::Clock_t::time_point m_Start;
+    };
+
+    /**
+     * Named metrics of the process, written in the Prometheus text format.
+     *
+     * A metric is identified by its name and label set, fe.
+     * `status="ok"`. Getting a metric takes a lock, callers keep the
+     * returned reference which stays valid for the life of the registry;
+     * updating it is lock free.
+     */
+    class Metrics {
+    public:
+        enum EType {
+            ECounter,
+            EGauge,
+            EHistogram
+        };
+
+        Metrics();
+
+        virtual ~Metrics();
+
+        /// @throw std::invalid_argument when pName is registered with another type.
+        Counter &getCounter(const std::string &pName, const std::string &pHelp,
+                            const std::string &pLabels = "");
+
+        /// @throw std::invalid_argument when pName is registered with another type.
+        Gauge &getGauge(const std::string &pName, const std::string &pHelp,
+                        const std::string &pLabels = "");
+
+        /// @throw std::invalid_argument when pName is registered with another type.
+        Histogram &getHistogram(const std::string &pName, const std::string &pHelp,
+                                const std::string &pLabels = "");
+
+        /// @brief Prometheus text exposition format 0.0.4, histograms in seconds.
+        void writePrometheus(std::ostream &pOut) const;
+
+        static const std::string &getTypeStr(const EType pType);
+
+    private:
+        struct Family {
+            EType m_Type;
+            std::string m_Help;
+            std::map<std::string, std::unique_ptr<Counter> > m_Counters;
+            std::map<std::string, std::unique_ptr<Gauge> > m_Gauges;
+            std::map<std::string, std::unique_ptr<Histogram> > m_Histograms;
+        };
+
+        Family &getFamily(const std::string &pName, const std::string &pHelp, const EType pType);
+
+        mutable std::mutex m_Mutex;
+        std::map<std::string, Family> m_Families;
+    };
+
+    /// @brief Registry of the process.
+    Metrics &getMetrics();
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_METRICS_HPP_ */
@@ -0,0 +1,324 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavMmapKeyStore.hpp"
+#include "trihlavLib/trihlavBinaryKeystore.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+
+using std::string;
+using boost::filesystem::path;
+
+namespace trihlav {
+
+    MmapKeyStore::MmapKeyStore(KeyManager &pKeyManager) //
+            : KeyStore(pKeyManager), m_Files(pKeyManager) //
+    {
+    }
+
+    MmapKeyStore::~MmapKeyStore() {
+    }
+
+    const string &MmapKeyStore::getName() const {
+        return Settings::getKeyStoreStr(Settings::EMmapFile);
+    }
+
+    const path MmapKeyStore::getLocation() const {
+        return getKeyManager().getKeystoreFilename();
+    }
+
+    std::shared_ptr<BinaryKeystore> MmapKeyStore::map() {
+        const path myFilename{getLocation()};
+        if (!exists(myFilename)) {
+            return std::shared_ptr<BinaryKeystore>();
+        }
+        try {
+            return std::make_shared<BinaryKeystore>(myFilename, isWritable());
+        } catch (std::exception &myExc) {
+            TRIHLAV_LOG(error) << "Exception caugh while loading keystore " << myFilename << " - " << myExc.what();
+        }
+        if (isWritable()) {
+            getKeyManager().prefixKeyFile(myFilename, "damaged");
+        }
+        return std::shared_ptr<BinaryKeystore>();
+    }
+
+    std::shared_ptr<BinaryKeystore> MmapKeyStore::getKeystore() {
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        if (!m_Keystore) {
+            m_Keystore = map();
+        }
+        return m_Keystore;
+    }
+
+/**
+ * The keystore is mapped anew, keys of an older load keep their mapping.
+ * The records are sorted already, the key files are merged in.
+ */
+    void MmapKeyStore::load(KeyList_t &pKeys) {
+        TRIHLAV_TRACE_SCOPE("MmapKeyStore::load");
+        KeyList_t myFiles;
+        m_Files.load(myFiles);
+        KeyList_t myStored;
+        std::shared_ptr<BinaryKeystore> myKeystore = map();
+        if (myKeystore) {
+            try {
+                const size_t myCnt = myKeystore->getRecordCount();
+                myStored.reserve(myCnt);
+                for (size_t myRec = 0; myRec < myCnt; ++myRec) {
+                    if (!myKeystore->isDeleted(myRec)) {
+                        KeyPtr_t myKey = std::make_shared<YubikoOtpKeyConfig>(getKeyManager(), path());
+                        myKey->load(myKeystore, myRec);
+                        myStored.emplace_back(myKey);
+                    }
+                }
+            } catch (std::exception &myExc) {
+                TRIHLAV_LOG(error) << "Exception caugh while loading keystore " << getLocation() << " - "
+                                   << myExc.what();
+                myStored.clear();
+                myKeystore.reset();
+                if (isWritable()) {
+                    getKeyManager().prefixKeyFile(getLocation(), "damaged");
+                }
+            }
+        }
+        {
+            std::lock_guard<std::mutex> myLock(m_Mutex);
+            m_Keystore = myKeystore;
+        }
+        const auto myByPublicId = [](const KeyPtr_t &pA, const KeyPtr_t &pB) {
+            return pA->getPublicId() < pB->getPublicId();
+        };
+        if (!std::is_sorted(myStored.begin(), myStored.end(), myByPublicId)) {
+            std::sort(myStored.begin(), myStored.end(), myByPublicId);
+        }
+        pKeys.reserve(pKeys.size() + myFiles.size() + myStored.size());
+        auto myFile = myFiles.begin();
+        for (const KeyPtr_t &myKey : myStored) {
+            while (myFile != myFiles.end() && (*myFile)->getPublicId() < myKey->getPublicId()) {
+                pKeys.push_back(*myFile++);
+            }
+            if (myFile != myFiles.end() && (*myFile)->getPublicId() == myKey->getPublicId()) {
+                TRIHLAV_LOG(debug) << "Key " << myKey->getPublicId() << " of the keystore is replaced by a key file.";
+            } else {
+                pKeys.push_back(myKey);
+            }
+        }
+        pKeys.insert(pKeys.end(), myFile, myFiles.end());
+    }
+
+    MmapKeyStore::KeyPtr_t MmapKeyStore::get(const string &pPubId) {
+        KeyPtr_t myKey = m_Files.get(pPubId);
+        if (myKey) {
+            return myKey;
+        }
+        std::shared_ptr<BinaryKeystore> myKeystore = getKeystore();
+        const int64_t myRec = myKeystore ? myKeystore->find(pPubId) : -1;
+        if (myRec >= 0) {
+            myKey = std::make_shared<YubikoOtpKeyConfig>(getKeyManager(), path());
+            myKey->load(myKeystore, size_t(myRec));
+        }
+        return myKey;
+    }
+
+/**
+ * Only the public IDs of the records are read, no key is built. The key
+ * files override records like in load().
+ */
+    void MmapKeyStore::loadLocations(std::vector<Location> &pLocations) {
+        TRIHLAV_TRACE_SCOPE("MmapKeyStore::loadLocations");
+        std::vector<Location> myFiles;
+        m_Files.loadLocations(myFiles);
+        const auto myById = [](const Location &pA, const Location &pB) {
+            return pA.m_Id < pB.m_Id;
+        };
+        std::sort(myFiles.begin(), myFiles.end(), myById);
+        std::vector<Location> myStored;
+        std::shared_ptr<BinaryKeystore> myKeystore = map();
+        if (myKeystore) {
+            try {
+                const size_t myCnt = myKeystore->getRecordCount();
+                myStored.reserve(myCnt);
+                for (size_t myRec = 0; myRec < myCnt; ++myRec) {
+                    if (myKeystore->isDeleted(myRec)) {
+                        continue;
+                    }
+                    Location myLocation;
+                    myLocation.m_Id = PublicId(myKeystore->getString(myKeystore->getRecord(myRec).m_PublicId));
+                    myLocation.m_Record = int64_t(myRec);
+                    if (std::binary_search(myFiles.begin(), myFiles.end(), myLocation, myById)) {
+                        TRIHLAV_LOG(debug) << "Key " << myLocation.m_Id.toString()
+                                           << " of the keystore is replaced by a key file.";
+                    } else {
+                        myStored.emplace_back(std::move(myLocation));
+                    }
+                }
+            } catch (std::exception &myExc) {
+                TRIHLAV_LOG(error) << "Exception caugh while loading keystore " << getLocation() << " - "
+                                   << myExc.what();
+                myStored.clear();
+                myKeystore.reset();
+                if (isWritable()) {
+                    getKeyManager().prefixKeyFile(getLocation(), "damaged");
+                }
+            }
+        }
+        {
+            std::lock_guard<std::mutex> myLock(m_Mutex);
+            m_Keystore = myKeystore;
+        }
+        pLocations.reserve(pLocations.size() + myFiles.size() + myStored.size());
+        pLocations.insert(pLocations.end(), std::make_move_iterator(myFiles.begin()),
+                          std::make_move_iterator(myFiles.end()));
+        pLocations.insert(pLocations.end(), std::make_move_iterator(myStored.begin()),
+                          std::make_move_iterator(myStored.end()));
+    }
+
+/**
+ * The record is taken from the current mapping. When a later
+ * loadLocations() mapped a rewritten keystore, the record number may point
+ * to another key, the public ID is looked up then.
+ */
+    MmapKeyStore::KeyPtr_t MmapKeyStore::loadKey(const Location &pLocation) {
+        if (!pLocation.m_Filename.empty()) {
+            return m_Files.loadKey(pLocation);
+        }
+        try {
+            const std::shared_ptr<BinaryKeystore> myKeystore = getKeystore();
+            if (!myKeystore) {
+                return KeyPtr_t();
+            }
+            int64_t myRec = pLocation.m_Record;
+            if (myRec < 0 || size_t(myRec) >= myKeystore->getRecordCount() || myKeystore->isDeleted(size_t(myRec))
+                || PublicId(myKeystore->getString(myKeystore->getRecord(size_t(myRec)).m_PublicId))
+                   != pLocation.m_Id) {
+                myRec = myKeystore->find(pLocation.m_Id.toString());
+            }
+            if (myRec < 0) {
+                return KeyPtr_t();
+            }
+            KeyPtr_t myKey = std::make_shared<YubikoOtpKeyConfig>(getKeyManager(), path());
+            myKey->load(myKeystore, size_t(myRec));
+            return myKey;
+        } catch (std::exception &myExc) {
+            TRIHLAV_LOG(error) << "Failed to load the key " << pLocation.m_Id.toString() << " from " << getLocation()
+                               << " - " << myExc.what();
+        }
+        return KeyPtr_t();
+    }
+
+/**
+ * A key of the keystore moves into a new key file, which takes precedence
+ * over the keystore. Its record is deleted, fe. the public ID could have
+ * changed.
+ */
+    void MmapKeyStore::put(YubikoOtpKeyConfig &pKey) {
+        checkWritable();
+        const std::shared_ptr<BinaryKeystore> myKeystore{pKey.getKeystore()};
+        const int64_t myRec = pKey.getStoreRecord();
+        if (myKeystore) {
+            pKey.setStoreRecord(-1);
+            pKey.generateFilename();
+        }
+        m_Files.put(pKey);
+        if (myKeystore) {
+            std::lock_guard<std::mutex> myLock(m_Mutex);
+            myKeystore->erase(size_t(myRec));
+            myKeystore->sync();
+        }
+    }
+
+/**
+ * A record hidden by the deleted key file is deleted too, it would come
+ * back otherwise.
+ */
+    void MmapKeyStore::erase(YubikoOtpKeyConfig &pKey) {
+        checkWritable();
+        std::shared_ptr<BinaryKeystore> myKeystore{pKey.getKeystore()};
+        int64_t myRec = pKey.getStoreRecord();
+        if (!myKeystore) {
+            m_Files.erase(pKey);
+            myKeystore = getKeystore();
+            myRec = myKeystore ? myKeystore->find(pKey.getPublicId()) : -1;
+        }
+        if (myKeystore && myRec >= 0) {
+            std::lock_guard<std::mutex> myLock(m_Mutex);
+            myKeystore->erase(size_t(myRec));
+            myKeystore->sync();
+        }
+    }
+
+/**
+ * The counters of a key of a replaced keystore are not written, they stay
+ * journaled until the keys are loaded from the new one.
+ * @throw std::runtime_error when the keystore of pKey was replaced.
+ */
+    bool MmapKeyStore::saveCounters(const YubikoOtpKeyConfig &pKey) {
+        checkWritable();
+        const std::shared_ptr<BinaryKeystore> &myKeystore = pKey.getKeystore();
+        if (!myKeystore) {
+            return m_Files.saveCounters(pKey);
+        }
+        if (myKeystore->isReplaced()) {
+            throw std::runtime_error("Keystore " + myKeystore->getFilename().string() + " was replaced.");
+        }
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        myKeystore->saveCounters(size_t(pKey.getStoreRecord()), pKey.getToken());
+        if (std::find(m_Unsynced.begin(), m_Unsynced.end(), myKeystore) == m_Unsynced.end()) {
+            m_Unsynced.push_back(myKeystore);
+        }
+        return true;
+    }
+
+    void MmapKeyStore::sync() {
+        TRIHLAV_TRACE_SCOPE("MmapKeyStore::sync");
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        for (const auto &myKeystore : m_Unsynced) {
+            myKeystore->sync();
+        }
+        m_Unsynced.clear();
+    }
+
+/**
+ * A running server keeps the old keystore mapped until its next load().
+ */
+    size_t MmapKeyStore::write(const std::vector<const YubikoOtpKeyConfig *> &pKeys) {
+        checkWritable();
+        return BinaryKeystore::write(getLocation(), pKeys);
+    }
+
+    void MmapKeyStore::saveSnapshot() {
+        m_Files.saveSnapshot();
+    }
+
+} /* namespace trihlav */
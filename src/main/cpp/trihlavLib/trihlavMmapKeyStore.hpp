@@ -0,0 +1,100 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_MMAP_KEY_STORE_HPP_
+#define TRIHLAV_MMAP_KEY_STORE_HPP_
+
+#include <mutex>
+#include <vector>
+#include <memory>
+
+#include "trihlavLib/trihlavJsonDirKeyStore.hpp"
+
+namespace trihlav {
+
+    class BinaryKeystore;
+
+    /**
+     * Keys in the memory mapped keystore, @see BinaryKeystore, overlaid by
+     * the JSON key files.
+     *
+     * A key file takes precedence over a record with the same public ID.
+     * Records are written in bulk by write(), fe. by trihlavConvertKeys,
+     * and their counters in place. A key edited in the UI moves into a new
+     * key file, its record is marked deleted.
+     */
+    class MmapKeyStore : public KeyStore {
+    public:
+        explicit MmapKeyStore(KeyManager &pKeyManager);
+
+        virtual ~MmapKeyStore();
+
+        virtual const std::string &getName() const override;
+
+        /// @brief The keystore file, @see KeyManager::getKeystoreFilename()
+        virtual const boost::filesystem::path getLocation() const override;
+
+        virtual void load(KeyList_t &pKeys) override;
+
+        virtual KeyPtr_t get(const std::string &pPubId) override;
+
+        /// @brief The key files and the records they do not override, the keystore is mapped anew.
+        virtual void loadLocations(std::vector<Location> &pLocations) override;
+
+        virtual KeyPtr_t loadKey(const Location &pLocation) override;
+
+        virtual void put(YubikoOtpKeyConfig &pKey) override;
+
+        virtual void erase(YubikoOtpKeyConfig &pKey) override;
+
+        virtual bool saveCounters(const YubikoOtpKeyConfig &pKey) override;
+
+        virtual void sync() override;
+
+        /// @brief Replace the keystore, the key files stay as they are.
+        virtual size_t write(const std::vector<const YubikoOtpKeyConfig *> &pKeys) override;
+
+        /// @brief The snapshot of the overlaid key files.
+        virtual void saveSnapshot() override;
+
+    private:
+        /// @brief Map the keystore anew, a damaged one is renamed. @return empty when there is none.
+        std::shared_ptr<BinaryKeystore> map();
+
+        /// @brief The mapping of the last load(), mapped on first use.
+        std::shared_ptr<BinaryKeystore> getKeystore();
+
+        JsonDirKeyStore m_Files;
+        std::mutex m_Mutex;
+        std::shared_ptr<BinaryKeystore> m_Keystore;
+        std::vector<std::shared_ptr<BinaryKeystore> > m_Unsynced; //< with counters written since sync()
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_MMAP_KEY_STORE_HPP_ */
@@ -49,13 +49,11 @@
 
 #include <boost/filesystem/fstream.hpp>
 
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
-#include <boost/log/expressions.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
 
 #include "trihlavLib/trihlavOsIface.hpp"
 #include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavMetrics.hpp"
 
 using std::string;
 
@@ -76,7 +74,10 @@ namespace trihlav {
 
     bool OsIface::checkOsPswd(const string &p_strUName,
                               const string &p_strPswd) const {
-        BOOST_LOG_NAMED_SCOPE("OsIface::checkOsPswd");
+        TRIHLAV_TRACE_SCOPE("OsIface::checkOsPswd");
+        static Histogram &theLatency = getMetrics().getHistogram("trihlav_os_pswd_check_seconds",
+                                                                 "PAM authentication of a system user.");
+        const ScopedLatency myLatency(theLatency);
 
         const struct pam_conv local_conversation = {function_conversation, NULL};
         pam_handle_t *local_auth_handle = nullptr; // this gets set by pam_start
@@ -86,7 +87,7 @@ namespace trihlav {
                             &local_auth_handle);
 //	pam_set_item( local_auth_handle, PAM_AUTHTOK, p_strPswd.c_str());
         if (aRetVal != PAM_SUCCESS) {
-            BOOST_LOG_TRIVIAL(info) << "pam_start returned: " << aRetVal << " for user " << p_strUName;
+            TRIHLAV_LOG(info) << "pam_start returned: " << aRetVal << " for user " << p_strUName;
             return false;
         }
 
@@ -98,18 +99,18 @@ namespace trihlav {
 
         if (aRetVal != PAM_SUCCESS) {
             if (aRetVal == PAM_AUTH_ERR) {
-                BOOST_LOG_TRIVIAL(info) << "Authentication failure for user " << p_strUName;
+                TRIHLAV_LOG(info) << "Authentication failure for user " << p_strUName;
             } else {
-                BOOST_LOG_TRIVIAL(info) << "pam_authenticate returned: " << aRetVal << " for user " << p_strUName;
+                TRIHLAV_LOG(info) << "pam_authenticate returned: " << aRetVal << " for user " << p_strUName;
             }
             return false;
         }
-        BOOST_LOG_TRIVIAL(info) << "Authenticated user " << p_strUName;
+        TRIHLAV_LOG(info) << "Authenticated user " << p_strUName;
 
         aRetVal = pam_end(local_auth_handle, aRetVal);
 
         if (aRetVal != PAM_SUCCESS) {
-            BOOST_LOG_TRIVIAL(info) << "pam_authenticate returned: " << aRetVal << " for user " << p_strUName;
+            TRIHLAV_LOG(info) << "pam_authenticate returned: " << aRetVal << " for user " << p_strUName;
             return false;
         }
 
@@ -176,7 +177,7 @@ namespace trihlav {
  * @return The operating system users in a STL container.
  */
     const SysUsers OsIface::getSysUsers(const Settings &pSettings) const {
-        BOOST_LOG_NAMED_SCOPE("OsIface::getSysUsers");
+        TRIHLAV_TRACE_SCOPE("OsIface::getSysUsers");
         SysUsers myUsers;
 #ifdef __unix__
         static const std::regex K_PSWD_LN(
@@ -192,15 +193,15 @@ namespace trihlav {
                         myUsers.push_back(myUser);
                     }
                 } else {
-                    BOOST_LOG_TRIVIAL(warning) << "Line did not match: " << aReadLine;
+                    TRIHLAV_LOG(warning) << "Line did not match: " << aReadLine;
                 }
             }
         } else {
-            BOOST_LOG_TRIVIAL(error) << "Could not open '" << K_ETC_PASSWD << "'.";
+            TRIHLAV_LOG(error) << "Could not open '" << K_ETC_PASSWD << "'.";
         }
 #endif
 #ifdef __WINDOWS__
-        BOOST_LOG_TRIVIAL(error)<<"OsIface::getSysUsers() is not yet implemented on windows.";
+        TRIHLAV_LOG(error)<<"OsIface::getSysUsers() is not yet implemented on windows.";
 #endif
         return myUsers;
     }
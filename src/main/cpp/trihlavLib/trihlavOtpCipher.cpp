@@ -0,0 +1,353 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+#include "trihlavLib/trihlavOtpCipher.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define TRIHLAV_HAVE_AESNI 1
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+using std::string;
+
+namespace trihlav {
+
+    namespace {
+        constexpr int K_ROUNDS = 10;
+        constexpr size_t K_ROUND_KEY_WORDS = 4 * (K_ROUNDS + 1);
+
+        constexpr uint8_t K_SBOX[256] = {
+            0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+            0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+            0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+            0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+            0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+            0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+            0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+            0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+            0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+            0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+            0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+            0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+            0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+            0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+            0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+            0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+        };
+
+        constexpr uint8_t xtime(const uint8_t pVal) {
+            return static_cast<uint8_t>((pVal << 1) ^ ((pVal & 0x80) ? 0x1b : 0));
+        }
+
+        constexpr uint8_t gfMul(uint8_t pA, uint8_t pB) {
+            uint8_t myRetVal = 0;
+            while (pB != 0) {
+                if (pB & 1) {
+                    myRetVal ^= pA;
+                }
+                pA = xtime(pA);
+                pB >>= 1;
+            }
+            return myRetVal;
+        }
+
+        constexpr uint32_t rotr(const uint32_t pVal, const int pBits) {
+            return (pVal >> pBits) | (pVal << (32 - pBits));
+        }
+
+        /// @brief Inverse S-box and the four decryption T-tables, built at compile time.
+        struct DecTables {
+            uint8_t m_InvSbox[256];
+            uint32_t m_Td[4][256];
+
+            constexpr DecTables() : m_InvSbox{}, m_Td{} {
+                for (unsigned myI = 0; myI < 256; ++myI) {
+                    m_InvSbox[K_SBOX[myI]] = static_cast<uint8_t>(myI);
+                }
+                for (unsigned myI = 0; myI < 256; ++myI) {
+                    const uint8_t mySi = m_InvSbox[myI];
+                    const uint32_t myW = uint32_t(gfMul(mySi, 0x0e)) << 24 | uint32_t(gfMul(mySi, 0x09)) << 16
+                                         | uint32_t(gfMul(mySi, 0x0d)) << 8 | uint32_t(gfMul(mySi, 0x0b));
+                    m_Td[0][myI] = myW;
+                    m_Td[1][myI] = rotr(myW, 8);
+                    m_Td[2][myI] = rotr(myW, 16);
+                    m_Td[3][myI] = rotr(myW, 24);
+                }
+            }
+        };
+
+        constexpr DecTables K_DEC;
+
+        inline uint32_t getU32(const uint8_t *pBuf) {
+            return uint32_t(pBuf[0]) << 24 | uint32_t(pBuf[1]) << 16 | uint32_t(pBuf[2]) << 8 | pBuf[3];
+        }
+
+        inline void putU32(uint8_t *pBuf, const uint32_t pVal) {
+            pBuf[0] = static_cast<uint8_t>(pVal >> 24);
+            pBuf[1] = static_cast<uint8_t>(pVal >> 16);
+            pBuf[2] = static_cast<uint8_t>(pVal >> 8);
+            pBuf[3] = static_cast<uint8_t>(pVal);
+        }
+
+        inline uint32_t subWord(const uint32_t pVal) {
+            return uint32_t(K_SBOX[pVal >> 24]) << 24 | uint32_t(K_SBOX[(pVal >> 16) & 0xff]) << 16
+                   | uint32_t(K_SBOX[(pVal >> 8) & 0xff]) << 8 | K_SBOX[pVal & 0xff];
+        }
+
+        /// @brief FIPS-197 key expansion, big endian words.
+        void expandKey(const uint8_t *pKey, uint32_t *pW) {
+            for (int myI = 0; myI < 4; ++myI) {
+                pW[myI] = getU32(pKey + 4 * myI);
+            }
+            uint8_t myRcon = 0x01;
+            for (size_t myI = 4; myI < K_ROUND_KEY_WORDS; ++myI) {
+                uint32_t myT = pW[myI - 1];
+                if (myI % 4 == 0) {
+                    myT = subWord((myT << 8) | (myT >> 24)) ^ (uint32_t(myRcon) << 24);
+                    myRcon = xtime(myRcon);
+                }
+                pW[myI] = pW[myI - 4] ^ myT;
+            }
+        }
+
+        /// @brief Round keys of the equivalent inverse cipher, round order reversed.
+        void makePortableSchedule(const uint32_t *pW, uint32_t *pRk) {
+            for (int myR = 0; myR <= K_ROUNDS; ++myR) {
+                memcpy(pRk + 4 * myR, pW + 4 * (K_ROUNDS - myR), 4 * sizeof(uint32_t));
+            }
+            for (size_t myI = 4; myI < 4 * K_ROUNDS; ++myI) {
+                const uint32_t myK = pRk[myI];
+                pRk[myI] = K_DEC.m_Td[0][K_SBOX[myK >> 24]] ^ K_DEC.m_Td[1][K_SBOX[(myK >> 16) & 0xff]]
+                           ^ K_DEC.m_Td[2][K_SBOX[(myK >> 8) & 0xff]] ^ K_DEC.m_Td[3][K_SBOX[myK & 0xff]];
+            }
+        }
+
+        void decryptPortable(const uint32_t *pRk, uint8_t *pBlock) {
+            const uint32_t(&myTd)[4][256] = K_DEC.m_Td;
+            const uint8_t *mySi = K_DEC.m_InvSbox;
+            uint32_t myS0 = getU32(pBlock) ^ pRk[0];
+            uint32_t myS1 = getU32(pBlock + 4) ^ pRk[1];
+            uint32_t myS2 = getU32(pBlock + 8) ^ pRk[2];
+            uint32_t myS3 = getU32(pBlock + 12) ^ pRk[3];
+            for (int myR = 1; myR < K_ROUNDS; ++myR) {
+                pRk += 4;
+                const uint32_t myT0 = myTd[0][myS0 >> 24] ^ myTd[1][(myS3 >> 16) & 0xff]
+                                      ^ myTd[2][(myS2 >> 8) & 0xff] ^ myTd[3][myS1 & 0xff] ^ pRk[0];
+                const uint32_t myT1 = myTd[0][myS1 >> 24] ^ myTd[1][(myS0 >> 16) & 0xff]
+                                      ^ myTd[2][(myS3 >> 8) & 0xff] ^ myTd[3][myS2 & 0xff] ^ pRk[1];
+                const uint32_t myT2 = myTd[0][myS2 >> 24] ^ myTd[1][(myS1 >> 16) & 0xff]
+                                      ^ myTd[2][(myS0 >> 8) & 0xff] ^ myTd[3][myS3 & 0xff] ^ pRk[2];
+                const uint32_t myT3 = myTd[0][myS3 >> 24] ^ myTd[1][(myS2 >> 16) & 0xff]
+                                      ^ myTd[2][(myS1 >> 8) & 0xff] ^ myTd[3][myS0 & 0xff] ^ pRk[3];
+                myS0 = myT0;
+                myS1 = myT1;
+                myS2 = myT2;
+                myS3 = myT3;
+            }
+            pRk += 4;
+            putU32(pBlock, (uint32_t(mySi[myS0 >> 24]) << 24 | uint32_t(mySi[(myS3 >> 16) & 0xff]) << 16
+                            | uint32_t(mySi[(myS2 >> 8) & 0xff]) << 8 | mySi[myS1 & 0xff]) ^ pRk[0]);
+            putU32(pBlock + 4, (uint32_t(mySi[myS1 >> 24]) << 24 | uint32_t(mySi[(myS0 >> 16) & 0xff]) << 16
+                                | uint32_t(mySi[(myS3 >> 8) & 0xff]) << 8 | mySi[myS2 & 0xff]) ^ pRk[1]);
+            putU32(pBlock + 8, (uint32_t(mySi[myS2 >> 24]) << 24 | uint32_t(mySi[(myS1 >> 16) & 0xff]) << 16
+                                | uint32_t(mySi[(myS0 >> 8) & 0xff]) << 8 | mySi[myS3 & 0xff]) ^ pRk[2]);
+            putU32(pBlock + 12, (uint32_t(mySi[myS3 >> 24]) << 24 | uint32_t(mySi[(myS2 >> 16) & 0xff]) << 16
+                                 | uint32_t(mySi[(myS1 >> 8) & 0xff]) << 8 | mySi[myS0 & 0xff]) ^ pRk[3]);
+        }
+
+#ifdef TRIHLAV_HAVE_AESNI
+        /// @brief Decryption round keys from the expanded encryption key.
+        __attribute__((target("aes,sse2")))
+        void makeAesNiSchedule(const uint32_t *pW, uint32_t *pRk) {
+            uint8_t myEk[(K_ROUNDS + 1) * OtpCipher::K_BLOCK_SIZE];
+            for (size_t myI = 0; myI < K_ROUND_KEY_WORDS; ++myI) {
+                putU32(myEk + 4 * myI, pW[myI]);
+            }
+            for (int myR = 0; myR <= K_ROUNDS; ++myR) {
+                __m128i myK = _mm_loadu_si128(reinterpret_cast<const __m128i *>(myEk + 16 * (K_ROUNDS - myR)));
+                if (myR > 0 && myR < K_ROUNDS) {
+                    myK = _mm_aesimc_si128(myK);
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(pRk + 4 * myR), myK);
+            }
+        }
+
+        __attribute__((target("aes,sse2")))
+        void decryptAesNi(const uint32_t *pRk, uint8_t *pBlock) {
+            const __m128i *myRk = reinterpret_cast<const __m128i *>(pRk);
+            __m128i myB = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pBlock)),
+                                        _mm_loadu_si128(myRk));
+            for (int myR = 1; myR < K_ROUNDS; ++myR) {
+                myB = _mm_aesdec_si128(myB, _mm_loadu_si128(myRk + myR));
+            }
+            myB = _mm_aesdeclast_si128(myB, _mm_loadu_si128(myRk + K_ROUNDS));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pBlock), myB);
+        }
+
+        /// @brief Four independent blocks, interleaved to hide the aesdec latency.
+        __attribute__((target("aes,sse2")))
+        void decrypt4AesNi(const uint32_t *const *pRk, uint8_t *const *pBlocks) {
+            const __m128i *myRk0 = reinterpret_cast<const __m128i *>(pRk[0]);
+            const __m128i *myRk1 = reinterpret_cast<const __m128i *>(pRk[1]);
+            const __m128i *myRk2 = reinterpret_cast<const __m128i *>(pRk[2]);
+            const __m128i *myRk3 = reinterpret_cast<const __m128i *>(pRk[3]);
+            __m128i myB0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pBlocks[0])),
+                                         _mm_loadu_si128(myRk0));
+            __m128i myB1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pBlocks[1])),
+                                         _mm_loadu_si128(myRk1));
+            __m128i myB2 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pBlocks[2])),
+                                         _mm_loadu_si128(myRk2));
+            __m128i myB3 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pBlocks[3])),
+                                         _mm_loadu_si128(myRk3));
+            for (int myR = 1; myR < K_ROUNDS; ++myR) {
+                myB0 = _mm_aesdec_si128(myB0, _mm_loadu_si128(myRk0 + myR));
+                myB1 = _mm_aesdec_si128(myB1, _mm_loadu_si128(myRk1 + myR));
+                myB2 = _mm_aesdec_si128(myB2, _mm_loadu_si128(myRk2 + myR));
+                myB3 = _mm_aesdec_si128(myB3, _mm_loadu_si128(myRk3 + myR));
+            }
+            myB0 = _mm_aesdeclast_si128(myB0, _mm_loadu_si128(myRk0 + K_ROUNDS));
+            myB1 = _mm_aesdeclast_si128(myB1, _mm_loadu_si128(myRk1 + K_ROUNDS));
+            myB2 = _mm_aesdeclast_si128(myB2, _mm_loadu_si128(myRk2 + K_ROUNDS));
+            myB3 = _mm_aesdeclast_si128(myB3, _mm_loadu_si128(myRk3 + K_ROUNDS));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pBlocks[0]), myB0);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pBlocks[1]), myB1);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pBlocks[2]), myB2);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pBlocks[3]), myB3);
+        }
+#endif
+
+        bool detectAesNi() {
+#ifdef TRIHLAV_HAVE_AESNI
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("aes");
+#else
+            return false;
+#endif
+        }
+    }
+
+    constexpr size_t OtpCipher::K_BLOCK_SIZE;
+
+    bool OtpCipher::hasAesNi() {
+        static const bool myHasAesNi = detectAesNi();
+        return myHasAesNi;
+    }
+
+    const string OtpCipher::getImplStr(const EImpl pImpl) {
+        switch (pImpl) {
+            case EPortable:
+                return "portable";
+            case EAesNi:
+                return "aes-ni";
+            case EAuto:
+            default:
+                return "auto";
+        }
+    }
+
+/**
+ * EAesNi falls back to EPortable when the CPU lacks AES-NI.
+ */
+    OtpCipher::OtpCipher(const EImpl pImpl) //
+            : m_Impl(pImpl == EPortable || !hasAesNi() ? EPortable : EAesNi) //
+    {
+        const uint8_t myZeroKey[YUBIKEY_KEY_SIZE] = {};
+        setKey(myZeroKey);
+    }
+
+    OtpCipher::OtpCipher(const uint8_t *pKey, const EImpl pImpl) //
+            : OtpCipher(pImpl) //
+    {
+        setKey(pKey);
+    }
+
+    void OtpCipher::setKey(const uint8_t *pKey) {
+        uint32_t myW[K_ROUND_KEY_WORDS];
+        expandKey(pKey, myW);
+#ifdef TRIHLAV_HAVE_AESNI
+        if (m_Impl == EAesNi) {
+            makeAesNiSchedule(myW, m_RoundKeys.data());
+            return;
+        }
+#endif
+        makePortableSchedule(myW, m_RoundKeys.data());
+    }
+
+    void OtpCipher::decrypt(uint8_t *pBlock) const {
+#ifdef TRIHLAV_HAVE_AESNI
+        if (m_Impl == EAesNi) {
+            decryptAesNi(m_RoundKeys.data(), pBlock);
+            return;
+        }
+#endif
+        decryptPortable(m_RoundKeys.data(), pBlock);
+    }
+
+    void OtpCipher::parse(const char *pOtp, yubikey_token_st &pToken) const {
+        static_assert(sizeof(yubikey_token_st) == K_BLOCK_SIZE, "Token is not one AES block.");
+        memset(&pToken, 0, sizeof(pToken));
+        yubikey_modhex_decode(reinterpret_cast<char *>(&pToken), pOtp, sizeof(pToken));
+        decrypt(reinterpret_cast<uint8_t *>(&pToken));
+    }
+
+/**
+ * Groups of four AES-NI ciphers go through the interleaved path, the rest
+ * one by one.
+ */
+    void OtpCipher::parseBatch(const OtpCipher *const *pCiphers, const char *const *pOtps,
+                               yubikey_token_st *pTokens, const size_t pCount) {
+        for (size_t myI = 0; myI < pCount; ++myI) {
+            memset(pTokens + myI, 0, sizeof(yubikey_token_st));
+            yubikey_modhex_decode(reinterpret_cast<char *>(pTokens + myI), pOtps[myI], sizeof(yubikey_token_st));
+        }
+        size_t myI = 0;
+#ifdef TRIHLAV_HAVE_AESNI
+        for (; myI + 4 <= pCount; myI += 4) {
+            if (pCiphers[myI]->m_Impl != EAesNi || pCiphers[myI + 1]->m_Impl != EAesNi
+                || pCiphers[myI + 2]->m_Impl != EAesNi || pCiphers[myI + 3]->m_Impl != EAesNi) {
+                break;
+            }
+            const uint32_t *const myRk[4] = {pCiphers[myI]->m_RoundKeys.data(), pCiphers[myI + 1]->m_RoundKeys.data(),
+                                            pCiphers[myI + 2]->m_RoundKeys.data(),
+                                            pCiphers[myI + 3]->m_RoundKeys.data()};
+            uint8_t *const myBlocks[4] = {reinterpret_cast<uint8_t *>(pTokens + myI),
+                                          reinterpret_cast<uint8_t *>(pTokens + myI + 1),
+                                          reinterpret_cast<uint8_t *>(pTokens + myI + 2),
+                                          reinterpret_cast<uint8_t *>(pTokens + myI + 3)};
+            decrypt4AesNi(myRk, myBlocks);
+        }
+#endif
+        for (; myI < pCount; ++myI) {
+            pCiphers[myI]->decrypt(reinterpret_cast<uint8_t *>(pTokens + myI));
+        }
+    }
+
+} /* namespace trihlav */
@@ -0,0 +1,101 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_OTP_CIPHER_HPP_
+#define TRIHLAV_OTP_CIPHER_HPP_
+
+#include <array>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <yubikey.h>
+
+namespace trihlav {
+
+    /**
+     * AES-128 decryption of Yubikey OTPs with a cached key schedule.
+     *
+     * libyubikey expands the key schedule on every yubikey_parse(), here it
+     * is expanded once when the secret key is set and kept next to the key.
+     * Blocks are decrypted with AES-NI when the CPU has it, otherwise with a
+     * portable table driven implementation. parseBatch() interleaves several
+     * OTPs, so the AES unit pipeline stays busy during bulk validation.
+     */
+    class OtpCipher {
+    public:
+        /// @brief Which implementation decrypts.
+        enum EImpl {
+            EAuto,     //< AES-NI when available, resolved in the constructor
+            EPortable, //< plain C++ tables
+            EAesNi     //< x86 AES instructions
+        };
+
+        static constexpr size_t K_BLOCK_SIZE = YUBIKEY_BLOCK_SIZE;
+
+        /// @brief Cipher for the all zero key.
+        explicit OtpCipher(EImpl pImpl = EAuto);
+
+        /// @param pKey YUBIKEY_KEY_SIZE bytes of the secret key.
+        explicit OtpCipher(const uint8_t *pKey, EImpl pImpl = EAuto);
+
+        /// @brief Expand the key schedule for a new secret key.
+        void setKey(const uint8_t *pKey);
+
+        /// @brief Decrypt one block in place.
+        void decrypt(uint8_t *pBlock) const;
+
+        /**
+         * @brief Same as yubikey_parse() without the key expansion.
+         * @param pOtp modhex encoded, decoding stops at a terminating zero or
+         * after YUBIKEY_OTP_SIZE characters.
+         */
+        void parse(const char *pOtp, yubikey_token_st &pToken) const;
+
+        /// @brief parse() pCount OTPs, each with its own cipher.
+        static void parseBatch(const OtpCipher *const *pCiphers, const char *const *pOtps,
+                               yubikey_token_st *pTokens, size_t pCount);
+
+        EImpl getImpl() const {
+            return m_Impl;
+        }
+
+        /// @brief Does this CPU support AES-NI?
+        static bool hasAesNi();
+
+        static const std::string getImplStr(EImpl pImpl);
+
+    private:
+        EImpl m_Impl;
+        /// Decryption round keys of the 10 AES-128 rounds, AES-NI: 11 blocks
+        /// in decryption order, portable: 44 big endian words.
+        alignas(16) std::array<uint32_t, 4 * (10 + 1)> m_RoundKeys;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_OTP_CIPHER_HPP_ */
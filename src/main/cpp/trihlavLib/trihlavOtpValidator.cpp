@@ -0,0 +1,341 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <yubikey.h>
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavOtpValidator.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+#include "trihlavLib/trihlavCounterJournal.hpp"
+#include "trihlavLib/trihlavOtpCipher.hpp"
+#include "trihlavLib/trihlavRecentOtpCache.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavRateLimiter.hpp"
+
+using std::string;
+using std::vector;
+
+namespace trihlav {
+
+    static const string K_ST_OK("ok");
+    static const string K_ST_TOO_SHORT("too-short");
+    static const string K_ST_NO_PUBLIC_ID("no-public-id");
+    static const string K_ST_UNKNOWN_KEY("unknown-key");
+    static const string K_ST_WRONG_USER("wrong-user");
+    static const string K_ST_INVALID("invalid");
+    static const string K_ST_REPLAYED("replayed");
+    static const string K_ST_STORAGE_ERROR("storage-error");
+    static const string K_ST_RATE_LIMITED("rate-limited");
+
+    /// @brief Length checks shared by validate() and validateBatch(), EOk when passed.
+    static OtpValidator::EStatus checkLength(const string &pOtp) {
+        if (pOtp.size() < YUBIKEY_OTP_SIZE) {
+            return OtpValidator::ETooShort;
+        }
+        if (pOtp.size() == YUBIKEY_OTP_SIZE) {
+            return OtpValidator::ENoPublicId;
+        }
+        return OtpValidator::EOk;
+    }
+
+    /**
+     * The hash of the key's system user is compared first, the names only
+     * when the hashes are equal, so a key without one is not touched beyond
+     * its HotKey record.
+     */
+    static bool isWrongUser(const HotKey &pKey, const string &pSysUser) {
+        if (pSysUser.empty() || pKey.m_SysUserHash == 0) {
+            return false;
+        }
+        if (pKey.m_SysUserHash == HotKey::hashSysUser(pSysUser) && pKey.m_Cold->getSysUser() == pSysUser) {
+            return false;
+        }
+        TRIHLAV_LOG_LIMITED(info, 60) << "Key " << pKey.m_Cold->getPublicId() << " does not belong to " << pSysUser
+                                      << ".";
+        return true;
+    }
+
+    static OtpValidator::EStatus toStatus(const YubikoOtpKeyConfig::EOtpCheck pCheck) {
+        switch (pCheck) {
+            case YubikoOtpKeyConfig::EOtpOk:
+                return OtpValidator::EOk;
+            case YubikoOtpKeyConfig::EOtpReplayed:
+                return OtpValidator::EReplayed;
+            default:
+                return OtpValidator::EInvalid;
+        }
+    }
+
+    /// @brief Only these outcomes are final, all others may change fe. after a reload.
+    static bool isFinal(const OtpValidator::EStatus pStatus) {
+        return pStatus == OtpValidator::EOk || pStatus == OtpValidator::EReplayed;
+    }
+
+    /// @brief Room for every key, or the configured count when that is larger.
+    static size_t getLimiterSlots(const KeyManager &pKeyManager) {
+        return std::max(static_cast<size_t>(std::max(0, pKeyManager.getSettings().getRateLimitSlots())),
+                        2 * pKeyManager.getKeyCount());
+    }
+
+    OtpValidator::OtpValidator(KeyManager &pKeyManager) //
+            : m_KeyManager(pKeyManager), //
+              m_RecentOtps(new RecentOtpCache(
+                      static_cast<size_t>(std::max(0, pKeyManager.getSettings().getRecentOtpCapacity())),
+                      std::chrono::seconds(pKeyManager.getSettings().getRecentOtpWindowS()))), //
+              m_KeyLimiter(new RateLimiter(pKeyManager.getSettings().getKeyRatePerMin(),
+                                           pKeyManager.getSettings().getKeyBurst(),
+                                           getLimiterSlots(pKeyManager), RateLimiter::EFailOpen)), //
+              m_ClientLimiter(new RateLimiter(pKeyManager.getSettings().getClientRatePerMin(),
+                                              pKeyManager.getSettings().getClientBurst(),
+                                              getLimiterSlots(pKeyManager), RateLimiter::EFailClosed)) //
+    {
+    }
+
+    OtpValidator::~OtpValidator() {
+    }
+
+    const string &OtpValidator::getStatusStr(const OtpValidator::EStatus pStatus) {
+        switch (pStatus) {
+            case EOk:
+                return K_ST_OK;
+            case ETooShort:
+                return K_ST_TOO_SHORT;
+            case ENoPublicId:
+                return K_ST_NO_PUBLIC_ID;
+            case EUnknownKey:
+                return K_ST_UNKNOWN_KEY;
+            case EWrongUser:
+                return K_ST_WRONG_USER;
+            case EReplayed:
+                return K_ST_REPLAYED;
+            case EStorageError:
+                return K_ST_STORAGE_ERROR;
+            case ERateLimited:
+                return K_ST_RATE_LIMITED;
+            case EInvalid:
+            default:
+                return K_ST_INVALID;
+        }
+    }
+
+/**
+ * IPv6 clients usually get a whole /64, so they share the bucket of their
+ * prefix instead of taking a new one with every address.
+ */
+    static uint64_t getClientHash(const string &pAddress) {
+        in6_addr myAddr;
+        if (pAddress.find(':') != string::npos && inet_pton(AF_INET6, pAddress.c_str(), &myAddr) == 1
+            && !IN6_IS_ADDR_V4MAPPED(&myAddr)) {
+            return std::hash<string>()(string(reinterpret_cast<const char *>(myAddr.s6_addr), 8));
+        }
+        return std::hash<string>()(pAddress);
+    }
+
+    bool OtpValidator::admitClient(const string &pAddress) {
+        if (m_ClientLimiter->tryTake(getClientHash(pAddress))) {
+            return true;
+        }
+        TRIHLAV_LOG(debug) << "Client " << pAddress << " is rate limited.";
+        return false;
+    }
+
+    bool OtpValidator::admitKey(const PublicId &pPubId) {
+        if (m_KeyLimiter->tryTake(pPubId.hash())) {
+            return true;
+        }
+        TRIHLAV_LOG(debug) << "Key " << pPubId.toString() << " is rate limited.";
+        return false;
+    }
+
+/**
+ * Passwords seen recently are answered from the cache. Otherwise the
+ * key is looked up by the public ID prefix, the remaining
+ * YUBIKEY_OTP_SIZE characters are decrypted and checked by
+ * YubikoOtpKeyConfig::verifyOtp, unless the key ran out of its rate limit
+ * tokens. Only the key's HotKey record and key schedule are read, unless
+ * the OTP is accepted or the key has a system user. Validation and the counter update happen
+ * under the key's mutex, @see KeyManager::withLockedHotKey(), so the same
+ * password can't be accepted twice while other keys are validated in
+ * parallel. The mutex is released before waiting for the journal flush, so
+ * concurrent validations can share one flush. Accepted and replayed
+ * passwords are remembered only once their counters are durable.
+ */
+    OtpValidator::EStatus OtpValidator::validate(const string &pOtp, const string &pSysUser, const string &pNonce,
+                                                 const string &pClient) {
+        TRIHLAV_TRACE_SCOPE("OtpValidator::validate");
+        const EStatus myLenStatus = checkLength(pOtp);
+        if (myLenStatus != EOk) {
+            return myLenStatus;
+        }
+        EStatus myCached;
+        if (m_RecentOtps->lookup(pOtp, pNonce, pSysUser, pClient, myCached)) {
+            TRIHLAV_LOG(debug) << "Recently seen, " << getStatusStr(myCached) << ".";
+            return myCached;
+        }
+        const size_t myPfxLen{pOtp.size() - YUBIKEY_OTP_SIZE};
+        const PublicId myPrefix(pOtp.data(), myPfxLen);
+        bool myWrongUser = false;
+        bool myLimited = false;
+        YubikoOtpKeyConfig::EOtpCheck myCheck = YubikoOtpKeyConfig::EOtpWrongUid;
+        uint64_t myCommit = 0;
+        try {
+            const bool myFound = m_KeyManager.withLockedHotKey(myPrefix, [&](HotKey &pKey) {
+                if (!admitKey(myPrefix)) {
+                    myLimited = true;
+                    return;
+                }
+                if (isWrongUser(pKey, pSysUser)) {
+                    myWrongUser = true;
+                    return;
+                }
+                myCheck = YubikoOtpKeyConfig::verifyOtp(pKey, pOtp.c_str() + myPfxLen);
+                if (myCheck == YubikoOtpKeyConfig::EOtpOk) {
+                    m_KeyManager.journalCounters(*pKey.m_Cold);
+                    myCommit = m_KeyManager.getJournal().getWrittenSeq();
+                }
+            });
+            if (!myFound) {
+                return EUnknownKey;
+            }
+            if (myLimited) {
+                return ERateLimited;
+            }
+            if (myWrongUser) {
+                return EWrongUser;
+            }
+            if (myCheck == YubikoOtpKeyConfig::EOtpOk) {
+                m_KeyManager.getJournal().waitDurable(myCommit);
+                m_KeyManager.compactJournalIfFull();
+            }
+        } catch (const std::exception &myExc) {
+            TRIHLAV_LOG_LIMITED(error, 10) << "Failed to store counters of key " << myPrefix.toString() << " - "
+                                           << myExc.what();
+            return EStorageError;
+        }
+        const EStatus myRetVal = toStatus(myCheck);
+        if (isFinal(myRetVal)) {
+            m_RecentOtps->insert(pOtp, pNonce, pSysUser, pClient, myRetVal);
+        }
+        return myRetVal;
+    }
+
+/**
+ * The tokens of all known keys are decrypted together, @see
+ * OtpCipher::parseBatch(), then checked one by one under the key's mutex
+ * as validate() does. All accepted passwords share one journal flush.
+ * Recently seen passwords are rejected as replays up front.
+ */
+    vector<OtpValidator::EStatus> OtpValidator::validateBatch(const vector<string> &pOtps, const string &pSysUser) {
+        TRIHLAV_TRACE_SCOPE("OtpValidator::validateBatch");
+        vector<EStatus> myRetVal(pOtps.size(), EInvalid);
+        // Keeps the looked up keys alive while their tokens are decrypted.
+        const KeyManager::KeyIndexPtr_t myIndex = m_KeyManager.getIndex();
+        vector<size_t> myPending;
+        vector<const HotKey *> myKeys;
+        vector<const OtpCipher *> myCiphers;
+        vector<const char *> myTails;
+        for (size_t myI = 0; myI < pOtps.size(); ++myI) {
+            const string &myOtp = pOtps[myI];
+            myRetVal[myI] = checkLength(myOtp);
+            if (myRetVal[myI] != EOk || m_RecentOtps->lookup(myOtp, "", pSysUser, "", myRetVal[myI])) {
+                continue;
+            }
+            const size_t myPfxLen{myOtp.size() - YUBIKEY_OTP_SIZE};
+            const HotKey *myKey = m_KeyManager.findHotKey(*myIndex, PublicId(myOtp.data(), myPfxLen));
+            if (myKey == 0) {
+                myRetVal[myI] = EUnknownKey;
+                continue;
+            }
+            myPending.push_back(myI);
+            myKeys.push_back(myKey);
+            myCiphers.push_back(&myKey->getCipher());
+            myTails.push_back(myOtp.c_str() + myPfxLen);
+        }
+        vector<yubikey_token_st> myTokens(myPending.size());
+        OtpCipher::parseBatch(myCiphers.data(), myTails.data(), myTokens.data(), myPending.size());
+        uint64_t myCommit = 0;
+        for (size_t myJ = 0; myJ < myPending.size(); ++myJ) {
+            const size_t myI = myPending[myJ];
+            const PublicId myPrefix(pOtps[myI].data(), pOtps[myI].size() - YUBIKEY_OTP_SIZE);
+            bool myWrongUser = false;
+            bool myLimited = false;
+            YubikoOtpKeyConfig::EOtpCheck myCheck = YubikoOtpKeyConfig::EOtpWrongUid;
+            try {
+                const bool myFound = m_KeyManager.withLockedHotKey(myPrefix, [&](HotKey &pKey) {
+                    if (!admitKey(myPrefix)) {
+                        myLimited = true;
+                        return;
+                    }
+                    if (isWrongUser(pKey, pSysUser)) {
+                        myWrongUser = true;
+                        return;
+                    }
+                    if (&pKey != myKeys[myJ]) {
+                        // Reloaded meanwhile, the secret key might have changed.
+                        pKey.getCipher().parse(myTails[myJ], myTokens[myJ]);
+                    }
+                    myCheck = YubikoOtpKeyConfig::verifyToken(pKey, myTokens[myJ]);
+                    if (myCheck == YubikoOtpKeyConfig::EOtpOk) {
+                        m_KeyManager.journalCounters(*pKey.m_Cold);
+                        myCommit = m_KeyManager.getJournal().getWrittenSeq();
+                    }
+                });
+                myRetVal[myI] = !myFound ? EUnknownKey : myLimited ? ERateLimited : myWrongUser ? EWrongUser
+                                                                                                 : toStatus(myCheck);
+            } catch (const std::exception &myExc) {
+                TRIHLAV_LOG_LIMITED(error, 10) << "Failed to store counters of key " << myPrefix.toString() << " - "
+                                               << myExc.what();
+                myRetVal[myI] = EStorageError;
+            }
+        }
+        if (myCommit > 0) {
+            try {
+                m_KeyManager.getJournal().waitDurable(myCommit);
+                m_KeyManager.compactJournalIfFull();
+            } catch (const std::exception &myExc) {
+                TRIHLAV_LOG_LIMITED(error, 10) << "Failed to store counters - " << myExc.what();
+                for (EStatus &myStatus : myRetVal) {
+                    if (myStatus == EOk) {
+                        myStatus = EStorageError;
+                    }
+                }
+            }
+        }
+        for (const size_t myI : myPending) {
+            if (isFinal(myRetVal[myI])) {
+                m_RecentOtps->insert(pOtps[myI], "", pSysUser, "", myRetVal[myI]);
+            }
+        }
+        return myRetVal;
+    }
+
+} /* namespace trihlav */
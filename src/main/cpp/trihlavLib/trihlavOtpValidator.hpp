@@ -0,0 +1,130 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_OTP_VALIDATOR_HPP_
+#define TRIHLAV_OTP_VALIDATOR_HPP_
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace trihlav {
+
+    class KeyManager;
+
+    class RecentOtpCache;
+
+    class RateLimiter;
+
+    class PublicId;
+
+    /**
+     * Validates complete one time passwords (public ID prefix followed by the
+     * encrypted token) against the keys already loaded in a KeyManager.
+     *
+     * Neither the key directory is scanned nor key files are parsed while
+     * validating, the keys have to be loaded upfront by KeyManager::loadKeys().
+     * One instance is shared by all request threads.
+     *
+     * Accepted and replayed passwords are remembered for a while, @see
+     * RecentOtpCache, so replays are rejected before any decryption.
+     * Attempts are rate limited per key and per client address, @see
+     * RateLimiter, also before any decryption or storage work.
+     */
+    class OtpValidator {
+    public:
+        /// @brief Machine readable outcome of a validation.
+        enum EStatus {
+            EOk,            //< password accepted
+            ETooShort,      //< shorter than an encrypted token
+            ENoPublicId,    //< keys without public ID prefix are not supported
+            EUnknownKey,    //< no key with such public ID prefix
+            EWrongUser,     //< key is assigned to another system user
+            EInvalid,       //< failed to decrypt, wrong private ID or CRC
+            EReplayed,      //< password was already used
+            EStorageError,  //< counters could not be persisted, not accepted
+            ERateLimited    //< too many attempts with this key or from this client
+        };
+
+        explicit OtpValidator(KeyManager &pKeyManager);
+
+        virtual ~OtpValidator();
+
+        /**
+         * @brief Check one modhex encoded password.
+         * @param pOtp public ID followed by the encrypted token.
+         * @param pSysUser when not empty, the key has to be assigned to this user.
+         * @param pNonce chosen by the client, a prompt retry with the same nonce
+         *        gets the original status instead of EReplayed, @see RecentOtpCache.
+         * @param pClient address of the client, a retry has to come from it.
+         */
+        EStatus validate(const std::string &pOtp, const std::string &pSysUser = "",
+                         const std::string &pNonce = "", const std::string &pClient = "");
+
+        /**
+         * @brief Check many passwords at once, fe. for bulk validation.
+         * @return the status of each password, in the same order.
+         * @see validate(const std::string&, const std::string&)
+         */
+        std::vector<EStatus> validateBatch(const std::vector<std::string> &pOtps, const std::string &pSysUser = "");
+
+        /// @brief Take a token of the client's rate limit bucket, false when exhausted or not placeable.
+        bool admitClient(const std::string &pAddress);
+
+        /// @brief Take a token of the key's rate limit bucket, false when exhausted.
+        bool admitKey(const PublicId &pPubId);
+
+        /// @brief Short, stable status name used in responses.
+        static const std::string &getStatusStr(const EStatus pStatus);
+
+        KeyManager &getKeyManager() {
+            return m_KeyManager;
+        }
+
+        RecentOtpCache &getRecentOtps() {
+            return *m_RecentOtps;
+        }
+
+        RateLimiter &getKeyLimiter() {
+            return *m_KeyLimiter;
+        }
+
+        RateLimiter &getClientLimiter() {
+            return *m_ClientLimiter;
+        }
+
+    private:
+        KeyManager &m_KeyManager;
+        std::unique_ptr<RecentOtpCache> m_RecentOtps;
+        std::unique_ptr<RateLimiter> m_KeyLimiter;     //< by PublicId::hash()
+        std::unique_ptr<RateLimiter> m_ClientLimiter;  //< by address hash, IPv6 by /64, fails closed
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_OTP_VALIDATOR_HPP_ */
@@ -27,9 +27,7 @@
  */
 
 #include <string>
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
 
 #include <boost/locale.hpp>
 
@@ -43,6 +41,7 @@
 #include "trihlavLib/trihlavButtonIface.hpp"
 #include "trihlavLib/trihlavKeyManager.hpp"
 #include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+#include "trihlavLib/trihlavOtpValidator.hpp"
 
 using std::string;
 using boost::locale::translate;
@@ -58,12 +57,12 @@ namespace trihlav {
             PresenterBase{pFactory}, //< has a factory
             m_View{nullptr}
     {
-        BOOST_LOG_NAMED_SCOPE("PswdChckPresenter::PswdChckPresenter");
+        TRIHLAV_TRACE_SCOPE("PswdChckPresenter::PswdChckPresenter");
     }
 
     PswdChckViewIface &PswdChckPresenter::getView() {
         if (!m_View) {
-            BOOST_LOG_NAMED_SCOPE("PswdChckPresenter::getView");
+            TRIHLAV_TRACE_SCOPE("PswdChckPresenter::getView");
             m_View = getFactory().createPswdChckView();
             m_View->getBtnOk().pressedSig.connect([=]() { okPressed(); });
         }
@@ -78,7 +77,7 @@ namespace trihlav {
     }
 
     void PswdChckPresenter::okPressed() {
-        BOOST_LOG_NAMED_SCOPE("PswdChckPresenter::okPressed");
+        TRIHLAV_TRACE_SCOPE("PswdChckPresenter::okPressed");
         string myPswd0(getView().getEdtPswd0().getValue());
         getView().getEdtPswd0().setValue("");
         const size_t myPswdSz(myPswd0.size());
@@ -98,16 +97,29 @@ namespace trihlav {
         }
         //myPswd0=YubikoOtpKeyConfig::modhex2Hex(myPswd0);
         const size_t myPfxLen{myPswdSz - YUBIKEY_OTP_SIZE};
-        const string myPrefix = myPswd0.substr(0, myPfxLen);
-        const string myPswdSx = myPswd0.substr(myPfxLen);
-        BOOST_LOG_TRIVIAL(info) << "Checking |" << myPrefix << ":" << myPswdSx << "|";
+        const PublicId myPrefix(myPswd0.data(), myPfxLen);
+        const char *myPswdSx = myPswd0.c_str() + myPfxLen;
+        TRIHLAV_LOG(info) << "Checking |" << myPrefix.toString() << ":" << myPswdSx << "|";
         auto &myManager = getFactory().getKeyManager();
-        YubikoOtpKeyConfig *myKey = myManager.getKeyByPublicId(myPrefix);
-        if (myKey == 0) {
+        OtpValidator &myValidator = getFactory().getOtpValidator();
+        bool myOk = false;
+        bool myLimited = false;
+        const bool myFound = myManager.withLockedKey(myPrefix, [&](YubikoOtpKeyConfig &pKey) {
+            if (!myValidator.admitKey(myPrefix)) {
+                myLimited = true;
+                return;
+            }
+            myOk = pKey.checkOtp(myPswdSx);
+        });
+        myManager.compactJournalIfFull();
+        if (myLimited) {
+            getMessageView().showMessage(translate(K_MSG_TITLE),
+                                         translate("Too many attempts, try again later."));
+        } else if (!myFound) {
             getMessageView().showMessage(translate(K_MSG_TITLE),
                                          translate("Key not found."));
         } else {
-            if (myKey->checkOtp(myPswdSx)) {
+            if (myOk) {
                 getMessageView().showMessage(translate(K_MSG_TITLE),
                                              translate(K_PSWD_OK));
             } else {
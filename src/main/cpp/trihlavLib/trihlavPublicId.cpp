@@ -0,0 +1,134 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include "trihlavLib/trihlavPublicId.hpp"
+
+using std::string;
+
+namespace trihlav {
+
+    static const char K_MODHEX[] = "cbdefghijklnrtuv";
+
+    /// @brief Value of a modhex digit or -1.
+    static inline int modhexValue(const char pChar) {
+        switch (pChar) {
+            case 'c': return 0x0;
+            case 'b': return 0x1;
+            case 'd': return 0x2;
+            case 'e': return 0x3;
+            case 'f': return 0x4;
+            case 'g': return 0x5;
+            case 'h': return 0x6;
+            case 'i': return 0x7;
+            case 'j': return 0x8;
+            case 'k': return 0x9;
+            case 'l': return 0xa;
+            case 'n': return 0xb;
+            case 'r': return 0xc;
+            case 't': return 0xd;
+            case 'u': return 0xe;
+            case 'v': return 0xf;
+            default: return -1;
+        }
+    }
+
+    PublicId::PublicId() //
+            : m_Bytes(), m_Size(0), m_Modhex(false) //
+    {
+    }
+
+    PublicId::PublicId(const string &pPubId) //
+            : PublicId(pPubId.data(), pPubId.size()) //
+    {
+    }
+
+/**
+ * Tries modhex first, falls back to the raw characters.
+ */
+    PublicId::PublicId(const char *pPubId, const size_t pLen) //
+            : m_Bytes(), m_Size(0), m_Modhex(false) //
+    {
+        if (pLen % 2 == 0 && pLen / 2 <= K_MAX_SIZE) {
+            size_t myI = 0;
+            for (; myI < pLen; myI += 2) {
+                const int myHi = modhexValue(pPubId[myI]);
+                const int myLo = modhexValue(pPubId[myI + 1]);
+                if (myHi < 0 || myLo < 0) {
+                    break;
+                }
+                m_Bytes[myI / 2] = static_cast<uint8_t>((myHi << 4) | myLo);
+            }
+            if (myI == pLen) {
+                m_Size = static_cast<uint8_t>(pLen / 2);
+                m_Modhex = pLen > 0;
+                return;
+            }
+            m_Bytes.fill(0);
+        }
+        if (pLen > K_MAX_SIZE) {
+            m_Size = K_MAX_SIZE + 1;
+            return;
+        }
+        memcpy(m_Bytes.data(), pPubId, pLen);
+        m_Size = static_cast<uint8_t>(pLen);
+    }
+
+    const string PublicId::toString() const {
+        if (!isValid()) {
+            return "<too long>";
+        }
+        if (!m_Modhex) {
+            return string(reinterpret_cast<const char *>(m_Bytes.data()), m_Size);
+        }
+        string myRetVal(m_Size * 2, '\0');
+        for (size_t myI = 0; myI < m_Size; ++myI) {
+            myRetVal[myI * 2] = K_MODHEX[m_Bytes[myI] >> 4];
+            myRetVal[myI * 2 + 1] = K_MODHEX[m_Bytes[myI] & 0xf];
+        }
+        return myRetVal;
+    }
+
+/**
+ * Both halves are mixed with the murmur3 finalizer, so sequentially issued
+ * IDs spread over the whole table.
+ */
+    uint64_t PublicId::hash() const {
+        uint64_t myLo;
+        uint64_t myHi;
+        memcpy(&myLo, m_Bytes.data(), sizeof(myLo));
+        memcpy(&myHi, m_Bytes.data() + sizeof(myLo), sizeof(myHi));
+        uint64_t myH = myLo ^ (myHi * 0x9e3779b97f4a7c15ULL) ^ (uint64_t(m_Size) << 56) ^ uint64_t(m_Modhex);
+        myH ^= myH >> 33;
+        myH *= 0xff51afd7ed558ccdULL;
+        myH ^= myH >> 33;
+        myH *= 0xc4ceb9fe1a85ec53ULL;
+        myH ^= myH >> 33;
+        return myH;
+    }
+
+} /* namespace trihlav */
@@ -0,0 +1,114 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_PUBLIC_ID_HPP_
+#define TRIHLAV_PUBLIC_ID_HPP_
+
+#include <array>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <yubikey.h>
+
+namespace trihlav {
+
+    /// @brief Private ID of a key, yubikey_token_st.uid.
+    using PrivateId_t = std::array<uint8_t, YUBIKEY_UID_SIZE>;
+
+    /// @brief Copy the private ID out of a token.
+    inline PrivateId_t getPrivateId(const yubikey_token_st &pToken) {
+        PrivateId_t myRetVal;
+        memcpy(myRetVal.data(), pToken.uid, YUBIKEY_UID_SIZE);
+        return myRetVal;
+    }
+
+    /**
+     * Public ID of a key in a fixed size binary form.
+     *
+     * Modhex encoded IDs, as sent by the keys, are stored decoded, a 12
+     * character ID takes 6 bytes. IDs which are not modhex are kept as they
+     * are, they never equal a decoded one. It is built straight from the
+     * prefix of an OTP, without copying it into a string first.
+     */
+    class PublicId {
+    public:
+        /// @brief Longest decoded or raw ID.
+        static constexpr size_t K_MAX_SIZE = 16;
+
+        /// @brief The empty ID, it is never indexed.
+        PublicId();
+
+        /// @brief Parse, isValid() is false when the ID is too long.
+        explicit PublicId(const std::string &pPubId);
+
+        /// @brief Parse the first pLen characters of pPubId, fe. of an OTP.
+        PublicId(const char *pPubId, size_t pLen);
+
+        bool isValid() const {
+            return m_Size <= K_MAX_SIZE;
+        }
+
+        bool isEmpty() const {
+            return m_Size == 0;
+        }
+
+        /// @brief Encode the ID back, as it was parsed.
+        const std::string toString() const;
+
+        /// @brief Well mixed hash over the bytes, suitable for power of two tables, IDs may collide.
+        uint64_t hash() const;
+
+        bool operator==(const PublicId &pOther) const {
+            return m_Size == pOther.m_Size && m_Modhex == pOther.m_Modhex
+                   && memcmp(m_Bytes.data(), pOther.m_Bytes.data(), K_MAX_SIZE) == 0;
+        }
+
+        bool operator!=(const PublicId &pOther) const {
+            return !(*this == pOther);
+        }
+
+        /// @brief Arbitrary but strict order, for sorted tables of IDs.
+        bool operator<(const PublicId &pOther) const {
+            if (m_Size != pOther.m_Size) {
+                return m_Size < pOther.m_Size;
+            }
+            if (m_Modhex != pOther.m_Modhex) {
+                return m_Modhex < pOther.m_Modhex;
+            }
+            return memcmp(m_Bytes.data(), pOther.m_Bytes.data(), K_MAX_SIZE) < 0;
+        }
+
+    private:
+        std::array<uint8_t, K_MAX_SIZE> m_Bytes; //< zero padded
+        uint8_t m_Size;                          //< used bytes, > K_MAX_SIZE when invalid
+        bool m_Modhex;                           //< m_Bytes are decoded modhex
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_PUBLIC_ID_HPP_ */
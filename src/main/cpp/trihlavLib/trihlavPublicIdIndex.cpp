@@ -0,0 +1,137 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <utility>
+
+#include "trihlavLib/trihlavPublicIdIndex.hpp"
+
+using std::string;
+
+namespace trihlav {
+
+    static_assert(sizeof(PublicId) <= 24, "A slot should stay within 32 bytes.");
+
+    static constexpr size_t K_MIN_CAPACITY = 16;
+
+    PublicIdIndex::PublicIdIndex() //
+            : m_Mask(0), m_Size(0) //
+    {
+    }
+
+    void PublicIdIndex::reserve(const size_t pCount) {
+        size_t myCapacity = K_MIN_CAPACITY;
+        while (myCapacity < pCount * 2) {
+            myCapacity *= 2;
+        }
+        if (myCapacity > m_Slots.size()) {
+            rehash(myCapacity);
+        }
+    }
+
+    size_t PublicIdIndex::probe(const PublicId &pId) const {
+        size_t myPos = pId.hash() & m_Mask;
+        while (m_Slots[myPos].m_Key != 0 && m_Slots[myPos].m_Id != pId) {
+            myPos = (myPos + 1) & m_Mask;
+        }
+        return myPos;
+    }
+
+    void PublicIdIndex::rehash(const size_t pCapacity) {
+        std::vector<Slot> myOld(pCapacity);
+        myOld.swap(m_Slots);
+        m_Mask = pCapacity - 1;
+        for (const Slot &mySlot : myOld) {
+            if (mySlot.m_Key != 0) {
+                m_Slots[probe(mySlot.m_Id)] = mySlot;
+            }
+        }
+    }
+
+    bool PublicIdIndex::insert(const PublicId &pId, HotKey *pKey) {
+        if (pId.isEmpty() || !pId.isValid() || pKey == 0) {
+            return false;
+        }
+        reserve(m_Size + 1);
+        Slot &mySlot = m_Slots[probe(pId)];
+        if (mySlot.m_Key != 0) {
+            return false;
+        }
+        mySlot.m_Id = pId;
+        mySlot.m_Key = pKey;
+        ++m_Size;
+        return true;
+    }
+
+    void PublicIdIndex::assign(const PublicId &pId, HotKey *pKey) {
+        if (!insert(pId, pKey) && pKey != 0 && !m_Slots.empty()) {
+            Slot &mySlot = m_Slots[probe(pId)];
+            if (mySlot.m_Key != 0) {
+                mySlot.m_Key = pKey;
+            }
+        }
+    }
+
+/**
+ * Backward shift deletion, the table keeps no tombstones.
+ */
+    bool PublicIdIndex::erase(const PublicId &pId) {
+        if (m_Size == 0) {
+            return false;
+        }
+        size_t myHole = probe(pId);
+        if (m_Slots[myHole].m_Key == 0) {
+            return false;
+        }
+        for (size_t myPos = (myHole + 1) & m_Mask; m_Slots[myPos].m_Key != 0; myPos = (myPos + 1) & m_Mask) {
+            const size_t myHome = m_Slots[myPos].m_Id.hash() & m_Mask;
+            // Move back unless the entry's home lies cyclically in (myHole, myPos].
+            if (((myPos - myHome) & m_Mask) >= ((myPos - myHole) & m_Mask)) {
+                m_Slots[myHole] = m_Slots[myPos];
+                myHole = myPos;
+            }
+        }
+        m_Slots[myHole] = Slot();
+        --m_Size;
+        return true;
+    }
+
+    HotKey *PublicIdIndex::find(const PublicId &pId) const {
+        if (m_Size == 0 || pId.isEmpty() || !pId.isValid()) {
+            return 0;
+        }
+        return m_Slots[probe(pId)].m_Key;
+    }
+
+    HotKey *PublicIdIndex::findByOtp(const string &pOtp) const {
+        if (pOtp.size() <= YUBIKEY_OTP_SIZE) {
+            return 0;
+        }
+        return find(PublicId(pOtp.data(), pOtp.size() - YUBIKEY_OTP_SIZE));
+    }
+
+} /* namespace trihlav */
@@ -0,0 +1,106 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_PUBLIC_ID_INDEX_HPP_
+#define TRIHLAV_PUBLIC_ID_INDEX_HPP_
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#include "trihlavLib/trihlavPublicId.hpp"
+
+namespace trihlav {
+
+    struct HotKey;
+
+    /**
+     * Open addressing hash table from PublicId to the HotKey of a loaded key.
+     *
+     * Slots hold the binary ID next to the record pointer, two per cache
+     * line, and are probed linearly. The table is kept at most half full, so
+     * a lookup usually touches one slot line and then the one line of the
+     * record, the rest of the key is reached by HotKey::m_Cold.
+     */
+    class PublicIdIndex {
+    public:
+        PublicIdIndex();
+
+        /// @brief Size the table for pCount keys up front.
+        void reserve(size_t pCount);
+
+        /// @brief Add a key, keeps the present one on duplicate ID.
+        /// @return false when pId is empty, invalid or already present.
+        bool insert(const PublicId &pId, HotKey *pKey);
+
+        /// @brief Add or replace a key.
+        void assign(const PublicId &pId, HotKey *pKey);
+
+        /// @return true when pId was present.
+        bool erase(const PublicId &pId);
+
+        /// @return the key or 0.
+        HotKey *find(const PublicId &pId) const;
+
+        /// @brief Look up the key of an OTP by its public ID prefix.
+        /// @param pOtp the whole OTP, the public ID followed by YUBIKEY_OTP_SIZE characters.
+        HotKey *findByOtp(const std::string &pOtp) const;
+
+        size_t size() const {
+            return m_Size;
+        }
+
+        /// @brief Call pAction(const PublicId&, HotKey*) for each key.
+        template<typename Action>
+        void forEach(Action pAction) const {
+            for (const Slot &mySlot : m_Slots) {
+                if (mySlot.m_Key != 0) {
+                    pAction(mySlot.m_Id, mySlot.m_Key);
+                }
+            }
+        }
+
+    private:
+        struct Slot {
+            PublicId m_Id;
+            HotKey *m_Key = 0; //< 0 marks a free slot
+        };
+
+        /// @return the slot holding pId or the free one ending its probe sequence.
+        size_t probe(const PublicId &pId) const;
+
+        void rehash(size_t pCapacity);
+
+        std::vector<Slot> m_Slots; //< power of two sized
+        size_t m_Mask;
+        size_t m_Size;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_PUBLIC_ID_INDEX_HPP_ */
@@ -0,0 +1,265 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <thread>
+#include <algorithm>
+
+#include "trihlavLib/trihlavRateLimiter.hpp"
+
+namespace trihlav {
+
+    constexpr size_t RateLimiter::K_MIN_SLOTS;
+    constexpr size_t RateLimiter::K_MAX_PROBE;
+    constexpr size_t RateLimiter::K_WHEEL_SPOKES;
+
+    static_assert(RateLimiter::K_MIN_SLOTS % RateLimiter::K_WHEEL_SPOKES == 0,
+                  "Spokes have to split the table evenly.");
+
+    /// @brief Low bits of a state, the tokens in thousandths.
+    static constexpr unsigned K_TOKEN_BITS = 24;
+    static constexpr uint64_t K_TOKEN_MASK = (uint64_t(1) << K_TOKEN_BITS) - 1;
+    /// @brief Largest bucket, in whole tokens.
+    static constexpr uint64_t K_MAX_BURST = K_TOKEN_MASK / 1000;
+    /// @brief Marks a bucket being freed.
+    static constexpr uint64_t K_DEAD = ~uint64_t(0);
+
+    static size_t roundSlots(const size_t pSlots) {
+        size_t myRetVal = RateLimiter::K_MIN_SLOTS;
+        while (myRetVal < pSlots && myRetVal < (size_t(1) << 30)) {
+            myRetVal *= 2;
+        }
+        return myRetVal;
+    }
+
+    RateLimiter::RateLimiter(const int pPerMinute, const int pBurst, const size_t pSlots,
+                             const EOverflow pOverflow) //
+            : m_PerMinute(uint64_t(std::max(0, pPerMinute))), //
+              m_Burst(std::min(K_MAX_BURST, uint64_t(std::max(0, pBurst)))), //
+              m_RefillMs(m_PerMinute == 0 ? 1 : std::max(uint64_t(1), (m_Burst * 60000 + m_PerMinute - 1) / m_PerMinute)), //
+              m_Epoch(Clock_t::now()), //
+              m_Mask(roundSlots(pSlots) - 1), //
+              m_OnOverflow(pOverflow), //
+              m_Slots(new Slot[m_Mask + 1]), //
+              m_NextTickMs(0), m_Spoke(0), m_Allowed(0), m_Limited(0), m_Overflow(0), m_Evicted(0) //
+    {
+        for (size_t myI = 0; myI <= m_Mask; ++myI) {
+            m_Slots[myI].m_Key.store(0, std::memory_order_relaxed);
+            m_Slots[myI].m_State.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    RateLimiter::~RateLimiter() {
+    }
+
+    uint64_t RateLimiter::getMs(const Clock_t::time_point pNow) const {
+        if (pNow <= m_Epoch) {
+            return 1;
+        }
+        return uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(pNow - m_Epoch).count()) + 1;
+    }
+
+/**
+ * One token per minute is 1000/60000 thousandths per millisecond.
+ */
+    uint64_t RateLimiter::getMilliTokens(const uint64_t pState, const uint64_t pNowMs) const {
+        const uint64_t myFull = m_Burst * 1000;
+        if (pState == 0) {
+            return myFull;
+        }
+        const uint64_t myLastMs = pState >> K_TOKEN_BITS;
+        const uint64_t myElapsedMs = pNowMs > myLastMs ? pNowMs - myLastMs : 0;
+        if (myElapsedMs >= m_RefillMs) {
+            return myFull;
+        }
+        return std::min(myFull, (pState & K_TOKEN_MASK) + myElapsedMs * m_PerMinute / 60);
+    }
+
+/**
+ * All probed slots are checked for pKey before a free one is claimed, so a
+ * bucket is not shadowed by a slot freed in front of it. With no free slot
+ * the idle bucket refilled longest ago is evicted the way advanceWheel()
+ * frees buckets and handed over to pKey. A bucket which still misses
+ * tokens is never evicted, pKey gets no bucket then.
+ */
+    RateLimiter::Slot *RateLimiter::getSlot(const uint64_t pKey, const uint64_t pNowMs) {
+        const size_t myBase = size_t(pKey) & m_Mask;
+        for (size_t myI = 0; myI < K_MAX_PROBE; ++myI) {
+            Slot &mySlot = m_Slots[(myBase + myI) & m_Mask];
+            if (mySlot.m_Key.load() == pKey) {
+                return &mySlot;
+            }
+        }
+        for (size_t myI = 0; myI < K_MAX_PROBE; ++myI) {
+            Slot &mySlot = m_Slots[(myBase + myI) & m_Mask];
+            uint64_t myKey = 0;
+            if (mySlot.m_Key.compare_exchange_strong(myKey, pKey)) {
+                return keepFirst(pKey, &mySlot);
+            }
+            if (myKey == pKey) {
+                return &mySlot;
+            }
+        }
+        Slot *myOldest = nullptr;
+        uint64_t myOldestState = 0;
+        for (size_t myI = 0; myI < K_MAX_PROBE; ++myI) {
+            Slot &mySlot = m_Slots[(myBase + myI) & m_Mask];
+            if (mySlot.m_Key.load() == pKey) {
+                return &mySlot;
+            }
+            const uint64_t myState = mySlot.m_State.load();
+            if (myState != K_DEAD && getMilliTokens(myState, pNowMs) == m_Burst * 1000
+                && (myOldest == nullptr || (myState >> K_TOKEN_BITS) < (myOldestState >> K_TOKEN_BITS))) {
+                myOldest = &mySlot;
+                myOldestState = myState;
+            }
+        }
+        if (myOldest == nullptr || !myOldest->m_State.compare_exchange_strong(myOldestState, K_DEAD)) {
+            return nullptr;
+        }
+        myOldest->m_Key.store(pKey);
+        myOldest->m_State.store(0);
+        m_Evicted.fetch_add(1, std::memory_order_relaxed);
+        return keepFirst(pKey, myOldest);
+    }
+
+/**
+ * Threads placing the same key at once may claim different slots. Each of
+ * them looks again, the slot first in the probe order is kept and the
+ * others are freed, so one key ends up with one bucket.
+ */
+    RateLimiter::Slot *RateLimiter::keepFirst(const uint64_t pKey, Slot *pSlot) {
+        const size_t myBase = size_t(pKey) & m_Mask;
+        for (size_t myI = 0; myI < K_MAX_PROBE; ++myI) {
+            Slot &mySlot = m_Slots[(myBase + myI) & m_Mask];
+            if (&mySlot == pSlot) {
+                break;
+            }
+            if (mySlot.m_Key.load() == pKey) {
+                freeSlot(*pSlot);
+                return &mySlot;
+            }
+        }
+        return pSlot;
+    }
+
+    void RateLimiter::freeSlot(Slot &pSlot) {
+        uint64_t myState = pSlot.m_State.load();
+        do {
+            if (myState == K_DEAD) {
+                // freed or evicted by another thread
+                return;
+            }
+        } while (!pSlot.m_State.compare_exchange_weak(myState, K_DEAD));
+        pSlot.m_Key.store(0);
+        pSlot.m_State.store(0);
+    }
+
+/**
+ * Freeing marks the state dead first, so a concurrent tryTake() either
+ * took its token before or looks the key up again.
+ */
+    void RateLimiter::advanceWheel(const uint64_t pNowMs) {
+        uint64_t myNextMs = m_NextTickMs.load();
+        if (pNowMs < myNextMs
+            || !m_NextTickMs.compare_exchange_strong(myNextMs,
+                                                     pNowMs + std::max(uint64_t(1), m_RefillMs / K_WHEEL_SPOKES))) {
+            return;
+        }
+        const size_t mySegment = (m_Mask + 1) / K_WHEEL_SPOKES;
+        const size_t myFirst = (m_Spoke.fetch_add(1) % K_WHEEL_SPOKES) * mySegment;
+        for (size_t myI = myFirst; myI < myFirst + mySegment; ++myI) {
+            Slot &mySlot = m_Slots[myI];
+            if (mySlot.m_Key.load() == 0) {
+                continue;
+            }
+            uint64_t myState = mySlot.m_State.load();
+            if (myState != K_DEAD && getMilliTokens(myState, pNowMs) == m_Burst * 1000
+                && mySlot.m_State.compare_exchange_strong(myState, K_DEAD)) {
+                mySlot.m_Key.store(0);
+                mySlot.m_State.store(0);
+            }
+        }
+    }
+
+    bool RateLimiter::tryTake(const uint64_t pKey, const Clock_t::time_point pNow) {
+        if (!isEnabled()) {
+            return true;
+        }
+        const uint64_t myNowMs = getMs(pNow);
+        advanceWheel(myNowMs);
+        const uint64_t myKey = pKey == 0 ? 1 : pKey;
+        for (;;) {
+            Slot *mySlot = getSlot(myKey, myNowMs);
+            if (mySlot == nullptr) {
+                m_Overflow.fetch_add(1, std::memory_order_relaxed);
+                if (m_OnOverflow == EFailClosed) {
+                    m_Limited.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                m_Allowed.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            for (;;) {
+                uint64_t myState = mySlot->m_State.load();
+                if (myState == K_DEAD) {
+                    if (mySlot->m_Key.load() != myKey) {
+                        break;
+                    }
+                    // Claimed right after being freed, the state is reset in a moment.
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (mySlot->m_Key.load() != myKey) {
+                    // Evicted for another key meanwhile.
+                    break;
+                }
+                const uint64_t myTokens = getMilliTokens(myState, myNowMs);
+                if (myTokens < 1000) {
+                    m_Limited.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                const uint64_t myStampMs = std::max(myNowMs, myState >> K_TOKEN_BITS);
+                if (mySlot->m_State.compare_exchange_weak(myState, (myStampMs << K_TOKEN_BITS) | (myTokens - 1000))) {
+                    m_Allowed.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+    }
+
+    size_t RateLimiter::getBucketCount() const {
+        size_t myRetVal = 0;
+        for (size_t myI = 0; myI <= m_Mask; ++myI) {
+            if (m_Slots[myI].m_Key.load(std::memory_order_relaxed) != 0) {
+                ++myRetVal;
+            }
+        }
+        return myRetVal;
+    }
+
+} /* namespace trihlav */
@@ -0,0 +1,162 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_RATE_LIMITER_HPP_
+#define TRIHLAV_RATE_LIMITER_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+
+namespace trihlav {
+
+    /**
+     * Lock free token buckets, one per 64 bit key hash.
+     *
+     * The buckets live in a fixed open addressing table. A bucket is a pair
+     * of atomic words, the key hash and the state (time of the last refill
+     * and the remaining tokens), taking a token is one compare and swap of
+     * the state. A key probes at most K_MAX_PROBE slots, when all of them
+     * belong to other keys the idle bucket refilled longest ago is evicted.
+     * When none of them is idle, or the eviction races with other threads,
+     * the request is let through or rejected, as chosen by EOverflow, and
+     * counted.
+     *
+     * A bucket which was idle long enough to refill completely behaves as a
+     * fresh one and is freed by a timer wheel: the table is split into
+     * K_WHEEL_SPOKES segments and each tick, driven by tryTake() itself,
+     * sweeps the next segment. One turn of the wheel takes the refill time.
+     */
+    class RateLimiter {
+    public:
+        using Clock_t = std::chrono::steady_clock;
+
+        /// @brief Smallest table, a power of two.
+        static constexpr size_t K_MIN_SLOTS = 1024;
+
+        /// @brief Slots probed at most for one key.
+        static constexpr size_t K_MAX_PROBE = 16;
+
+        /// @brief Count of table segments swept in turn.
+        static constexpr size_t K_WHEEL_SPOKES = 64;
+
+        /// @brief What happens to a request when no bucket could be placed.
+        enum EOverflow {
+            EFailOpen,  //< let it through, fe. for keys
+            EFailClosed //< reject it, fe. for clients
+        };
+
+        /**
+         * @param pPerMinute tokens added per minute, 0 disables the limiter.
+         * @param pBurst bucket size, 0 disables the limiter.
+         * @param pSlots bucket slots, rounded up to a power of two, at least K_MIN_SLOTS.
+         */
+        RateLimiter(const int pPerMinute, const int pBurst, const size_t pSlots = 16384,
+                    const EOverflow pOverflow = EFailOpen);
+
+        virtual ~RateLimiter();
+
+        /// @brief Take one token of the bucket pKey, false when it is empty.
+        bool tryTake(const uint64_t pKey, const Clock_t::time_point pNow = Clock_t::now());
+
+        bool isEnabled() const {
+            return m_PerMinute > 0 && m_Burst > 0;
+        }
+
+        /// @brief Requests let through.
+        uint64_t getAllowedCount() const {
+            return m_Allowed.load(std::memory_order_relaxed);
+        }
+
+        /// @brief Requests rejected for an empty bucket.
+        uint64_t getLimitedCount() const {
+            return m_Limited.load(std::memory_order_relaxed);
+        }
+
+        /// @brief Requests let through or rejected because no bucket could be placed.
+        uint64_t getOverflowCount() const {
+            return m_Overflow.load(std::memory_order_relaxed);
+        }
+
+        /// @brief Buckets evicted for other keys.
+        uint64_t getEvictedCount() const {
+            return m_Evicted.load(std::memory_order_relaxed);
+        }
+
+        /// @brief Count of bucket slots.
+        size_t getSlotCount() const {
+            return m_Mask + 1;
+        }
+
+        /// @brief Buckets currently in use.
+        size_t getBucketCount() const;
+
+    private:
+        struct Slot {
+            std::atomic<uint64_t> m_Key;    //< 0 when free
+            std::atomic<uint64_t> m_State;  //< 0 when full, K_DEAD while freed
+        };
+
+        /// @brief Milliseconds since m_Epoch, never 0.
+        uint64_t getMs(const Clock_t::time_point pNow) const;
+
+        /// @brief Tokens in thousandths after refilling pState up to pNowMs.
+        uint64_t getMilliTokens(const uint64_t pState, const uint64_t pNowMs) const;
+
+        /// @return nullptr when no slot could be claimed or evicted for pKey.
+        Slot *getSlot(const uint64_t pKey, const uint64_t pNowMs);
+
+        /// @return the first slot of pKey in its probe order, pSlot is freed when it is not.
+        Slot *keepFirst(const uint64_t pKey, Slot *pSlot);
+
+        /// @brief Free pSlot unless another thread frees it already.
+        void freeSlot(Slot &pSlot);
+
+        /// @brief Free the idle buckets of the next segment when a tick passed.
+        void advanceWheel(const uint64_t pNowMs);
+
+        const uint64_t m_PerMinute;
+        const uint64_t m_Burst;
+        const uint64_t m_RefillMs;  //< empty to full
+        const Clock_t::time_point m_Epoch;
+        const size_t m_Mask;  //< slots - 1
+        const EOverflow m_OnOverflow;
+        std::unique_ptr<Slot[]> m_Slots;
+        std::atomic<uint64_t> m_NextTickMs;
+        std::atomic<size_t> m_Spoke;
+        std::atomic<uint64_t> m_Allowed;
+        std::atomic<uint64_t> m_Limited;
+        std::atomic<uint64_t> m_Overflow;
+        std::atomic<uint64_t> m_Evicted;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_RATE_LIMITER_HPP_ */
@@ -0,0 +1,127 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <functional>
+
+#include "trihlavLib/trihlavRecentOtpCache.hpp"
+
+using std::string;
+
+namespace trihlav {
+
+    constexpr size_t RecentOtpCache::K_SHARDS;
+    constexpr size_t RecentOtpCache::K_MAX_NONCE_SIZE;
+    constexpr std::chrono::seconds RecentOtpCache::K_RETRY_WINDOW;
+    constexpr unsigned RecentOtpCache::K_MAX_RETRIES;
+
+    RecentOtpCache::RecentOtpCache(const size_t pCapacity, const std::chrono::seconds pWindow) //
+            : m_ShardCapacity((pCapacity + K_SHARDS - 1) / K_SHARDS), m_Window(pWindow), m_Hits(0) //
+    {
+    }
+
+    RecentOtpCache::~RecentOtpCache() {
+    }
+
+    RecentOtpCache::Shard &RecentOtpCache::getShard(const string &pOtp) {
+        return m_Shards[std::hash<string>()(pOtp) % K_SHARDS];
+    }
+
+    void RecentOtpCache::expire(Shard &pShard, const Clock_t::time_point pNow) {
+        while (!pShard.m_Order.empty()
+               && (pShard.m_Order.size() > m_ShardCapacity || pShard.m_Order.front().second + m_Window <= pNow)) {
+            const auto myIt = pShard.m_Entries.find(pShard.m_Order.front().first);
+            // A re-inserted entry has its own, younger place in m_Order.
+            if (myIt != pShard.m_Entries.end() && myIt->second.m_Seen == pShard.m_Order.front().second) {
+                pShard.m_Entries.erase(myIt);
+            }
+            pShard.m_Order.pop_front();
+        }
+    }
+
+/**
+ * An empty or oversized nonce never matches, such requests always get
+ * OtpValidator::EReplayed for a known password. So do retries from another
+ * client, late ones and those beyond K_MAX_RETRIES.
+ */
+    bool RecentOtpCache::lookup(const string &pOtp, const string &pNonce, const string &pSysUser,
+                                const string &pClient, OtpValidator::EStatus &pStatus,
+                                const Clock_t::time_point pNow) {
+        if (!isEnabled()) {
+            return false;
+        }
+        Shard &myShard = getShard(pOtp);
+        std::lock_guard<std::mutex> myLock(myShard.m_Mutex);
+        const auto myIt = myShard.m_Entries.find(pOtp);
+        if (myIt == myShard.m_Entries.end() || myIt->second.m_Seen + m_Window <= pNow) {
+            return false;
+        }
+        Entry &myEntry = myIt->second;
+        if (!pNonce.empty() && pNonce.size() <= K_MAX_NONCE_SIZE && myEntry.m_Nonce == pNonce
+            && myEntry.m_SysUser == pSysUser && myEntry.m_Client == pClient
+            && pNow < myEntry.m_Seen + K_RETRY_WINDOW && myEntry.m_Retries < K_MAX_RETRIES) {
+            ++myEntry.m_Retries;
+            pStatus = myEntry.m_Status;
+        } else {
+            pStatus = OtpValidator::EReplayed;
+        }
+        m_Hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void RecentOtpCache::insert(const string &pOtp, const string &pNonce, const string &pSysUser,
+                                const string &pClient, const OtpValidator::EStatus pStatus,
+                                const Clock_t::time_point pNow) {
+        if (!isEnabled()) {
+            return;
+        }
+        Shard &myShard = getShard(pOtp);
+        std::lock_guard<std::mutex> myLock(myShard.m_Mutex);
+        expire(myShard, pNow);
+        auto myIt = myShard.m_Entries.find(pOtp);
+        if (myIt != myShard.m_Entries.end()) {
+            if (myIt->second.m_Seen + m_Window > pNow) {
+                return;
+            }
+            myShard.m_Entries.erase(myIt);
+        }
+        const string &myNonce = pNonce.size() <= K_MAX_NONCE_SIZE ? pNonce : string();
+        myShard.m_Entries.emplace(pOtp, Entry{pStatus, myNonce, pSysUser, pClient, pNow, 0});
+        myShard.m_Order.emplace_back(pOtp, pNow);
+        expire(myShard, pNow);
+    }
+
+    size_t RecentOtpCache::size() const {
+        size_t myRetVal = 0;
+        for (const Shard &myShard : m_Shards) {
+            std::lock_guard<std::mutex> myLock(myShard.m_Mutex);
+            myRetVal += myShard.m_Entries.size();
+        }
+        return myRetVal;
+    }
+
+} /* namespace trihlav */
@@ -0,0 +1,137 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_RECENT_OTP_CACHE_HPP_
+#define TRIHLAV_RECENT_OTP_CACHE_HPP_
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+#include "trihlavLib/trihlavOtpValidator.hpp"
+
+namespace trihlav {
+
+    /**
+     * Bounded, time windowed memory of recently validated passwords.
+     *
+     * A password which was accepted once can never be accepted again, so
+     * OtpValidator asks this cache before decrypting anything. A client
+     * which retries a request (fe. after a timeout) with the same nonce, from
+     * the same address and within K_RETRY_WINDOW gets the original answer
+     * instead of a replay error, at most K_MAX_RETRIES times. A captured
+     * request can't be replayed for the whole window so.
+     *
+     * Entries are spread over K_SHARDS independently locked shards. Each
+     * shard forgets its entries in insertion order, when they are older than
+     * the window or the shard is full.
+     */
+    class RecentOtpCache {
+    public:
+        using Clock_t = std::chrono::steady_clock;
+
+        /// @brief Count of independently locked shards.
+        static constexpr size_t K_SHARDS = 16;
+
+        /// @brief Longer nonces are ignored, they would only bloat the cache.
+        static constexpr size_t K_MAX_NONCE_SIZE = 64;
+
+        /// @brief How long after the first request a retry gets the original answer.
+        static constexpr std::chrono::seconds K_RETRY_WINDOW{5};
+
+        /// @brief Retries answered with the original status.
+        static constexpr unsigned K_MAX_RETRIES = 2;
+
+        /// @param pCapacity entries remembered at most, 0 disables the cache.
+        /// @param pWindow how long an entry is remembered.
+        RecentOtpCache(const size_t pCapacity, const std::chrono::seconds pWindow);
+
+        virtual ~RecentOtpCache();
+
+        /**
+         * @brief Was pOtp validated within the window?
+         * @param pClient address of the client.
+         * @param pStatus set to the original status when this is a retry of
+         *        the first request, to OtpValidator::EReplayed otherwise.
+         * @return false when pOtp is unknown, it has to be validated then.
+         */
+        bool lookup(const std::string &pOtp, const std::string &pNonce, const std::string &pSysUser,
+                    const std::string &pClient, OtpValidator::EStatus &pStatus,
+                    const Clock_t::time_point pNow = Clock_t::now());
+
+        /// @brief Remember the outcome of pOtp, keeps a present entry.
+        void insert(const std::string &pOtp, const std::string &pNonce, const std::string &pSysUser,
+                    const std::string &pClient, const OtpValidator::EStatus pStatus,
+                    const Clock_t::time_point pNow = Clock_t::now());
+
+        /// @brief Entries currently remembered, expired ones included.
+        size_t size() const;
+
+        /// @brief How many lookups were answered from the cache.
+        uint64_t getHitCount() const {
+            return m_Hits.load(std::memory_order_relaxed);
+        }
+
+        bool isEnabled() const {
+            return m_ShardCapacity > 0;
+        }
+
+    private:
+        struct Entry {
+            OtpValidator::EStatus m_Status;
+            std::string m_Nonce;
+            std::string m_SysUser;
+            std::string m_Client;
+            Clock_t::time_point m_Seen;
+            unsigned m_Retries;
+        };
+
+        struct Shard {
+            mutable std::mutex m_Mutex;
+            std::unordered_map<std::string, Entry> m_Entries;
+            std::deque<std::pair<std::string, Clock_t::time_point> > m_Order; //< oldest first
+        };
+
+        Shard &getShard(const std::string &pOtp);
+
+        /// @brief Forget expired entries and the oldest ones above capacity.
+        void expire(Shard &pShard, const Clock_t::time_point pNow);
+
+        const size_t m_ShardCapacity;
+        const Clock_t::duration m_Window;
+        std::array<Shard, K_SHARDS> m_Shards;
+        std::atomic<uint64_t> m_Hits;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_RECENT_OTP_CACHE_HPP_ */
@@ -26,14 +26,18 @@
 	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
 */
 
+#include <cstdlib>
 #include <fstream>
+#include <stdexcept>
 
 // include headers that implement a archive in simple text format
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
+#include <boost/serialization/version.hpp>
 
 #include "trihlavLib/trihlavLogApi.hpp"
 #include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavConstants.hpp"
 #include "trihlavLib/trihlavFailedCreateConfigDir.hpp"
 #include "trihlavLib/trihlavCannotWriteConfigDir.hpp"
 
@@ -49,15 +53,103 @@ namespace boost {
         void serialize(Archive &pArch, trihlav::Settings &pSettings, const unsigned int pVersion) {
             pArch & pSettings.getMinUser();
             pArch & pSettings.isAllowRoot();
+            if (pVersion > 0) {
+                pArch & pSettings.getDurability();
+                pArch & pSettings.getGroupCommitDelayUs();
+            }
+            if (pVersion > 1) {
+                pArch & pSettings.getRecentOtpWindowS();
+                pArch & pSettings.getRecentOtpCapacity();
+            }
+            if (pVersion > 2) {
+                pArch & pSettings.getKeyRatePerMin();
+                pArch & pSettings.getKeyBurst();
+                pArch & pSettings.getClientRatePerMin();
+                pArch & pSettings.getClientBurst();
+            }
+            if (pVersion > 3) {
+                pArch & pSettings.getLogQueueSize();
+                pArch & pSettings.getLogOverflow();
+            }
+            if (pVersion > 4) {
+                pArch & pSettings.getKeyStore();
+            }
+            if (pVersion > 5) {
+                pArch & pSettings.getLoadThreads();
+            }
+            if (pVersion > 6) {
+                pArch & pSettings.getLazyKeys();
+            }
+            if (pVersion > 7) {
+                pArch & pSettings.getRateLimitSlots();
+            }
+            if (pVersion > 8) {
+                pArch & pSettings.getTraceResource();
+            }
         }
 
     } // namespace serialization
 } // namespace boost
 
+BOOST_CLASS_VERSION(trihlav::Settings, 9)
+
 namespace trihlav {
 
     static const string K_SETTINGS_FILE_NAME = "settings.hpp";
 
+    static const string K_DURABLE_PER_COMMIT("per-commit");
+    static const string K_DURABLE_GROUP_COMMIT("group-commit");
+    static const string K_DURABLE_ASYNC("async");
+    static const string K_LOG_DROP("drop");
+    static const string K_LOG_BLOCK("block");
+    static const string K_KEY_STORE_JSON_DIR("json-dir");
+    static const string K_KEY_STORE_MMAP_FILE("mmap");
+    static const string K_KEY_STORE_SQLITE("sqlite");
+
+    const string &Settings::getDurabilityStr(const Settings::EDurability pDurability) {
+        switch (pDurability) {
+            case EPerCommit:
+                return K_DURABLE_PER_COMMIT;
+            case EAsync:
+                return K_DURABLE_ASYNC;
+            case EGroupCommit:
+            default:
+                return K_DURABLE_GROUP_COMMIT;
+        }
+    }
+
+    const string &Settings::getLogOverflowStr(const Settings::ELogOverflow pLogOverflow) {
+        switch (pLogOverflow) {
+            case ELogBlock:
+                return K_LOG_BLOCK;
+            case ELogDrop:
+            default:
+                return K_LOG_DROP;
+        }
+    }
+
+    const string &Settings::getKeyStoreStr(const Settings::EKeyStore pKeyStore) {
+        switch (pKeyStore) {
+            case EMmapFile:
+                return K_KEY_STORE_MMAP_FILE;
+            case ESqlite:
+                return K_KEY_STORE_SQLITE;
+            case EJsonDir:
+            default:
+                return K_KEY_STORE_JSON_DIR;
+        }
+    }
+
+    Settings::EKeyStore Settings::parseKeyStore(const string &pName) {
+        for (const EKeyStore myKeyStore : {EJsonDir, EMmapFile, ESqlite}) {
+            if (getKeyStoreStr(myKeyStore) == pName) {
+                return myKeyStore;
+            }
+        }
+        throw std::invalid_argument("Unknown key store \"" + pName + "\", use " + K_KEY_STORE_JSON_DIR + ", "
+                                    + K_KEY_STORE_MMAP_FILE + " or " + K_KEY_STORE_SQLITE + ".");
+    }
+
     bool Settings::load() {
 
         if (exists(m_ArchFilename)) {
@@ -69,7 +161,7 @@ namespace trihlav {
             // archive and stream closed when destructors are called
             return true;
         } else {
-            BOOST_LOG_TRIVIAL(info) << "Config file " << m_ArchFilename << " does not exists.";
+            TRIHLAV_LOG(info) << "Config file " << m_ArchFilename << " does not exists.";
         }
         return false;
     }
@@ -91,30 +183,29 @@ namespace trihlav {
  */
     const path &
     Settings::getConfigDir() const {
-        BOOST_LOG_NAMED_SCOPE("Settings::getConfigDir()");
         if (!isInitialized()) {
-            BOOST_LOG_TRIVIAL(debug) << "Checking config dir " << m_ConfigDir << ".";
+            TRIHLAV_LOG(debug) << "Checking config dir " << m_ConfigDir << ".";
             if (exists(m_ConfigDir)) {
                 const perms &myPerms = status(m_ConfigDir).permissions();
                 if (!myPerms & perms::owner_write) {
                     throw CannotWriteConfigDir(m_ConfigDir);
                 }
             } else {
-                BOOST_LOG_TRIVIAL(debug) << "Creating config dir " << m_ConfigDir << ".";
+                TRIHLAV_LOG(debug) << "Creating config dir " << m_ConfigDir << ".";
                 if (!create_directories(m_ConfigDir)) {
                     throw FailedCreateConfigDir(m_ConfigDir);
                 }
             }
             m_InitializedFlag = true;
         } else {
-            BOOST_LOG_TRIVIAL(debug) << "Config. dir. was already initialized.";
+            TRIHLAV_LOG(debug) << "Config. dir. was already initialized.";
         }
         return m_ConfigDir;
     }
 
     void Settings::checkPath(const path &pPath, bool &readable,
                              bool &writable) const {
-        BOOST_LOG_NAMED_SCOPE("Settings::checkPath()");
+        TRIHLAV_TRACE_SCOPE("Settings::checkPath()");
         path filePath = pPath / "test.txt";
 
 // remove a possibly existing test file
@@ -170,19 +261,31 @@ namespace trihlav {
     }
 
     const path Settings::detectConfigDir() const {
-        BOOST_LOG_NAMED_SCOPE("Settings::detectConfigDir()");
+        TRIHLAV_TRACE_SCOPE("Settings::detectConfigDir()");
+        bool myWriteable, myReadable;
+// an explicit directory wins, e.g. a temporary keystore of a benchmark
+        const char *myEnvDir = getenv(K_CONFIG_DIR_ENV.c_str());
+        if (myEnvDir != 0 && *myEnvDir != 0) {
+            const path myEnvPath(myEnvDir);
+            create_directories(myEnvPath);
+            checkPath(myEnvPath, myReadable, myWriteable);
+            if (!myWriteable) {
+                throw FailedCreateConfigDir(myEnvPath);
+            }
+            TRIHLAV_LOG(debug) << K_CONFIG_DIR_ENV << ": " << myEnvPath << " is writable.";
+            return myEnvPath;
+        }
 // try to open
         path myDefPath("/etc/trihlav/keys");
-        bool myWriteable, myReadable;
         checkPath(myDefPath, myWriteable, myReadable);
         if (myWriteable) {
-            BOOST_LOG_TRIVIAL(debug) << ": " << myDefPath << " is writable.";
+            TRIHLAV_LOG(debug) << ": " << myDefPath << " is writable.";
         } else {
             myDefPath = (((getHome() / ".config") / "trihlav") / "keys");
             create_directories(myDefPath);
             checkPath(myDefPath, myWriteable, myReadable);
             if (myWriteable) {
-                BOOST_LOG_TRIVIAL(debug) << ": " << myDefPath << " is writable.";
+                TRIHLAV_LOG(debug) << ": " << myDefPath << " is writable.";
             } else {
                 throw FailedCreateConfigDir(m_ConfigDir);
             }
@@ -194,26 +297,26 @@ namespace trihlav {
  * @param pConfigDir configuration directory.
  */
     void Settings::setConfigDir(const path &pConfigDir) {
-        BOOST_LOG_NAMED_SCOPE("Settings::setConfigDir");
+        TRIHLAV_TRACE_SCOPE("Settings::setConfigDir");
         bool myReadable = false, myWriteable = false;
         checkPath(pConfigDir, myReadable, myWriteable);
         if (myWriteable) {
-            BOOST_LOG_TRIVIAL(debug) << ": " << pConfigDir << " is writable.";
+            TRIHLAV_LOG(debug) << ": " << pConfigDir << " is writable.";
         } else {
             throw FailedCreateConfigDir(m_ConfigDir);
         }
         m_ConfigDir = pConfigDir;
         m_ArchFilename = (getConfigDir() / K_SETTINGS_FILE_NAME);
-        BOOST_LOG_TRIVIAL(debug) << "Config. dir set: " << m_ConfigDir << " " << m_ConfigDir << ".";
+        TRIHLAV_LOG(debug) << "Config. dir set: " << m_ConfigDir << " " << m_ConfigDir << ".";
     }
 
     Settings::Settings(const path &pConfigDir) //
             : m_InitializedFlag(false) //
             , m_ConfigDir(pConfigDir) //
     {
-        BOOST_LOG_NAMED_SCOPE("Settings::Settings");
+        TRIHLAV_TRACE_SCOPE("Settings::Settings");
         m_ArchFilename = (m_ConfigDir / K_SETTINGS_FILE_NAME);
-        BOOST_LOG_TRIVIAL(debug) << "C'tor from config. dir: " << m_ConfigDir << " " << m_ConfigDir << ".";
+        TRIHLAV_LOG(debug) << "C'tor from config. dir: " << m_ConfigDir << " " << m_ConfigDir << ".";
     }
 
 
@@ -221,9 +324,9 @@ namespace trihlav {
             : m_InitializedFlag(false) //
             , m_ConfigDir(detectConfigDir()) //
     {
-        BOOST_LOG_NAMED_SCOPE("Settings::Settings");
+        TRIHLAV_TRACE_SCOPE("Settings::Settings");
         m_ArchFilename = (m_ConfigDir / K_SETTINGS_FILE_NAME);
-        BOOST_LOG_TRIVIAL(debug) << "Default c'tor config dir:" << m_ConfigDir << " " << m_ConfigDir << ".";
+        TRIHLAV_LOG(debug) << "Default c'tor config dir:" << m_ConfigDir << " " << m_ConfigDir << ".";
 
     }
 
@@ -234,7 +337,7 @@ namespace trihlav {
  *
  */
     const path Settings::getHome() {
-        BOOST_LOG_NAMED_SCOPE("KeyManager::getHome");
+        TRIHLAV_TRACE_SCOPE("KeyManager::getHome");
 
 #ifdef TARGET_OS_MAC
 
@@ -245,7 +348,7 @@ namespace trihlav {
 #else
 #   error "unknown platform"
 #endif
-        BOOST_LOG_TRIVIAL(debug) << "Home: " << myHome << ".";
+        TRIHLAV_LOG(debug) << "Home: " << myHome << ".";
         return myHome;
     }
 
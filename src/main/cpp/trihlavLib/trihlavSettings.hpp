@@ -39,6 +39,25 @@ namespace trihlav {
      */
     class Settings {
     public:
+        /// @brief When are journaled counter advances flushed to disk?
+        enum EDurability {
+            EPerCommit,   //< one flush per accepted OTP, before answering
+            EGroupCommit, //< concurrent commits share one flush, before answering
+            EAsync        //< answer at once, flush in background
+        };
+
+        /// @brief What does a log record do when the asynchronous log queue is full?
+        enum ELogOverflow {
+            ELogDrop,  //< is dropped and counted
+            ELogBlock  //< waits for the writer thread
+        };
+
+        /// @brief Where are the keys stored? @see KeyStore
+        enum EKeyStore {
+            EJsonDir,  //< one JSON file per key in the configuration directory
+            EMmapFile, //< memory mapped keystore, key files take precedence
+            ESqlite    //< SQLite database in WAL mode
+        };
 
         Settings();
 
@@ -76,6 +95,256 @@ namespace trihlav {
             return m_MinUser;
         }
 
+        /**
+         * Durability of the counter journal.
+         * @return Settings#m_Durability .
+         */
+        EDurability getDurability() const {
+            return m_Durability;
+        }
+
+        /**
+         * Durability of the counter journal.
+         * @return Settings#m_Durability .
+         */
+        EDurability &getDurability() {
+            return m_Durability;
+        }
+
+        /**
+         * How long the journal waits to gather more commits into one flush.
+         * @return Settings#m_GroupCommitDelayUs .
+         */
+        int getGroupCommitDelayUs() const {
+            return m_GroupCommitDelayUs;
+        }
+
+        /**
+         * How long the journal waits to gather more commits into one flush.
+         * @return Settings#m_GroupCommitDelayUs .
+         */
+        int &getGroupCommitDelayUs() {
+            return m_GroupCommitDelayUs;
+        }
+
+        /**
+         * How long accepted passwords are remembered to reject replays early.
+         * @return Settings#m_RecentOtpWindowS .
+         */
+        int getRecentOtpWindowS() const {
+            return m_RecentOtpWindowS;
+        }
+
+        /**
+         * How long accepted passwords are remembered to reject replays early.
+         * @return Settings#m_RecentOtpWindowS .
+         */
+        int &getRecentOtpWindowS() {
+            return m_RecentOtpWindowS;
+        }
+
+        /**
+         * How many passwords are remembered at most, 0 disables the cache.
+         * @return Settings#m_RecentOtpCapacity .
+         */
+        int getRecentOtpCapacity() const {
+            return m_RecentOtpCapacity;
+        }
+
+        /**
+         * How many passwords are remembered at most, 0 disables the cache.
+         * @return Settings#m_RecentOtpCapacity .
+         */
+        int &getRecentOtpCapacity() {
+            return m_RecentOtpCapacity;
+        }
+
+        /**
+         * Tokens per minute added to the rate limit bucket of each key, 0 disables it.
+         * @return Settings#m_KeyRatePerMin .
+         */
+        int getKeyRatePerMin() const {
+            return m_KeyRatePerMin;
+        }
+
+        /**
+         * Tokens per minute added to the rate limit bucket of each key, 0 disables it.
+         * @return Settings#m_KeyRatePerMin .
+         */
+        int &getKeyRatePerMin() {
+            return m_KeyRatePerMin;
+        }
+
+        /**
+         * Size of the rate limit bucket of each key.
+         * @return Settings#m_KeyBurst .
+         */
+        int getKeyBurst() const {
+            return m_KeyBurst;
+        }
+
+        /**
+         * Size of the rate limit bucket of each key.
+         * @return Settings#m_KeyBurst .
+         */
+        int &getKeyBurst() {
+            return m_KeyBurst;
+        }
+
+        /**
+         * Tokens per minute added to the rate limit bucket of each client address, 0 disables it.
+         * @return Settings#m_ClientRatePerMin .
+         */
+        int getClientRatePerMin() const {
+            return m_ClientRatePerMin;
+        }
+
+        /**
+         * Tokens per minute added to the rate limit bucket of each client address, 0 disables it.
+         * @return Settings#m_ClientRatePerMin .
+         */
+        int &getClientRatePerMin() {
+            return m_ClientRatePerMin;
+        }
+
+        /**
+         * Size of the rate limit bucket of each client address.
+         * @return Settings#m_ClientBurst .
+         */
+        int getClientBurst() const {
+            return m_ClientBurst;
+        }
+
+        /**
+         * Size of the rate limit bucket of each client address.
+         * @return Settings#m_ClientBurst .
+         */
+        int &getClientBurst() {
+            return m_ClientBurst;
+        }
+
+        /**
+         * Buckets each rate limiter keeps, rounded up to a power of two. Idle
+         * buckets are evicted when the table fills up.
+         * @return Settings#m_RateLimitSlots .
+         */
+        int getRateLimitSlots() const {
+            return m_RateLimitSlots;
+        }
+
+        /**
+         * Buckets each rate limiter keeps, rounded up to a power of two.
+         * @return Settings#m_RateLimitSlots .
+         */
+        int &getRateLimitSlots() {
+            return m_RateLimitSlots;
+        }
+
+        /**
+         * Records queued for the log writer thread, 0 writes them synchronously.
+         * @return Settings#m_LogQueueSize .
+         */
+        int getLogQueueSize() const {
+            return m_LogQueueSize;
+        }
+
+        /**
+         * Records queued for the log writer thread, 0 writes them synchronously.
+         * @return Settings#m_LogQueueSize .
+         */
+        int &getLogQueueSize() {
+            return m_LogQueueSize;
+        }
+
+        /**
+         * Policy when the log queue is full.
+         * @return Settings#m_LogOverflow .
+         */
+        ELogOverflow getLogOverflow() const {
+            return m_LogOverflow;
+        }
+
+        /**
+         * Policy when the log queue is full.
+         * @return Settings#m_LogOverflow .
+         */
+        ELogOverflow &getLogOverflow() {
+            return m_LogOverflow;
+        }
+
+        /**
+         * Backend holding the keys.
+         * @return Settings#m_KeyStore .
+         */
+        EKeyStore getKeyStore() const {
+            return m_KeyStore;
+        }
+
+        /**
+         * Backend holding the keys.
+         * @return Settings#m_KeyStore .
+         */
+        EKeyStore &getKeyStore() {
+            return m_KeyStore;
+        }
+
+        /**
+         * Threads parsing key files at load time, 0 for one per core.
+         * @return Settings#m_LoadThreads .
+         */
+        int getLoadThreads() const {
+            return m_LoadThreads;
+        }
+
+        /**
+         * Threads parsing key files at load time, 0 for one per core.
+         * @return Settings#m_LoadThreads .
+         */
+        int &getLoadThreads() {
+            return m_LoadThreads;
+        }
+
+        /**
+         * Index only the public IDs at load time, a key is loaded on first use.
+         * @return Settings#m_LazyKeys .
+         */
+        bool getLazyKeys() const {
+            return m_LazyKeys;
+        }
+
+        /**
+         * Index only the public IDs at load time, a key is loaded on first use.
+         * @return Settings#m_LazyKeys .
+         */
+        bool &getLazyKeys() {
+            return m_LazyKeys;
+        }
+
+        /**
+         * Serve the trace spans of the server to local clients, off by default.
+         * @return Settings#m_TraceResource .
+         */
+        bool getTraceResource() const {
+            return m_TraceResource;
+        }
+
+        /**
+         * Serve the trace spans of the server to local clients, off by default.
+         * @return Settings#m_TraceResource .
+         */
+        bool &getTraceResource() {
+            return m_TraceResource;
+        }
+
+        static const std::string &getDurabilityStr(const EDurability pDurability);
+
+        static const std::string &getLogOverflowStr(const ELogOverflow pLogOverflow);
+
+        static const std::string &getKeyStoreStr(const EKeyStore pKeyStore);
+
+        /// @brief Parse a name of getKeyStoreStr(), throws std::invalid_argument for an unknown one.
+        static EKeyStore parseKeyStore(const std::string &pName);
+
         void save();
 
         /// @brief Load settings from disk, when they exists.
@@ -101,6 +370,21 @@ namespace trihlav {
 
         bool m_AllowRoot = true;
         int m_MinUser = 1000;
+        EDurability m_Durability = EGroupCommit;
+        int m_GroupCommitDelayUs = 0;
+        int m_RecentOtpWindowS = 300;
+        int m_RecentOtpCapacity = 65536;
+        int m_KeyRatePerMin = 60;
+        int m_KeyBurst = 10;
+        int m_ClientRatePerMin = 600;
+        int m_ClientBurst = 100;
+        int m_RateLimitSlots = 65536;
+        int m_LogQueueSize = 8192;
+        ELogOverflow m_LogOverflow = ELogDrop;
+        EKeyStore m_KeyStore = EJsonDir;
+        int m_LoadThreads = 0;
+        bool m_LazyKeys = false;
+        bool m_TraceResource = false;
 
         boost::filesystem::path m_ConfigDir;
         mutable bool m_InitializedFlag;
@@ -0,0 +1,427 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <stdexcept>
+#include <sqlite3.h>
+#include <boost/filesystem.hpp>
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavSqliteKeyStore.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+#include "trihlavLib/trihlavUTimestamp.hpp"
+
+using std::string;
+using std::runtime_error;
+using boost::filesystem::path;
+
+namespace trihlav {
+
+    namespace {
+        const char *K_CREATE_TABLE =
+                "CREATE TABLE IF NOT EXISTS keys ("
+                " public_id TEXT PRIMARY KEY NOT NULL,"
+                " private_id BLOB NOT NULL,"
+                " secret_key BLOB NOT NULL,"
+                " session_counter INTEGER NOT NULL,"
+                " use_counter INTEGER NOT NULL,"
+                " timestamp INTEGER NOT NULL,"
+                " random INTEGER NOT NULL,"
+                " crc INTEGER NOT NULL,"
+                " description TEXT NOT NULL,"
+                " sys_user TEXT NOT NULL)";
+
+        const char *K_SELECT_KEYS =
+                "SELECT rowid, public_id, private_id, secret_key, session_counter, use_counter, timestamp,"
+                " random, crc, description, sys_user FROM keys";
+
+        const char *K_INSERT_KEY =
+                "INSERT INTO keys (public_id, private_id, secret_key, session_counter, use_counter, timestamp,"
+                " random, crc, description, sys_user) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10)";
+
+        const char *K_UPDATE_KEY =
+                "UPDATE keys SET public_id = ?1, private_id = ?2, secret_key = ?3, session_counter = ?4,"
+                " use_counter = ?5, timestamp = ?6, random = ?7, crc = ?8, description = ?9, sys_user = ?10"
+                " WHERE rowid = ?11";
+
+        const char *K_UPDATE_COUNTERS =
+                "UPDATE keys SET session_counter = ?1, use_counter = ?2, timestamp = ?3, random = ?4, crc = ?5"
+                " WHERE rowid = ?6 AND private_id = ?7";
+
+        /// @brief A prepared SQL statement, finalized with its scope.
+        class Statement {
+        public:
+            Statement(sqlite3 *pDb, const char *pSql) //
+                    : m_Db(pDb), m_Stmt(0) //
+            {
+                check(sqlite3_prepare_v2(m_Db, pSql, -1, &m_Stmt, 0));
+            }
+
+            Statement(const Statement &) = delete;
+
+            Statement &operator=(const Statement &) = delete;
+
+            ~Statement() {
+                sqlite3_finalize(m_Stmt);
+            }
+
+            void bind(const int pIdx, const int64_t pVal) {
+                check(sqlite3_bind_int64(m_Stmt, pIdx, pVal));
+            }
+
+            void bind(const int pIdx, const string &pVal) {
+                check(sqlite3_bind_text(m_Stmt, pIdx, pVal.data(), int(pVal.size()), SQLITE_TRANSIENT));
+            }
+
+            void bindBlob(const int pIdx, const void *pVal, const size_t pSz) {
+                check(sqlite3_bind_blob(m_Stmt, pIdx, pVal, int(pSz), SQLITE_TRANSIENT));
+            }
+
+            /// @brief Bind all values of pKey as K_INSERT_KEY and K_UPDATE_KEY expect them.
+            void bindKey(const YubikoOtpKeyConfig &pKey) {
+                const yubikey_token_st &myToken = pKey.getToken();
+                bind(1, pKey.getPublicId());
+                bindBlob(2, myToken.uid, YUBIKEY_UID_SIZE);
+                bindBlob(3, pKey.getSecretKeyArray().data(), YUBIKEY_KEY_SIZE);
+                bind(4, myToken.ctr);
+                bind(5, myToken.use);
+                bind(6, pKey.getTimestamp().tstp_int);
+                bind(7, myToken.rnd);
+                bind(8, myToken.crc);
+                bind(9, pKey.getDescription());
+                bind(10, pKey.getSysUser());
+            }
+
+            /// @return true when a row was read, false when done.
+            bool step() {
+                const int myRc = sqlite3_step(m_Stmt);
+                if (myRc == SQLITE_ROW) {
+                    return true;
+                }
+                if (myRc != SQLITE_DONE) {
+                    check(myRc);
+                }
+                return false;
+            }
+
+            void reset() {
+                sqlite3_reset(m_Stmt);
+                sqlite3_clear_bindings(m_Stmt);
+            }
+
+            int64_t getInt(const int pCol) const {
+                return sqlite3_column_int64(m_Stmt, pCol);
+            }
+
+            const string getText(const int pCol) const {
+                const unsigned char *myText = sqlite3_column_text(m_Stmt, pCol);
+                return myText == 0 ? string() : string(reinterpret_cast<const char *>(myText),
+                                                       size_t(sqlite3_column_bytes(m_Stmt, pCol)));
+            }
+
+            /// @brief Copy a blob of exactly pSz bytes, @return false when it has another size.
+            bool getBlob(const int pCol, void *pBuf, const size_t pSz) const {
+                const void *myBlob = sqlite3_column_blob(m_Stmt, pCol);
+                if (myBlob == 0 || size_t(sqlite3_column_bytes(m_Stmt, pCol)) != pSz) {
+                    return false;
+                }
+                memcpy(pBuf, myBlob, pSz);
+                return true;
+            }
+
+            /// @brief A key of the current row of K_SELECT_KEYS, throws std::runtime_error when it is damaged.
+            std::shared_ptr<YubikoOtpKeyConfig> getKey(KeyManager &pKeyManager) const {
+                yubikey_token_st myToken;
+                memset(&myToken, 0, sizeof(myToken));
+                uint8_t myKey[YUBIKEY_KEY_SIZE];
+                const string myPubId{getText(1)};
+                if (!getBlob(2, myToken.uid, YUBIKEY_UID_SIZE) || !getBlob(3, myKey, YUBIKEY_KEY_SIZE)) {
+                    throw runtime_error("Key " + myPubId + " has a private ID or secret key of a wrong size.");
+                }
+                myToken.ctr = uint16_t(getInt(4));
+                myToken.use = uint8_t(getInt(5));
+                const UTimestamp myTstp(int(getInt(6)));
+                myToken.tstpl = myTstp.tstp.tstpl;
+                myToken.tstph = myTstp.tstp.tstph;
+                myToken.rnd = uint16_t(getInt(7));
+                myToken.crc = uint16_t(getInt(8));
+                std::shared_ptr<YubikoOtpKeyConfig> myRetVal =
+                        std::make_shared<YubikoOtpKeyConfig>(pKeyManager, path());
+                myRetVal->assign(myPubId, myToken, myKey, getText(9), getText(10));
+                myRetVal->setStoreRecord(getInt(0));
+                return myRetVal;
+            }
+
+        private:
+            void check(const int pRc) const {
+                if (pRc != SQLITE_OK) {
+                    throw runtime_error(string("SQLite key store failed - ") + sqlite3_errmsg(m_Db));
+                }
+            }
+
+            sqlite3 *m_Db;
+            sqlite3_stmt *m_Stmt;
+        };
+    }
+
+    SqliteKeyStore::SqliteKeyStore(KeyManager &pKeyManager) //
+            : KeyStore(pKeyManager), m_Db(0), m_InTransaction(false) //
+    {
+    }
+
+/**
+ * Counters written but not synced yet are committed, they would be rolled
+ * back otherwise.
+ */
+    SqliteKeyStore::~SqliteKeyStore() {
+        if (m_Db != 0) {
+            try {
+                commit();
+            } catch (const std::exception &myExc) {
+                TRIHLAV_LOG(error) << "Failed to commit the key counters - " << myExc.what();
+            }
+            sqlite3_close(m_Db);
+        }
+    }
+
+    const string &SqliteKeyStore::getName() const {
+        return Settings::getKeyStoreStr(Settings::ESqlite);
+    }
+
+    const path SqliteKeyStore::getLocation() const {
+        return getKeyManager().getSettings().getConfigDir() / "keys.trihlav-sqlite";
+    }
+
+/**
+ * Each commit is flushed (synchronous=FULL), so put() and erase() are
+ * durable when they return. Readers do not block the writer in WAL mode.
+ */
+    bool SqliteKeyStore::open() {
+        if (m_Db != 0) {
+            return true;
+        }
+        const path myFilename{getLocation()};
+        if (!isWritable() && !exists(myFilename)) {
+            return false;
+        }
+        TRIHLAV_TRACE_SCOPE("SqliteKeyStore::open");
+        const int myFlags = isWritable() ? SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE : SQLITE_OPEN_READONLY;
+        if (sqlite3_open_v2(myFilename.c_str(), &m_Db, myFlags | SQLITE_OPEN_NOMUTEX, 0) != SQLITE_OK) {
+            const string myMsg = "Failed to open " + myFilename.string() + " - "
+                                 + (m_Db == 0 ? string("out of memory") : string(sqlite3_errmsg(m_Db)));
+            sqlite3_close(m_Db);
+            m_Db = 0;
+            throw runtime_error(myMsg);
+        }
+        try {
+            sqlite3_busy_timeout(m_Db, 5000);
+            if (isWritable()) {
+                exec("PRAGMA journal_mode=WAL");
+                exec("PRAGMA synchronous=FULL");
+                exec(K_CREATE_TABLE);
+            }
+        } catch (...) {
+            sqlite3_close(m_Db);
+            m_Db = 0;
+            throw;
+        }
+        TRIHLAV_LOG(info) << "Opened key database " << myFilename << ".";
+        return true;
+    }
+
+    void SqliteKeyStore::exec(const char *pSql) {
+        char *myErr = 0;
+        if (sqlite3_exec(m_Db, pSql, 0, 0, &myErr) != SQLITE_OK) {
+            const string myMsg = "SQLite key store failed to run \"" + string(pSql) + "\" - "
+                                 + (myErr == 0 ? string(sqlite3_errmsg(m_Db)) : string(myErr));
+            sqlite3_free(myErr);
+            throw runtime_error(myMsg);
+        }
+    }
+
+    void SqliteKeyStore::commit() {
+        if (m_InTransaction) {
+            exec("COMMIT");
+            m_InTransaction = false;
+        }
+    }
+
+    void SqliteKeyStore::load(KeyList_t &pKeys) {
+        TRIHLAV_TRACE_SCOPE("SqliteKeyStore::load");
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        if (!open()) {
+            return;
+        }
+        Statement mySelect(m_Db, (string(K_SELECT_KEYS) + " ORDER BY public_id").c_str());
+        while (mySelect.step()) {
+            try {
+                pKeys.emplace_back(mySelect.getKey(getKeyManager()));
+            } catch (std::exception &myExc) {
+                TRIHLAV_LOG(error) << "Skipping row " << mySelect.getInt(0) << " of " << getLocation() << " - "
+                                   << myExc.what();
+            }
+        }
+    }
+
+    SqliteKeyStore::KeyPtr_t SqliteKeyStore::get(const string &pPubId) {
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        if (!open()) {
+            return KeyPtr_t();
+        }
+        Statement mySelect(m_Db, (string(K_SELECT_KEYS) + " WHERE public_id = ?1").c_str());
+        mySelect.bind(1, pPubId);
+        return mySelect.step() ? mySelect.getKey(getKeyManager()) : KeyPtr_t();
+    }
+
+    void SqliteKeyStore::loadLocations(std::vector<Location> &pLocations) {
+        TRIHLAV_TRACE_SCOPE("SqliteKeyStore::loadLocations");
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        if (!open()) {
+            return;
+        }
+        Statement mySelect(m_Db, "SELECT rowid, public_id FROM keys");
+        while (mySelect.step()) {
+            Location myLocation;
+            myLocation.m_Record = mySelect.getInt(0);
+            myLocation.m_Id = PublicId(mySelect.getText(1));
+            pLocations.emplace_back(std::move(myLocation));
+        }
+    }
+
+    void SqliteKeyStore::put(YubikoOtpKeyConfig &pKey) {
+        TRIHLAV_TRACE_SCOPE("SqliteKeyStore::put");
+        checkWritable();
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        open();
+        commit();
+        try {
+            if (pKey.getStoreRecord() >= 0) {
+                Statement myUpdate(m_Db, K_UPDATE_KEY);
+                myUpdate.bindKey(pKey);
+                myUpdate.bind(11, pKey.getStoreRecord());
+                myUpdate.step();
+                if (sqlite3_changes(m_Db) > 0) {
+                    return;
+                }
+            }
+            Statement myInsert(m_Db, K_INSERT_KEY);
+            myInsert.bindKey(pKey);
+            myInsert.step();
+            pKey.setStoreRecord(sqlite3_last_insert_rowid(m_Db));
+        } catch (const runtime_error &myExc) {
+            if (sqlite3_extended_errcode(m_Db) == SQLITE_CONSTRAINT_PRIMARYKEY) {
+                throw runtime_error("Public ID " + pKey.getPublicId() + " is used by another key.");
+            }
+            throw;
+        }
+    }
+
+    void SqliteKeyStore::erase(YubikoOtpKeyConfig &pKey) {
+        TRIHLAV_TRACE_SCOPE("SqliteKeyStore::erase");
+        checkWritable();
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        open();
+        commit();
+        if (pKey.getStoreRecord() >= 0) {
+            Statement myDelete(m_Db, "DELETE FROM keys WHERE rowid = ?1");
+            myDelete.bind(1, pKey.getStoreRecord());
+            myDelete.step();
+        } else {
+            Statement myDelete(m_Db, "DELETE FROM keys WHERE public_id = ?1");
+            myDelete.bind(1, pKey.getPublicId());
+            myDelete.step();
+        }
+        pKey.setStoreRecord(-1);
+    }
+
+/**
+ * A row re-created with another private ID keeps its counters.
+ */
+    bool SqliteKeyStore::saveCounters(const YubikoOtpKeyConfig &pKey) {
+        checkWritable();
+        if (pKey.getStoreRecord() < 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        open();
+        if (!m_InTransaction) {
+            exec("BEGIN IMMEDIATE");
+            m_InTransaction = true;
+        }
+        const yubikey_token_st &myToken = pKey.getToken();
+        Statement myUpdate(m_Db, K_UPDATE_COUNTERS);
+        myUpdate.bind(1, myToken.ctr);
+        myUpdate.bind(2, myToken.use);
+        myUpdate.bind(3, pKey.getTimestamp().tstp_int);
+        // the CRC covers the random too, both are written together
+        myUpdate.bind(4, myToken.rnd);
+        myUpdate.bind(5, myToken.crc);
+        myUpdate.bind(6, pKey.getStoreRecord());
+        myUpdate.bindBlob(7, myToken.uid, YUBIKEY_UID_SIZE);
+        myUpdate.step();
+        return sqlite3_changes(m_Db) > 0;
+    }
+
+    void SqliteKeyStore::sync() {
+        TRIHLAV_TRACE_SCOPE("SqliteKeyStore::sync");
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        if (m_Db != 0) {
+            commit();
+        }
+    }
+
+    size_t SqliteKeyStore::write(const std::vector<const YubikoOtpKeyConfig *> &pKeys) {
+        TRIHLAV_TRACE_SCOPE("SqliteKeyStore::write");
+        checkWritable();
+        std::lock_guard<std::mutex> myLock(m_Mutex);
+        open();
+        commit();
+        size_t myRetVal = 0;
+        exec("BEGIN IMMEDIATE");
+        try {
+            exec("DELETE FROM keys");
+            Statement myInsert(m_Db, K_INSERT_KEY);
+            for (const YubikoOtpKeyConfig *myKey : pKeys) {
+                if (!myKey->getPublicId().empty()) {
+                    myInsert.bindKey(*myKey);
+                    myInsert.step();
+                    myInsert.reset();
+                    ++myRetVal;
+                }
+            }
+            exec("COMMIT");
+        } catch (...) {
+            sqlite3_exec(m_Db, "ROLLBACK", 0, 0, 0);
+            throw;
+        }
+        TRIHLAV_LOG(info) << "Wrote " << myRetVal << " keys into " << getLocation() << ".";
+        return myRetVal;
+    }
+
+} /* namespace trihlav */
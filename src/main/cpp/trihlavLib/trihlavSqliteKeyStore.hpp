@@ -0,0 +1,95 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_SQLITE_KEY_STORE_HPP_
+#define TRIHLAV_SQLITE_KEY_STORE_HPP_
+
+#include <mutex>
+
+#include "trihlavLib/trihlavKeyStore.hpp"
+
+struct sqlite3;
+
+namespace trihlav {
+
+    /**
+     * Keys in an embedded SQLite database in WAL mode.
+     *
+     * One row per key, the row ID is YubikoOtpKeyConfig::getStoreRecord().
+     * put() and erase() commit at once, saveCounters() gathers the counters
+     * in one transaction which sync() commits. The database is opened on
+     * first use, read only for a read only key manager.
+     */
+    class SqliteKeyStore : public KeyStore {
+    public:
+        explicit SqliteKeyStore(KeyManager &pKeyManager);
+
+        virtual ~SqliteKeyStore();
+
+        virtual const std::string &getName() const override;
+
+        /// @brief The database file in the configuration directory.
+        virtual const boost::filesystem::path getLocation() const override;
+
+        virtual void load(KeyList_t &pKeys) override;
+
+        virtual KeyPtr_t get(const std::string &pPubId) override;
+
+        /// @brief Only the row IDs and the public IDs, keys are loaded by their public ID.
+        virtual void loadLocations(std::vector<Location> &pLocations) override;
+
+        /// @brief Throws std::runtime_error when another key has the same public ID.
+        virtual void put(YubikoOtpKeyConfig &pKey) override;
+
+        virtual void erase(YubikoOtpKeyConfig &pKey) override;
+
+        virtual bool saveCounters(const YubikoOtpKeyConfig &pKey) override;
+
+        virtual void sync() override;
+
+        /// @brief Replace all rows in one transaction.
+        virtual size_t write(const std::vector<const YubikoOtpKeyConfig *> &pKeys) override;
+
+    private:
+        /// @brief Open the database, the caller holds m_Mutex. @return false when there is none to read.
+        bool open();
+
+        /// @brief Run pSql, throws std::runtime_error when it fails.
+        void exec(const char *pSql);
+
+        /// @brief Commit the counters of saveCounters(), the caller holds m_Mutex.
+        void commit();
+
+        std::mutex m_Mutex;
+        sqlite3 *m_Db;
+        bool m_InTransaction;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_SQLITE_KEY_STORE_HPP_ */
@@ -6,10 +6,7 @@
  */
 
 #include <algorithm>
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
-#include <boost/log/expressions.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
 
 #include "trihlavLib/trihlavFactoryIface.hpp"
 #include "trihlavLib/trihlavSysUserListViewIface.hpp"
@@ -25,13 +22,13 @@ namespace trihlav {
     SysUserListPresenter::SysUserListPresenter(FactoryIface &pFactory) :
             PresenterBase(pFactory), m_SysUsers(new SysUsers()), m_CurrentUser(
             m_SysUsers->end()) {
-        BOOST_LOG_NAMED_SCOPE("SysUserListPresenter::SysUserListPresenter");
+        TRIHLAV_TRACE_SCOPE("SysUserListPresenter::SysUserListPresenter");
         getView().selectionChangedSig.connect([=](int pIdx) { selectedUser(pIdx); });
         getView().sigDialogFinished.connect([=](bool pAccepted) { accepted(pAccepted); });
     }
 
     SysUserListViewIface &SysUserListPresenter::getView() {
-        BOOST_LOG_NAMED_SCOPE("SysUserListPresenter::getView");
+        TRIHLAV_TRACE_SCOPE("SysUserListPresenter::getView");
         if (!m_View) {
             m_View = getFactory().createSysUserListView();
         }
@@ -39,7 +36,7 @@ namespace trihlav {
     }
 
     const string SysUserListPresenter::getSelectedSysUser() const {
-        BOOST_LOG_NAMED_SCOPE("SysUserListPresenter::getSelectedSysUser");
+        TRIHLAV_TRACE_SCOPE("SysUserListPresenter::getSelectedSysUser");
         static const string K_EMPTY;
         if (m_CurrentUser != m_SysUsers->end()) {
             return m_CurrentUser->str();
@@ -48,7 +45,7 @@ namespace trihlav {
     }
 
     void SysUserListPresenter::show() {
-        BOOST_LOG_NAMED_SCOPE("SysUserListPresenter::show");
+        TRIHLAV_TRACE_SCOPE("SysUserListPresenter::show");
         OsIface &myOs{getFactory().getOsIface()};
         const SysUsers myUsers{myOs.getSysUsers(getFactory().getSettings())};
         m_SysUsers->clear();
@@ -59,22 +56,22 @@ namespace trihlav {
     }
 
     SysUserListPresenter::~SysUserListPresenter() {
-        BOOST_LOG_NAMED_SCOPE("SysUserListPresenter::~SysUserListPresenter");
+        TRIHLAV_TRACE_SCOPE("SysUserListPresenter::~SysUserListPresenter");
     }
 
     void SysUserListPresenter::selectedUser(int pIdx) {
-        BOOST_LOG_NAMED_SCOPE("SysUserListPresenter::selectedUser");
+        TRIHLAV_TRACE_SCOPE("SysUserListPresenter::selectedUser");
         if (pIdx >= 0 || pIdx < m_SysUsers->size()) {
             auto mySelected = getView().getRow(pIdx);
-            BOOST_LOG_TRIVIAL(debug) << "Selected " << std::get<0>(mySelected);
+            TRIHLAV_LOG(debug) << "Selected " << std::get<0>(mySelected);
             m_CurrentUser = (m_SysUsers->begin() += pIdx);
         }
     }
 
     void SysUserListPresenter::accepted(const bool pAccepted) {
-        BOOST_LOG_NAMED_SCOPE("SysUserListPresenter::accepted");
+        TRIHLAV_TRACE_SCOPE("SysUserListPresenter::accepted");
         if (pAccepted) {
-            BOOST_LOG_TRIVIAL(debug) << "accepted";
+            TRIHLAV_LOG(debug) << "accepted";
             this->userSelectedSig();
         }
     }
@@ -0,0 +1,182 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+
+#include "trihlavLib/trihlavTrace.hpp"
+
+namespace trihlav {
+
+    constexpr size_t Trace::K_RING_SIZE;
+
+    std::atomic<bool> Trace::theEnabled(false);
+
+    /**
+     * Spans of one thread. Only the owning thread writes, a dump reads the
+     * slots concurrently and drops those which may have been overwritten
+     * meanwhile.
+     */
+    struct TraceRing {
+        struct Slot {
+            std::atomic<const char *> m_Name;
+            std::atomic<uint64_t> m_StartNs;
+            std::atomic<uint64_t> m_EndNs;
+        };
+
+        explicit TraceRing(const uint64_t pTid) : m_Tid(pTid), m_Next(0), m_Cleared(0) {
+        }
+
+        const uint64_t m_Tid;
+        std::atomic<uint64_t> m_Next;     //< count of spans ever written
+        std::atomic<uint64_t> m_Cleared;  //< spans before it are not dumped
+        Slot m_Slots[Trace::K_RING_SIZE];
+    };
+
+    /// @brief Rings of all threads which traced, they outlive their threads.
+    struct TraceRings {
+        std::mutex m_Mutex;
+        std::vector<std::shared_ptr<TraceRing> > m_Rings;
+    };
+
+    static TraceRings &getRings() {
+        static TraceRings theRings;
+        return theRings;
+    }
+
+    static TraceRing &getThreadRing() {
+        static thread_local std::shared_ptr<TraceRing> theRing;
+        if (!theRing) {
+            TraceRings &myRings = getRings();
+            std::lock_guard<std::mutex> myLock(myRings.m_Mutex);
+            theRing = std::make_shared<TraceRing>(myRings.m_Rings.size() + 1);
+            myRings.m_Rings.push_back(theRing);
+        }
+        return *theRing;
+    }
+
+    void Trace::setEnabled(const bool pEnabled) {
+        getNowNs();
+        theEnabled.store(pEnabled, std::memory_order_relaxed);
+    }
+
+/**
+ * Never 0, which marks a span started while tracing was off.
+ */
+    uint64_t Trace::getNowNs() {
+        static const std::chrono::steady_clock::time_point theEpoch = std::chrono::steady_clock::now();
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - theEpoch).count()) + 1;
+    }
+
+    void Trace::record(const char *pName, const uint64_t pStartNs, const uint64_t pEndNs) {
+        TraceRing &myRing = getThreadRing();
+        const uint64_t myPos = myRing.m_Next.load(std::memory_order_relaxed);
+        TraceRing::Slot &mySlot = myRing.m_Slots[myPos % K_RING_SIZE];
+        // A dump reading the overwritten slot sees m_Next advanced at least up to myPos.
+        std::atomic_thread_fence(std::memory_order_release);
+        mySlot.m_Name.store(pName, std::memory_order_relaxed);
+        mySlot.m_StartNs.store(pStartNs, std::memory_order_relaxed);
+        mySlot.m_EndNs.store(pEndNs, std::memory_order_relaxed);
+        myRing.m_Next.store(myPos + 1, std::memory_order_release);
+    }
+
+    static void writeJsonStr(std::ostream &pOut, const char *pStr) {
+        pOut << '"';
+        for (const char *myC = pStr; *myC != 0; ++myC) {
+            if (*myC == '"' || *myC == '\\') {
+                pOut << '\\';
+            }
+            pOut << *myC;
+        }
+        pOut << '"';
+    }
+
+/**
+ * Complete events ("ph":"X") with microsecond timestamps. Slots are
+ * copied first and kept only when the writer did not lap them while they
+ * were copied.
+ */
+    void Trace::writeChromeTrace(std::ostream &pOut) {
+        std::vector<std::shared_ptr<TraceRing> > myRings;
+        {
+            TraceRings &myAll = getRings();
+            std::lock_guard<std::mutex> myLock(myAll.m_Mutex);
+            myRings = myAll.m_Rings;
+        }
+        const int myPid = int(getpid());
+        const std::streamsize myPrecision = pOut.precision(15);
+        pOut << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool myFirst = true;
+        struct Span {
+            const char *m_Name;
+            uint64_t m_StartNs;
+            uint64_t m_EndNs;
+        };
+        std::vector<Span> mySpans;
+        for (const std::shared_ptr<TraceRing> &myRing : myRings) {
+            const uint64_t myEnd = myRing->m_Next.load(std::memory_order_acquire);
+            const uint64_t myBegin = std::max(myRing->m_Cleared.load(std::memory_order_relaxed),
+                                              myEnd > K_RING_SIZE ? myEnd - K_RING_SIZE : 0);
+            mySpans.clear();
+            for (uint64_t myPos = myBegin; myPos < myEnd; ++myPos) {
+                const TraceRing::Slot &mySlot = myRing->m_Slots[myPos % K_RING_SIZE];
+                mySpans.push_back(Span{mySlot.m_Name.load(std::memory_order_relaxed),
+                                       mySlot.m_StartNs.load(std::memory_order_relaxed),
+                                       mySlot.m_EndNs.load(std::memory_order_relaxed)});
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t myLapped = myRing->m_Next.load(std::memory_order_relaxed);
+            // The slot of position myLapped - K_RING_SIZE may be being overwritten.
+            const uint64_t mySafe = myLapped + 1 > K_RING_SIZE ? myLapped + 1 - K_RING_SIZE : 0;
+            for (uint64_t myPos = std::max(myBegin, mySafe); myPos < myEnd; ++myPos) {
+                const Span &mySpan = mySpans[myPos - myBegin];
+                pOut << (myFirst ? "\n" : ",\n") << "{\"name\":";
+                writeJsonStr(pOut, mySpan.m_Name);
+                pOut << ",\"ph\":\"X\",\"ts\":" << double(mySpan.m_StartNs) / 1000.0
+                     << ",\"dur\":" << double(mySpan.m_EndNs - mySpan.m_StartNs) / 1000.0
+                     << ",\"pid\":" << myPid << ",\"tid\":" << myRing->m_Tid << "}";
+                myFirst = false;
+            }
+        }
+        pOut << "\n]}\n";
+        pOut.precision(myPrecision);
+    }
+
+    void Trace::clear() {
+        TraceRings &myRings = getRings();
+        std::lock_guard<std::mutex> myLock(myRings.m_Mutex);
+        for (const std::shared_ptr<TraceRing> &myRing : myRings.m_Rings) {
+            myRing->m_Cleared.store(myRing->m_Next.load(std::memory_order_acquire), std::memory_order_relaxed);
+        }
+    }
+
+} /* namespace trihlav */
@@ -0,0 +1,99 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_TRACE_HPP_
+#define TRIHLAV_TRACE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <cstdint>
+
+namespace trihlav {
+
+    /**
+     * Runtime switchable tracing of function spans.
+     *
+     * While tracing is off a span costs one relaxed load and a branch
+     * predicted not taken. While it is on, every span ending stores its
+     * name, start and duration into a ring buffer of the current thread,
+     * the oldest spans are overwritten. The rings are dumped as Chrome
+     * trace event JSON, to be opened in chrome://tracing or Perfetto.
+     */
+    class Trace {
+    public:
+        /// @brief Slots per thread, the newest K_RING_SIZE - 1 spans are dumped.
+        static constexpr size_t K_RING_SIZE = 8192;
+
+        static bool isEnabled() {
+            return __builtin_expect(theEnabled.load(std::memory_order_relaxed), false);
+        }
+
+        static void setEnabled(const bool pEnabled);
+
+        /// @brief Nanoseconds since the first call.
+        static uint64_t getNowNs();
+
+        /// @brief Store a finished span into the ring of the current thread, pName has to be a literal.
+        static void record(const char *pName, const uint64_t pStartNs, const uint64_t pEndNs);
+
+        /// @brief Write the spans of all threads as Chrome trace event JSON.
+        static void writeChromeTrace(std::ostream &pOut);
+
+        /// @brief Forget the recorded spans.
+        static void clear();
+
+    private:
+        static std::atomic<bool> theEnabled;
+    };
+
+    /// @brief A span from its construction to its destruction, @see TRIHLAV_TRACE_SCOPE .
+    class TraceSpan {
+    public:
+        explicit TraceSpan(const char *pName) //
+                : m_Name(pName), m_StartNs(Trace::isEnabled() ? Trace::getNowNs() : 0) {
+        }
+
+        ~TraceSpan() {
+            if (m_StartNs != 0) {
+                Trace::record(m_Name, m_StartNs, Trace::getNowNs());
+            }
+        }
+
+        TraceSpan(const TraceSpan &) = delete;
+
+        TraceSpan &operator=(const TraceSpan &) = delete;
+
+    private:
+        const char *const m_Name;
+        const uint64_t m_StartNs;  //< 0 when tracing was off
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_TRACE_HPP_ */
@@ -0,0 +1,143 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <type_traits>
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavUnknownIdCache.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+namespace trihlav {
+
+    constexpr size_t UnknownIdCache::K_SLOTS;
+
+    static constexpr unsigned K_SLOT_BITS = 12;
+
+    static_assert(UnknownIdCache::K_SLOTS == size_t(1) << K_SLOT_BITS, "K_SLOTS has to match K_SLOT_BITS.");
+
+    constexpr size_t UnknownIdCache::K_ID_WORDS;
+
+    static_assert(std::is_trivially_copyable<PublicId>::value, "A PublicId is stored as plain words.");
+
+    /// @brief The bytes of a PublicId, zero padded to whole words.
+    using IdWords = std::array<uint64_t, 3>;
+
+    static_assert(sizeof(PublicId) <= sizeof(IdWords), "A PublicId has to fit the slot words.");
+
+    static IdWords toWords(const PublicId &pId) {
+        IdWords myRetVal{};
+        memcpy(myRetVal.data(), &pId, sizeof(PublicId));
+        return myRetVal;
+    }
+
+    UnknownIdCache::UnknownIdCache(const std::chrono::seconds pReportInterval) //
+            : m_ReportInterval(std::chrono::duration_cast<Clock::duration>(pReportInterval).count()), //
+              m_Misses(0), m_Distinct(0), m_NextReport(0), m_ReportedMisses(0), m_ReportedDistinct(0) //
+    {
+        for (Slot &mySlot : m_Slots) {
+            mySlot.m_Seq.store(0, std::memory_order_relaxed);
+            mySlot.m_Generation.store(0, std::memory_order_relaxed);
+            for (std::atomic<uint64_t> &myWord : mySlot.m_Id) {
+                myWord.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    UnknownIdCache::~UnknownIdCache() {
+    }
+
+    size_t UnknownIdCache::getSlot(const PublicId &pId, const uint64_t pGeneration) {
+        return (pId.hash() ^ (pGeneration * 0x9e3779b97f4a7c15ULL)) >> (64 - K_SLOT_BITS);
+    }
+
+/**
+ * A slot being written or rewritten while it is read is a miss of the
+ * cache, the caller looks the ID up in the index then.
+ */
+    bool UnknownIdCache::isUnknown(const PublicId &pId, const uint64_t pGeneration) {
+        const Slot &mySlot = m_Slots[getSlot(pId, pGeneration)];
+        const uint64_t mySeq = mySlot.m_Seq.load(std::memory_order_acquire);
+        if (mySeq == 0 || (mySeq & 1) != 0) {
+            return false;
+        }
+        bool myEqual = mySlot.m_Generation.load(std::memory_order_relaxed) == pGeneration;
+        const IdWords myId = toWords(pId);
+        for (size_t myI = 0; myI < K_ID_WORDS; ++myI) {
+            myEqual = mySlot.m_Id[myI].load(std::memory_order_relaxed) == myId[myI] && myEqual;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!myEqual || mySlot.m_Seq.load(std::memory_order_relaxed) != mySeq) {
+            return false;
+        }
+        countMiss(false);
+        return true;
+    }
+
+/**
+ * A slot another thread is just writing is left to it.
+ */
+    void UnknownIdCache::addUnknown(const PublicId &pId, const uint64_t pGeneration) {
+        Slot &mySlot = m_Slots[getSlot(pId, pGeneration)];
+        uint64_t mySeq = mySlot.m_Seq.load(std::memory_order_relaxed);
+        if ((mySeq & 1) == 0
+            && mySlot.m_Seq.compare_exchange_strong(mySeq, mySeq + 1, std::memory_order_acquire)) {
+            std::atomic_thread_fence(std::memory_order_release);
+            const IdWords myId = toWords(pId);
+            for (size_t myI = 0; myI < K_ID_WORDS; ++myI) {
+                mySlot.m_Id[myI].store(myId[myI], std::memory_order_relaxed);
+            }
+            mySlot.m_Generation.store(pGeneration, std::memory_order_relaxed);
+            mySlot.m_Seq.store(mySeq + 2, std::memory_order_release);
+        }
+        TRIHLAV_LOG_LIMITED(debug, 60) << "Key prefixed " << pId.toString() << " has not been found.";
+        countMiss(true);
+    }
+
+/**
+ * The first miss is reported at once, later ones together after the
+ * report interval passed. Only the thread which advanced the report time
+ * logs.
+ */
+    void UnknownIdCache::countMiss(const bool pDistinct) {
+        const uint64_t myMisses = m_Misses.fetch_add(1, std::memory_order_relaxed) + 1;
+        const uint64_t myDistinct = pDistinct ? m_Distinct.fetch_add(1, std::memory_order_relaxed) + 1
+                                              : m_Distinct.load(std::memory_order_relaxed);
+        const int64_t myNow = Clock::now().time_since_epoch().count();
+        int64_t myNext = m_NextReport.load(std::memory_order_relaxed);
+        if (myNow < myNext || !m_NextReport.compare_exchange_strong(myNext, myNow + m_ReportInterval)) {
+            return;
+        }
+        TRIHLAV_LOG(warning) << myMisses - m_ReportedMisses.exchange(myMisses)
+                             << " lookups of unknown public IDs ("
+                             << myDistinct - m_ReportedDistinct.exchange(myDistinct)
+                             << " new) since the last report.";
+    }
+
+} /* namespace trihlav */
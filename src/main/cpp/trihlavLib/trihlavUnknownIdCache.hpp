@@ -0,0 +1,104 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_UNKNOWN_ID_CACHE_HPP_
+#define TRIHLAV_UNKNOWN_ID_CACHE_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "trihlavLib/trihlavPublicId.hpp"
+
+namespace trihlav {
+
+    /**
+     * Remembers public IDs recently looked up in vain and counts the misses.
+     *
+     * The IDs are stored with the generation of the key index they were
+     * missing from, so publishing a new index invalidates all of them
+     * without touching the table. A slot holds the whole ID, an ID is only
+     * reported unknown when it equals the stored one, hash collisions never
+     * hide a loaded key. Slots are read and written lock free under a
+     * sequence counter, colliding IDs simply overwrite each other.
+     *
+     * Misses are not logged one by one, a summary is logged as warning at
+     * most once per report interval.
+     */
+    class UnknownIdCache {
+    public:
+        /// @brief Count of slots, a power of two.
+        static constexpr size_t K_SLOTS = 4096;
+
+        explicit UnknownIdCache(const std::chrono::seconds pReportInterval = std::chrono::seconds(60));
+
+        virtual ~UnknownIdCache();
+
+        /// @brief Was pId recorded as unknown to the index generation pGeneration? Counts the miss if so.
+        bool isUnknown(const PublicId &pId, const uint64_t pGeneration);
+
+        /// @brief Record pId as unknown to the index generation pGeneration and count the miss.
+        void addUnknown(const PublicId &pId, const uint64_t pGeneration);
+
+        /// @brief All lookups of unknown IDs so far.
+        uint64_t getMissCount() const {
+            return m_Misses.load(std::memory_order_relaxed);
+        }
+
+        /// @brief Misses which were not answered by the cache.
+        uint64_t getDistinctCount() const {
+            return m_Distinct.load(std::memory_order_relaxed);
+        }
+
+    private:
+        /// @brief PublicId as atomic words.
+        static constexpr size_t K_ID_WORDS = 3;
+
+        struct Slot {
+            std::atomic<uint64_t> m_Seq;        //< odd while being written, 0 for an empty slot
+            std::atomic<uint64_t> m_Generation;
+            std::array<std::atomic<uint64_t>, K_ID_WORDS> m_Id;
+        };
+
+        static size_t getSlot(const PublicId &pId, const uint64_t pGeneration);
+
+        void countMiss(const bool pDistinct);
+
+        const int64_t m_ReportInterval;  //< in Clock ticks
+        std::array<Slot, K_SLOTS> m_Slots;
+        std::atomic<uint64_t> m_Misses;
+        std::atomic<uint64_t> m_Distinct;
+        std::atomic<int64_t> m_NextReport;  //< Clock ticks
+        std::atomic<uint64_t> m_ReportedMisses;
+        std::atomic<uint64_t> m_ReportedDistinct;
+    };
+
+} /* namespace trihlav */
+
+#endif /* TRIHLAV_UNKNOWN_ID_CACHE_HPP_ */
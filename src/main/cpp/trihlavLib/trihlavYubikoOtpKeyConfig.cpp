@@ -3,13 +3,17 @@
 #include <sstream>
 #include <vector>
 #include <array>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
@@ -23,6 +27,11 @@
 #include "trihlavLib/trihlavEmptyPublicId.hpp"
 #include "trihlavLib/trihlavLog.hpp"
 #include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavCounterJournal.hpp"
+#include "trihlavLib/trihlavBinaryKeystore.hpp"
+#include "trihlavLib/trihlavKeyStore.hpp"
+#include "trihlavLib/trihlavCrc16.hpp"
+#include "trihlavLib/trihlavMetrics.hpp"
 
 using std::cout;
 using std::ostringstream;
@@ -49,7 +58,8 @@ typedef array<uint8_t, YUBIKEY_UID_SIZE + 1> OTP_t;
 PRETTY_DEFAULT_DECORATION(vector<int>, "[[", "||", ">")
 
 namespace {
-    constexpr uintmax_t K_MX_KEY_FILE_SZ = 1024;
+    constexpr uintmax_t K_MX_KEY_FILE_SZ = trihlav::YubikoOtpKeyConfig::K_MAX_KEY_FILE_SIZE;
+    constexpr size_t K_JSON_BUF_SZ = 2 * K_MX_KEY_FILE_SZ;
     constexpr uintmax_t K_SEC_KEY_SZ = YUBIKEY_KEY_SIZE * 2;
 }
 
@@ -83,8 +93,9 @@ namespace trihlav {
     static const string K_NM_DOC_SYS_USER = K_NM_DOC + K_NM_SYS_USER;
 
     void YubikoOtpKeyConfig::zeroToken() {
-        memset(&m_Token, 0, sizeof(yubikey_token_st));
-        memset(&m_Key, 0, YUBIKEY_KEY_SIZE);
+        memset(&m_Hot->m_Token, 0, sizeof(yubikey_token_st));
+        const SecretKeyArr myZero{};
+        m_Hot->setKey(myZero.data());
     }
 
 /**
@@ -95,9 +106,10 @@ namespace trihlav {
     YubikoOtpKeyConfig::YubikoOtpKeyConfig(KeyManager &pKeyManager,
                                            const bfs::path &pFilename) :
             m_KeyManager(pKeyManager), m_ChangedFlag(false), m_Filename(
-            pFilename) {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyConfig::YubikoOtpKeyConfig");
-        BOOST_LOG_TRIVIAL(debug) << "Passed filename:  " << pFilename.native();
+            pFilename), m_Hot(getHotKeys().allocate()) {
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyConfig::YubikoOtpKeyConfig");
+        m_Hot->m_Cold = this;
+        TRIHLAV_LOG(debug) << "Passed filename:  " << pFilename.native();
         zeroToken();
     }
 
@@ -105,22 +117,37 @@ namespace trihlav {
  *
  */
     YubikoOtpKeyConfig::YubikoOtpKeyConfig(KeyManager &pKeyManager) :
-            m_KeyManager(pKeyManager), m_ChangedFlag(false) {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyConfig::YubikoOtpKeyConfig");
+            m_KeyManager(pKeyManager), m_ChangedFlag(false), m_Hot(getHotKeys().allocate()) {
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyConfig::YubikoOtpKeyConfig");
+        m_Hot->m_Cold = this;
         generateFilename();
         zeroToken();
     }
 
+/**
+ * Everything is copied, the HotKey record too, into a record of its own.
+ */
+    YubikoOtpKeyConfig::YubikoOtpKeyConfig(const YubikoOtpKeyConfig &pOther) :
+            m_PublicId(pOther.m_PublicId), m_ChangedFlag(pOther.m_ChangedFlag),
+            m_Filename(pOther.m_Filename), m_Hot(getHotKeys().allocate()),
+            m_Description(pOther.m_Description), m_KeyManager(pOther.m_KeyManager),
+            m_SysUser(pOther.m_SysUser), m_Keystore(pOther.m_Keystore),
+            m_StoreRecord(pOther.m_StoreRecord) {
+        m_Hot->m_Token = pOther.m_Hot->m_Token;
+        m_Hot->setKey(pOther.m_Hot->m_Key.data());
+        m_Hot->m_SysUserHash = pOther.m_Hot->m_SysUserHash;
+        m_Hot->m_Cold = this;
+    }
+
 /**
  * Getter.
  *
  * @return Hex-encoded string representing the private id Yubikey token part.
  */
     const string YubikoOtpKeyConfig::getPrivateId() const {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyConfig::getPrivateId");
         string myRetVal(K_YBK_PRIVATE_ID_LEN, '.');
         yubikey_hex_encode(&myRetVal[0],
-                           reinterpret_cast<const char *>(&m_Token.uid), YUBIKEY_UID_SIZE);
+                           reinterpret_cast<const char *>(&getToken().uid), YUBIKEY_UID_SIZE);
         return string(myRetVal);
     }
 
@@ -130,7 +157,7 @@ namespace trihlav {
  * @param pPrivateId Hex-encoded string representing the private id Yubikey token part.
  */
     void YubikoOtpKeyConfig::setPrivateId(const string &pPrivateId) {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyConfig::setPrivateId");
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyConfig::setPrivateId");
         string myPrivateId(pPrivateId);
         trim(myPrivateId);
         if (myPrivateId.size() != K_YBK_PRIVATE_ID_LEN) {
@@ -138,22 +165,22 @@ namespace trihlav {
                                    K_YBK_PRIVATE_ID_LEN, myPrivateId);
         }
         if (getPrivateId() != pPrivateId) {
-            yubikey_hex_decode(reinterpret_cast<char *>(m_Token.uid),
+            yubikey_hex_decode(reinterpret_cast<char *>(getToken().uid),
                                myPrivateId.c_str(), YUBIKEY_UID_SIZE);
             m_ChangedFlag = true;
         }
     }
 
     const std::string YubikoOtpKeyConfig::getSecretKey() const {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyConfig::getSecretKey()");
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyConfig::getSecretKey()");
         string myRetVal(K_SEC_KEY_SZ, '.');
-        yubikey_hex_encode(&myRetVal[0], reinterpret_cast<const char *>(&m_Key),
+        yubikey_hex_encode(&myRetVal[0], reinterpret_cast<const char *>(m_Hot->m_Key.data()),
                            YUBIKEY_KEY_SIZE);
         return string(myRetVal);
     }
 
     void YubikoOtpKeyConfig::setSecretKey(const std::string &pKey) {
-        BOOST_LOG_NAMED_SCOPE(
+        TRIHLAV_TRACE_SCOPE(
                 "YubikoOtpKeyConfig::setSecretKey( const std::string& pKey)");
         string mySecretKey(pKey);
         trim(mySecretKey);
@@ -162,42 +189,49 @@ namespace trihlav {
                                    mySecretKey);
         }
         if (getSecretKey() != pKey) {
-            yubikey_hex_decode(reinterpret_cast<char *>(m_Key.data()),
+            SecretKeyArr myKey;
+            yubikey_hex_decode(reinterpret_cast<char *>(myKey.data()),
                                mySecretKey.c_str(),
                                YUBIKEY_KEY_SIZE);
+            m_Hot->setKey(myKey.data());
             m_ChangedFlag = true;
         }
     }
 
+/**
+ * There are only 16^6 names, a name in use is drawn again.
+ */
     void YubikoOtpKeyConfig::generateFilename() {
         if (m_KeyManager.getSettings().getConfigDir().empty()) {
             throw std::runtime_error("YubikoOtpKeyConfig::generateFilename()==\"\"");
         }
         path myFilename = m_KeyManager.getSettings().getConfigDir()
                           / "%%-%%-%%.trihlav-key.json";
-        m_Filename = unique_path(myFilename);
+        do {
+            m_Filename = unique_path(myFilename);
+        } while (exists(m_Filename));
     }
 
     const string YubikoOtpKeyConfig::checkFileName(bool pIsOut) const {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyConfig::checkFileName");
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyConfig::checkFileName");
         std::string myRetVal;
         if (is_directory(getFilename())) {
             const string myMsg =
                     (format("File %1% is a directory.") % getFilename()).str();
-            BOOST_LOG_TRIVIAL(error) << myMsg;
+            TRIHLAV_LOG(error) << myMsg;
             throw out_of_range(myMsg);
         }
         if (pIsOut) {
             if (exists(getFilename())) {
                 const string myMsg = (format("File %1% already exists.")
                                       % getFilename()).str();
-                BOOST_LOG_TRIVIAL(error) << myMsg;
+                TRIHLAV_LOG(error) << myMsg;
                 ptime myTime = microsec_clock::universal_time();
                 stringstream myStrStr;
                 myStrStr << "." << myTime;
                 path myBackup(getFilename());
                 myBackup += (myStrStr.str());
-                BOOST_LOG_TRIVIAL(debug) << "Moving " << getFilename() << " to " << myBackup;
+                TRIHLAV_LOG(debug) << "Moving " << getFilename() << " to " << myBackup;
                 rename(getFilename(), myBackup);
             }
             myRetVal = getFilename().native();
@@ -205,14 +239,14 @@ namespace trihlav {
             if (!exists(getFilename())) {
                 const string myMsg = (format("Couldn't open save file %1%.")
                                       % getFilename()).str();
-                BOOST_LOG_TRIVIAL(error) << myMsg;
+                TRIHLAV_LOG(error) << myMsg;
                 throw out_of_range(myMsg);
             }
             uintmax_t myFSz = file_size(getFilename());
             if (myFSz > K_MX_KEY_FILE_SZ) {
                 const string myMsg = (format("File %1% is too big: %2%.")
                                       % getFilename() % myFSz).str();
-                BOOST_LOG_TRIVIAL(error) << myMsg;
+                TRIHLAV_LOG(error) << myMsg;
                 throw out_of_range(myMsg);
             }
             myRetVal = getFilename().native();
@@ -220,13 +254,135 @@ namespace trihlav {
         return myRetVal;
     }
 
+/**
+ * The checks of checkFileName(false) on the open file, one open and one
+ * fstat instead of a stat per check. Keys are loaded on many threads.
+ */
+    size_t YubikoOtpKeyConfig::readFile(char *pBuf) const {
+        const int myFd = ::open(getFilename().c_str(), O_RDONLY | O_CLOEXEC);
+        if (myFd < 0) {
+            const string myMsg = (format("Couldn't open save file %1%.") % getFilename()).str();
+            TRIHLAV_LOG(error) << myMsg;
+            throw out_of_range(myMsg);
+        }
+        struct stat myStat;
+        size_t mySize = 0;
+        string myMsg;
+        if (::fstat(myFd, &myStat) != 0) {
+            myMsg = (format("Couldn't open save file %1%.") % getFilename()).str();
+        } else if (S_ISDIR(myStat.st_mode)) {
+            myMsg = (format("File %1% is a directory.") % getFilename()).str();
+        } else if (uintmax_t(myStat.st_size) > K_MX_KEY_FILE_SZ) {
+            myMsg = (format("File %1% is too big: %2%.") % getFilename() % myStat.st_size).str();
+        } else {
+            mySize = size_t(myStat.st_size);
+            size_t myDone = 0;
+            while (myDone < mySize) {
+                const ssize_t myRead = ::read(myFd, pBuf + myDone, mySize - myDone);
+                if (myRead < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (myRead <= 0) {
+                    myMsg = (format("Failed to read %1%: %2%.") % getFilename()
+                             % (myRead == 0 ? "unexpected end of file" : strerror(errno))).str();
+                    break;
+                }
+                myDone += size_t(myRead);
+            }
+        }
+        ::close(myFd);
+        if (!myMsg.empty()) {
+            TRIHLAV_LOG(error) << myMsg;
+            throw out_of_range(myMsg);
+        }
+        return mySize;
+    }
+
     void YubikoOtpKeyConfig::load() {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyConfig::load");
-        const string myInFile = checkFileName(false);
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyConfig::load");
+        static Histogram &theLatency = getMetrics().getHistogram("trihlav_key_load_seconds",
+                                                                 "Reading of a key file.");
+        const ScopedLatency myLatency(theLatency);
+        char myRaw[K_MX_KEY_FILE_SZ];
+        const size_t mySize = readFile(myRaw);
+        // parse() unescapes in place, property_tree needs the file as it was read
+        char myJson[K_MX_KEY_FILE_SZ];
+        memcpy(myJson, myRaw, mySize);
+        KeyFileJson::Document myDoc;
+        if (!KeyFileJson::parse(myJson, mySize, myDoc) || !load(myDoc)) {
+            TRIHLAV_LOG(debug) << "Reading " << getFilename() << " with property_tree.";
+            loadTree(string(myRaw, mySize));
+        }
+        m_ChangedFlag = false;
+    }
+
+/**
+ * The other values are checked when the key is loaded. Files KeyFileJson
+ * leaves out are loaded completely.
+ */
+    const string YubikoOtpKeyConfig::loadPublicId() {
+        char myJson[K_MX_KEY_FILE_SZ];
+        KeyFileJson::Document myDoc;
+        if (KeyFileJson::parse(myJson, readFile(myJson), myDoc)) {
+            const KeyFileJson::Value &myPubId = myDoc.m_Values[KeyFileJson::EPublicId];
+            if (myPubId.m_Size > 0) {
+                return string(myPubId.m_Data, myPubId.m_Size);
+            }
+        }
+        load();
+        return getPublicId();
+    }
+
+/**
+ * Checks everything the setters called by loadTree() check before anything
+ * is taken over. What they would accept after trimming or converting is
+ * left to loadTree(), fe. upper case hex, which yubikey_hex_decode() reads
+ * as zeros.
+ */
+    bool YubikoOtpKeyConfig::load(const KeyFileJson::Document &pDoc) {
+        const KeyFileJson::Value *myValues = pDoc.m_Values;
+        const KeyFileJson::Value &myVer = myValues[KeyFileJson::EVersion];
+        const bool myHasSysUser = myVer == "0.0.2";
+        const KeyFileJson::Value &mySysUser = myValues[KeyFileJson::ESysUser];
+        uint64_t myTimestamp, myCounter, myCrc, myRandom, myUse;
+        if (!(myHasSysUser || myVer == "0.0.1")
+            || !KeyFileJson::isHex(myValues[KeyFileJson::EPrivateId], YUBIKEY_UID_SIZE)
+            || myValues[KeyFileJson::EPublicId].m_Size == 0
+            || !KeyFileJson::isHex(myValues[KeyFileJson::ESecretKey], YUBIKEY_KEY_SIZE)
+            || !KeyFileJson::decodeUnsigned(myValues[KeyFileJson::ETimestamp], UINT64_MAX, myTimestamp)
+            || !KeyFileJson::decodeUnsigned(myValues[KeyFileJson::ECounter], UINT8_MAX, myCounter)
+            || !KeyFileJson::decodeUnsigned(myValues[KeyFileJson::ECrc], UINT16_MAX, myCrc)
+            || !KeyFileJson::decodeUnsigned(myValues[KeyFileJson::ERandom], UINT16_MAX, myRandom)
+            || !KeyFileJson::decodeUnsigned(myValues[KeyFileJson::EUse], UINT8_MAX, myUse)
+            || !myValues[KeyFileJson::EDescription].isSet()
+            || (myHasSysUser && (!mySysUser.isSet() || mySysUser.m_Size > K_MAX_SYS_USER_LEN))) {
+            return false;
+        }
+        TRIHLAV_LOG(debug) << K_NM_VERS << ":" << string(myVer.m_Data, myVer.m_Size);
+        KeyFileJson::decodeHex(myValues[KeyFileJson::EPrivateId], getToken().uid);
+        setPublicId(string(myValues[KeyFileJson::EPublicId].m_Data, myValues[KeyFileJson::EPublicId].m_Size));
+        SecretKeyArr myKey;
+        KeyFileJson::decodeHex(myValues[KeyFileJson::ESecretKey], myKey.data());
+        m_Hot->setKey(myKey.data());
+        setTimestamp(UTimestamp(myTimestamp));
+        setCounter(uint8_t(myCounter));
+        setCrc(uint16_t(myCrc));
+        setRandom(uint16_t(myRandom));
+        setUseCounter(uint8_t(myUse));
+        m_Description.assign(myValues[KeyFileJson::EDescription].m_Data, myValues[KeyFileJson::EDescription].m_Size);
+        if (myHasSysUser && mySysUser.m_Size > 0) {
+            m_SysUser.assign(mySysUser.m_Data, mySysUser.m_Size);
+            m_Hot->m_SysUserHash = HotKey::hashSysUser(m_SysUser);
+        }
+        return true;
+    }
+
+    void YubikoOtpKeyConfig::loadTree(const string &pJson) {
+        std::istringstream myIn(pJson);
         ptree myTree;
-        read_json(myInFile, myTree);
+        read_json(myIn, myTree);
         const string myVer(myTree.get<string>(K_NM_DOC_VERS));
-        BOOST_LOG_TRIVIAL(info) << K_NM_VERS << ":" << myVer;
+        TRIHLAV_LOG(debug) << K_NM_VERS << ":" << myVer;
         setPrivateId(myTree.get<string>(K_NM_DOC_PRIV_ID));
         setPublicId(myTree.get<string>(K_NM_DOC_PUB_ID));
         setSecretKey(myTree.get<string>(K_NM_DOC_SEC_KEY));
@@ -241,32 +397,200 @@ namespace trihlav {
             if (!mySysUser.empty())
                 setSysUser(mySysUser);
         }
+    }
+
+/**
+ * Straight copies of the record, nothing is parsed.
+ */
+    void YubikoOtpKeyConfig::load(const std::shared_ptr<BinaryKeystore> &pKeystore, const size_t pRecord) {
+        const BinaryKeystore::Record &myRec = pKeystore->getRecord(pRecord);
+        assign(pKeystore->getString(myRec.m_PublicId), myRec.m_Token, myRec.m_Key,
+               pKeystore->getString(myRec.m_Description), pKeystore->getString(myRec.m_SysUser));
+        m_Filename.clear();
+        setStoreRecord(int64_t(pRecord), pKeystore);
+    }
+
+/**
+ * The token and key go to the HotKey record, the key schedule is expanded
+ * like setSecretKey() does.
+ */
+    void YubikoOtpKeyConfig::assign(const string &pPublicId, const yubikey_token_st &pToken, const uint8_t *pKey,
+                                    const string &pDescription, const string &pSysUser) {
+        if (pPublicId.empty()) {
+            throw EmptyPublicId();
+        }
+        if (pSysUser.size() > K_MAX_SYS_USER_LEN) {
+            throw invalid_argument{"System user of " + pPublicId + " is too long."};
+        }
+        m_PublicId = pPublicId;
+        m_SysUser = pSysUser;
+        m_Description = pDescription;
+        m_Hot->m_Token = pToken;
+        m_Hot->setKey(pKey);
+        m_Hot->m_SysUserHash = HotKey::hashSysUser(pSysUser);
         m_ChangedFlag = false;
     }
 
+    void YubikoOtpKeyConfig::setStoreRecord(const int64_t pRecord, const std::shared_ptr<BinaryKeystore> &pKeystore) {
+        m_StoreRecord = pRecord;
+        m_Keystore = pKeystore;
+    }
+
+    void YubikoOtpKeyConfig::save() {
+        m_KeyManager.getKeyStore().put(*this);
+    }
+
+    void YubikoOtpKeyConfig::saveCounters() const {
+        m_KeyManager.getKeyStore().saveCounters(*this);
+    }
+
+/**
+ * Plain write as write_json() did it, the key editor is the only writer.
+ */
+    static void writeFile(const string &pFilename, const char *pContent, const size_t pSize) {
+        const int myFd = ::open(pFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (myFd < 0) {
+            throw std::runtime_error("Failed to open " + pFilename + ": " + strerror(errno));
+        }
+        const bool myOk = ::write(myFd, pContent, pSize) == ssize_t(pSize);
+        const int myErrno = errno;
+        ::close(myFd);
+        if (!myOk) {
+            throw std::runtime_error("Failed to write " + pFilename + ": " + strerror(myErrno));
+        }
+    }
+
 /**
  * Save the key data in a JSON like format. The filename is specified in
  * constructor YubikoOtpKeyConfig::YubikoOtpKeyConfig(const string& )
  */
-    void YubikoOtpKeyConfig::save() {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyConfig::save");
+    void YubikoOtpKeyConfig::saveFile() {
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyConfig::saveFile");
+        static Histogram &theLatency = getMetrics().getHistogram("trihlav_key_save_seconds",
+                                                                 "Writing of a key file.");
+        const ScopedLatency myLatency(theLatency);
         const string myOutFile = checkFileName(true);
-        ptree myTree;
-        myTree.put(K_NM_DOC_PRIV_ID /*--->*/, getPrivateId());
-        myTree.put(K_NM_DOC_PUB_ID /*---->*/, getPublicId());
-        myTree.put(K_NM_DOC_SEC_KEY /*--->*/, getSecretKey());
-        myTree.put(K_NM_DOC_TIMESTAMP /*->*/, getTimestamp().tstp_int);
-        myTree.put(K_NM_DOC_SES_CNTR /*-->*/, getCounter());
-        myTree.put(K_NM_DOC_CRC /*------->*/, getCrc());
-        myTree.put(K_NM_DOC_RANDOM /*---->*/, getRandom());
-        myTree.put(K_NM_DOC_USE_CNTR /*-->*/, getUseCounter());
-        myTree.put(K_NM_DOC_DESC /*------>*/, getDescription());
-        myTree.put(K_NM_DOC_SYS_USER /*-->*/, getSysUser());
-        myTree.put(K_NM_DOC_VERS /*------>*/, K_VL_VERS);
-        write_json(myOutFile, myTree);
+        char myJson[K_JSON_BUF_SZ];
+        const size_t mySize = toJson(myJson, sizeof(myJson));
+        if (mySize <= sizeof(myJson)) {
+            writeFile(myOutFile, myJson, mySize);
+        } else {
+            string myLongJson(mySize, '\0');
+            toJson(&myLongJson[0], mySize);
+            writeFile(myOutFile, myLongJson.data(), mySize);
+        }
         m_ChangedFlag = false;
     }
 
+/**
+ * The same fields in the same order as write_json() of the property tree
+ * saveFile() used to build, the numbers as their decimal digits.
+ */
+    size_t YubikoOtpKeyConfig::toJson(char *pBuf, const size_t pCapacity) const {
+        char myPrivateId[K_YBK_PRIVATE_ID_LEN];
+        char mySecretKey[K_SEC_KEY_SZ];
+        char myNumbers[5][KeyFileJson::K_MAX_DIGITS];
+        KeyFileJson::Document myDoc;
+        myDoc.put(KeyFileJson::EPrivateId, KeyFileJson::encodeHex(getToken().uid, YUBIKEY_UID_SIZE, myPrivateId));
+        myDoc.put(KeyFileJson::EPublicId, {m_PublicId.data(), m_PublicId.size()});
+        myDoc.put(KeyFileJson::ESecretKey, KeyFileJson::encodeHex(m_Hot->m_Key.data(), YUBIKEY_KEY_SIZE, mySecretKey));
+        myDoc.put(KeyFileJson::ETimestamp, KeyFileJson::encodeUnsigned(getTimestamp().tstp_int, myNumbers[0]));
+        myDoc.put(KeyFileJson::ECounter, KeyFileJson::encodeUnsigned(getCounter(), myNumbers[1]));
+        myDoc.put(KeyFileJson::ECrc, KeyFileJson::encodeUnsigned(getCrc(), myNumbers[2]));
+        myDoc.put(KeyFileJson::ERandom, KeyFileJson::encodeUnsigned(getRandom(), myNumbers[3]));
+        myDoc.put(KeyFileJson::EUse, KeyFileJson::encodeUnsigned(getUseCounter(), myNumbers[4]));
+        myDoc.put(KeyFileJson::EDescription, {m_Description.data(), m_Description.size()});
+        myDoc.put(KeyFileJson::ESysUser, {m_SysUser.data(), m_SysUser.size()});
+        myDoc.put(KeyFileJson::EVersion, {K_VL_VERS.data(), K_VL_VERS.size()});
+        return KeyFileJson::write(myDoc, pBuf, pCapacity);
+    }
+
+/**
+ * Write into a temporary file, flush it, rename it over pFilename and flush
+ * the directory, so either the old or the new content survives a crash.
+ */
+    static void writeDurably(const path &pFilename, const char *pContent, const size_t pSize) {
+        path myTmpFile(pFilename);
+        myTmpFile += ".tmp";
+        const int myFd = ::open(myTmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (myFd < 0) {
+            throw std::runtime_error("Failed to open " + myTmpFile.string() + ": " + strerror(errno));
+        }
+        const bool myOk = ::write(myFd, pContent, pSize) == ssize_t(pSize) && ::fsync(myFd) == 0;
+        const int myErrno = errno;
+        ::close(myFd);
+        if (!myOk) {
+            remove(myTmpFile);
+            throw std::runtime_error("Failed to write " + myTmpFile.string() + ": " + strerror(myErrno));
+        }
+        rename(myTmpFile, pFilename);
+        const int myDirFd = ::open(pFilename.parent_path().c_str(), O_RDONLY | O_CLOEXEC);
+        if (myDirFd >= 0) {
+            ::fsync(myDirFd);
+            ::close(myDirFd);
+        }
+    }
+
+/**
+ * Used when folding the counter journal back into the key file. Reading the
+ * file back keeps changes made meanwhile by the key editor. The file is read
+ * once, parse() works on a copy. Files KeyFileJson does not take, fe. with
+ * extra keys, go through property_tree, both write the same bytes.
+ */
+    void YubikoOtpKeyConfig::saveFileCounters() const {
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyConfig::saveFileCounters");
+        char myRaw[K_MX_KEY_FILE_SZ];
+        const size_t myInSize = readFile(myRaw);
+        char myIn[K_MX_KEY_FILE_SZ];
+        memcpy(myIn, myRaw, myInSize);
+        KeyFileJson::Document myDoc;
+        if (!KeyFileJson::parse(myIn, myInSize, myDoc)) {
+            std::istringstream myInTree(string(myRaw, myInSize));
+            ptree myTree;
+            read_json(myInTree, myTree);
+            myTree.put(K_NM_DOC_TIMESTAMP /*->*/, getTimestamp().tstp_int);
+            myTree.put(K_NM_DOC_SES_CNTR /*-->*/, getCounter());
+            myTree.put(K_NM_DOC_CRC /*------->*/, getCrc());
+            myTree.put(K_NM_DOC_USE_CNTR /*-->*/, getUseCounter());
+            std::ostringstream myOut;
+            write_json(myOut, myTree);
+            const string myJson(myOut.str());
+            writeDurably(getFilename(), myJson.data(), myJson.size());
+            return;
+        }
+        char myNumbers[4][KeyFileJson::K_MAX_DIGITS];
+        myDoc.put(KeyFileJson::ETimestamp, KeyFileJson::encodeUnsigned(getTimestamp().tstp_int, myNumbers[0]));
+        myDoc.put(KeyFileJson::ECounter, KeyFileJson::encodeUnsigned(getCounter(), myNumbers[1]));
+        myDoc.put(KeyFileJson::ECrc, KeyFileJson::encodeUnsigned(getCrc(), myNumbers[2]));
+        myDoc.put(KeyFileJson::EUse, KeyFileJson::encodeUnsigned(getUseCounter(), myNumbers[3]));
+        char myOut[K_JSON_BUF_SZ];
+        const size_t mySize = KeyFileJson::write(myDoc, myOut, sizeof(myOut));
+        if (mySize <= sizeof(myOut)) {
+            writeDurably(getFilename(), myOut, mySize);
+        } else {
+            string myLongJson(mySize, '\0');
+            KeyFileJson::write(myDoc, &myLongJson[0], mySize);
+            writeDurably(getFilename(), myLongJson.data(), mySize);
+        }
+    }
+
+/**
+ * The session counter has precedence over the use counter, same as in
+ * verifyOtp(const std::string&).
+ */
+    bool YubikoOtpKeyConfig::advanceCounters(const yubikey_token_st &pToken) {
+        if (pToken.ctr < getToken().ctr
+            || (pToken.ctr == getToken().ctr && pToken.use <= getToken().use)) {
+            return false;
+        }
+        setCounter(pToken.ctr);
+        setUseCounter(pToken.use);
+        getToken().tstph = pToken.tstph;
+        getToken().tstpl = pToken.tstpl;
+        computeCrc();
+        return true;
+    }
+
 /**
  * The description will not be compared, only the token, public ID and secret
  * key are being considered.
@@ -276,29 +600,30 @@ namespace trihlav {
     bool YubikoOtpKeyConfig::operator==(const YubikoOtpKeyConfig &pOther) const {
         if (memcmp(&this->getToken(), &pOther.getToken(), sizeof(yubikey_token_st))
             != 0) {
-            BOOST_LOG_TRIVIAL(debug) << "Token "
-                                     << this->token2json() << "!=" << pOther.token2json();
+            TRIHLAV_LOG(debug) << "Token "
+                               << this->token2json() << "!=" << pOther.token2json();
             return false;
         }
         if (this->getPublicId().compare(pOther.getPublicId()) != 0) {
-            BOOST_LOG_TRIVIAL(debug) << "PublicId "
-                                     << this->getPublicId() << "!=" << pOther.getPublicId();
+            TRIHLAV_LOG(debug) << "PublicId "
+                               << this->getPublicId() << "!=" << pOther.getPublicId();
             return false;
         }
-        if (memcmp(&this->m_Key, &pOther.m_Key, sizeof(m_Key)) != 0) {
-            BOOST_LOG_TRIVIAL(debug) << "Secret key "
-                                     << this->getSecretKey() << "!=" << pOther.getSecretKey();
+        if (getSecretKeyArray() != pOther.getSecretKeyArray()) {
+            TRIHLAV_LOG(debug) << "Secret key "
+                               << this->getSecretKey() << "!=" << pOther.getSecretKey();
             return false;
         }
         return true;
     }
 
     YubikoOtpKeyConfig::~YubikoOtpKeyConfig() {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyConfig::~YubikoOtpKeyConfig");
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyConfig::~YubikoOtpKeyConfig");
+        getHotKeys().free(m_Hot);
     }
 
     void YubikoOtpKeyConfig::setFilename(const string &value) {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyConfig::setFilename");
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyConfig::setFilename");
         m_Filename = value;
     }
 
@@ -372,81 +697,136 @@ namespace trihlav {
             throw EmptyPublicId();
         }
         m_PublicId = pPubId;
-        m_KeyManager.update(pPubId, *this);
-    }
-
-    void YubikoOtpKeyConfig::copyAndSaveToken(const yubikey_token_st &pToken) {
-        setCounter(pToken.ctr);
-        setUseCounter(pToken.use);
-        getToken().tstph = pToken.tstph;
-        getToken().tstpl = pToken.tstpl;
-        computeCrc();
-        save();
+        if (myOldKey != pPubId) {
+            try {
+                m_KeyManager.update(myOldKey, *this);
+            } catch (...) {
+                m_PublicId = myOldKey;
+                throw;
+            }
+        }
     }
 
 /**
  * @param pPswd2check modhex encoded
  */
     bool YubikoOtpKeyConfig::checkOtp(const std::string &pPswd2check) {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyConfig::checkPassword");
+        return checkOtp(pPswd2check.c_str());
+    }
+
+/**
+ * @param pPswd2check modhex encoded, zero terminated
+ */
+    bool YubikoOtpKeyConfig::checkOtp(const char *pPswd2check) {
+        if (verifyOtp(pPswd2check) != EOtpOk) {
+            return false;
+        }
+        CounterJournal &myJournal = m_KeyManager.getJournal();
+        myJournal.waitDurable(myJournal.getWrittenSeq());
+        return true;
+    }
+
+/**
+ * @param pPswd2check modhex encoded, without the public ID prefix.
+ */
+    YubikoOtpKeyConfig::EOtpCheck YubikoOtpKeyConfig::verifyOtp(const std::string &pPswd2check) {
+        return verifyOtp(pPswd2check.c_str());
+    }
+
+/**
+ * Check the OTP and on success save the advanced counters.
+ *
+ * @param pPswd2check modhex encoded, without the public ID prefix, fe. the
+ * tail of the whole OTP.
+ * @return EOtpOk when the password is valid, otherwise the reason why not.
+ */
+    YubikoOtpKeyConfig::EOtpCheck YubikoOtpKeyConfig::verifyOtp(const char *pPswd2check) {
+        const EOtpCheck myRetVal = verifyOtp(*m_Hot, pPswd2check);
+        if (myRetVal == EOtpOk) {
+            m_KeyManager.journalCounters(*this);
+        }
+        return myRetVal;
+    }
+
+/**
+ * Check the token and on success save the advanced counters.
+ */
+    YubikoOtpKeyConfig::EOtpCheck YubikoOtpKeyConfig::verifyToken(const yubikey_token_st &pToken) {
+        const EOtpCheck myRetVal = verifyToken(*m_Hot, pToken);
+        if (myRetVal == EOtpOk) {
+            m_KeyManager.journalCounters(*this);
+        }
+        return myRetVal;
+    }
+
+/**
+ * Decrypt the OTP with the cached key schedule and check it.
+ */
+    YubikoOtpKeyConfig::EOtpCheck YubikoOtpKeyConfig::verifyOtp(HotKey &pKey, const char *pPswd2check) {
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyConfig::verifyOtp");
+        static Histogram &theLatency = getMetrics().getHistogram("trihlav_otp_check_seconds",
+                                                                 "Decryption and check of an OTP against its key.");
+        const ScopedLatency myLatency(theLatency);
         yubikey_token_st myToken;
-        yubikey_parse(reinterpret_cast<const uint8_t *>(pPswd2check.c_str()),
-                      this->getSecretKeyArray().data(), &myToken);
-        BOOST_LOG_TRIVIAL(debug) << "Key token:";
-        logDebug_token(getToken());
-        BOOST_LOG_TRIVIAL(debug) << "Decrypted token:";
-        logDebug_token(myToken);
-        if (strncmp(reinterpret_cast<const char *>(&getToken().uid),
-                    reinterpret_cast<char *>(&myToken.uid), YUBIKEY_UID_SIZE) == 0) {
-            BOOST_LOG_TRIVIAL(debug) << "UID is same.";
-            uint16_t myComputedCrc = computeCrc(myToken);
-            if (myToken.crc != myComputedCrc) {
-                BOOST_LOG_TRIVIAL(debug) << "Decrypted CRC is wrong: "
-                                         << myComputedCrc << "!=" << myToken.crc;
-                return false;
-            }
-            if (myToken.ctr > getToken().ctr) {
-                BOOST_LOG_TRIVIAL(debug) << "Decrypted counter is bigger than stored value: "
-                                         << int(myToken.ctr) << ">" << int(getToken().ctr)
-                                         << " reseting use counter & clock.";
-                getToken().use = myToken.use;
-                copyAndSaveToken(myToken);
-                BOOST_LOG_TRIVIAL(debug) << "OTP OK (use counter reset)!";
-                return true;
-            } else {
-                if (myToken.ctr < getToken().ctr) {
-                    BOOST_LOG_TRIVIAL(debug) << "Decrypted counter is smaller than stored value: "
-                                             << int(myToken.ctr) << "<" << int(getToken().ctr) << " returning false.";
-                    return false;
-                }
-            }
-            BOOST_LOG_TRIVIAL(debug) << "Counter is " << int(myToken.ctr) << ".";
-            if (myToken.use <= getToken().use) {
-                BOOST_LOG_TRIVIAL(debug) << "Decrypted use counter is wrong: "
-                                         << int(myToken.use) << "<=" << int(getToken().use);
-                return false;
+        pKey.getCipher().parse(pPswd2check, myToken);
+        return verifyToken(pKey, myToken);
+    }
+
+/**
+ * Compare a decrypted token with the stored one and on success advance
+ * the stored counters.
+ */
+    YubikoOtpKeyConfig::EOtpCheck YubikoOtpKeyConfig::verifyToken(HotKey &pKey, const yubikey_token_st &pToken) {
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyConfig::verifyToken");
+        yubikey_token_st &myStored = pKey.m_Token;
+        TRIHLAV_LOG(debug) << "Key token:";
+        logDebug_token(myStored);
+        TRIHLAV_LOG(debug) << "Decrypted token:";
+        logDebug_token(pToken);
+        if (memcmp(myStored.uid, pToken.uid, YUBIKEY_UID_SIZE) != 0) {
+            return EOtpWrongUid;
+        }
+        TRIHLAV_LOG(debug) << "UID is same.";
+        const uint16_t myComputedCrc = computeCrc(pToken);
+        if (pToken.crc != myComputedCrc) {
+            TRIHLAV_LOG(debug) << "Decrypted CRC is wrong: "
+                               << myComputedCrc << "!=" << pToken.crc;
+            return EOtpWrongCrc;
+        }
+        if (pToken.ctr < myStored.ctr) {
+            TRIHLAV_LOG(debug) << "Decrypted counter is smaller than stored value: "
+                               << int(pToken.ctr) << "<" << int(myStored.ctr) << " returning false.";
+            return EOtpReplayed;
+        }
+        if (pToken.ctr == myStored.ctr) {
+            TRIHLAV_LOG(debug) << "Counter is " << int(pToken.ctr) << ".";
+            if (pToken.use <= myStored.use) {
+                TRIHLAV_LOG(debug) << "Decrypted use counter is wrong: "
+                                   << int(pToken.use) << "<=" << int(myStored.use);
+                return EOtpReplayed;
             }
-            UTimestamp myTstmp;
-            myTstmp.tstp.tstph = myToken.tstph;
-            myTstmp.tstp.tstpl = myToken.tstpl;
-            if (myTstmp.tstp_int <= getTimestamp().tstp_int) {
-                BOOST_LOG_TRIVIAL(debug) << "Decrypted timer is smaller than stored value: "
-                                         << myTstmp.tstp_int << "<=" << getTimestamp().tstp_int << " returning false.";
-                return false;
-            } else {
-                BOOST_LOG_TRIVIAL(debug) << "Decrypted timer int value: "
-                                         << myTstmp.tstp_int << ".";
+            const uint64_t myTstmp = getTimestamp(pToken).tstp_int;
+            if (myTstmp <= getTimestamp(myStored).tstp_int) {
+                TRIHLAV_LOG(debug) << "Decrypted timer is smaller than stored value: "
+                                   << myTstmp << "<=" << getTimestamp(myStored).tstp_int << " returning false.";
+                return EOtpReplayed;
             }
-            copyAndSaveToken(myToken);
-            BOOST_LOG_TRIVIAL(debug) << "OTP OK!";
-            return true;
+        } else {
+            TRIHLAV_LOG(debug) << "Decrypted counter is bigger than stored value: "
+                               << int(pToken.ctr) << ">" << int(myStored.ctr)
+                               << " reseting use counter & clock.";
         }
-        return false;
+        myStored.ctr = pToken.ctr;
+        myStored.use = pToken.use;
+        myStored.tstph = pToken.tstph;
+        myStored.tstpl = pToken.tstpl;
+        myStored.crc = computeCrc(myStored);
+        TRIHLAV_LOG(debug) << "OTP OK!";
+        return EOtpOk;
     }
 
     uint16_t YubikoOtpKeyConfig::computeCrc(const yubikey_token_st &pToken) {
-        return ~yubikey_crc16(reinterpret_cast<const uint8_t *>(&pToken),
-                              sizeof(pToken) - sizeof(pToken.crc));
+        return ~crc16(reinterpret_cast<const uint8_t *>(&pToken), sizeof(pToken) - sizeof(pToken.crc));
     }
 
     void YubikoOtpKeyConfig::setSysUser(const string &pSysUser) {
@@ -455,17 +835,28 @@ namespace trihlav {
                                     + pSysUser + "\""};
         }
         m_SysUser = pSysUser;
+        m_Hot->m_SysUserHash = HotKey::hashSysUser(pSysUser);
     }
 
     const std::string YubikoOtpKeyConfig::generateOtp() const {
-        string myOtp0(YUBIKEY_OTP_SIZE + 1, '.');
         yubikey_token_st myTkn{getToken()};
-        myTkn.use++;
-        myTkn.tstpl++;
-        myTkn.crc = computeCrc(myTkn);
-        yubikey_generate(&myTkn, getSecretKeyArray().data(), &myOtp0[0]);
+        const string myOtp0{generateOtp(myTkn, getSecretKeyArray())};
+        TRIHLAV_LOG(debug) << "Generated yubikey OTP:" << myOtp0 << ".";
+        return myOtp0;
+    }
+
+    const std::string YubikoOtpKeyConfig::generateOtp(yubikey_token_st &pToken, const SecretKeyArr &pKey) {
+        if (++pToken.use == 0) {
+            pToken.ctr++;
+        }
+        if (++pToken.tstpl == 0) {
+            pToken.tstph++;
+        }
+        pToken.crc = computeCrc(pToken);
+        yubikey_token_st myEncrypted{pToken}; // yubikey_generate() encrypts in place
+        string myOtp0(YUBIKEY_OTP_SIZE + 1, '.');
+        yubikey_generate(&myEncrypted, pKey.data(), &myOtp0[0]);
         myOtp0.resize(YUBIKEY_OTP_SIZE);
-        BOOST_LOG_TRIVIAL(debug) << "Generated yubikey OTP:" << myOtp0 << ".";
         return myOtp0;
     }
 
@@ -3,10 +3,15 @@
 
 #include <yubikey.h>
 #include <string>
+#include <memory>
+#include <cstdint>
 #include <boost/array.hpp>
 #include <boost/filesystem.hpp>
 
 #include "trihlavLib/trihlavUTimestamp.hpp"
+#include "trihlavLib/trihlavOtpCipher.hpp"
+#include "trihlavLib/trihlavHotKey.hpp"
+#include "trihlavLib/trihlavKeyFileJson.hpp"
 
 namespace bfs = ::boost::filesystem;
 
@@ -14,6 +19,8 @@ namespace trihlav {
 
     class KeyManager;
 
+    class BinaryKeystore;
+
 /**
  * @brief Store, load and provide the APIs configuration.
  */
@@ -21,7 +28,18 @@ namespace trihlav {
     public:
         static const size_t K_MAX_SYS_USER_LEN = 1024;
 
-        using SecretKeyArr=std::array<uint8_t, YUBIKEY_KEY_SIZE>;
+        /// @brief Larger key files are refused.
+        static const size_t K_MAX_KEY_FILE_SIZE = 1024;
+
+        /// @brief Detailed outcome of verifyOtp(const std::string&).
+        enum EOtpCheck {
+            EOtpOk,         //< valid, counters were advanced and saved
+            EOtpWrongUid,   //< decrypted private ID does not match, wrong key or garbage
+            EOtpWrongCrc,   //< decrypted token is damaged
+            EOtpReplayed    //< counters or timestamp are not newer than the stored ones
+        };
+
+        using SecretKeyArr=HotKey::SecretKeyArr;
 
         /**
          * @brief YubikoOtpKeyConfig::YubikoOtpKeyConfig
@@ -33,6 +51,11 @@ namespace trihlav {
          */
         YubikoOtpKeyConfig(KeyManager &pKeyManager);
 
+        /// @brief A copy with a HotKey of its own.
+        YubikoOtpKeyConfig(const YubikoOtpKeyConfig &pOther);
+
+        YubikoOtpKeyConfig &operator=(const YubikoOtpKeyConfig &) = delete;
+
         /**
          * @brief getPrivateId access the private id config value
          */
@@ -44,10 +67,7 @@ namespace trihlav {
          * @return yubikey_token_st.tstpl and yubikey_token_st.tstph
          */
         const UTimestamp getTimestamp() const {
-            UTimestamp myRetVal;
-            myRetVal.tstp.tstpl = m_Token.tstpl;
-            myRetVal.tstp.tstph = m_Token.tstph;
-            return myRetVal;
+            return getTimestamp(getToken());
         }
 
         /**
@@ -55,8 +75,16 @@ namespace trihlav {
          * @param pVal new value of timestamp values.
          */
         void setTimestamp(const UTimestamp pVal) {
-            m_Token.tstpl = pVal.tstp.tstpl;
-            m_Token.tstph = pVal.tstp.tstph;
+            getToken().tstpl = pVal.tstp.tstpl;
+            getToken().tstph = pVal.tstp.tstph;
+        }
+
+        /// @brief The timestamp of pToken, @see getTimestamp()
+        static const UTimestamp getTimestamp(const yubikey_token_st &pToken) {
+            UTimestamp myRetVal;
+            myRetVal.tstp.tstpl = pToken.tstpl;
+            myRetVal.tstp.tstph = pToken.tstph;
+            return myRetVal;
         }
 
         /**
@@ -129,15 +157,73 @@ namespace trihlav {
         }
 
         /**
-         * @brief save the configuration values to passed filename.
+         * @brief save the configuration values into the key store.
+         * @see KeyStore::put()
          */
         void save();
 
         /**
-         * @brief load the configuration values from passed filename.
+         * @brief load the configuration values from the key file.
          */
         void load();
 
+        /**
+         * @brief read only the public ID from the key file, fe. for a lazy index.
+         * @return the public ID, throws like load().
+         */
+        const std::string loadPublicId();
+
+        /**
+         * @brief save the configuration values into the key file.
+         */
+        void saveFile();
+
+        /**
+         * @brief load the configuration values from a record of a keystore.
+         *
+         * The key keeps the keystore mapped, its counters are saved there
+         * and it has no filename.
+         */
+        void load(const std::shared_ptr<BinaryKeystore> &pKeystore, const size_t pRecord);
+
+        /// @brief Take over all values at once, nothing is parsed, fe. from a key store.
+        void assign(const std::string &pPublicId, const yubikey_token_st &pToken, const uint8_t *pKey,
+                    const std::string &pDescription, const std::string &pSysUser);
+
+        /**
+         * @brief write only the counters into the key store.
+         * @see KeyStore::saveCounters()
+         */
+        void saveCounters() const;
+
+        /**
+         * @brief write only the counters into the existing key file.
+         *
+         * The file is replaced atomically, all other values are kept as they
+         * are on disk.
+         */
+        void saveFileCounters() const;
+
+        /// @brief The keystore the key was loaded from, empty for a key file.
+        const std::shared_ptr<BinaryKeystore> &getKeystore() const {
+            return m_Keystore;
+        }
+
+        /// @brief Record of the key in its key store, -1 when it is not stored there.
+        int64_t getStoreRecord() const {
+            return m_StoreRecord;
+        }
+
+        /// @brief Set by the key store, pKeystore only for a key of a BinaryKeystore.
+        void setStoreRecord(const int64_t pRecord,
+                            const std::shared_ptr<BinaryKeystore> &pKeystore = std::shared_ptr<BinaryKeystore>());
+
+        /**
+         * @brief take over counters and timestamp when they are newer.
+         * @return true when the stored counters changed.
+         */
+        bool advanceCounters(const yubikey_token_st &pToken);
+
         /**
          * @brief ~YubikoOtpKeyConfig
          */
@@ -154,21 +240,31 @@ namespace trihlav {
          * @return The Yubikey constant token.
          */
         const yubikey_token_st &getToken() const {
-            return m_Token;
+            return m_Hot->m_Token;
         }
 
         /**
          * @return The Yubikey token.
          */
         yubikey_token_st &getToken() {
-            return m_Token;
+            return m_Hot->m_Token;
+        }
+
+        /// @brief The state validation needs, @see KeyManager::withLockedHotKey()
+        HotKey &getHotKey() {
+            return *m_Hot;
+        }
+
+        /// @see getHotKey()
+        const HotKey &getHotKey() const {
+            return *m_Hot;
         }
 
         const std::string &getPublicId() const {
             return m_PublicId;
         }
 
-        /// @brief Set the public id and update indexes.
+        /// @brief Set the public id and update indexes, throws and keeps the old one when another loaded key has pPubId.
         void setPublicId(const std::string &pPubId);
 
         const std::string getPublicIdModhex() const;
@@ -179,7 +275,12 @@ namespace trihlav {
          * @return the secret key binnary array.
          */
         const SecretKeyArr &getSecretKeyArray() const {
-            return m_Key;
+            return m_Hot->m_Key;
+        }
+
+        /// @brief Decrypts OTPs of this key, expanded when the secret key is set.
+        const OtpCipher &getCipher() const {
+            return m_Hot->getCipher();
         }
 
         /**
@@ -230,9 +331,34 @@ namespace trihlav {
 
         static const std::string modhex2Hex(const std::string &p2Hex);
 
-        /// @brief check a modhex encoded password
+        /// @brief check a modhex encoded password, hold KeyManager::getKeyMutex().
         bool checkOtp(const std::string &pPswd2check);
 
+        /// @see checkOtp(const std::string&)
+        bool checkOtp(const char *pPswd2check);
+
+        /// @brief check a modhex encoded password, tell why it failed.
+        /// @see checkOtp(const std::string&) for locking.
+        EOtpCheck verifyOtp(const std::string &pPswd2check);
+
+        /// @brief @see verifyOtp(const std::string&), reads up to YUBIKEY_OTP_SIZE characters.
+        EOtpCheck verifyOtp(const char *pPswd2check);
+
+        /// @brief check an already decrypted token, @see getCipher().
+        /// @see checkOtp(const std::string&) for locking.
+        EOtpCheck verifyToken(const yubikey_token_st &pToken);
+
+        /**
+         * @brief verifyOtp(const char*) on the hot state of a key only.
+         *
+         * The counters of pKey are advanced but not journaled, the caller
+         * journals them, @see KeyManager::journalCounters(const PublicId&, const yubikey_token_st&).
+         */
+        static EOtpCheck verifyOtp(HotKey &pKey, const char *pPswd2check);
+
+        /// @brief verifyToken() on the hot state of a key only, @see verifyOtp(HotKey&, const char*).
+        static EOtpCheck verifyToken(HotKey &pKey, const yubikey_token_st &pToken);
+
         /**
          *  @brief Compute CRC, store it in token and return it.
          *  @return the newly computed CRC.
@@ -252,27 +378,51 @@ namespace trihlav {
 
         const std::string checkFileName(bool pIsOut) const;
 
+        /// @brief Read the key file into pBuf of K_MAX_KEY_FILE_SIZE bytes, checked like checkFileName(false).
+        size_t readFile(char *pBuf) const;
+
+        /**
+         * @brief The key file content as saveFile() writes it.
+         * @return Its size, pBuf is filled only up to pCapacity.
+         */
+        size_t toJson(char *pBuf, const size_t pCapacity) const;
+
         /**
          * Generate an OTP token, it does not increase OTP counter or use counter.
          * @return the token
          */
         const std::string generateOtp() const;
+
+        /**
+         * Advance pToken as the key does on each use and encrypt it with pKey.
+         *
+         * The use counter wraps into the session counter, the timestamp
+         * low part into the high one. Called over and over on the same token
+         * it yields a sequence of OTPs each of which is newer than the last.
+         * @return the OTP, without public ID.
+         */
+        static const std::string generateOtp(yubikey_token_st &pToken, const SecretKeyArr &pKey);
     protected:
         void setFilename(const std::string &value);
 
         void zeroToken();
 
-        void copyAndSaveToken(const yubikey_token_st &pToken);
-
     private:
+        /// @brief Take over the values of a parsed key file, @return false without any change unless all are valid.
+        bool load(const KeyFileJson::Document &pDoc);
+
+        /// @brief load() through property_tree, for the key files KeyFileJson leaves out.
+        void loadTree(const std::string &pJson);
+
         std::string m_PublicId;    //< Keys public ID max 6 characters.
         bool m_ChangedFlag;        //< will be set internal when something changed
         bfs::path m_Filename;      //< where to store it
-        yubikey_token_st m_Token;
-        SecretKeyArr m_Key;
+        HotKey *m_Hot;             //< token and secret key, owned, from getHotKeys()
         std::string m_Description; //< Users free text describing the key
         KeyManager &m_KeyManager;  //< Global functionality & data
         std::string m_SysUser;     //< assotiated system user
+        std::shared_ptr<BinaryKeystore> m_Keystore; //< when loaded from a keystore
+        int64_t m_StoreRecord = -1;                 //< keystore record or SQLite row ID
     };
 
 } // end namespace trihlavApi
@@ -7,10 +7,7 @@
 
 #include <iostream>
 
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
-#include <boost/log/expressions.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
 #include <boost/locale/message.hpp>
 #include <boost/format.hpp>
 
@@ -20,6 +17,7 @@
 #include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
 #include "trihlavLib/trihlavMessageViewIface.hpp"
 #include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavKeyStore.hpp"
 #include "trihlavLib/trihlavSpinBoxIface.hpp"
 #include "trihlavLib/trihlavYubikoOtpKeyViewIface.hpp"
 #include "trihlavLib/trihlavYubikoOtpKeyPresenter.hpp"
@@ -59,24 +57,24 @@ namespace trihlav {
     }
 
     void YubikoOtpKeyPresenter::selectSystemUser() {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyPresenter::selectSystemUser");
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyPresenter::selectSystemUser");
         getSysUserListPresenter().show();
     }
 
     void YubikoOtpKeyPresenter::systemUserSelected() {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyPresenter::systemUserSelected");
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyPresenter::systemUserSelected");
         std::string mySelectedUser{getSysUserListPresenter().getSelectedSysUser()};
-        BOOST_LOG_TRIVIAL(debug) << "selected " << mySelectedUser;
+        TRIHLAV_LOG(debug) << "selected " << mySelectedUser;
         getView().getEdtSysUser().setValue(mySelectedUser);
     }
 
     YubikoOtpKeyPresenter::YubikoOtpKeyPresenter(FactoryIface &pFactory) :
             PresenterBase(pFactory) {
-        BOOST_LOG_NAMED_SCOPE("YubikoOptKeyPresenter::YubikoOptKeyPresenter");
+        TRIHLAV_TRACE_SCOPE("YubikoOptKeyPresenter::YubikoOptKeyPresenter");
     }
 
     YubikoOtpKeyPresenter::~YubikoOtpKeyPresenter() {
-        BOOST_LOG_NAMED_SCOPE("YubikoOptKeyPresenter::~YubikoOptKeyPresenter");
+        TRIHLAV_TRACE_SCOPE("YubikoOptKeyPresenter::~YubikoOptKeyPresenter");
         delete m_CurCfg;
     }
 
@@ -109,7 +107,7 @@ namespace trihlav {
                         this->deleteKey();
                         this->saved();
                         this->m_Mode = None;
-                        BOOST_LOG_TRIVIAL(info) << "Key " << myKeyName << " deleted.";
+                        TRIHLAV_LOG(info) << "Key " << myKeyName << " deleted.";
                     }
                 }
         );
@@ -131,23 +129,26 @@ namespace trihlav {
 
     void YubikoOtpKeyPresenter::deleteKey() {
         if (m_CurCfg) {
-            const path myFilename = getCurCfg().getFilename();
-            if (exists(myFilename)) {
-                getFactory().getKeyManager().prefixKeyFile(myFilename, "deleted");
-            } else {
-                BOOST_LOG_TRIVIAL(warning) << "Filename " << myFilename
-                                           << " does not exist.";
-            }
+            getFactory().getKeyManager().getKeyStore().erase(getCurCfg());
+            reloadCurCfg();
         } else {
             throwNoConfig();
         }
     }
 
+/**
+ * Only the key file of the current key is read again, key stores without
+ * key files reload all keys.
+ */
+    void YubikoOtpKeyPresenter::reloadCurCfg() {
+        getFactory().getKeyManager().reloadKeyFiles({getCurCfg().getFilename()});
+    }
+
     void YubikoOtpKeyPresenter::throwNoConfig() {
         const string myErrMsg =
                 translate(
                         "Internal error, YubikoOtpKeyPresenter has no YubikoOtpKeyConfigPtr.");
-        BOOST_LOG_TRIVIAL(error) << myErrMsg;
+        TRIHLAV_LOG(error) << myErrMsg;
         throw std::runtime_error(myErrMsg);
     }
 
@@ -157,8 +158,8 @@ namespace trihlav {
     }
 
     void YubikoOtpKeyPresenter::accepted(const bool pAccepted) {
-        BOOST_LOG_NAMED_SCOPE("YubikoOptKeyPresenter::accepted");
-        BOOST_LOG_TRIVIAL(info) << "Accepted==" << pAccepted;
+        TRIHLAV_TRACE_SCOPE("YubikoOptKeyPresenter::accepted");
+        TRIHLAV_LOG(info) << "Accepted==" << pAccepted;
         if (pAccepted) {
             if (m_CurCfg == 0) {
                 throwNoConfig();
@@ -177,6 +178,7 @@ namespace trihlav {
                     getCurCfg().setDescription(getDescription());
 
                     getCurCfg().save();
+                    reloadCurCfg();
                 }
                 saved();
             } catch (const std::exception &pExc) {
@@ -205,7 +207,7 @@ namespace trihlav {
     }
 
     void YubikoOtpKeyPresenter::generatePrivateId() {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyPresenter::generatePrivateId");
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyPresenter::generatePrivateId");
         string myNewId;
         generate(YUBIKEY_UID_SIZE, myNewId);
         getEdtPrivateId().setValue(myNewId);
@@ -223,7 +225,7 @@ namespace trihlav {
     YubikoOtpKeyViewIface &YubikoOtpKeyPresenter::getView() {
         if (!m_View) {
             m_View = getFactory().createYubikoOtpKeyView();
-            BOOST_LOG_TRIVIAL(debug) << "Allocated view " << m_View;
+            TRIHLAV_LOG(debug) << "Allocated view " << m_View;
             initUi();
         }
         return *m_View;
@@ -242,7 +244,7 @@ namespace trihlav {
     }
 
     void YubikoOtpKeyPresenter::generatePublicId() {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyPresenter::generatePublicId");
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyPresenter::generatePublicId");
         const int mySz = getPublicIdLen();
         string myNewId;
         generateModhex(mySz, myNewId);
@@ -254,7 +256,7 @@ namespace trihlav {
     }
 
     void YubikoOtpKeyPresenter::generateSecretKey() {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyPresenter::generateSecretKey");
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyPresenter::generateSecretKey");
         string myNewKey;
         generate(YUBIKEY_KEY_SIZE, myNewKey);
         getEdtSecretKey().setValue(myNewKey);
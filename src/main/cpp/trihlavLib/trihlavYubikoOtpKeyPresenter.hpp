@@ -125,6 +125,9 @@ namespace trihlav {
 
         signal_t saved;
     private:
+        /// @brief Apply the saved or deleted current key to the loaded keys.
+        void reloadCurCfg();
+
         EMode m_Mode = None;
         YubikoOtpKeyViewIfacePtr m_View{nullptr};
         YubikoOtpKeyConfig *m_CurCfg{nullptr};
@@ -32,7 +32,7 @@
 namespace trihlav {
 
     YubikoOtpKeyViewIface::~YubikoOtpKeyViewIface() {
-        BOOST_LOG_NAMED_SCOPE("YubikoOtpKeyViewIface::~YubikoOtpKeyViewIface");
+        TRIHLAV_TRACE_SCOPE("YubikoOtpKeyViewIface::~YubikoOtpKeyViewIface");
     }
 
 
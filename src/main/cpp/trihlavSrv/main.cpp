@@ -7,7 +7,13 @@
 
 #include "trihlavApp.hpp"
 #include "trihlavWtAuthResource.hpp"
+#include "trihlavWtMetricsResource.hpp"
+#include "trihlavWtTraceResource.hpp"
 #include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavGetUiFactory.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
 
 
 #include "trihlavLib/trihlavConstants.hpp"
@@ -35,12 +41,20 @@ using trihlav::App;
 using trihlav::WtAuthResource;
 using trihlav::K_APP_PATH;
 using trihlav::K_AUTH_URL;
+using trihlav::WtMetricsResource;
+using trihlav::K_METRICS_URL;
+using trihlav::WtTraceResource;
+using trihlav::K_TRACE_URL;
 
 static const char *const K_TRIHLAV_WT_HTTPD_CFG //
         = "/etc/trihlav/wt_httpd.ini";
 
 int main(int argc, char **argv, char **envp) {
     try {
+        // log records are written by a writer thread, off the request threads
+        trihlav::Settings &mySettings = trihlav::getUiFactory().getSettings();
+        mySettings.load();
+        trihlav::initLog(mySettings);
         // use argv[0] as the application name to match a suitable entry
         // in the Wt configuration file, and use the default configuration
         // file (which defaults to /etc/wt/wt_config.xml unless the environment
@@ -51,17 +65,30 @@ int main(int argc, char **argv, char **envp) {
         // add a single entry point, at the default location (as determined
         // by the server configuration's deploy-path)
         myServer.addEntryPoint(EntryPointType::Application, &App::createApplication, K_APP_PATH);
-        // create the auth REST resource
+        // the auth REST resource validates against keys loaded upfront
+        const size_t myKeyCnt = trihlav::getUiFactory().getKeyManager().loadKeys();
+        TRIHLAV_LOG(info) << "Loaded " << myKeyCnt << " keys.";
+        // key files changed by the UI or by hand are applied one by one
+        trihlav::getUiFactory().getKeyManager().watchKeys();
         WtAuthResource myAuthResource;
         myServer.addResource(&myAuthResource, K_AUTH_URL);
+        WtMetricsResource myMetricsResource;
+        myServer.addResource(&myMetricsResource, K_METRICS_URL);
+        // the trace is for local debugging only
+        WtTraceResource myTraceResource;
+        if (mySettings.getTraceResource()) {
+            myServer.addResource(&myTraceResource, K_TRACE_URL);
+        }
         const string &myErrorPage =
                 myServer.appRoot() + trihlav::K_ERROR_PAGE;
-        BOOST_LOG_TRIVIAL(debug) << "Adding error page \"" + myErrorPage + "\".";
+        TRIHLAV_LOG(debug) << "Adding error page \"" + myErrorPage + "\".";
         myServer.addResource(new WFileResource("text/html", myErrorPage), "/" + trihlav::K_ERROR_PAGE);
         if (myServer.start()) {
             int sig = WServer::waitForShutdown();
-            BOOST_LOG_TRIVIAL(error) << "Shutdown (signal = " << sig << ")" << std::endl;
+            TRIHLAV_LOG(error) << "Shutdown (signal = " << sig << ")" << std::endl;
             myServer.stop();
+            // the next start reads only the key files changed after this
+            trihlav::getUiFactory().getKeyManager().saveKeySnapshot();
             if (sig == SIGHUP)
                 WServer::restart(argc, argv, envp);
         }
@@ -59,7 +59,7 @@ namespace trihlav {
     App::App(const WEnvironment &pEnv) :
             WApplication(pEnv) //
     {
-        BOOST_LOG_TRIVIAL(debug) << "App creating...";
+        TRIHLAV_LOG(debug) << "App creating...";
         setTitle(K_APP_NAME);               // application title
         auto bootstrapTheme = std::make_shared<WBootstrapTheme>();
         setTheme(bootstrapTheme);
@@ -69,24 +69,24 @@ namespace trihlav {
         auto &myMainPanelView = dynamic_cast<WtMainPanelView &>(myIMainPanelView);
         root()->addWidget(std::unique_ptr<Wt::WWidget>(myMainPanelView.getRootWidget()));
         m_MainPanelCntrl->setupUi();
-        BOOST_LOG_TRIVIAL(debug) << "App created.";
+        TRIHLAV_LOG(debug) << "App created.";
     }
 
     AppPtr App::createApplication(const WEnvironment &pEnv) {
         const string &myHost{pEnv.hostName()};
         std::unique_ptr<App> myAppPtr{std::make_unique<App>(pEnv)};
-        BOOST_LOG_TRIVIAL(debug) << "Adding session from " << myHost << pEnv.internalPath() << ".";
+        TRIHLAV_LOG(debug) << "Adding session from " << myHost << pEnv.internalPath() << ".";
         const bool valid = myAppPtr->isAlloved(myHost);
         if (!valid) {
             myAppPtr->redirect("/" + K_ERROR_PAGE);
-            BOOST_LOG_TRIVIAL(error) << "Host \"" << myHost << "\" is not aloved here.";
+            TRIHLAV_LOG(error) << "Host \"" << myHost << "\" is not aloved here.";
             myAppPtr->quit();
         }
         return myAppPtr;
     }
 
     App::~App() {
-        BOOST_LOG_NAMED_SCOPE("App::~App()");
+        TRIHLAV_TRACE_SCOPE("App::~App()");
     }
 
     bool App::isAlloved(const std::string &pHostName) const {
@@ -2,7 +2,9 @@
 // Created by grobap on 10.01.17.
 //
 
+#include <chrono>
 #include <string>
+#include <sstream>
 
 #include <Wt/WResource.h>
 #include <Wt/Http/Response.h>
@@ -11,6 +13,9 @@
 
 #include "trihlavLib/trihlavConstants.hpp"
 #include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavGetUiFactory.hpp"
+#include "trihlavLib/trihlavOtpValidator.hpp"
+#include "trihlavLib/trihlavMetrics.hpp"
 
 using std::string;
 using std::vector;
@@ -20,34 +25,80 @@ using Wt::Http::Response;
 
 namespace trihlav {
 
+    WtAuthResource::WtAuthResource() //
+            : m_Validator(getUiFactory().getOtpValidator()), //
+              m_Latency(getMetrics().getHistogram("trihlav_auth_request_seconds", "Handling of an auth request.")) //
+    {
+        for (int myStatus = OtpValidator::EOk; myStatus <= OtpValidator::ERateLimited; ++myStatus) {
+            m_Validations.push_back(&getMetrics().getCounter(
+                    "trihlav_otp_validations_total", "Passwords validated by the auth resource, by outcome.",
+                    "status=\"" + OtpValidator::getStatusStr(OtpValidator::EStatus(myStatus)) + "\""));
+        }
+    }
+
     /**
      * Reimplement the parents main action. The password request parameter can have up to 3 values (OTP passwords).
-     * @param pRequest incoming - has login and password parameters.
-     * @param pResponse outgoing - return "ok" on success.
+     * All of them have to be valid. A retried request carrying the same nonce gets the original answer.
+     * Clients exceeding their rate limit are rejected before any password is looked at.
+     * @param pRequest incoming - has login (or username), password and optionally nonce parameters.
+     * @param pResponse outgoing - "ok!" on success, "Fail!" otherwise, followed by a "status: " line.
+     * The time spent validating goes to the "Server-Timing" header, so clients can tell it from the transport.
      */
     void WtAuthResource::handleRequest(const Wt::Http::Request &pRequest, Wt::Http::Response &pResponse) {
-        BOOST_LOG_NAMED_SCOPE("WtAuthResource::handleRequest");
+        TRIHLAV_TRACE_SCOPE("WtAuthResource::handleRequest");
+        const ScopedLatency myLatency(m_Latency);
         const Wt::Http::ParameterValues &myLoginVals = pRequest.getParameterValues(K_LOGIN);
+        const Wt::Http::ParameterValues &myUserNmVals = pRequest.getParameterValues(K_USER_NM);
         const Wt::Http::ParameterValues &myOtpVals = pRequest.getParameterValues(K_PSWD);
+        const string *myNonceVal = pRequest.getParameter(K_NONCE);
+        const string myNonce{myNonceVal == 0 ? "" : *myNonceVal};
         string myLogin;
         vector<string> myOtp;
         if (myLoginVals.size() == 1) {
             myLogin = myLoginVals[0];
+        } else if (myUserNmVals.size() == 1) {
+            myLogin = myUserNmVals[0];
         }
-        BOOST_LOG_TRIVIAL(debug) << "login " << myLogin;
+        TRIHLAV_LOG(debug) << "login " << myLogin;
         if (myOtpVals.size() >= 1) {
             myOtp.push_back(myOtpVals[0]);
-            BOOST_LOG_TRIVIAL(debug) << "otp[0] " << myOtp[0];
+            TRIHLAV_LOG(debug) << "otp[0] " << myOtp[0];
         }
         if (myOtpVals.size() >= 2) {
             myOtp.push_back(myOtpVals[1]);
-            BOOST_LOG_TRIVIAL(debug) << "otp[1] " << myOtp[1];
+            TRIHLAV_LOG(debug) << "otp[1] " << myOtp[1];
         }
         if (myOtpVals.size() >= 3) {
             myOtp.push_back(myOtpVals[2]);
-            BOOST_LOG_TRIVIAL(debug) << "otp[2] " << myOtp[2];
+            TRIHLAV_LOG(debug) << "otp[2] " << myOtp[2];
+        }
+        OtpValidator::EStatus myStatus = OtpValidator::ETooShort;
+        const std::chrono::steady_clock::time_point myValidateStart = std::chrono::steady_clock::now();
+        if (!m_Validator.admitClient(pRequest.clientAddress())) {
+            myStatus = OtpValidator::ERateLimited;
+            m_Validations[myStatus]->inc();
+            myOtp.clear();
+        }
+        for (const string &myPswd : myOtp) {
+            myStatus = m_Validator.validate(myPswd, myLogin, myNonce, pRequest.clientAddress());
+            m_Validations[myStatus]->inc();
+            if (myStatus != OtpValidator::EOk) {
+                break;
+            }
+        }
+        const std::chrono::duration<double, std::milli> myValidateMs =
+                std::chrono::steady_clock::now() - myValidateStart;
+        TRIHLAV_LOG(info) << "Auth " << myLogin << ": " << OtpValidator::getStatusStr(myStatus);
+        std::ostringstream myTiming;
+        myTiming << "validate;dur=" << myValidateMs.count();
+        pResponse.addHeader("Server-Timing", myTiming.str());
+        pResponse.setMimeType("text/plain");
+        if (myStatus == OtpValidator::EOk) {
+            pResponse.out() << "ok!\n";
+        } else {
+            pResponse.out() << "Fail!\n";
         }
-        pResponse.out() << "Fail!\n";
+        pResponse.out() << "status: " << OtpValidator::getStatusStr(myStatus) << "\n";
     }
 
 }
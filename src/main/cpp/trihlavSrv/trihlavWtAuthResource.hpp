@@ -5,19 +5,36 @@
 #ifndef TRIHLAV_WT_AUTH_RESOURCE_HPP_
 #define TRIHLAV_WT_AUTH_RESOURCE_HPP_
 
+#include <vector>
 #include <Wt/WResource.h>
 
 namespace trihlav {
 
+    class OtpValidator;
+
+    class Counter;
+
+    class Histogram;
+
     /**
      * Authenticate an "one time password" (OTP) as a REST API call.
+     *
+     * Called concurrently from all Wt worker threads, the state lives in the
+     * shared OtpValidator.
      */
     class WtAuthResource : public Wt::WResource {
     public:
+        WtAuthResource();
+
         ~WtAuthResource() = default;
 
     protected:
         void handleRequest(const Wt::Http::Request &pRequest, Wt::Http::Response &pResponse) override;
+
+    private:
+        OtpValidator &m_Validator;
+        std::vector<Counter *> m_Validations;  //< per OtpValidator::EStatus
+        Histogram &m_Latency;
     };
 
 }
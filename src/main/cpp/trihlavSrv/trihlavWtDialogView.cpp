@@ -53,7 +53,7 @@ namespace trihlav {
             m_OkBtn(new WtPushButton(translate("ok"))) //
 
     {
-        BOOST_LOG_NAMED_SCOPE("WtDialogView::WtDialogView()");
+        TRIHLAV_TRACE_SCOPE("WtDialogView::WtDialogView()");
         WHBoxLayout *myBtnLayout = new WHBoxLayout;
         {
             m_CancelBtn->resize(WLength(11.0, U::FontEm), WLength(4.0, U::FontEm));
@@ -88,7 +88,7 @@ namespace trihlav {
     }
 
     WtDialogView::~WtDialogView() {
-        BOOST_LOG_NAMED_SCOPE("WtDialogView::~WtDialogView");
+        TRIHLAV_TRACE_SCOPE("WtDialogView::~WtDialogView");
     }
 
     void WtDialogView::finishedSlot(Wt::DialogCode pCode) {
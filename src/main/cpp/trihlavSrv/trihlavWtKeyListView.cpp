@@ -31,9 +31,7 @@
 #include <list>
 #include <boost/locale.hpp>
 
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
 
 #include <Wt/WAny.h>
 #include <Wt/WTableView.h>
@@ -94,7 +92,7 @@ namespace trihlav {
     };
 
     void WtKeyListView::layoutSizeChanged(int pW, int pH) {
-        BOOST_LOG_TRIVIAL(debug) << "W=" << pW << " H=" << pH;
+        TRIHLAV_LOG(debug) << "W=" << pW << " H=" << pH;
         const int WIDTH = 120;
         const int K_TBL_W = pW - 2 * K_TBL_V_MARGIN;
         int K_COL_CNT{1};
@@ -184,7 +182,7 @@ namespace trihlav {
     }
 
     void WtKeyListView::addedAllRows() {
-        BOOST_LOG_TRIVIAL(debug) << "We have " << m_DtaMdl->rowCount();
+        TRIHLAV_LOG(debug) << "We have " << m_DtaMdl->rowCount();
         m_Table->refresh();
     }
 
@@ -209,7 +207,7 @@ namespace trihlav {
     }
 
     void WtKeyListView::selectionChanged() {
-        BOOST_LOG_NAMED_SCOPE("WtKeyListView::selectionChanged");
+        TRIHLAV_TRACE_SCOPE("WtKeyListView::selectionChanged");
         this->selectionChangedSig(getSelected());
     }
 
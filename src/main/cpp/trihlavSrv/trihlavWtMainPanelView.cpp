@@ -182,7 +182,7 @@ namespace trihlav {
     }
 
     WtMainPanelView::~WtMainPanelView() {
-        BOOST_LOG_TRIVIAL(debug) << "~WtMainPanelView()";
+        TRIHLAV_LOG(debug) << "~WtMainPanelView()";
     }
 
     Wt::WWidget *WtMainPanelView::getRootWidget() {
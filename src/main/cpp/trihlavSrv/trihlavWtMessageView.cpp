@@ -1,9 +1,7 @@
 #include "../../main/cpp/trihlavSrv/trihlavWtMessageView.hpp"
 
 #include <stdexcept>
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
 
 #include <Wt/WMessageBox.h>
 
@@ -15,12 +13,12 @@ using std::bind;
 namespace trihlav {
 
     WtMessageView::WtMessageView() {
-        BOOST_LOG_NAMED_SCOPE("WtMessageView::WtMessageView");
+        TRIHLAV_TRACE_SCOPE("WtMessageView::WtMessageView");
     }
 
     void WtMessageView::showMessage(const std::string &pHeader,
                                     const std::string &pMsg) {
-        BOOST_LOG_NAMED_SCOPE("WtMessageView::showMessage");
+        TRIHLAV_TRACE_SCOPE("WtMessageView::showMessage");
         WMessageBox *myMsgBox = new Wt::WMessageBox( //
                 pHeader.c_str(),
                 pMsg.c_str(),
@@ -33,7 +31,7 @@ namespace trihlav {
 
     void WtMessageView::ask(const std::string &pHeader,
                             const std::string &pMsg, TCallback pCallback) {
-        BOOST_LOG_NAMED_SCOPE("WtMessageView::ask");
+        TRIHLAV_TRACE_SCOPE("WtMessageView::ask");
         WMessageBox *myMsgBox = new Wt::WMessageBox( //
                 pHeader.c_str(),
                 pMsg.c_str(),
@@ -50,7 +48,7 @@ namespace trihlav {
     }
 
     WtMessageView::~WtMessageView() {
-        BOOST_LOG_NAMED_SCOPE("WtMessageView::~WtMessageView");
+        TRIHLAV_TRACE_SCOPE("WtMessageView::~WtMessageView");
     }
 
 } /* namespace trihlav */
@@ -0,0 +1,52 @@
+#include <string>
+#include <ostream>
+
+#include <Wt/WResource.h>
+#include <Wt/Http/Response.h>
+
+#include "trihlavWtMetricsResource.hpp"
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavGetUiFactory.hpp"
+#include "trihlavLib/trihlavOtpValidator.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavRecentOtpCache.hpp"
+#include "trihlavLib/trihlavUnknownIdCache.hpp"
+#include "trihlavLib/trihlavRateLimiter.hpp"
+#include "trihlavLib/trihlavMetrics.hpp"
+
+using std::string;
+using Wt::Http::Request;
+using Wt::Http::Response;
+
+namespace trihlav {
+
+    static void writeMetric(std::ostream &pOut, const string &pName, const string &pType, const string &pHelp) {
+        pOut << "# HELP " << pName << ' ' << pHelp << '\n';
+        pOut << "# TYPE " << pName << ' ' << pType << '\n';
+    }
+
+    WtMetricsResource::WtMetricsResource() : m_Validator(getUiFactory().getOtpValidator()) {
+    }
+
+    void WtMetricsResource::handleRequest(const Wt::Http::Request &pRequest, Wt::Http::Response &pResponse) {
+        TRIHLAV_TRACE_SCOPE("WtMetricsResource::handleRequest");
+        pResponse.setMimeType("text/plain; version=0.0.4");
+        std::ostream &myOut = pResponse.out();
+        getMetrics().writePrometheus(myOut);
+        writeMetric(myOut, "trihlav_recent_otp_hits_total", "counter",
+                    "Passwords answered from the recent OTP cache.");
+        myOut << "trihlav_recent_otp_hits_total " << m_Validator.getRecentOtps().getHitCount() << '\n';
+        writeMetric(myOut, "trihlav_recent_otps", "gauge", "Passwords in the recent OTP cache.");
+        myOut << "trihlav_recent_otps " << m_Validator.getRecentOtps().size() << '\n';
+        const UnknownIdCache &myUnknownIds = m_Validator.getKeyManager().getUnknownIds();
+        writeMetric(myOut, "trihlav_unknown_id_lookups_total", "counter", "Lookups of unknown public IDs.");
+        myOut << "trihlav_unknown_id_lookups_total " << myUnknownIds.getMissCount() << '\n';
+        writeMetric(myOut, "trihlav_rate_limited_total", "counter", "Requests rejected by a rate limiter.");
+        myOut << "trihlav_rate_limited_total{limiter=\"key\"} "
+              << m_Validator.getKeyLimiter().getLimitedCount() << '\n';
+        myOut << "trihlav_rate_limited_total{limiter=\"client\"} "
+              << m_Validator.getClientLimiter().getLimitedCount() << '\n';
+    }
+
+}
@@ -0,0 +1,31 @@
+
+#ifndef TRIHLAV_WT_METRICS_RESOURCE_HPP_
+#define TRIHLAV_WT_METRICS_RESOURCE_HPP_
+
+#include <Wt/WResource.h>
+
+namespace trihlav {
+
+    class OtpValidator;
+
+    /**
+     * Serves the metrics registry in the Prometheus text format, together
+     * with the counters kept by the caches and rate limiters of the shared
+     * OtpValidator.
+     */
+    class WtMetricsResource : public Wt::WResource {
+    public:
+        WtMetricsResource();
+
+        ~WtMetricsResource() = default;
+
+    protected:
+        void handleRequest(const Wt::Http::Request &pRequest, Wt::Http::Response &pResponse) override;
+
+    private:
+        OtpValidator &m_Validator;
+    };
+
+}
+
+#endif //TRIHLAV_WT_METRICS_RESOURCE_HPP_
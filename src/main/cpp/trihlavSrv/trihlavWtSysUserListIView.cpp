@@ -34,9 +34,7 @@
 #include <Wt/WHBoxLayout.h>
 #include <Wt/WVBoxLayout.h>
 
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/attributes.hpp>
+#include "trihlavLib/trihlavLogApi.hpp"
 
 #include "trihlavWtListModel.hpp"
 
@@ -81,7 +79,7 @@ WtSysUserListView::WtSysUserListView() :
 		m_DtaMdl(new WtSysUserListModel), //
 		m_SysUserTable(new WTableView) //
 {
-	BOOST_LOG_NAMED_SCOPE("WtSysUserListView::WtSysUserListView");
+	TRIHLAV_TRACE_SCOPE("WtSysUserListView::WtSysUserListView");
     getDlg().setWindowTitle(translate("Add key").str());
 	getDlg().setObjectName("WtSysUserListView");
 	getDlg().resize(K_DLG_W, K_DLG_H);
@@ -105,17 +103,17 @@ WtSysUserListView::WtSysUserListView() :
 }
 
 void WtSysUserListView::show(const SysUsers& pUsers) {
-	BOOST_LOG_NAMED_SCOPE("WtSysUserListView::show");
+	TRIHLAV_TRACE_SCOPE("WtSysUserListView::show");
 	int myCnt = 0;
 	m_DtaMdl->clear();
 	for (const SysUser& myUser : pUsers) {
 		myCnt++;
-		BOOST_LOG_TRIVIAL(debug)<<"User: " << myUser.m_Login;
+		TRIHLAV_LOG(debug)<<"User: " << myUser.m_Login;
 		m_DtaMdl->addRow(
 				WtSysUserListModel::Row_t(std::string(myUser.m_Login),
 						std::string(myUser.m_FullName)));
 	}
-	BOOST_LOG_TRIVIAL(debug)<<"System users loaded.";
+	TRIHLAV_LOG(debug)<<"System users loaded.";
 	getDlg().setModal(true);
 	getDlg().show();
 }
@@ -137,7 +135,7 @@ WtSysUserListView::getRow(int pId) const {
 }
 
 void WtSysUserListView::selectionChanged() {
-	BOOST_LOG_NAMED_SCOPE("WtSysUserListView::selectionChanged");
+	TRIHLAV_TRACE_SCOPE("WtSysUserListView::selectionChanged");
 	this->selectionChangedSig(getSelected());
 
 }
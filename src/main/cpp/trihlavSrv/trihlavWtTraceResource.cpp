@@ -0,0 +1,84 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+
+#include <Wt/WResource.h>
+#include <Wt/Http/Request.h>
+#include <Wt/Http/Response.h>
+
+#include "trihlavWtTraceResource.hpp"
+
+#include "trihlavLib/trihlavConstants.hpp"
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavTrace.hpp"
+
+using std::string;
+using Wt::Http::Request;
+using Wt::Http::Response;
+
+namespace trihlav {
+
+    /// @brief Is pAddress one of this host, IPv4, IPv6 or IPv4 mapped into IPv6?
+    static bool isLoopback(const string &pAddress) {
+        return pAddress.compare(0, 4, "127.") == 0 || pAddress == "::1" || pAddress.compare(0, 11, "::ffff:127.") == 0;
+    }
+
+/**
+ * Only clients on this host are served, others get 403. Switching tracing
+ * changes the state of the server, so it takes a POST, a GET with enable
+ * gets 405.
+ */
+    void WtTraceResource::handleRequest(const Wt::Http::Request &pRequest, Wt::Http::Response &pResponse) {
+        pResponse.setMimeType("text/plain");
+        if (!isLoopback(pRequest.clientAddress())) {
+            TRIHLAV_LOG_LIMITED(warning, 10) << "Refused the trace to " << pRequest.clientAddress() << ".";
+            pResponse.setStatus(403);
+            return;
+        }
+        const string *myEnable = pRequest.getParameter(K_ENABLE);
+        if (myEnable != 0) {
+            if (pRequest.method() != "POST") {
+                pResponse.setStatus(405);
+                pResponse.addHeader("Allow", "POST");
+                return;
+            }
+            const bool myOn = *myEnable == "1";
+            if (myOn && !Trace::isEnabled()) {
+                Trace::clear();
+            }
+            Trace::setEnabled(myOn);
+            TRIHLAV_LOG(info) << "Tracing " << (myOn ? "enabled" : "disabled") << ".";
+            pResponse.out() << "tracing: " << (myOn ? "on" : "off") << "\n";
+            return;
+        }
+        pResponse.setMimeType("application/json");
+        Trace::writeChromeTrace(pResponse.out());
+    }
+
+}
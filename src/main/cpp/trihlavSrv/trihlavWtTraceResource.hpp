@@ -0,0 +1,54 @@
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+	der GNU General Public License, wie von der Free Software Foundation,
+	Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+	veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+	Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+	OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+	Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+	Siehe die GNU General Public License für weitere Details.
+
+	Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+	Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRIHLAV_WT_TRACE_RESOURCE_HPP_
+#define TRIHLAV_WT_TRACE_RESOURCE_HPP_
+
+#include <Wt/WResource.h>
+
+namespace trihlav {
+
+    /**
+     * Switches tracing on and off (POST with enable=1 or enable=0) and
+     * otherwise serves the recorded spans as Chrome trace event JSON. Only
+     * clients on this host are served, and the resource is registered only
+     * when Settings::getTraceResource() is set.
+     */
+    class WtTraceResource : public Wt::WResource {
+    public:
+        WtTraceResource() = default;
+
+        ~WtTraceResource() = default;
+
+    protected:
+        void handleRequest(const Wt::Http::Request &pRequest, Wt::Http::Response &pResponse) override;
+    };
+
+}
+
+#endif //TRIHLAV_WT_TRACE_RESOURCE_HPP_
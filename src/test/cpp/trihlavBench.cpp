@@ -0,0 +1,732 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Microbenchmarks of the core library.
+ *
+ * Usage: trihlavBench [google benchmark options] 2>/dev/null
+ *
+ * Without --benchmark_out the results are also saved to trihlavBench.json,
+ * compare two builds with tools/compare.py of google benchmark:
+ *   compare.py benchmarks old/trihlavBench.json new/trihlavBench.json
+ *
+ * Besides the time per operation every benchmark reports allocs/op, the
+ * operator new calls per operation. The keystores are synthetic, @see
+ * createSyntheticKeys(), and written below /tmp. BM_KeyStore_* compare the
+ * key stores, @see Settings::getKeyStore(), eagerly and lazily loaded,
+ * @see Settings::getLazyKeys(), and the JSON directory with and without
+ * its KeySnapshot. BM_KeyFile_* compare
+ * KeyFileJson with the property_tree code it replaced. The counter journal
+ * runs in async mode, so no flush is measured.
+ */
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <new>
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <iostream>
+#include <malloc.h>
+#include <yubikey.h>
+#include <benchmark/benchmark.h>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavVersion.hpp"
+#include "trihlavLib/trihlavPublicId.hpp"
+#include "trihlavLib/trihlavTupleList.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavKeyStore.hpp"
+#include "trihlavLib/trihlavKeySnapshot.hpp"
+#include "trihlavLib/trihlavOtpValidator.hpp"
+#include "trihlavLib/trihlavHotKey.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+
+#include "trihlavTestCommonUtils.hpp"
+
+using std::map;
+using std::string;
+using std::vector;
+using std::unique_ptr;
+using boost::format;
+using ::trihlav::Settings;
+using ::trihlav::PublicId;
+using ::trihlav::TupleList;
+using ::trihlav::KeyManager;
+using ::trihlav::KeySnapshot;
+using ::trihlav::OtpValidator;
+using ::trihlav::YubikoOtpKeyConfig;
+using ::boost::filesystem::path;
+using ::boost::filesystem::unique_path;
+using ::boost::property_tree::ptree;
+
+static std::atomic<uint64_t> theAllocs { 0 };
+
+void* operator new(size_t pSize) {
+	theAllocs.fetch_add(1, std::memory_order_relaxed);
+	if (void *myRetVal = std::malloc(pSize == 0 ? 1 : pSize)) {
+		return myRetVal;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *pPtr) noexcept {
+	std::free(pPtr);
+}
+
+void operator delete(void *pPtr, size_t) noexcept {
+	std::free(pPtr);
+}
+
+/// @brief Reports the operator new calls of the timed loop as allocs/op.
+class AllocCounter {
+public:
+	explicit AllocCounter(benchmark::State &pState) :
+			m_State(pState), m_Start(theAllocs.load(std::memory_order_relaxed)) {
+	}
+
+	~AllocCounter() {
+		m_State.counters["allocs/op"] = benchmark::Counter(
+				double(theAllocs.load(std::memory_order_relaxed) - m_Start), benchmark::Counter::kAvgIterations);
+	}
+
+private:
+	benchmark::State &m_State;
+	const uint64_t m_Start;
+};
+
+/// @brief A synthetic keystore in its own directory, loaded.
+struct BenchKeys {
+	explicit BenchKeys(size_t pCount) :
+			m_Settings(unique_path("/tmp/trihlav-bench-%%%%-%%%%")), m_KeyMan() {
+		m_Settings.getDurability() = Settings::EAsync;
+		m_KeyMan.reset(new KeyManager(m_Settings));
+		::trihlav::createSyntheticKeys(*m_KeyMan, pCount);
+		m_KeyMan->loadKeys();
+	}
+
+	~BenchKeys() {
+		m_KeyMan.reset();
+		remove_all(m_Settings.getConfigDir());
+	}
+
+	Settings m_Settings;
+	unique_ptr<KeyManager> m_KeyMan;
+};
+
+static map<size_t, unique_ptr<BenchKeys> > theKeyStores;
+
+/// @return the keystore of pCount keys, created on first use and kept until exit.
+static KeyManager &getKeyStore(size_t pCount) {
+	unique_ptr<BenchKeys> &myKeys = theKeyStores[pCount];
+	if (!myKeys) {
+		myKeys.reset(new BenchKeys(pCount));
+	}
+	return *myKeys->m_KeyMan;
+}
+
+/// @return OTPs, without public ID, following the stored counter of pKey.
+static vector<string> makeOtps(const YubikoOtpKeyConfig &pKey, size_t pCount) {
+	vector<string> myRetVal;
+	yubikey_token_st myTkn { pKey.getToken() };
+	for (size_t myI = 0; myI < pCount; ++myI) {
+		++myTkn.ctr;
+		myTkn.use = 0;
+		myTkn.crc = YubikoOtpKeyConfig::computeCrc(myTkn);
+		string myOtp(YUBIKEY_OTP_SIZE + 1, '.');
+		yubikey_token_st myEncrypted { myTkn }; // yubikey_generate() encrypts in place
+		yubikey_generate(&myEncrypted, pKey.getSecretKeyArray().data(), &myOtp[0]);
+		myOtp.resize(YUBIKEY_OTP_SIZE);
+		myRetVal.push_back(myOtp);
+	}
+	return myRetVal;
+}
+
+/// @brief Accepted OTPs, each one advances the counter, it is reset when they run out.
+static void BM_checkOtpAccept(benchmark::State &pState) {
+	KeyManager &myKeyMan = getKeyStore(1);
+	YubikoOtpKeyConfig &myKey = *myKeyMan.getKeyByPublicId(::trihlav::getSyntheticPublicId(0));
+	const yubikey_token_st myStart { myKey.getToken() };
+	const vector<string> myOtps { makeOtps(myKey, 0xffff - myStart.ctr) };
+	size_t myNext = 0;
+	int64_t myRejected = 0;
+	{
+		AllocCounter myAllocs(pState);
+		for (auto _ : pState) {
+			if (myNext == myOtps.size()) {
+				pState.PauseTiming();
+				myKey.getToken() = myStart;
+				myKeyMan.compactJournalIfFull();
+				myNext = 0;
+				pState.ResumeTiming();
+			}
+			myRejected += myKey.checkOtp(myOtps[myNext++]) ? 0 : 1;
+		}
+	}
+	myKey.getToken() = myStart;
+	if (myRejected != 0) {
+		pState.SkipWithError("A valid OTP was rejected.");
+	}
+}
+BENCHMARK(BM_checkOtpAccept);
+
+/// @brief A replayed OTP, decrypted and compared with the stored counters.
+static void BM_checkOtpReject(benchmark::State &pState) {
+	YubikoOtpKeyConfig &myKey = *getKeyStore(1).getKeyByPublicId(::trihlav::getSyntheticPublicId(0));
+	const yubikey_token_st myStart { myKey.getToken() };
+	const string myOtp { makeOtps(myKey, 1).front() };
+	myKey.checkOtp(myOtp);
+	int64_t myAccepted = 0;
+	{
+		AllocCounter myAllocs(pState);
+		for (auto _ : pState) {
+			myAccepted += myKey.checkOtp(myOtp) ? 1 : 0;
+		}
+	}
+	myKey.getToken() = myStart;
+	if (myAccepted != 0) {
+		pState.SkipWithError("A replayed OTP was accepted.");
+	}
+}
+BENCHMARK(BM_checkOtpReject);
+
+static void BM_hex2Modhex(benchmark::State &pState) {
+	const string myHex { ::trihlav::K_TST_SECU0 };
+	AllocCounter myAllocs(pState);
+	for (auto _ : pState) {
+		benchmark::DoNotOptimize(YubikoOtpKeyConfig::hex2Modhex(myHex));
+	}
+}
+BENCHMARK(BM_hex2Modhex);
+
+static void BM_modhex2Hex(benchmark::State &pState) {
+	const string myModhex { YubikoOtpKeyConfig::hex2Modhex(::trihlav::K_TST_SECU0) };
+	AllocCounter myAllocs(pState);
+	for (auto _ : pState) {
+		benchmark::DoNotOptimize(YubikoOtpKeyConfig::modhex2Hex(myModhex));
+	}
+}
+BENCHMARK(BM_modhex2Hex);
+
+static void BM_computeCrc(benchmark::State &pState) {
+	yubikey_token_st myTkn { getKeyStore(1).getKey(0).getToken() };
+	AllocCounter myAllocs(pState);
+	for (auto _ : pState) {
+		++myTkn.use;
+		benchmark::DoNotOptimize(YubikoOtpKeyConfig::computeCrc(myTkn));
+	}
+}
+BENCHMARK(BM_computeCrc);
+
+static void BM_generateOtp(benchmark::State &pState) {
+	const YubikoOtpKeyConfig &myKey = getKeyStore(1).getKey(0);
+	AllocCounter myAllocs(pState);
+	for (auto _ : pState) {
+		benchmark::DoNotOptimize(myKey.generateOtp());
+	}
+}
+BENCHMARK(BM_generateOtp);
+
+/// @brief Public IDs of pKeyCount synthetic keys picked in a random order.
+static vector<string> makeLookups(size_t pKeyCount) {
+	constexpr size_t K_LOOKUPS = 4096;
+	vector<string> myRetVal;
+	uint64_t myRnd = 88172645463325252ULL;
+	for (size_t myI = 0; myI < K_LOOKUPS; ++myI) {
+		myRnd ^= myRnd << 13;
+		myRnd ^= myRnd >> 7;
+		myRnd ^= myRnd << 17;
+		myRetVal.push_back(::trihlav::getSyntheticPublicId(myRnd % pKeyCount));
+	}
+	return myRetVal;
+}
+
+/**
+ * The keys are built in memory, writing and loading a million key files
+ * would dominate the run. Each hit reads the counter of the found key, as
+ * the validation does.
+ */
+static void BM_KeyIndex_getKeyByPublicId(benchmark::State &pState) {
+	const size_t myCount = size_t(pState.range(0));
+	Settings mySettings(unique_path("/tmp/trihlav-bench-%%%%-%%%%"));
+	KeyManager myKeyMan(mySettings);
+	KeyManager::KeyIndex myIndex;
+	myIndex.m_KeyList.reserve(myCount);
+	myIndex.m_ByPublicId.reserve(myCount);
+	for (size_t myNr = 0; myNr < myCount; ++myNr) {
+		myIndex.m_KeyList.push_back(std::make_shared<YubikoOtpKeyConfig>(myKeyMan));
+		::trihlav::setSyntheticKey(*myIndex.m_KeyList.back(), myNr);
+		myIndex.m_ByPublicId.insert(PublicId(myIndex.m_KeyList.back()->getPublicId()),
+				&myIndex.m_KeyList.back()->getHotKey());
+	}
+	vector<PublicId> myIds;
+	for (const string &myId : makeLookups(myCount)) {
+		myIds.push_back(PublicId(myId));
+	}
+	size_t myNext = 0;
+	int64_t myMissed = 0;
+	{
+		AllocCounter myAllocs(pState);
+		for (auto _ : pState) {
+			const YubikoOtpKeyConfig *myKey = myIndex.getKeyByPublicId(myIds[myNext++ & (myIds.size() - 1)]);
+			if (myKey == 0) {
+				++myMissed;
+			} else {
+				benchmark::DoNotOptimize(myKey->getToken().ctr);
+			}
+		}
+	}
+	myIndex = KeyManager::KeyIndex();
+	remove_all(mySettings.getConfigDir());
+	if (myMissed != 0) {
+		pState.SkipWithError("A synthetic key was not found.");
+	}
+}
+BENCHMARK(BM_KeyIndex_getKeyByPublicId)->Arg(1000)->Arg(100000)->Arg(1000000);
+
+/// @brief The string API over a loaded keystore, parses the ID and takes the snapshot.
+static void BM_KeyManager_getKeyByPublicId(benchmark::State &pState) {
+	KeyManager &myKeyMan = getKeyStore(size_t(pState.range(0)));
+	const vector<string> myIds { makeLookups(size_t(pState.range(0))) };
+	size_t myNext = 0;
+	AllocCounter myAllocs(pState);
+	for (auto _ : pState) {
+		benchmark::DoNotOptimize(myKeyMan.getKeyByPublicId(myIds[myNext++ & (myIds.size() - 1)]));
+	}
+}
+BENCHMARK(BM_KeyManager_getKeyByPublicId)->Arg(1000);
+
+static void BM_loadKeys(benchmark::State &pState) {
+	KeyManager &myKeyMan = getKeyStore(size_t(pState.range(0)));
+	AllocCounter myAllocs(pState);
+	for (auto _ : pState) {
+		benchmark::DoNotOptimize(myKeyMan.loadKeys());
+	}
+	pState.SetItemsProcessed(pState.iterations() * pState.range(0));
+}
+BENCHMARK(BM_loadKeys)->Arg(100)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+/// @brief loadKeys() of range(0) key files parsed by range(1) threads.
+static void BM_loadKeys_threads(benchmark::State &pState) {
+	KeyManager &myKeyMan = getKeyStore(size_t(pState.range(0)));
+	int &myThreads = theKeyStores[size_t(pState.range(0))]->m_Settings.getLoadThreads();
+	const int myDefault = myThreads;
+	myThreads = int(pState.range(1));
+	for (auto _ : pState) {
+		benchmark::DoNotOptimize(myKeyMan.loadKeys());
+	}
+	myThreads = myDefault;
+	pState.SetItemsProcessed(pState.iterations() * pState.range(0));
+}
+BENCHMARK(BM_loadKeys_threads)->ArgsProduct( { { 10000 }, { 1, 2, 4, 8 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/// @brief range(1) key files of range(0) loaded keys change, only they are read again.
+static void BM_reloadKeyFiles(benchmark::State &pState) {
+	KeyManager &myKeyMan = getKeyStore(size_t(pState.range(0)));
+	const size_t myChanges = size_t(pState.range(1));
+	const KeyManager::KeyIndexPtr_t myIndex = myKeyMan.getIndex();
+	size_t myRound = 0;
+	AllocCounter myAllocs(pState);
+	for (auto _ : pState) {
+		pState.PauseTiming();
+		std::set<path> myChanged;
+		for (size_t myI = 0; myI < myChanges; ++myI) {
+			YubikoOtpKeyConfig myKey { *myIndex->m_KeyList[myI * myIndex->m_KeyList.size() / myChanges] };
+			myKey.setDescription("Changed " + std::to_string(myRound));
+			myKey.save();
+			myChanged.insert(myKey.getFilename());
+		}
+		++myRound;
+		pState.ResumeTiming();
+		benchmark::DoNotOptimize(myKeyMan.reloadKeyFiles(myChanged));
+	}
+	pState.SetItemsProcessed(pState.iterations() * pState.range(1));
+}
+BENCHMARK(BM_reloadKeyFiles)->Args( { 1000, 1 })->Args( { 1000, 100 })->Args( { 10000, 1 })->Args( { 10000, 100 })->Unit(
+		benchmark::kMillisecond);
+
+/// @brief YubikoOtpKeyConfig::load() as it was done with read_json(), the baseline of BM_KeyFile_load.
+static void loadTree(YubikoOtpKeyConfig &pKey) {
+	char myJson[YubikoOtpKeyConfig::K_MAX_KEY_FILE_SIZE];
+	std::istringstream myIn(string(myJson, pKey.readFile(myJson)));
+	ptree myTree;
+	read_json(myIn, myTree);
+	const string myVer(myTree.get<string>("yubikey.version"));
+	pKey.setPrivateId(myTree.get<string>("yubikey.privateId"));
+	pKey.setPublicId(myTree.get<string>("yubikey.publicId"));
+	pKey.setSecretKey(myTree.get<string>("yubikey.secretKey"));
+	pKey.setTimestamp(::trihlav::UTimestamp(myTree.get<uint64_t>("yubikey.timestamp")));
+	pKey.setCounter(myTree.get<uint8_t>("yubikey.counter"));
+	pKey.setCrc(myTree.get<uint16_t>("yubikey.crc"));
+	pKey.setRandom(myTree.get<uint16_t>("yubikey.random"));
+	pKey.setUseCounter(myTree.get<uint8_t>("yubikey.use"));
+	pKey.setDescription(myTree.get<string>("yubikey.description"));
+	if (myVer != "0.0.1") {
+		const string mySysUser { myTree.get<string>("yubikey.sysUser") };
+		if (!mySysUser.empty())
+			pKey.setSysUser(mySysUser);
+	}
+}
+
+/// @brief The key file as saveFile() built it with write_json(), the baseline of BM_KeyFile_save.
+static string writeTree(const YubikoOtpKeyConfig &pKey) {
+	ptree myTree;
+	myTree.put("yubikey.privateId", pKey.getPrivateId());
+	myTree.put("yubikey.publicId", pKey.getPublicId());
+	myTree.put("yubikey.secretKey", pKey.getSecretKey());
+	myTree.put("yubikey.timestamp", pKey.getTimestamp().tstp_int);
+	myTree.put("yubikey.counter", pKey.getCounter());
+	myTree.put("yubikey.crc", pKey.getCrc());
+	myTree.put("yubikey.random", pKey.getRandom());
+	myTree.put("yubikey.use", pKey.getUseCounter());
+	myTree.put("yubikey.description", pKey.getDescription());
+	myTree.put("yubikey.sysUser", pKey.getSysUser());
+	myTree.put("yubikey.version", "0.0.2");
+	std::ostringstream myOut;
+	write_json(myOut, myTree);
+	return myOut.str();
+}
+
+/// @brief Reading one key file, range(0) 0 through property_tree, 1 through KeyFileJson.
+static void BM_KeyFile_load(benchmark::State &pState) {
+	KeyManager &myKeyMan = getKeyStore(1);
+	YubikoOtpKeyConfig myKey { *myKeyMan.getIndex()->m_KeyList[0] };
+	const bool myTree = pState.range(0) == 0;
+	pState.SetLabel(myTree ? "ptree" : "KeyFileJson");
+	AllocCounter myAllocs(pState);
+	for (auto _ : pState) {
+		if (myTree) {
+			loadTree(myKey);
+		} else {
+			myKey.load();
+		}
+	}
+	pState.SetBytesProcessed(pState.iterations() * int64_t(file_size(myKey.getFilename())));
+}
+BENCHMARK(BM_KeyFile_load)->Arg(0)->Arg(1);
+
+/// @brief Laying out one key file in memory, range(0) 0 through property_tree, 1 through KeyFileJson.
+static void BM_KeyFile_save(benchmark::State &pState) {
+	KeyManager &myKeyMan = getKeyStore(1);
+	const YubikoOtpKeyConfig &myKey = *myKeyMan.getIndex()->m_KeyList[0];
+	const bool myTree = pState.range(0) == 0;
+	pState.SetLabel(myTree ? "ptree" : "KeyFileJson");
+	char myJson[2 * YubikoOtpKeyConfig::K_MAX_KEY_FILE_SIZE];
+	size_t mySize = 0;
+	AllocCounter myAllocs(pState);
+	for (auto _ : pState) {
+		if (myTree) {
+			mySize = writeTree(myKey).size();
+		} else {
+			mySize = myKey.toJson(myJson, sizeof(myJson));
+		}
+		benchmark::DoNotOptimize(myJson);
+	}
+	pState.SetBytesProcessed(pState.iterations() * int64_t(mySize));
+}
+BENCHMARK(BM_KeyFile_save)->Arg(0)->Arg(1);
+
+/**
+ * pCount synthetic keys written in bulk into a key store in a directory of
+ * its own. They are built in memory, a million key files one by one would
+ * take ages.
+ */
+struct BenchKeyStore {
+	BenchKeyStore(Settings::EKeyStore pKeyStore, size_t pCount) :
+			m_Settings(unique_path("/tmp/trihlav-bench-%%%%-%%%%")), m_KeyMan() {
+		m_Settings.getDurability() = Settings::EAsync;
+		m_Settings.getKeyStore() = pKeyStore;
+		m_KeyMan.reset(new KeyManager(m_Settings));
+		vector<unique_ptr<YubikoOtpKeyConfig> > myKeys;
+		vector<const YubikoOtpKeyConfig *> myKeyPtrs;
+		for (size_t myNr = 0; myNr < pCount; ++myNr) {
+			myKeys.emplace_back(new YubikoOtpKeyConfig(*m_KeyMan));
+			::trihlav::setSyntheticKey(*myKeys.back(), myNr);
+			myKeyPtrs.push_back(myKeys.back().get());
+		}
+		m_KeyMan->getKeyStore().write(myKeyPtrs);
+	}
+
+	~BenchKeyStore() {
+		m_KeyMan.reset();
+		remove_all(m_Settings.getConfigDir());
+	}
+
+	Settings m_Settings;
+	unique_ptr<KeyManager> m_KeyMan;
+};
+
+static const Settings::EKeyStore K_BENCH_KEY_STORES[] = { Settings::EJsonDir, Settings::EMmapFile, Settings::ESqlite };
+
+/// @brief All key stores, up to 100k keys as key files and up to 1M keys otherwise.
+static void applyKeyStoreSizes(benchmark::internal::Benchmark *pBench) {
+	pBench->ArgNames( { "store", "keys" });
+	for (const Settings::EKeyStore myStore : K_BENCH_KEY_STORES) {
+		for (const int64_t myKeys : { 10000, 100000, 1000000 }) {
+			if (myStore != Settings::EJsonDir || myKeys <= 100000) {
+				pBench->Args( { myStore, myKeys });
+			}
+		}
+	}
+}
+
+/// @brief Startup of each key store, @see Settings::getKeyStore().
+static void BM_KeyStore_load(benchmark::State &pState) {
+	const Settings::EKeyStore myStore = Settings::EKeyStore(pState.range(0));
+	const size_t myCount = size_t(pState.range(1));
+	pState.SetLabel(Settings::getKeyStoreStr(myStore));
+	BenchKeyStore myKeys(myStore, myCount);
+	{
+		AllocCounter myAllocs(pState);
+		for (auto _ : pState) {
+			benchmark::DoNotOptimize(myKeys.m_KeyMan->loadKeys());
+		}
+	}
+	pState.SetItemsProcessed(pState.iterations() * pState.range(1));
+	if (myKeys.m_KeyMan->getKeyCount() != myCount) {
+		pState.SkipWithError("Not all synthetic keys were loaded.");
+	}
+}
+BENCHMARK(BM_KeyStore_load)->Apply(applyKeyStoreSizes)->Unit(benchmark::kMillisecond);
+
+/**
+ * Startup with Settings::getLazyKeys(), compare with BM_KeyStore_load: the
+ * public IDs are indexed and a working set of 1000 keys is looked up.
+ */
+static void BM_KeyStore_lazyLoad(benchmark::State &pState) {
+	constexpr size_t K_WORKING_SET = 1000;
+	const Settings::EKeyStore myStore = Settings::EKeyStore(pState.range(0));
+	const size_t myCount = size_t(pState.range(1));
+	pState.SetLabel(Settings::getKeyStoreStr(myStore));
+	BenchKeyStore myKeys(myStore, myCount);
+	myKeys.m_Settings.getLazyKeys() = true;
+	vector<PublicId> myWorkingSet;
+	for (size_t myNr = 0; myNr < K_WORKING_SET; ++myNr) {
+		myWorkingSet.emplace_back(::trihlav::getSyntheticPublicId(myNr * 7919 % myCount));
+	}
+	size_t myFound = 0;
+	{
+		AllocCounter myAllocs(pState);
+		for (auto _ : pState) {
+			myKeys.m_KeyMan->loadKeys();
+			const KeyManager::KeyIndexPtr_t myIndex = myKeys.m_KeyMan->getIndex();
+			myFound = 0;
+			for (const PublicId &myId : myWorkingSet) {
+				myFound += myIndex->getKeyByPublicId(myId) != 0;
+			}
+		}
+	}
+	pState.SetItemsProcessed(pState.iterations() * pState.range(1));
+	if (myKeys.m_KeyMan->getKeyCount() != myCount || myFound != K_WORKING_SET) {
+		pState.SkipWithError("Not all synthetic keys were found.");
+	}
+}
+BENCHMARK(BM_KeyStore_lazyLoad)->Apply(applyKeyStoreSizes)->Unit(benchmark::kMillisecond);
+
+/**
+ * Restart of the JSON key directory with and without the key snapshot of
+ * the previous run, @see KeySnapshot. The key files are left to age, so
+ * the snapshot trusts them. Without it all files are parsed and the
+ * snapshot is written again.
+ */
+static void BM_KeyStore_warmLoad(benchmark::State &pState) {
+	const size_t myCount = size_t(pState.range(0));
+	const bool mySnapshot = pState.range(1) != 0;
+	BenchKeyStore myKeys(Settings::EJsonDir, myCount);
+	std::this_thread::sleep_for(std::chrono::nanoseconds(KeySnapshot::K_RACY_NS + 100000000));
+	myKeys.m_KeyMan->loadKeys();
+	const path mySnapshotFile = myKeys.m_KeyMan->getKeySnapshotFilename();
+	{
+		AllocCounter myAllocs(pState);
+		for (auto _ : pState) {
+			if (!mySnapshot) {
+				pState.PauseTiming();
+				remove(mySnapshotFile);
+				pState.ResumeTiming();
+			}
+			benchmark::DoNotOptimize(myKeys.m_KeyMan->loadKeys());
+		}
+	}
+	pState.SetItemsProcessed(pState.iterations() * pState.range(0));
+	if (myKeys.m_KeyMan->getKeyCount() != myCount) {
+		pState.SkipWithError("Not all synthetic keys were loaded.");
+	}
+}
+BENCHMARK(BM_KeyStore_warmLoad)->ArgNames( { "keys", "snapshot" })->ArgsProduct( { { 10000, 100000 }, { 0, 1 } })->Unit(
+		benchmark::kMillisecond);
+
+/**
+ * Compaction of the counter journal: the counters of a batch of keys are
+ * written and made durable by one sync.
+ */
+static void BM_KeyStore_saveCounters(benchmark::State &pState) {
+	constexpr size_t K_KEYS = 10000;
+	const Settings::EKeyStore myStore = Settings::EKeyStore(pState.range(0));
+	const size_t myBatch = size_t(pState.range(1));
+	pState.SetLabel(Settings::getKeyStoreStr(myStore));
+	BenchKeyStore myKeys(myStore, K_KEYS);
+	KeyManager &myKeyMan = *myKeys.m_KeyMan;
+	myKeyMan.loadKeys();
+	vector<YubikoOtpKeyConfig *> myDirty;
+	for (size_t myNr = 0; myNr < myBatch; ++myNr) {
+		myDirty.push_back(myKeyMan.getKeyByPublicId(::trihlav::getSyntheticPublicId(myNr * 7919 % K_KEYS)));
+	}
+	{
+		AllocCounter myAllocs(pState);
+		for (auto _ : pState) {
+			for (YubikoOtpKeyConfig *myKey : myDirty) {
+				yubikey_token_st myToken = myKey->getToken();
+				++myToken.ctr;
+				myKey->advanceCounters(myToken);
+				myKeyMan.getKeyStore().saveCounters(*myKey);
+			}
+			myKeyMan.getKeyStore().sync();
+		}
+	}
+	pState.SetItemsProcessed(pState.iterations() * pState.range(1));
+}
+BENCHMARK(BM_KeyStore_saveCounters)->ArgNames( { "store", "batch" })->Args( { Settings::EJsonDir, 1 })->Args(
+		{ Settings::EJsonDir, 1000 })->Args( { Settings::EMmapFile, 1 })->Args( { Settings::EMmapFile, 1000 })->Args(
+		{ Settings::ESqlite, 1 })->Args( { Settings::ESqlite, 1000 })->Unit(benchmark::kMicrosecond);
+
+/// @brief Bytes of the heap in use, malloc() bookkeeping and blocks malloc() mapped included.
+static size_t getHeapInUse() {
+	const struct mallinfo2 myInfo = mallinfo2();
+	return myInfo.uordblks + myInfo.hblkhd;
+}
+
+/**
+ * Validation of OTPs of keys picked at random from a keystore of
+ * pState.range(0) keys, all of them accepted. At 1M keys the look up and
+ * the key state miss the caches. The heap taken by the loaded keys is
+ * reported as bytes/key, the mapped keystore itself is not on the heap.
+ */
+static void BM_OtpValidator_validate(benchmark::State &pState) {
+	constexpr size_t K_OTPS = 200000;
+	const size_t myCount = size_t(pState.range(0));
+	BenchKeyStore myKeys(Settings::EMmapFile, myCount);
+	myKeys.m_Settings.getKeyRatePerMin() = 0;
+	KeyManager &myKeyMan = *myKeys.m_KeyMan;
+	// The hot key table keeps its slabs, the records of the keys written to
+	// the keystore are reused, so they are counted one by one.
+	const size_t myHeap = getHeapInUse() - ::trihlav::getHotKeys().getMemory();
+	const size_t myHotKeys = ::trihlav::getHotKeys().getSize();
+	myKeyMan.loadKeys();
+	const size_t myHotBytes = (::trihlav::getHotKeys().getSize() - myHotKeys)
+			* (sizeof(::trihlav::HotKey) + sizeof(::trihlav::OtpCipher));
+	pState.counters["bytes/key"] = double(getHeapInUse() - ::trihlav::getHotKeys().getMemory() - myHeap + myHotBytes)
+			/ double(myCount);
+	vector<yubikey_token_st> myTokens(myCount);
+	for (size_t myNr = 0; myNr < myCount; ++myNr) {
+		myTokens[myNr] = myKeyMan.getKeyByPublicId(::trihlav::getSyntheticPublicId(myNr))->getToken();
+	}
+	vector<string> myOtps;
+	uint64_t myRnd = 88172645463325252ULL;
+	YubikoOtpKeyConfig myKey(myKeyMan);
+	for (size_t myI = 0; myI < K_OTPS; ++myI) {
+		myRnd ^= myRnd << 13;
+		myRnd ^= myRnd >> 7;
+		myRnd ^= myRnd << 17;
+		const size_t myNr = myRnd % myCount;
+		::trihlav::setSyntheticKey(myKey, myNr);
+		myOtps.push_back(myKey.getPublicId() + YubikoOtpKeyConfig::generateOtp(myTokens[myNr],
+				myKey.getSecretKeyArray()));
+	}
+	OtpValidator myValidator(myKeyMan);
+	size_t myNext = 0;
+	int64_t myRejected = 0;
+	{
+		AllocCounter myAllocs(pState);
+		for (auto _ : pState) {
+			myRejected += myValidator.validate(myOtps[myNext++], "", "") == OtpValidator::EOk ? 0 : 1;
+		}
+	}
+	pState.SetItemsProcessed(pState.iterations());
+	if (myRejected != 0) {
+		pState.SkipWithError("A valid OTP was rejected.");
+	}
+}
+BENCHMARK(BM_OtpValidator_validate)->ArgName("keys")->Arg(1000)->Arg(1000000)->Iterations(200000)->Unit(
+		benchmark::kMicrosecond);
+
+using BenchTupLst = TupleList<int, string, string, string, int, int>;
+
+static void BM_TupleList_get(benchmark::State &pState) {
+	BenchTupLst myList;
+	for (int myI = 0; myI < 1000; ++myI) {
+		myList.addRow(BenchTupLst::Row_t(myI, "ccddccddccdd", "Description of a key", "user", myI, 2 * myI));
+	}
+	size_t myRow = 0;
+	size_t myCol = 0;
+	AllocCounter myAllocs(pState);
+	for (auto _ : pState) {
+		benchmark::DoNotOptimize(myList.get(myRow, myCol));
+		if (++myCol == BenchTupLst::K_COL_CNT) {
+			myCol = 0;
+			myRow = (myRow + 1) % 1000;
+		}
+	}
+}
+BENCHMARK(BM_TupleList_get);
+
+int main(int argc, char **argv) {
+	::trihlav::initLog();
+	::trihlav::setLogLevel(boost::log::trivial::warning);
+	vector<char*> myArgs(argv, argv + argc);
+	string myOut { "--benchmark_out=trihlavBench.json" };
+	string myFormat { "--benchmark_out_format=json" };
+	bool myHasOut = false;
+	for (int myI = 1; myI < argc; ++myI) {
+		myHasOut = myHasOut || string(argv[myI]).compare(0, 16, "--benchmark_out=") == 0;
+	}
+	if (!myHasOut) {
+		myArgs.push_back(&myOut[0]);
+		myArgs.push_back(&myFormat[0]);
+	}
+	int myArgc = int(myArgs.size());
+	benchmark::Initialize(&myArgc, myArgs.data());
+	if (benchmark::ReportUnrecognizedArguments(myArgc, myArgs.data())) {
+		return 1;
+	}
+	benchmark::AddCustomContext("trihlav_version", ::trihlav::Version::getVersion());
+	benchmark::AddCustomContext("trihlav_log_min_level", std::to_string(TRIHLAV_LOG_MIN_LEVEL));
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	theKeyStores.clear();
+	return 0;
+}
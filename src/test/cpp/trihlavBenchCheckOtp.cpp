@@ -0,0 +1,119 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Cost of YubikoOtpKeyConfig::checkOtp with debug records enabled and
+ * filtered at runtime. Build with -DTRIHLAV_LOG_MIN_LEVEL=2 to compare with
+ * debug records compiled out.
+ *
+ * Usage: trihlavBenchCheckOtp [passwords] 2>/dev/null
+ *
+ * The counter journal runs in async mode, so no flush is measured.
+ */
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <yubikey.h>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+
+#include "trihlavTestCommonUtils.hpp"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::endl;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+using boost::format;
+using boost::log::trivial::severity_level;
+using ::trihlav::Settings;
+using ::trihlav::KeyManager;
+using ::trihlav::YubikoOtpKeyConfig;
+using ::boost::filesystem::path;
+using ::boost::filesystem::unique_path;
+
+/// @return pCount passwords following the stored counters of pKey, without public ID.
+static vector<string> makeOtps(const YubikoOtpKeyConfig &pKey, const int pCount) {
+	vector<string> myRetVal;
+	yubikey_token_st myTkn { pKey.getToken() };
+	for (int myI = 0; myI < pCount; ++myI) {
+		++myTkn.ctr;
+		myTkn.use = 0;
+		myTkn.crc = YubikoOtpKeyConfig::computeCrc(myTkn);
+		string myOtp(YUBIKEY_OTP_SIZE + 1, '.');
+		yubikey_token_st myEncrypted { myTkn }; // yubikey_generate() encrypts in place
+		yubikey_generate(&myEncrypted, pKey.getSecretKeyArray().data(), &myOtp[0]);
+		myOtp.resize(YUBIKEY_OTP_SIZE);
+		myRetVal.push_back(myOtp);
+	}
+	return myRetVal;
+}
+
+static void runLevel(KeyManager &pKeyMan, const severity_level pLevel, const int pCount) {
+	::trihlav::setLogLevel(pLevel);
+	YubikoOtpKeyConfig *myKey = pKeyMan.getKeyByPublicId(::trihlav::K_TST_PUBL0);
+	const vector<string> myOtps { makeOtps(*myKey, pCount) };
+	int myOk = 0;
+	const auto myStart = steady_clock::now();
+	for (const string &myOtp : myOtps) {
+		myOk += myKey->checkOtp(myOtp) ? 1 : 0;
+	}
+	const double myNs = double(duration_cast<nanoseconds>(steady_clock::now() - myStart).count());
+	cout << format("runtime level %-8s %8.0f ns/checkOtp  %d of %d accepted") % pLevel % (myNs / pCount) % myOk
+			% pCount << endl;
+}
+
+int main(int argc, char **argv) {
+	::trihlav::initLog();
+	const int myCount = argc > 1 ? std::stoi(argv[1]) : 10000;
+	if (myCount < 1 || myCount > 30000) {
+		std::cerr << "Usage: " << argv[0] << " [passwords, at most 30000]" << endl;
+		return 1;
+	}
+	Settings mySettings(unique_path("/tmp/trihlav-bench-%%%%-%%%%"));
+	mySettings.getDurability() = Settings::EAsync;
+	KeyManager myKeyMan(mySettings);
+	::trihlav::createYubikoOtpKeyConfig(myKeyMan);
+	myKeyMan.loadKeys();
+	cout << format("compiled in from log level %d") % TRIHLAV_LOG_MIN_LEVEL << endl;
+	for (severity_level myLevel : { boost::log::trivial::debug, boost::log::trivial::warning }) {
+		runLevel(myKeyMan, myLevel, myCount);
+	}
+	remove_all(mySettings.getConfigDir());
+	return 0;
+}
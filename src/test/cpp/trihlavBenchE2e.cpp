@@ -0,0 +1,258 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Full login latency: the PAM client path trihlav::checkOtps() against a
+ * trihlavsrv on localhost, which validates against a generated temporary
+ * keystore. Every login is timed over HTTP and over HTTPS (throwaway
+ * self signed certificate) and broken down into
+ *  setup     - SSL context and io_service, built anew by every checkOtps()
+ *  resolve, connect, handshake (HTTPS only),
+ *  request   - request written until the answer is read,
+ *  validate  - the servers validation, taken from its "Server-Timing" header.
+ *
+ * Usage: trihlavBenchE2e [logins] [trihlavsrv] [keys] [http port]
+ *
+ * The HTTPS port is the HTTP port + 1. Rate limits are switched off in the
+ * temporary keystore, the server log lands in its directory.
+ */
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <yubikey.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <boost/asio.hpp>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavConstants.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavCreateX509.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+#include "pam/trihlavPam.hpp"
+
+#include "trihlavTestCommonUtils.hpp"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using boost::format;
+using ::trihlav::Settings;
+using ::trihlav::KeyManager;
+using ::trihlav::LoginTimings;
+using ::trihlav::YubikoOtpKeyConfig;
+using ::boost::filesystem::path;
+using ::boost::filesystem::unique_path;
+using ::boost::filesystem::create_directories;
+
+/// @brief Client side copy of a synthetic key, advanced with every login.
+struct BenchKey {
+	string m_PublicId;
+	yubikey_token_st m_Token;
+	YubikoOtpKeyConfig::SecretKeyArr m_Secret;
+};
+
+/// @brief Samples of one phase in microseconds.
+using Samples = vector<double>;
+
+static double toUs(const LoginTimings::Duration &pDur) {
+	return duration<double, std::micro>(pDur).count();
+}
+
+static bool createCertificate(const path &pKeyFile, const path &pCertFile) {
+	EVP_PKEY *myKey = ::trihlav::generate_key();
+	if (myKey == 0) {
+		return false;
+	}
+	X509 *myCert = ::trihlav::generate_x509(myKey);
+	const bool myRetVal = myCert != 0 && ::trihlav::write_to_disk(myKey, myCert, pKeyFile.native(),
+			pCertFile.native());
+	X509_free(myCert);
+	EVP_PKEY_free(myKey);
+	return myRetVal;
+}
+
+/// @brief fork and exec the server, its output goes to pLog.
+static pid_t startServer(const string &pSrv, const path &pDir, const path &pKeyDir, const int pPort,
+		const path &pLog) {
+	const path myDocRoot { pDir / "docroot" };
+	create_directories(myDocRoot);
+	const vector<string> myArgs { pSrv, "--docroot", myDocRoot.native(), "--approot", pDir.native(), //
+			"--http-address", "127.0.0.1", "--http-port", std::to_string(pPort), //
+			"--https-address", "127.0.0.1", "--https-port", std::to_string(pPort + 1), //
+			"--ssl-certificate", (pDir / "cert.pem").native(), //
+			"--ssl-private-key", (pDir / "key.pem").native() };
+	const pid_t myPid = fork();
+	if (myPid == 0) {
+		setenv(::trihlav::K_CONFIG_DIR_ENV.c_str(), pKeyDir.c_str(), 1);
+		const int myLog = open(pLog.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		dup2(myLog, STDOUT_FILENO);
+		dup2(myLog, STDERR_FILENO);
+		vector<char *> myArgv;
+		for (const string &myArg : myArgs) {
+			myArgv.push_back(const_cast<char *>(myArg.c_str()));
+		}
+		myArgv.push_back(0);
+		execvp(myArgv[0], myArgv.data());
+		_exit(127);
+	}
+	return myPid;
+}
+
+/// @brief Wait until the server accepts connections on pPort, false when it died or took too long.
+static bool waitForServer(const pid_t pPid, const int pPort) {
+	boost::asio::io_service myIoSvc;
+	const boost::asio::ip::tcp::endpoint myEp(boost::asio::ip::address_v4::loopback(), pPort);
+	for (int myTry = 0; myTry < 300; ++myTry) {
+		int myStatus;
+		if (waitpid(pPid, &myStatus, WNOHANG) == pPid) {
+			return false;
+		}
+		boost::asio::ip::tcp::socket mySocket(myIoSvc);
+		boost::system::error_code myErr;
+		mySocket.connect(myEp, myErr);
+		if (!myErr) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+	return false;
+}
+
+static void printPhase(const string &pName, Samples &pSamples) {
+	if (pSamples.empty()) {
+		return;
+	}
+	std::sort(pSamples.begin(), pSamples.end());
+	double mySum = 0;
+	for (const double mySample : pSamples) {
+		mySum += mySample;
+	}
+	const size_t myN = pSamples.size();
+	cout << format("  %-10s mean %9.1f  p50 %9.1f  p99 %9.1f  max %9.1f us") % pName % (mySum / myN)
+			% pSamples[myN / 2] % pSamples[std::min(myN - 1, myN * 99 / 100)] % pSamples[myN - 1] << endl;
+}
+
+static bool runLogins(const string &pUrl, vector<BenchKey> &pKeys, const int pLogins) {
+	Samples mySetup, myResolve, myConnect, myHandshake, myRequest, myValidate, myTotal;
+	int myOk = 0, myRetried = 0;
+	for (int myI = 0; myI < pLogins; ++myI) {
+		BenchKey &myKey = pKeys[myI % pKeys.size()];
+		const string myOtp { myKey.m_PublicId + YubikoOtpKeyConfig::generateOtp(myKey.m_Token, myKey.m_Secret) };
+		LoginTimings myTimings;
+		const steady_clock::time_point myStart = steady_clock::now();
+		const ::trihlav::AuthResult myRes = ::trihlav::checkOtps(pUrl, "", { myOtp }, &myTimings);
+		myTotal.push_back(toUs(steady_clock::now() - myStart));
+		myOk += std::get<0>(myRes) ? 1 : 0;
+		myRetried += myTimings.m_Attempts > 1 ? 1 : 0;
+		mySetup.push_back(toUs(myTimings.m_Setup));
+		myResolve.push_back(toUs(myTimings.m_Resolve));
+		myConnect.push_back(toUs(myTimings.m_Connect));
+		myHandshake.push_back(toUs(myTimings.m_Handshake));
+		myRequest.push_back(toUs(myTimings.m_Request));
+		if (myTimings.m_ValidateMs >= 0) {
+			myValidate.push_back(myTimings.m_ValidateMs * 1000.0);
+		}
+	}
+	cout << format("%s: %d logins, %d accepted, %d retried") % pUrl % pLogins % myOk % myRetried << endl;
+	printPhase("setup", mySetup);
+	printPhase("resolve", myResolve);
+	printPhase("connect", myConnect);
+	printPhase("handshake", myHandshake);
+	printPhase("request", myRequest);
+	printPhase("validate", myValidate);
+	printPhase("total", myTotal);
+	return myOk == pLogins;
+}
+
+int main(int argc, char **argv) {
+	::trihlav::initLog();
+	::trihlav::setLogLevel(boost::log::trivial::warning);
+	const int myLogins = argc > 1 ? std::stoi(argv[1]) : 200;
+	const string mySrv { argc > 2 ? argv[2] : "trihlavsrv" };
+	const int myKeyCnt = argc > 3 ? std::stoi(argv[3]) : 100;
+	const int myPort = argc > 4 ? std::stoi(argv[4]) : 18080;
+	if (myLogins < 1 || myKeyCnt < 1 || myPort < 1 || myPort > 65534) {
+		cerr << "Usage: " << argv[0] << " [logins] [trihlavsrv] [keys] [http port]" << endl;
+		return 1;
+	}
+	const path myDir { unique_path("/tmp/trihlav-e2e-%%%%-%%%%") };
+	const path myKeyDir { myDir / "keys" };
+	create_directories(myKeyDir);
+	vector<BenchKey> myKeys;
+	{
+		Settings mySettings(myKeyDir);
+		mySettings.getKeyRatePerMin() = 0;
+		mySettings.getClientRatePerMin() = 0;
+		mySettings.save();
+		KeyManager myKeyMan(mySettings);
+		::trihlav::createSyntheticKeys(myKeyMan, myKeyCnt);
+		for (int myNr = 0; myNr < myKeyCnt; ++myNr) {
+			YubikoOtpKeyConfig myCfg(myKeyMan);
+			::trihlav::setSyntheticKey(myCfg, myNr);
+			myKeys.push_back(BenchKey { myCfg.getPublicId(), myCfg.getToken(), myCfg.getSecretKeyArray() });
+		}
+	}
+	const path myCert { myDir / "cert.pem" };
+	if (!createCertificate(myDir / "key.pem", myCert)) {
+		cerr << "Failed to create the certificate." << endl;
+		return 1;
+	}
+	// the client trusts the throwaway certificate through the default verify paths
+	setenv("SSL_CERT_FILE", myCert.c_str(), 1);
+	const path myLog { myDir / "trihlavsrv.log" };
+	const pid_t myPid = startServer(mySrv, myDir, myKeyDir, myPort, myLog);
+	bool myOk = waitForServer(myPid, myPort) && waitForServer(myPid, myPort + 1);
+	if (myOk) {
+		cout << format("%d keys, server %s, keystore %s") % myKeyCnt % mySrv % myKeyDir << endl;
+		myOk = runLogins("http://localhost:" + std::to_string(myPort), myKeys, myLogins);
+		myOk = runLogins("https://localhost:" + std::to_string(myPort + 1), myKeys, myLogins) && myOk;
+	} else {
+		cerr << "Server " << mySrv << " did not come up, see " << myLog << "." << endl;
+	}
+	kill(myPid, SIGTERM);
+	waitpid(myPid, 0, 0);
+	if (myOk) {
+		remove_all(myDir);
+	}
+	return myOk ? 0 : 1;
+}
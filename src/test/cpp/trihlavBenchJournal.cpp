@@ -0,0 +1,125 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Throughput and latency of the counter journal durability modes.
+ *
+ * Usage: trihlavBenchJournal [threads [commits per thread [delay us [directory]]]]
+ *
+ * Every thread appends a record and waits until it is durable, the same as
+ * an authentication request does, and measures how long that took.
+ */
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <yubikey.h>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavCounterJournal.hpp"
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::endl;
+using std::chrono::microseconds;
+using std::chrono::duration_cast;
+using std::chrono::steady_clock;
+using boost::format;
+using ::trihlav::Settings;
+using ::trihlav::CounterJournal;
+using ::boost::filesystem::path;
+using ::boost::filesystem::unique_path;
+
+static void runMode(const path &pDir, const Settings::EDurability pMode, const int pThreads, const int pCommits,
+		const microseconds pDelay) {
+	const path myFile { pDir / ("bench-" + Settings::getDurabilityStr(pMode)) };
+	vector<vector<double> > myLatencies(pThreads);
+	CounterJournal myJournal(myFile, pMode, pDelay);
+	const auto myStart = steady_clock::now();
+	vector<std::thread> myThreads;
+	for (int myT = 0; myT < pThreads; ++myT) {
+		myThreads.emplace_back([&myJournal, &myLatencies, pCommits, myT]() {
+			yubikey_token_st myToken;
+			memset(&myToken, 0, sizeof(myToken));
+			myToken.ctr = uint16_t(myT);
+			const string myPubId { str(format("bench%06d") % myT) };
+			myLatencies[myT].reserve(pCommits);
+			for (int myC = 0; myC < pCommits; ++myC) {
+				const auto myBegin = steady_clock::now();
+				++myToken.use;
+				myJournal.waitDurable(myJournal.append(myPubId, myToken));
+				myLatencies[myT].push_back(
+						duration_cast<std::chrono::nanoseconds>(steady_clock::now() - myBegin).count() / 1000.0);
+			}
+		});
+	}
+	for (auto &myThread : myThreads) {
+		myThread.join();
+	}
+	const double mySecs = duration_cast<std::chrono::nanoseconds>(steady_clock::now() - myStart).count() / 1e9;
+	vector<double> myAll;
+	for (const auto &myLat : myLatencies) {
+		myAll.insert(myAll.end(), myLat.begin(), myLat.end());
+	}
+	std::sort(myAll.begin(), myAll.end());
+	const size_t myCnt = myAll.size();
+	cout << format("%-13s %10.0f commits/s %8d flushes  p50 %8.1f us  p99 %8.1f us  max %8.1f us") //
+			% Settings::getDurabilityStr(pMode) % (myCnt / mySecs) % myJournal.getSyncCount() //
+			% myAll[myCnt / 2] % myAll[std::min(myCnt - 1, myCnt * 99 / 100)] % myAll.back() << endl;
+}
+
+int main(int argc, char **argv) {
+	boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::warning);
+	const int myThreads = argc > 1 ? std::stoi(argv[1]) : 16;
+	const int myCommits = argc > 2 ? std::stoi(argv[2]) : 500;
+	const microseconds myDelay(argc > 3 ? std::stoi(argv[3]) : 500);
+	const path myDir { argc > 4 ? path(argv[4]) / unique_path("trihlav-bench-%%%%-%%%%") : unique_path(
+			"/tmp/trihlav-bench-%%%%-%%%%") };
+	if (myThreads < 1 || myCommits < 1) {
+		std::cerr << "Usage: " << argv[0] << " [threads [commits per thread [delay us [directory]]]]" << endl;
+		return 1;
+	}
+	create_directories(myDir);
+	cout << format("%d threads x %d commits, group commit delay %d us, in %s") % myThreads % myCommits
+			% myDelay.count() % myDir << endl;
+	for (Settings::EDurability myMode : { Settings::EPerCommit, Settings::EGroupCommit, Settings::EAsync }) {
+		runMode(myDir, myMode, myThreads, myCommits, myDelay);
+	}
+	remove_all(myDir);
+	return 0;
+}
@@ -23,6 +23,7 @@
 #include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
 #include "trihlavLib/trihlavLog.hpp"
 #include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavConstants.hpp"
 
 using namespace std;
 using namespace trihlav;
@@ -160,6 +161,16 @@ TEST( trihlavApi, testLoadAndSaveKeyCfg) {
 	BOOST_LOG_TRIVIAL(debug)<< "test file removed, testLoadAndSaveKeyCfg OK";
 }
 
+TEST( trihlavApi, testConfigDirFromEnv) {
+	path myTestCfgDir(unique_path("/tmp/trihlav-%%%%-%%%%"));
+	setenv(K_CONFIG_DIR_ENV.c_str(), myTestCfgDir.c_str(), 1);
+	Settings mySettings;
+	unsetenv(K_CONFIG_DIR_ENV.c_str());
+	EXPECT_EQ(myTestCfgDir, mySettings.getConfigDir());
+	EXPECT_TRUE(is_directory(myTestCfgDir));
+	remove_all(myTestCfgDir);
+}
+
 int main(int argc, char **argv) {
 	initLog();
 	::testing::InitGoogleTest(&argc, argv);
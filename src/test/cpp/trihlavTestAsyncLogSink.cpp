@@ -0,0 +1,202 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <sstream>
+#include <condition_variable>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/attributes.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/sinks/unlocked_frontend.hpp>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"  // Brings in Google Mock.
+
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavAsyncLogSink.hpp"
+
+using std::string;
+using std::atomic;
+using std::shared_ptr;
+using std::stringbuf;
+using std::chrono::milliseconds;
+using ::trihlav::Settings;
+using ::trihlav::AsyncLogSink;
+using ::trihlav::LogSiteLimit;
+
+using AsyncFrontend_t = boost::log::sinks::unlocked_sink<AsyncLogSink>;
+
+/**
+ * Stream buffer whose writes wait while it is closed, stands for a slow
+ * terminal.
+ */
+class GateBuf : public stringbuf {
+public:
+	void setOpen(const bool pOpen) {
+		{
+			std::lock_guard<std::mutex> myLock(m_Mutex);
+			m_Open = pOpen;
+		}
+		m_Cv.notify_all();
+	}
+
+	/// @brief Only while the writer is idle.
+	size_t getLineCount() const {
+		const string myStr = str();
+		return size_t(std::count(myStr.begin(), myStr.end(), '\n'));
+	}
+
+protected:
+	std::streamsize xsputn(const char *pStr, std::streamsize pCount) override {
+		waitOpen();
+		return stringbuf::xsputn(pStr, pCount);
+	}
+
+	int_type overflow(int_type pChar) override {
+		waitOpen();
+		return stringbuf::overflow(pChar);
+	}
+
+private:
+	void waitOpen() {
+		std::unique_lock<std::mutex> myLock(m_Mutex);
+		m_Cv.wait(myLock, [this] { return m_Open; });
+	}
+
+	std::mutex m_Mutex;
+	std::condition_variable m_Cv;
+	bool m_Open = true;
+};
+
+class TestAsyncLogSink: public ::testing::Test {
+public:
+	void start(const size_t pCapacity, const Settings::ELogOverflow pOverflow) {
+		m_Backend = boost::make_shared<AsyncLogSink>(std::make_shared<std::ostream>(&m_Buf),
+				boost::log::expressions::stream << boost::log::expressions::smessage, pCapacity, pOverflow);
+		m_Frontend = boost::make_shared<AsyncFrontend_t>(m_Backend);
+		boost::log::core::get()->add_sink(m_Frontend);
+	}
+
+	virtual void TearDown() {
+		m_Buf.setOpen(true);
+		if (m_Frontend) {
+			boost::log::core::get()->remove_sink(m_Frontend);
+		}
+		m_Frontend.reset();
+		m_Backend.reset();
+	}
+
+protected:
+	GateBuf m_Buf;
+	boost::shared_ptr<AsyncLogSink> m_Backend;
+	boost::shared_ptr<AsyncFrontend_t> m_Frontend;
+};
+
+TEST_F(TestAsyncLogSink,writesInOrder) {
+	start(64, Settings::ELogBlock);
+	EXPECT_EQ(64U, m_Backend->getCapacity());
+	for (int myI = 0; myI < 1000; ++myI) {
+		BOOST_LOG_TRIVIAL(info) << "record " << myI;
+	}
+	m_Backend->flush();
+	EXPECT_EQ(1000U, m_Backend->getWrittenCount());
+	EXPECT_EQ(0U, m_Backend->getDroppedCount());
+	std::istringstream myIn(m_Buf.str());
+	string myLine;
+	for (int myI = 0; myI < 1000; ++myI) {
+		ASSERT_TRUE(std::getline(myIn, myLine));
+		EXPECT_EQ("record " + std::to_string(myI), myLine);
+	}
+}
+
+TEST_F(TestAsyncLogSink,dropsWhenFull) {
+	start(16, Settings::ELogDrop);
+	m_Buf.setOpen(false);
+	for (int myI = 0; myI < 100; ++myI) {
+		BOOST_LOG_TRIVIAL(info) << "record " << myI;
+	}
+	// The ring and the record the writer waits with.
+	EXPECT_LE(100U - 17U, m_Backend->getDroppedCount());
+	m_Buf.setOpen(true);
+	m_Backend->flush();
+	EXPECT_EQ(100U, m_Backend->getWrittenCount() + m_Backend->getDroppedCount());
+	EXPECT_NE(string::npos, m_Buf.str().find("log records dropped"));
+}
+
+TEST_F(TestAsyncLogSink,blocksWhenFull) {
+	start(16, Settings::ELogBlock);
+	m_Buf.setOpen(false);
+	atomic<bool> myDone(false);
+	std::thread myLogger([&myDone]() {
+		for (int myI = 0; myI < 100; ++myI) {
+			BOOST_LOG_TRIVIAL(info) << "record " << myI;
+		}
+		myDone = true;
+	});
+	std::this_thread::sleep_for(milliseconds(50));
+	EXPECT_FALSE(myDone);
+	m_Buf.setOpen(true);
+	myLogger.join();
+	m_Backend->flush();
+	EXPECT_EQ(100U, m_Backend->getWrittenCount());
+	EXPECT_EQ(0U, m_Backend->getDroppedCount());
+	EXPECT_EQ(100U, m_Buf.getLineCount());
+}
+
+TEST_F(TestAsyncLogSink,siteLimit) {
+	LogSiteLimit myLimit(3);
+	for (int myI = 0; myI < 3; ++myI) {
+		EXPECT_EQ(0, myLimit.admit(0));
+	}
+	for (int myI = 0; myI < 5; ++myI) {
+		EXPECT_EQ(-1, myLimit.admit(10));
+	}
+	EXPECT_EQ(5, myLimit.admit(LogSiteLimit::K_WINDOW_MS));
+	EXPECT_EQ(0, myLimit.admit(LogSiteLimit::K_WINDOW_MS));
+
+	start(64, Settings::ELogBlock);
+	int myEvaluated = 0;
+	for (int myI = 0; myI < 100; ++myI) {
+		TRIHLAV_LOG_LIMITED(warning, 10) << "same warning " << ++myEvaluated;
+	}
+	m_Backend->flush();
+	EXPECT_EQ(10, myEvaluated);
+	EXPECT_EQ(10U, m_Buf.getLineCount());
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
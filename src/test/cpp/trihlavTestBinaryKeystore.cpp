@@ -0,0 +1,220 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <yubikey.h>
+#include <boost/log/trivial.hpp>
+#include <boost/filesystem.hpp>
+
+#include "gtest/gtest.h"
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavKeyStore.hpp"
+#include "trihlavLib/trihlavBinaryKeystore.hpp"
+#include "trihlavLib/trihlavCounterJournal.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+#include "trihlavLib/trihlavOtpValidator.hpp"
+
+#include "trihlavTestCommonUtils.hpp"
+
+using std::string;
+using std::vector;
+using ::trihlav::initLog;
+using ::trihlav::Settings;
+using ::trihlav::KeyManager;
+using ::trihlav::BinaryKeystore;
+using ::trihlav::YubikoOtpKeyConfig;
+using ::trihlav::OtpValidator;
+using ::trihlav::K_TST_PUBL0;
+using ::boost::filesystem::path;
+using ::boost::filesystem::unique_path;
+
+class TestBinaryKeystore: public ::testing::Test {
+public:
+	static constexpr size_t K_KEYS = 50;
+
+	TestBinaryKeystore() :
+			m_Settings(unique_path("/tmp/trihlav-tst-%%%%-%%%%-%%%%-%%%%")) {
+	}
+
+	virtual void TearDown() {
+		remove_all(m_Settings.getConfigDir());
+	}
+
+	/// @brief Key files of synthetic keys and the test key, converted into the keystore and renamed.
+	/// The settings select the keystore then.
+	void convert() {
+		KeyManager myKeyMan(m_Settings);
+		::trihlav::createSyntheticKeys(myKeyMan, K_KEYS);
+		YubikoOtpKeyConfig myKey { ::trihlav::createYubikoOtpKeyConfig(myKeyMan) };
+		myKey.setSysUser("tester");
+		myKey.save();
+		ASSERT_EQ(K_KEYS + 1, myKeyMan.loadKeys());
+		vector<const YubikoOtpKeyConfig *> myKeys;
+		for (const auto &myKey : myKeyMan.getIndex()->m_KeyList) {
+			myKeys.push_back(myKey.get());
+		}
+		EXPECT_EQ(K_KEYS + 1, BinaryKeystore::write(myKeyMan.getKeystoreFilename(), myKeys));
+		for (const YubikoOtpKeyConfig *myKey : myKeys) {
+			m_Tokens.push_back(myKey->getToken());
+			m_Keys.push_back(myKey->getSecretKey());
+			m_Descriptions.push_back(myKey->getDescription());
+			m_SysUsers.push_back(myKey->getSysUser());
+			myKeyMan.prefixKeyFile(myKey->getFilename(), "converted");
+		}
+		m_Settings.getKeyStore() = Settings::EMmapFile;
+	}
+
+	Settings m_Settings;
+	vector<yubikey_token_st> m_Tokens;
+	vector<string> m_Keys, m_Descriptions, m_SysUsers;
+};
+
+constexpr size_t TestBinaryKeystore::K_KEYS;
+
+TEST_F(TestBinaryKeystore,convertAndLoad) {
+	convert();
+	string myOtp;
+	{
+		KeyManager myKeyMan(m_Settings);
+		ASSERT_EQ(K_KEYS + 1, myKeyMan.loadKeys());
+		for (size_t myI = 0; myI < K_KEYS + 1; ++myI) {
+			const YubikoOtpKeyConfig &myKey = myKeyMan.getKey(myI);
+			ASSERT_TRUE(bool(myKey.getKeystore()));
+			EXPECT_TRUE(myKey.getFilename().empty());
+			EXPECT_EQ(0, memcmp(&m_Tokens[myI], &myKey.getToken(), sizeof(yubikey_token_st))) << myI;
+			EXPECT_EQ(m_Keys[myI], myKey.getSecretKey());
+			EXPECT_EQ(m_Descriptions[myI], myKey.getDescription());
+			EXPECT_EQ(m_SysUsers[myI], myKey.getSysUser());
+		}
+		YubikoOtpKeyConfig *myKey = myKeyMan.getKeyByPublicId(K_TST_PUBL0);
+		ASSERT_NE(nullptr, myKey);
+		EXPECT_EQ("tester", myKey->getSysUser());
+		myOtp = myKey->getPublicId() + myKey->generateOtp();
+		EXPECT_EQ(OtpValidator::EOk, OtpValidator(myKeyMan).validate(myOtp));
+	}
+	// the journal was folded into the keystore record
+	KeyManager myKeyMan(m_Settings);
+	ASSERT_EQ(K_KEYS + 1, myKeyMan.loadKeys());
+	EXPECT_EQ(0, myKeyMan.getJournal().getRecordCount());
+	EXPECT_EQ(OtpValidator::EReplayed, OtpValidator(myKeyMan).validate(myOtp));
+	YubikoOtpKeyConfig *myKey = myKeyMan.getKeyByPublicId(K_TST_PUBL0);
+	ASSERT_NE(nullptr, myKey);
+	EXPECT_EQ(OtpValidator::EOk, OtpValidator(myKeyMan).validate(myKey->getPublicId() + myKey->generateOtp()));
+}
+
+TEST_F(TestBinaryKeystore,keyFileReplacesRecord) {
+	convert();
+	KeyManager myKeyMan(m_Settings);
+	ASSERT_EQ(K_KEYS + 1, myKeyMan.loadKeys());
+	YubikoOtpKeyConfig myEdited { *myKeyMan.getKeyByPublicId(K_TST_PUBL0) };
+	myEdited.setDescription("edited");
+	myEdited.save();
+	EXPECT_FALSE(myEdited.getKeystore());
+	EXPECT_TRUE(exists(myEdited.getFilename()));
+	EXPECT_EQ(K_KEYS + 1, myKeyMan.loadKeys());
+	const YubikoOtpKeyConfig *myKey = myKeyMan.getKeyByPublicId(K_TST_PUBL0);
+	ASSERT_NE(nullptr, myKey);
+	EXPECT_EQ("edited", myKey->getDescription());
+	EXPECT_FALSE(myKey->getKeystore());
+	BinaryKeystore myStore(myKeyMan.getKeystoreFilename(), false);
+	size_t myDeleted = 0;
+	for (size_t myRec = 0; myRec < myStore.getRecordCount(); ++myRec) {
+		myDeleted += myStore.isDeleted(myRec) ? 1 : 0;
+	}
+	EXPECT_EQ(1, myDeleted);
+	// the keys are still sorted by their public ID
+	for (size_t myI = 1; myI < myKeyMan.getKeyCount(); ++myI) {
+		EXPECT_LT(myKeyMan.getKey(myI - 1).getPublicId(), myKeyMan.getKey(myI).getPublicId());
+	}
+}
+
+TEST_F(TestBinaryKeystore,damagedKeystore) {
+	convert();
+	KeyManager myKeyMan(m_Settings);
+	const path myFile { myKeyMan.getKeystoreFilename() };
+	resize_file(myFile, file_size(myFile) - 100);
+	EXPECT_THROW(BinaryKeystore(myFile, false), std::runtime_error);
+	{
+		std::ofstream myOut(myFile.native());
+		myOut << "{ \"yubikey\": {} }";
+	}
+	EXPECT_THROW(BinaryKeystore(myFile, false), std::runtime_error);
+	EXPECT_EQ(0, myKeyMan.loadKeys());
+	EXPECT_FALSE(exists(myFile));
+	EXPECT_TRUE(exists(myFile.parent_path() / ("damaged-" + myFile.filename().string())));
+}
+
+TEST_F(TestBinaryKeystore,readOnlyMapping) {
+	convert();
+	KeyManager myKeyMan(m_Settings, KeyManager::EReadOnly);
+	ASSERT_EQ(K_KEYS + 1, myKeyMan.loadKeys());
+	const YubikoOtpKeyConfig *myKey = myKeyMan.getKeyByPublicId(K_TST_PUBL0);
+	ASSERT_NE(nullptr, myKey);
+	EXPECT_FALSE(myKey->getKeystore()->isWritable());
+	EXPECT_THROW(myKey->getKeystore()->erase(myKey->getStoreRecord()), std::logic_error);
+}
+
+/// Counters are not written into a keystore replaced meanwhile, they stay journaled for the new one.
+TEST_F(TestBinaryKeystore,replacedKeystore) {
+	convert();
+	string myOtp;
+	{
+		KeyManager myStale(m_Settings, KeyManager::EReadOnly);
+		ASSERT_EQ(K_KEYS + 1, myStale.loadKeys());
+		KeyManager myKeyMan(m_Settings);
+		ASSERT_EQ(K_KEYS + 1, myKeyMan.loadKeys());
+		YubikoOtpKeyConfig *myKey = myKeyMan.getKeyByPublicId(K_TST_PUBL0);
+		ASSERT_NE(nullptr, myKey);
+		myOtp = myKey->getPublicId() + myKey->generateOtp();
+		EXPECT_EQ(OtpValidator::EOk, OtpValidator(myKeyMan).validate(myOtp));
+		EXPECT_FALSE(myKey->getKeystore()->isReplaced());
+		vector<const YubikoOtpKeyConfig *> myKeys;
+		for (const auto &myOld : myStale.getIndex()->m_KeyList) {
+			myKeys.push_back(myOld.get());
+		}
+		EXPECT_EQ(K_KEYS + 1, BinaryKeystore::write(myKeyMan.getKeystoreFilename(), myKeys));
+		EXPECT_TRUE(myKey->getKeystore()->isReplaced());
+		EXPECT_THROW(myKeyMan.getKeyStore().saveCounters(*myKey), std::runtime_error);
+	}
+	KeyManager myKeyMan(m_Settings);
+	ASSERT_EQ(K_KEYS + 1, myKeyMan.loadKeys());
+	EXPECT_EQ(0, myKeyMan.getJournal().getRecordCount());
+	EXPECT_EQ(OtpValidator::EReplayed, OtpValidator(myKeyMan).validate(myOtp));
+}
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
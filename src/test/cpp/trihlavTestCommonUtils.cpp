@@ -26,6 +26,8 @@
  Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
  */
 
+#include <boost/format.hpp>
+
 #include "trihlavLib/trihlavFactoryIface.hpp"
 #include "trihlavLib/trihlavKeyManager.hpp"
 #include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
@@ -51,4 +53,36 @@ namespace trihlav {
         logDebug_token(myCfg0.getToken());
         return myCfg0;
     }
-}
\ No newline at end of file
+
+    /// @brief splitmix64, spreads the key number over the key material.
+    static uint64_t mixSynthetic(uint64_t pX) {
+        pX += 0x9e3779b97f4a7c15ULL;
+        pX = (pX ^ (pX >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        pX = (pX ^ (pX >> 27)) * 0x94d049bb133111ebULL;
+        return pX ^ (pX >> 31);
+    }
+
+    std::string getSyntheticPublicId(size_t pNr) {
+        return YubikoOtpKeyConfig::hex2Modhex((boost::format("%012x") % (0x100000000000ULL + pNr)).str());
+    }
+
+    void setSyntheticKey(YubikoOtpKeyConfig &pKey, size_t pNr) {
+        const uint64_t myBits = mixSynthetic(pNr);
+        pKey.setDescription((boost::format("Synthetic key %1%") % pNr).str());
+        pKey.setPrivateId((boost::format("%012x") % (myBits & 0xffffffffffffULL)).str());
+        pKey.setPublicId(getSyntheticPublicId(pNr));
+        pKey.setCounter(K_TST_CNTR0);
+        pKey.setRandom(uint16_t(myBits >> 48));
+        pKey.setSecretKey((boost::format("%016x%016x") % mixSynthetic(myBits) % mixSynthetic(~myBits)).str());
+        pKey.setTimestamp(333);
+        pKey.computeCrc();
+    }
+
+    void createSyntheticKeys(KeyManager &pKeyMan, size_t pCount) {
+        for (size_t myNr = 0; myNr < pCount; ++myNr) {
+            YubikoOtpKeyConfig myKey(pKeyMan);
+            setSyntheticKey(myKey, myNr);
+            myKey.save();
+        }
+    }
+}
@@ -28,6 +28,9 @@
 #ifndef TRIHLAV_TRIHLAVTESTCOMMONUTILS_HPP
 #define TRIHLAV_TRIHLAVTESTCOMMONUTILS_HPP
 
+#include <string>
+#include <cstddef>
+
 namespace trihlav {
 
     class KeyManager;
@@ -43,6 +46,15 @@ namespace trihlav {
     constexpr static const char *K_TST_DESC0 = "Test key 1";
     constexpr static const char *K_TST_PRIV0 = "aabbaabbaabb";
 
+    /// @brief Public ID of the synthetic key pNr, 12 characters modhex, @see setSyntheticKey().
+    std::string getSyntheticPublicId(size_t pNr);
+
+    /// @brief Fill pKey with the synthetic key pNr, the same pNr gives the same key, it is not saved.
+    void setSyntheticKey(YubikoOtpKeyConfig &pKey, size_t pNr);
+
+    /// @brief Save synthetic keys 0 .. pCount-1 into the config directory of pKeyMan.
+    void createSyntheticKeys(KeyManager &pKeyMan, size_t pCount);
+
 }
 
 #endif //TRIHLAV_TRIHLAVTESTCOMMONUTILS_HPP
@@ -0,0 +1,262 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <csignal>
+#include <yubikey.h>
+#include <sys/resource.h>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/attributes.hpp>
+#include <boost/log/expressions.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"  // Brings in Google Mock.
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavCounterJournal.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+#include "trihlavLib/trihlavOtpValidator.hpp"
+
+#include "trihlavTestCommonUtils.hpp"
+
+using std::string;
+using std::vector;
+using ::trihlav::initLog;
+using ::trihlav::Settings;
+using ::trihlav::KeyManager;
+using ::trihlav::CounterJournal;
+using ::trihlav::YubikoOtpKeyConfig;
+using ::trihlav::OtpValidator;
+using ::trihlav::K_TST_PUBL0;
+using ::boost::filesystem::path;
+using ::boost::filesystem::unique_path;
+
+class TestCounterJournal: public ::testing::Test {
+public:
+	TestCounterJournal() :
+			m_Settings(unique_path("/tmp/trihlav-tst-%%%%-%%%%-%%%%-%%%%")) {
+	}
+
+	// Tears down the test fixture.
+	virtual void TearDown() {
+		BOOST_LOG_NAMED_SCOPE("TestCounterJournal::TearDown");
+		remove_all(m_Settings.getConfigDir());
+	}
+
+	const path getJournalFile() const {
+		return m_Settings.getConfigDir() / "journal";
+	}
+
+	static yubikey_token_st makeToken(uint16_t pCtr, uint8_t pUse) {
+		yubikey_token_st myToken;
+		memset(&myToken, 0, sizeof(myToken));
+		myToken.ctr = pCtr;
+		myToken.use = pUse;
+		myToken.tstpl = pUse;
+		return myToken;
+	}
+
+	Settings m_Settings;
+};
+
+TEST_F(TestCounterJournal,appendAndReplay) {
+	BOOST_LOG_NAMED_SCOPE("TestCounterJournal::appendAndReplay");
+	{
+		CounterJournal myJournal(getJournalFile());
+		myJournal.append(K_TST_PUBL0, makeToken(1, 1));
+		myJournal.append(K_TST_PUBL0, makeToken(1, 2));
+		EXPECT_EQ(2, myJournal.getRecordCount());
+	}
+	CounterJournal myJournal(getJournalFile());
+	vector<CounterJournal::Record> myRecs;
+	EXPECT_EQ(2, myJournal.replay([&myRecs](const CounterJournal::Record &pRec) {
+		myRecs.push_back(pRec);
+	}));
+	ASSERT_EQ(2, myRecs.size());
+	EXPECT_EQ(K_TST_PUBL0, myRecs[0].getPublicId());
+	EXPECT_EQ(1, myRecs[0].m_Use);
+	EXPECT_EQ(2, myRecs[1].m_Use);
+	myJournal.truncate();
+	EXPECT_EQ(0, myJournal.replay([](const CounterJournal::Record &) {
+		FAIL() << "Truncated journal replayed a record.";
+	}));
+}
+
+TEST_F(TestCounterJournal,truncateKeepsLaterRecords) {
+	BOOST_LOG_NAMED_SCOPE("TestCounterJournal::truncateKeepsLaterRecords");
+	{
+		CounterJournal myJournal(getJournalFile());
+		myJournal.append(K_TST_PUBL0, makeToken(1, 1));
+	}
+	CounterJournal myJournal(getJournalFile());
+	myJournal.append(K_TST_PUBL0, makeToken(1, 2));
+	const uint64_t mySeq = myJournal.append(K_TST_PUBL0, makeToken(1, 3));
+	myJournal.append(K_TST_PUBL0, makeToken(1, 4));
+	myJournal.append(K_TST_PUBL0, makeToken(1, 5));
+	// The record of the previous run goes with the ones up to mySeq.
+	myJournal.truncate(mySeq);
+	EXPECT_EQ(2, myJournal.getRecordCount());
+	myJournal.append(K_TST_PUBL0, makeToken(1, 6));
+	vector<int> myUses;
+	EXPECT_EQ(3, CounterJournal::scan(getJournalFile(), [&myUses](const CounterJournal::Record &pRec) {
+		myUses.push_back(pRec.m_Use);
+	}));
+	EXPECT_EQ(vector<int>({4, 5, 6}), myUses);
+	myJournal.truncate(mySeq);
+	EXPECT_EQ(3, myJournal.getRecordCount());
+}
+
+TEST_F(TestCounterJournal,ignoreTornRecord) {
+	BOOST_LOG_NAMED_SCOPE("TestCounterJournal::ignoreTornRecord");
+	{
+		CounterJournal myJournal(getJournalFile());
+		myJournal.append(K_TST_PUBL0, makeToken(1, 1));
+		myJournal.append(K_TST_PUBL0, makeToken(1, 2));
+	}
+	resize_file(getJournalFile(), file_size(getJournalFile()) - 3);
+	CounterJournal myJournal(getJournalFile());
+	EXPECT_EQ(1, myJournal.replay([](const CounterJournal::Record &) {}));
+	myJournal.append(K_TST_PUBL0, makeToken(1, 3));
+	EXPECT_EQ(2, myJournal.replay([](const CounterJournal::Record &) {}));
+}
+
+TEST_F(TestCounterJournal,failedAppendLeavesNoPartialRecord) {
+	BOOST_LOG_NAMED_SCOPE("TestCounterJournal::failedAppendLeavesNoPartialRecord");
+	CounterJournal myJournal(getJournalFile());
+	myJournal.append(K_TST_PUBL0, makeToken(1, 1));
+	const uintmax_t mySz = file_size(getJournalFile());
+	// Let only a part of the next record fit, the rest fails with EFBIG.
+	rlimit myOldLimit;
+	ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &myOldLimit));
+	rlimit myLimit = myOldLimit;
+	myLimit.rlim_cur = rlim_t(mySz + 20);
+	void (*myOldHandler)(int) = signal(SIGXFSZ, SIG_IGN);
+	ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &myLimit));
+	EXPECT_THROW(myJournal.append(K_TST_PUBL0, makeToken(1, 2)), std::runtime_error);
+	ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &myOldLimit));
+	signal(SIGXFSZ, myOldHandler);
+	EXPECT_EQ(mySz, file_size(getJournalFile()));
+	myJournal.append(K_TST_PUBL0, makeToken(1, 3));
+	vector<int> myUses;
+	EXPECT_EQ(2, CounterJournal::scan(getJournalFile(), [&myUses](const CounterJournal::Record &pRec) {
+		myUses.push_back(pRec.m_Use);
+	}));
+	EXPECT_EQ(vector<int>({1, 3}), myUses);
+}
+
+TEST_F(TestCounterJournal,countersSurviveReload) {
+	BOOST_LOG_NAMED_SCOPE("TestCounterJournal::countersSurviveReload");
+	string myOtp;
+	{
+		KeyManager myKeyMan(m_Settings);
+		trihlav::createYubikoOtpKeyConfig(myKeyMan);
+		EXPECT_EQ(1, myKeyMan.loadKeys());
+		OtpValidator myValidator(myKeyMan);
+		YubikoOtpKeyConfig* myKey = myKeyMan.getKeyByPublicId(K_TST_PUBL0);
+		ASSERT_NE(nullptr, myKey);
+		myOtp = myKey->getPublicId() + myKey->generateOtp();
+		EXPECT_EQ(OtpValidator::EOk, myValidator.validate(myOtp));
+		EXPECT_EQ(1, myKeyMan.getJournal().getRecordCount());
+		// Reload without compaction, the journal has to be replayed.
+		KeyManager myKeyMan1(m_Settings);
+		EXPECT_EQ(1, myKeyMan1.loadKeys());
+		EXPECT_EQ(OtpValidator::EReplayed, OtpValidator(myKeyMan1).validate(myOtp));
+	}
+	KeyManager myKeyMan(m_Settings);
+	EXPECT_EQ(1, myKeyMan.loadKeys());
+	EXPECT_EQ(0, myKeyMan.getJournal().getRecordCount());
+	OtpValidator myValidator(myKeyMan);
+	EXPECT_EQ(OtpValidator::EReplayed, myValidator.validate(myOtp));
+	YubikoOtpKeyConfig* myKey = myKeyMan.getKeyByPublicId(K_TST_PUBL0);
+	ASSERT_NE(nullptr, myKey);
+	EXPECT_EQ(OtpValidator::EOk, myValidator.validate(myKey->getPublicId() + myKey->generateOtp()));
+}
+
+TEST_F(TestCounterJournal,readOnlySeesJournal) {
+	BOOST_LOG_NAMED_SCOPE("TestCounterJournal::readOnlySeesJournal");
+	KeyManager myKeyMan(m_Settings);
+	trihlav::createYubikoOtpKeyConfig(myKeyMan);
+	EXPECT_EQ(1, myKeyMan.loadKeys());
+	YubikoOtpKeyConfig* myKey = myKeyMan.getKeyByPublicId(K_TST_PUBL0);
+	ASSERT_NE(nullptr, myKey);
+	EXPECT_EQ(OtpValidator::EOk, OtpValidator(myKeyMan).validate(myKey->getPublicId() + myKey->generateOtp()));
+	const uintmax_t mySize = file_size(myKeyMan.getJournalFilename());
+	{
+		KeyManager myReader(m_Settings, KeyManager::EReadOnly);
+		EXPECT_EQ(1, myReader.loadKeys());
+		const YubikoOtpKeyConfig* myCopy = myReader.getKeyByPublicId(K_TST_PUBL0);
+		ASSERT_NE(nullptr, myCopy);
+		EXPECT_EQ(myKey->getToken().use, myCopy->getToken().use);
+		EXPECT_THROW(myReader.getJournal(), std::logic_error);
+	}
+	EXPECT_EQ(mySize, file_size(myKeyMan.getJournalFilename()));
+	EXPECT_EQ(1, myKeyMan.getJournal().getRecordCount());
+	EXPECT_EQ(0, CounterJournal::scan(m_Settings.getConfigDir() / "missing", [](const CounterJournal::Record &) {}));
+}
+
+TEST_F(TestCounterJournal,durabilityModes) {
+	BOOST_LOG_NAMED_SCOPE("TestCounterJournal::durabilityModes");
+	const int K_THREADS = 8;
+	const int K_COMMITS = 50;
+	for (Settings::EDurability myMode : { Settings::EPerCommit, Settings::EGroupCommit, Settings::EAsync }) {
+		const path myFile { getJournalFile().native() + "-" + Settings::getDurabilityStr(myMode) };
+		CounterJournal myJournal(myFile, myMode, std::chrono::microseconds(200));
+		vector<std::thread> myThreads;
+		for (int myT = 0; myT < K_THREADS; ++myT) {
+			myThreads.emplace_back([&myJournal, K_COMMITS, myT]() {
+				for (int myC = 1; myC <= K_COMMITS; ++myC) {
+					myJournal.waitDurable(myJournal.append(K_TST_PUBL0, makeToken(myT, myC)));
+				}
+			});
+		}
+		for (auto &myThread : myThreads) {
+			myThread.join();
+		}
+		EXPECT_EQ(K_THREADS * K_COMMITS, myJournal.getWrittenSeq());
+		if (myMode == Settings::EPerCommit) {
+			EXPECT_EQ(K_THREADS * K_COMMITS, myJournal.getSyncCount());
+		} else {
+			EXPECT_LT(myJournal.getSyncCount(), K_THREADS * K_COMMITS);
+		}
+		EXPECT_EQ(K_THREADS * K_COMMITS, myJournal.replay([](const CounterJournal::Record &) {}));
+	}
+}
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
@@ -0,0 +1,258 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <stdexcept>
+#include <condition_variable>
+#include <boost/filesystem.hpp>
+
+#include "gtest/gtest.h"
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavKeyStore.hpp"
+#include "trihlavLib/trihlavKeyDirWatcher.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+
+#include "trihlavTestCommonUtils.hpp"
+
+using std::string;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using ::trihlav::initLog;
+using ::trihlav::Settings;
+using ::trihlav::KeyManager;
+using ::trihlav::KeyDirWatcher;
+using ::trihlav::YubikoOtpKeyConfig;
+using ::trihlav::getSyntheticPublicId;
+using ::trihlav::setSyntheticKey;
+using ::boost::filesystem::path;
+using ::boost::filesystem::unique_path;
+
+static constexpr size_t K_KEYS = 20;
+
+class TestKeyDirWatcher: public ::testing::Test {
+public:
+	TestKeyDirWatcher() :
+			m_Settings(unique_path("/tmp/trihlav-tst-%%%%-%%%%-%%%%-%%%%")) {
+	}
+
+	virtual void SetUp() {
+		KeyManager myKeyMan(m_Settings);
+		::trihlav::createSyntheticKeys(myKeyMan, K_KEYS);
+	}
+
+	virtual void TearDown() {
+		remove_all(m_Settings.getConfigDir());
+	}
+
+	/// @brief Wait up to 5 s for pCondition.
+	template<typename Condition>
+	static bool waitFor(Condition pCondition) {
+		const steady_clock::time_point myEnd = steady_clock::now() + std::chrono::seconds(5);
+		while (!pCondition()) {
+			if (steady_clock::now() > myEnd) {
+				return false;
+			}
+			std::this_thread::sleep_for(milliseconds(10));
+		}
+		return true;
+	}
+
+	Settings m_Settings;
+};
+
+/// A burst of changes is handed over in one call.
+TEST_F(TestKeyDirWatcher,coalescesBursts) {
+	if (!KeyDirWatcher::isSupported()) {
+		return;
+	}
+	const path myDir = m_Settings.getConfigDir();
+	std::mutex myMutex;
+	std::vector<KeyDirWatcher::Files_t> myCalls;
+	KeyDirWatcher myWatcher(myDir, [&](const KeyDirWatcher::Files_t &pFiles, const bool pRescan) {
+		EXPECT_FALSE(pRescan);
+		std::lock_guard<std::mutex> myLock(myMutex);
+		myCalls.push_back(pFiles);
+	}, milliseconds(200), milliseconds(2000));
+	for (int myI = 0; myI < 10; ++myI) {
+		std::ofstream((myDir / ("file-" + std::to_string(myI))).string()) << myI;
+	}
+	rename(myDir / "file-0", myDir / "file-10");
+	remove(myDir / "file-1");
+	ASSERT_TRUE(waitFor([&] {
+		std::lock_guard<std::mutex> myLock(myMutex);
+		return !myCalls.empty();
+	}));
+	std::this_thread::sleep_for(milliseconds(300));
+	std::lock_guard<std::mutex> myLock(myMutex);
+	ASSERT_EQ(1, myCalls.size());
+	EXPECT_EQ(11, myCalls[0].size());
+	EXPECT_EQ(1, myCalls[0].count(myDir / "file-10"));
+	EXPECT_EQ(1, myCalls[0].count(myDir / "file-1"));
+}
+
+/// Changes arriving without a pause are handed over after the maximal delay.
+TEST_F(TestKeyDirWatcher,steadyChangesFlushed) {
+	if (!KeyDirWatcher::isSupported()) {
+		return;
+	}
+	const path myDir = m_Settings.getConfigDir();
+	std::atomic<int> myCalls(0);
+	KeyDirWatcher myWatcher(myDir, [&](const KeyDirWatcher::Files_t &, const bool) {
+		++myCalls;
+	}, milliseconds(200), milliseconds(500));
+	const steady_clock::time_point myEnd = steady_clock::now() + milliseconds(2000);
+	for (int myI = 0; steady_clock::now() < myEnd && myCalls == 0; ++myI) {
+		std::ofstream((myDir / "file").string()) << myI;
+		std::this_thread::sleep_for(milliseconds(20));
+	}
+	EXPECT_LT(0, myCalls);
+}
+
+/// Only the given files are read, keys of other files stay as they are.
+TEST_F(TestKeyDirWatcher,reloadKeyFiles) {
+	KeyManager myKeyMan(m_Settings);
+	ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+	const YubikoOtpKeyConfig *myKept = myKeyMan.getKeyByPublicId(getSyntheticPublicId(5));
+	ASSERT_NE(nullptr, myKept);
+	YubikoOtpKeyConfig myEdited { *myKeyMan.getKeyByPublicId(getSyntheticPublicId(3)) };
+	myEdited.setDescription("edited");
+	myEdited.save();
+	YubikoOtpKeyConfig myDeleted { *myKeyMan.getKeyByPublicId(getSyntheticPublicId(4)) };
+	myKeyMan.getKeyStore().erase(myDeleted);
+	YubikoOtpKeyConfig myAdded(myKeyMan);
+	setSyntheticKey(myAdded, K_KEYS);
+	myAdded.save();
+	const uint64_t myGeneration = myKeyMan.getIndex()->m_Generation;
+	EXPECT_EQ(K_KEYS, myKeyMan.reloadKeyFiles( { myEdited.getFilename(), myDeleted.getFilename(),
+			myAdded.getFilename(), myKept->getFilename() }));
+	EXPECT_EQ(myGeneration + 1, myKeyMan.getIndex()->m_Generation);
+	EXPECT_EQ(myKept, myKeyMan.getKeyByPublicId(getSyntheticPublicId(5)));
+	ASSERT_NE(nullptr, myKeyMan.getKeyByPublicId(getSyntheticPublicId(3)));
+	EXPECT_EQ("edited", myKeyMan.getKeyByPublicId(getSyntheticPublicId(3))->getDescription());
+	EXPECT_EQ(nullptr, myKeyMan.getKeyByPublicId(getSyntheticPublicId(4)));
+	EXPECT_NE(nullptr, myKeyMan.getKeyByPublicId(getSyntheticPublicId(K_KEYS)));
+	const KeyManager::KeyIndexPtr_t myIndex = myKeyMan.getIndex();
+	for (size_t myI = 1; myI < myIndex->m_KeyList.size(); ++myI) {
+		EXPECT_LT(myIndex->m_KeyList[myI - 1]->getPublicId(), myIndex->m_KeyList[myI]->getPublicId());
+	}
+	// nothing changed, nothing is published
+	EXPECT_EQ(K_KEYS, myKeyMan.reloadKeyFiles( { myEdited.getFilename(), myKept->getFilename() }));
+	EXPECT_EQ(myGeneration + 1, myKeyMan.getIndex()->m_Generation);
+}
+
+/// Changes passed by concurrent calls are all applied, some of them together.
+TEST_F(TestKeyDirWatcher,concurrentReloads) {
+	const size_t K_THREADS = 4;
+	KeyManager myKeyMan(m_Settings);
+	ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+	const uint64_t myGeneration = myKeyMan.getIndex()->m_Generation;
+	std::vector<std::thread> myThreads;
+	for (size_t myT = 0; myT < K_THREADS; ++myT) {
+		YubikoOtpKeyConfig myEdited { *myKeyMan.getKeyByPublicId(getSyntheticPublicId(myT)) };
+		myEdited.setDescription("edited " + std::to_string(myT));
+		myEdited.save();
+		myThreads.emplace_back([&myKeyMan, myEdited]() {
+			EXPECT_EQ(K_KEYS, myKeyMan.reloadKeyFiles( { myEdited.getFilename() }));
+		});
+	}
+	for (auto &myThread : myThreads) {
+		myThread.join();
+	}
+	for (size_t myT = 0; myT < K_THREADS; ++myT) {
+		EXPECT_EQ("edited " + std::to_string(myT), myKeyMan.getKeyByPublicId(getSyntheticPublicId(myT))->getDescription());
+	}
+	EXPECT_GE(myGeneration + K_THREADS, myKeyMan.getIndex()->m_Generation);
+}
+
+/// A loaded key can not take the public ID of another one.
+TEST_F(TestKeyDirWatcher,duplicatePublicId) {
+	KeyManager myKeyMan(m_Settings);
+	ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+	YubikoOtpKeyConfig *myKey = myKeyMan.getKeyByPublicId(getSyntheticPublicId(3));
+	const YubikoOtpKeyConfig *myOther = myKeyMan.getKeyByPublicId(getSyntheticPublicId(5));
+	ASSERT_NE(nullptr, myKey);
+	ASSERT_NE(nullptr, myOther);
+	EXPECT_THROW(myKey->setPublicId(getSyntheticPublicId(5)), std::invalid_argument);
+	EXPECT_EQ(getSyntheticPublicId(3), myKey->getPublicId());
+	EXPECT_EQ(myKey, myKeyMan.getKeyByPublicId(getSyntheticPublicId(3)));
+	EXPECT_EQ(myOther, myKeyMan.getKeyByPublicId(getSyntheticPublicId(5)));
+}
+
+/// Counters advanced in memory survive an older key file being read again.
+TEST_F(TestKeyDirWatcher,reloadKeepsCounters) {
+	KeyManager myKeyMan(m_Settings);
+	ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+	const string myPubId { getSyntheticPublicId(2) };
+	YubikoOtpKeyConfig myEdited { *myKeyMan.getKeyByPublicId(myPubId) };
+	myKeyMan.withLockedKey(myPubId, [](YubikoOtpKeyConfig &pKey) {
+		pKey.setCounter(pKey.getCounter() + 5);
+	});
+	const int myCounter = myKeyMan.getKeyByPublicId(myPubId)->getCounter();
+	myEdited.setDescription("edited");
+	myEdited.save();
+	EXPECT_EQ(K_KEYS, myKeyMan.reloadKeyFiles( { myEdited.getFilename() }));
+	EXPECT_EQ("edited", myKeyMan.getKeyByPublicId(myPubId)->getDescription());
+	EXPECT_EQ(myCounter, myKeyMan.getKeyByPublicId(myPubId)->getCounter());
+}
+
+/// The watcher applies key files written meanwhile.
+TEST_F(TestKeyDirWatcher,watchKeys) {
+	KeyManager myKeyMan(m_Settings);
+	ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+	if (!myKeyMan.watchKeys()) {
+		return;
+	}
+	EXPECT_TRUE(myKeyMan.isWatching());
+	YubikoOtpKeyConfig myAdded(myKeyMan);
+	setSyntheticKey(myAdded, K_KEYS);
+	myAdded.save();
+	EXPECT_TRUE(waitFor([&] {
+		return myKeyMan.getKeyByPublicId(getSyntheticPublicId(K_KEYS)) != nullptr;
+	}));
+	YubikoOtpKeyConfig myDeleted { *myKeyMan.getKeyByPublicId(getSyntheticPublicId(0)) };
+	myKeyMan.getKeyStore().erase(myDeleted);
+	EXPECT_TRUE(waitFor([&] {
+		return myKeyMan.getKeyByPublicId(getSyntheticPublicId(0)) == nullptr;
+	}));
+	EXPECT_EQ(K_KEYS, myKeyMan.getKeyCount());
+}
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
@@ -0,0 +1,282 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <yubikey.h>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "gtest/gtest.h"
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavKeyFileJson.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+
+#include "trihlavTestCommonUtils.hpp"
+
+using std::string;
+using std::vector;
+using ::trihlav::initLog;
+using ::trihlav::Settings;
+using ::trihlav::KeyManager;
+using ::trihlav::KeyFileJson;
+using ::trihlav::UTimestamp;
+using ::trihlav::YubikoOtpKeyConfig;
+using ::trihlav::setSyntheticKey;
+using ::boost::filesystem::path;
+using ::boost::filesystem::unique_path;
+using ::boost::property_tree::ptree;
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
+
+/// @brief What property_tree made of the keys, the reference KeyFileJson has to match.
+class TestKeyFileJson: public ::testing::Test {
+public:
+	TestKeyFileJson() :
+			m_Settings(unique_path("/tmp/trihlav-tst-%%%%-%%%%-%%%%-%%%%")), m_KeyMan(m_Settings) {
+	}
+
+	virtual void TearDown() {
+		remove_all(m_Settings.getConfigDir());
+	}
+
+	/// @brief A new file in the config directory.
+	path newFile() {
+		return unique_path(m_Settings.getConfigDir() / "%%%%-%%%%.trihlav-key.json");
+	}
+
+	static string readAll(const path &pFile) {
+		std::ifstream myIn(pFile.string(), std::ios::binary);
+		return string(std::istreambuf_iterator<char>(myIn), std::istreambuf_iterator<char>());
+	}
+
+	static void writeAll(const path &pFile, const string &pContent) {
+		std::ofstream(pFile.string(), std::ios::binary) << pContent;
+	}
+
+	/// @brief write_json() of the tree saveFile() used to build.
+	static string writeTree(const YubikoOtpKeyConfig &pKey) {
+		ptree myTree;
+		myTree.put("yubikey.privateId", pKey.getPrivateId());
+		myTree.put("yubikey.publicId", pKey.getPublicId());
+		myTree.put("yubikey.secretKey", pKey.getSecretKey());
+		myTree.put("yubikey.timestamp", pKey.getTimestamp().tstp_int);
+		myTree.put("yubikey.counter", pKey.getCounter());
+		myTree.put("yubikey.crc", pKey.getCrc());
+		myTree.put("yubikey.random", pKey.getRandom());
+		myTree.put("yubikey.use", pKey.getUseCounter());
+		myTree.put("yubikey.description", pKey.getDescription());
+		myTree.put("yubikey.sysUser", pKey.getSysUser());
+		myTree.put("yubikey.version", "0.0.2");
+		std::ostringstream myOut;
+		write_json(myOut, myTree);
+		return myOut.str();
+	}
+
+	/// @brief load() as it was done with read_json().
+	static void loadTree(YubikoOtpKeyConfig &pKey, const string &pJson) {
+		std::istringstream myIn(pJson);
+		ptree myTree;
+		read_json(myIn, myTree);
+		const string myVer(myTree.get<string>("yubikey.version"));
+		pKey.setPrivateId(myTree.get<string>("yubikey.privateId"));
+		pKey.setPublicId(myTree.get<string>("yubikey.publicId"));
+		pKey.setSecretKey(myTree.get<string>("yubikey.secretKey"));
+		pKey.setTimestamp(UTimestamp(myTree.get<uint64_t>("yubikey.timestamp")));
+		pKey.setCounter(myTree.get<uint8_t>("yubikey.counter"));
+		pKey.setCrc(myTree.get<uint16_t>("yubikey.crc"));
+		pKey.setRandom(myTree.get<uint16_t>("yubikey.random"));
+		pKey.setUseCounter(myTree.get<uint8_t>("yubikey.use"));
+		pKey.setDescription(myTree.get<string>("yubikey.description"));
+		if (myVer != "0.0.1") {
+			const string mySysUser { myTree.get<string>("yubikey.sysUser") };
+			if (!mySysUser.empty())
+				pKey.setSysUser(mySysUser);
+		}
+	}
+
+	/// @brief saveFileCounters() as it was done with read_json() and write_json().
+	static string saveTreeCounters(const YubikoOtpKeyConfig &pKey, const string &pJson) {
+		std::istringstream myIn(pJson);
+		ptree myTree;
+		read_json(myIn, myTree);
+		myTree.put("yubikey.timestamp", pKey.getTimestamp().tstp_int);
+		myTree.put("yubikey.counter", pKey.getCounter());
+		myTree.put("yubikey.crc", pKey.getCrc());
+		myTree.put("yubikey.use", pKey.getUseCounter());
+		std::ostringstream myOut;
+		write_json(myOut, myTree);
+		return myOut.str();
+	}
+
+	static void expectSameKey(const YubikoOtpKeyConfig &pExpected, const YubikoOtpKeyConfig &pActual) {
+		EXPECT_EQ(pExpected.getPrivateId(), pActual.getPrivateId());
+		EXPECT_EQ(pExpected.getPublicId(), pActual.getPublicId());
+		EXPECT_EQ(pExpected.getSecretKey(), pActual.getSecretKey());
+		EXPECT_EQ(pExpected.getTimestamp().tstp_int, pActual.getTimestamp().tstp_int);
+		EXPECT_EQ(pExpected.getToken().ctr, pActual.getToken().ctr);
+		EXPECT_EQ(pExpected.getCrc(), pActual.getCrc());
+		EXPECT_EQ(pExpected.getRandom(), pActual.getRandom());
+		EXPECT_EQ(pExpected.getUseCounter(), pActual.getUseCounter());
+		EXPECT_EQ(pExpected.getDescription(), pActual.getDescription());
+		EXPECT_EQ(pExpected.getSysUser(), pActual.getSysUser());
+	}
+
+	/// @brief Descriptions with every character write_json() escapes or passes.
+	static vector<string> getDescriptions() {
+		string myAllBytes;
+		for (int myC = 1; myC < 256; ++myC) {
+			myAllBytes += char(myC);
+		}
+		return {"", "Key of the boss", "a/b\"c\\d\te\nf\rg\bh\fi", string("nul\0byte", 8), "Žluťoučký kůň",
+			myAllBytes, string(3000, '/')};
+	}
+
+	Settings m_Settings;
+	KeyManager m_KeyMan;
+};
+
+TEST_F(TestKeyFileJson, saveFileLikeWriteJson) {
+	size_t myNr = 0;
+	for (const string &myDesc : getDescriptions()) {
+		YubikoOtpKeyConfig myKey(m_KeyMan, newFile());
+		setSyntheticKey(myKey, myNr++);
+		myKey.setDescription(myDesc);
+		myKey.setSysUser(myNr % 2 ? "user/ä" : "root");
+		myKey.getToken().ctr = uint16_t(myNr * 40);
+		myKey.saveFile();
+		EXPECT_EQ(writeTree(myKey), readAll(myKey.getFilename())) << "description " << myNr;
+	}
+}
+
+TEST_F(TestKeyFileJson, loadLikeReadJson) {
+	YubikoOtpKeyConfig mySaved(m_KeyMan, newFile());
+	setSyntheticKey(mySaved, 7);
+	mySaved.setDescription("Žluťoučký kůň \"úpěl\"\t/\x01");
+	const string myCanonical = writeTree(mySaved);
+	const vector<string> myFiles { myCanonical, // the parsed ones
+		"{\"yubikey\":{\"privateId\":\"0a1b2c3d4e5f\",\"publicId\":\"cccccccccccb\",\"secretKey\":"
+				"\"00112233445566778899aabbccddeeff\",\"timestamp\":123456,\"counter\":255,\"crc\":65535,"
+				"\"random\":0,\"use\":7,\"description\":\"\\u0041\\/\\u001f\",\"version\":\"0.0.1\"}}",
+		"\r\n{ \"yubikey\" : { \"version\" : \"0.0.2\", \"sysUser\" : \"\", \"description\" : \"\", \"use\" : \"1\","
+				" \"random\" : \"2\", \"crc\" : \"3\", \"counter\" : \"4\", \"timestamp\" : \"5\", \"secretKey\" :"
+				" \"ffeeddccbbaa99887766554433221100\", \"publicId\" : \"vvvvvvvvvvvv\", \"privateId\" :"
+				" \"ffffffffffff\" } }\t",
+		// left to property_tree
+		"{\"yubikey\":{\"privateId\":\"0A1B2C3D4E5F\",\"publicId\":\"cccccccccccd\",\"secretKey\":"
+				"\"00112233445566778899AABBCCDDEEFF\",\"timestamp\":\"007\",\"counter\":\" 3\",\"crc\":0,"
+				"\"random\":0,\"use\":0,\"description\":\"\\u00e9\",\"sysUser\":\"x\",\"version\":\"0.0.2\"}}",
+		"{\"yubikey\":{\"privateId\":\"0a1b2c3d4e5f\",\"publicId\":\"ccccccccccce\",\"secretKey\":"
+				"\"00112233445566778899aabbccddeeff\",\"timestamp\":0,\"counter\":0,\"crc\":0,\"random\":0,"
+				"\"use\":0,\"description\":\"\",\"sysUser\":\"x\",\"version\":\"0.0.3\",\"extra\":[1,2]}}" };
+	for (const string &myJson : myFiles) {
+		const path myFile = newFile();
+		writeAll(myFile, myJson);
+		YubikoOtpKeyConfig myExpected(m_KeyMan, myFile);
+		loadTree(myExpected, myJson);
+		YubikoOtpKeyConfig myKey(m_KeyMan, myFile);
+		myKey.load();
+		SCOPED_TRACE(myJson);
+		expectSameKey(myExpected, myKey);
+	}
+	const vector<string> myDamaged { "", "{\"yubikey\":{", myCanonical.substr(0, myCanonical.size() / 2),
+		"{\"yubikey\":{\"version\":\"0.0.2\"}}", "{\"yubikey\":{\"privateId\":\"0a1b2c3d4e5f\",\"publicId\":\"\","
+				"\"secretKey\":\"00112233445566778899aabbccddeeff\",\"timestamp\":0,\"counter\":256,\"crc\":0,"
+				"\"random\":0,\"use\":0,\"description\":\"\",\"version\":\"0.0.1\"}}" };
+	for (const string &myJson : myDamaged) {
+		const path myFile = newFile();
+		writeAll(myFile, myJson);
+		YubikoOtpKeyConfig myKey(m_KeyMan, myFile);
+		EXPECT_ANY_THROW(myKey.load()) << myJson;
+	}
+}
+
+TEST_F(TestKeyFileJson, saveFileCountersLikePtree) {
+	YubikoOtpKeyConfig mySaved(m_KeyMan, newFile());
+	setSyntheticKey(mySaved, 3);
+	mySaved.setDescription("a/b \"c\"");
+	const vector<string> myFiles { writeTree(mySaved),
+		"{\"yubikey\":{\"version\":\"0.0.1\",\"privateId\":\"0a1b2c3d4e5f\",\"publicId\":\"cccccccccccb\","
+				"\"secretKey\":\"00112233445566778899aabbccddeeff\",\"random\":\"0012\",\"crc\":9,"
+				"\"description\":\"\\/\\u0007\"}}",
+		"{\"yubikey\":{}}",
+		"{\"yubikey\":{\"version\":\"0.0.2\",\"other\":{\"a\":\"b\"}}}" };
+	for (const string &myJson : myFiles) {
+		const path myFile = newFile();
+		writeAll(myFile, myJson);
+		YubikoOtpKeyConfig myKey(m_KeyMan, myFile);
+		setSyntheticKey(myKey, 11);
+		myKey.getToken().ctr = 300;
+		myKey.setUseCounter(200);
+		myKey.setTimestamp(UTimestamp(0x12345678));
+		myKey.computeCrc();
+		myKey.saveFileCounters();
+		EXPECT_EQ(saveTreeCounters(myKey, myJson), readAll(myFile)) << myJson;
+	}
+}
+
+TEST_F(TestKeyFileJson, parse) {
+	YubikoOtpKeyConfig myKey(m_KeyMan, newFile());
+	setSyntheticKey(myKey, 1);
+	string myJson(writeTree(myKey));
+	KeyFileJson::Document myDoc;
+	ASSERT_TRUE(KeyFileJson::parse(&myJson[0], myJson.size(), myDoc));
+	ASSERT_EQ(size_t(KeyFileJson::EFieldCount), myDoc.m_Count);
+	for (size_t myI = 0; myI < myDoc.m_Count; ++myI) {
+		EXPECT_EQ(KeyFileJson::EField(myI), myDoc.m_Order[myI]);
+	}
+	uint8_t myUid[YUBIKEY_UID_SIZE];
+	ASSERT_TRUE(KeyFileJson::isHex(myDoc.m_Values[KeyFileJson::EPrivateId], YUBIKEY_UID_SIZE));
+	KeyFileJson::decodeHex(myDoc.m_Values[KeyFileJson::EPrivateId], myUid);
+	EXPECT_EQ(0, memcmp(myUid, myKey.getToken().uid, YUBIKEY_UID_SIZE));
+	uint64_t myVal = 0;
+	EXPECT_TRUE(KeyFileJson::decodeUnsigned(myDoc.m_Values[KeyFileJson::ECrc], UINT16_MAX, myVal));
+	EXPECT_EQ(myKey.getCrc(), myVal);
+	char myCopy[1024];
+	ASSERT_EQ(myJson.size(), myKey.toJson(myCopy, sizeof(myCopy)));
+	EXPECT_EQ(writeTree(myKey), string(myCopy, myJson.size()));
+	EXPECT_EQ(myJson.size(), myKey.toJson(myCopy, 10));
+	for (string myBad : { "{\"yubikey\":{\"use\":1,\"use\":2}}", "{\"yubikey\":{\"use\":01}}",
+		"{\"yubikey\":{\"use\":1.5}}", "{\"yubikey\":{\"use\":-1}}", "{\"yubikey\":{\"use\":true}}",
+		"{\"yubikey\":{\"use\":[1]}}", "{\"yubikey\":{\"use\":\"\\u0100\"}}", "{\"yubikey\":{\"use\":\"\t\"}}",
+		"{\"yubikey\":{\"use\":\"\xC3\"}}", "{\"yubikey\":{\"color\":\"red\"}}", "{\"yubikey\":{}} x",
+		"{\"yubikey\":{},\"more\":{}}", "{\"yubikey\":{\"use\":1,}}", "[]" }) {
+		EXPECT_FALSE(KeyFileJson::parse(&myBad[0], myBad.size(), myDoc)) << myBad;
+	}
+}
@@ -0,0 +1,197 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <boost/filesystem.hpp>
+
+#include "gtest/gtest.h"
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavKeyStore.hpp"
+#include "trihlavLib/trihlavKeySnapshot.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+
+#include "trihlavTestCommonUtils.hpp"
+
+using std::string;
+using std::vector;
+using ::trihlav::initLog;
+using ::trihlav::Settings;
+using ::trihlav::KeyManager;
+using ::trihlav::KeySnapshot;
+using ::trihlav::YubikoOtpKeyConfig;
+using ::trihlav::getSyntheticPublicId;
+using ::boost::filesystem::path;
+using ::boost::filesystem::unique_path;
+
+class TestKeySnapshot: public ::testing::Test {
+public:
+	static constexpr size_t K_KEYS = 20;
+
+	TestKeySnapshot() :
+			m_Settings(unique_path("/tmp/trihlav-tst-%%%%-%%%%-%%%%-%%%%")) {
+	}
+
+	virtual void TearDown() {
+		remove_all(m_Settings.getConfigDir());
+	}
+
+	/// @brief Identity of the snapshot file, it changes when it is written again.
+	KeySnapshot::FileId getSnapshotId(const KeyManager &pKeyMan) {
+		KeySnapshot::FileId myId;
+		EXPECT_TRUE(myId.read(pKeyMan.getKeySnapshotFilename()));
+		return myId;
+	}
+
+	Settings m_Settings;
+};
+
+constexpr size_t TestKeySnapshot::K_KEYS;
+
+/// Entries are found only while the file identity matches and is older than the snapshot.
+TEST_F(TestKeySnapshot,writeFind) {
+	KeyManager myKeyMan(m_Settings);
+	YubikoOtpKeyConfig myKey(myKeyMan);
+	::trihlav::setSyntheticKey(myKey, 5);
+	myKey.setSysUser("tester");
+	vector<KeySnapshot::Entry> myEntries(3);
+	for (size_t myI = 0; myI < myEntries.size(); ++myI) {
+		myEntries[myI].m_Filename = "/keys/" + std::to_string(2 - myI);
+		myEntries[myI].m_FileId.m_Ino = 100 + myI;
+		myEntries[myI].m_FileId.m_Size = 300;
+		myEntries[myI].m_FileId.m_MtimeNs = 1000;
+		myEntries[myI].m_FileId.m_CtimeNs = 2000;
+		myEntries[myI].m_PublicId = getSyntheticPublicId(myI);
+	}
+	myEntries[1].m_Key = &myKey;
+	myEntries[0].m_FileId.m_MtimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	create_directories(m_Settings.getConfigDir());
+	const path myFilename = myKeyMan.getKeySnapshotFilename();
+	KeySnapshot::write(myFilename, myEntries);
+	const KeySnapshot mySnapshot(myFilename);
+	ASSERT_EQ(3u, mySnapshot.getRecordCount());
+	KeySnapshot::FileId myId;
+	myId.m_Ino = 102;
+	myId.m_Size = 300;
+	myId.m_MtimeNs = 1000;
+	myId.m_CtimeNs = 2000;
+	const KeySnapshot::Record *myRec = mySnapshot.find("/keys/0", myId);
+	ASSERT_NE(nullptr, myRec);
+	EXPECT_EQ(0u, myRec->m_Flags & KeySnapshot::EWithKey);
+	EXPECT_EQ(getSyntheticPublicId(2), mySnapshot.getString(myRec->m_Key.m_PublicId));
+	EXPECT_EQ(nullptr, mySnapshot.find("/keys/3", myId));
+	EXPECT_EQ(nullptr, mySnapshot.find("/keys/", myId));
+	myId.m_Size = 301;
+	EXPECT_EQ(nullptr, mySnapshot.find("/keys/0", myId));
+	myId.m_Size = 300;
+	myId.m_Ino = 101;
+	myRec = mySnapshot.find("/keys/1", myId);
+	ASSERT_NE(nullptr, myRec);
+	ASSERT_NE(0u, myRec->m_Flags & KeySnapshot::EWithKey);
+	YubikoOtpKeyConfig myLoaded(myKeyMan);
+	mySnapshot.load(myLoaded, *myRec);
+	EXPECT_TRUE(myKey == myLoaded);
+	EXPECT_EQ("tester", myLoaded.getSysUser());
+	// changed right before the snapshot was written
+	EXPECT_EQ(nullptr, mySnapshot.find("/keys/2", myEntries[0].m_FileId));
+	EXPECT_EQ(0600u, status(myFilename).permissions() & 0777);
+}
+
+/// A damaged snapshot is refused, the keys load anyway and a new one is written.
+TEST_F(TestKeySnapshot,damaged) {
+	KeyManager myKeyMan(m_Settings);
+	::trihlav::createSyntheticKeys(myKeyMan, K_KEYS);
+	const path myFilename = myKeyMan.getKeySnapshotFilename();
+	{
+		std::ofstream myOut(myFilename.string());
+		myOut << "TRHLVS01 and nothing else";
+	}
+	EXPECT_THROW(KeySnapshot mySnapshot(myFilename), std::runtime_error);
+	ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+	EXPECT_EQ(K_KEYS, KeySnapshot(myFilename).getRecordCount());
+	resize_file(myFilename, file_size(myFilename) - 1);
+	EXPECT_THROW(KeySnapshot mySnapshot(myFilename), std::runtime_error);
+}
+
+/// Unchanged key files are taken from the snapshot, changed ones are read again.
+TEST_F(TestKeySnapshot,warmLoad) {
+	const string myPubId { getSyntheticPublicId(4) };
+	{
+		KeyManager myKeyMan(m_Settings);
+		::trihlav::createSyntheticKeys(myKeyMan, K_KEYS);
+	}
+	// let the key files age beyond KeySnapshot::K_RACY_NS
+	std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+	KeySnapshot::FileId mySnapshotId;
+	{
+		KeyManager myKeyMan(m_Settings);
+		ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+		mySnapshotId = getSnapshotId(myKeyMan);
+	}
+	{
+		KeyManager myKeyMan(m_Settings);
+		ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+		// all files were found, nothing to write
+		EXPECT_TRUE(mySnapshotId == getSnapshotId(myKeyMan));
+		for (const auto &myKey : myKeyMan.getIndex()->m_KeyList) {
+			const auto myStored = myKeyMan.getKeyStore().get(myKey->getPublicId());
+			ASSERT_TRUE(bool(myStored));
+			EXPECT_TRUE(*myStored == *myKey);
+			EXPECT_EQ(myStored->getFilename(), myKey->getFilename());
+		}
+		YubikoOtpKeyConfig myEdited { *myKeyMan.getKeyByPublicId(myPubId) };
+		myEdited.setDescription("edited");
+		myEdited.save();
+	}
+	{
+		KeyManager myKeyMan(m_Settings);
+		ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+		EXPECT_EQ("edited", myKeyMan.getKeyByPublicId(myPubId)->getDescription());
+		EXPECT_FALSE(mySnapshotId == getSnapshotId(myKeyMan));
+		mySnapshotId = getSnapshotId(myKeyMan);
+	}
+	m_Settings.getLazyKeys() = true;
+	KeyManager myKeyMan(m_Settings);
+	ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+	EXPECT_EQ("edited", myKeyMan.getKeyByPublicId(myPubId)->getDescription());
+	ASSERT_NE(nullptr, myKeyMan.getKeyByPublicId(getSyntheticPublicId(K_KEYS - 1)));
+}
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
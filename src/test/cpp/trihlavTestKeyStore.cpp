@@ -0,0 +1,300 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <yubikey.h>
+#include <boost/filesystem.hpp>
+
+#include "gtest/gtest.h"
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavKeyStore.hpp"
+#include "trihlavLib/trihlavJsonDirKeyStore.hpp"
+#include "trihlavLib/trihlavLazyKeys.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+
+#include "trihlavTestCommonUtils.hpp"
+
+using std::string;
+using std::vector;
+using ::trihlav::initLog;
+using ::trihlav::Settings;
+using ::trihlav::KeyManager;
+using ::trihlav::KeyStore;
+using ::trihlav::JsonDirKeyStore;
+using ::trihlav::YubikoOtpKeyConfig;
+using ::trihlav::getSyntheticPublicId;
+using ::boost::filesystem::path;
+using ::boost::filesystem::unique_path;
+
+/// @brief The same tests for each key store.
+class TestKeyStore: public ::testing::TestWithParam<Settings::EKeyStore> {
+public:
+	static constexpr size_t K_KEYS = 20;
+
+	TestKeyStore() :
+			m_Settings(unique_path("/tmp/trihlav-tst-%%%%-%%%%-%%%%-%%%%")), //
+			m_OtherSettings(unique_path("/tmp/trihlav-tst-%%%%-%%%%-%%%%-%%%%")) {
+		m_Settings.getKeyStore() = GetParam();
+		m_OtherSettings.getKeyStore() = GetParam();
+	}
+
+	virtual void SetUp() {
+		KeyManager myKeyMan(m_Settings);
+		::trihlav::createSyntheticKeys(myKeyMan, K_KEYS);
+	}
+
+	virtual void TearDown() {
+		remove_all(m_Settings.getConfigDir());
+		remove_all(m_OtherSettings.getConfigDir());
+	}
+
+	Settings m_Settings;
+	Settings m_OtherSettings;
+};
+
+constexpr size_t TestKeyStore::K_KEYS;
+
+TEST_P(TestKeyStore,putLoadGet) {
+	KeyManager myKeyMan(m_Settings);
+	EXPECT_EQ(GetParam(), Settings::parseKeyStore(myKeyMan.getKeyStore().getName()));
+	ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+	for (size_t myI = 1; myI < K_KEYS; ++myI) {
+		EXPECT_LT(myKeyMan.getKey(myI - 1).getPublicId(), myKeyMan.getKey(myI).getPublicId());
+	}
+	const string myPubId { getSyntheticPublicId(7) };
+	const YubikoOtpKeyConfig *myLoaded = myKeyMan.getKeyByPublicId(myPubId);
+	ASSERT_NE(nullptr, myLoaded);
+	const KeyStore::KeyPtr_t myKey = myKeyMan.getKeyStore().get(myPubId);
+	ASSERT_TRUE(bool(myKey));
+	EXPECT_TRUE(*myLoaded == *myKey);
+	EXPECT_EQ("Synthetic key 7", myKey->getDescription());
+	EXPECT_FALSE(myKeyMan.getKeyStore().get(getSyntheticPublicId(K_KEYS)));
+}
+
+TEST_P(TestKeyStore,updateAndErase) {
+	const string myPubId { getSyntheticPublicId(3) };
+	{
+		KeyManager myKeyMan(m_Settings);
+		ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+		YubikoOtpKeyConfig myEdited { *myKeyMan.getKeyByPublicId(myPubId) };
+		myEdited.setDescription("edited");
+		myEdited.setSysUser("tester");
+		myEdited.save();
+		ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+		const YubikoOtpKeyConfig *myKey = myKeyMan.getKeyByPublicId(myPubId);
+		ASSERT_NE(nullptr, myKey);
+		EXPECT_EQ("edited", myKey->getDescription());
+		EXPECT_EQ("tester", myKey->getSysUser());
+		YubikoOtpKeyConfig myDeleted { *myKey };
+		myKeyMan.getKeyStore().erase(myDeleted);
+	}
+	KeyManager myKeyMan(m_Settings);
+	EXPECT_EQ(K_KEYS - 1, myKeyMan.loadKeys());
+	EXPECT_EQ(nullptr, myKeyMan.getKeyByPublicId(myPubId));
+	EXPECT_FALSE(myKeyMan.getKeyStore().get(myPubId));
+}
+
+/// Bulk write into another directory, the counters are updated in place there.
+TEST_P(TestKeyStore,writeAndSaveCounters) {
+	KeyManager myKeyMan(m_Settings);
+	ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+	vector<const YubikoOtpKeyConfig *> myKeys;
+	for (const auto &myKey : myKeyMan.getIndex()->m_KeyList) {
+		myKeys.push_back(myKey.get());
+	}
+	const string myPubId { getSyntheticPublicId(11) };
+	yubikey_token_st myToken = myKeyMan.getKeyByPublicId(myPubId)->getToken();
+	{
+		KeyManager myOtherMan(m_OtherSettings);
+		EXPECT_EQ(K_KEYS, myOtherMan.getKeyStore().write(myKeys));
+		ASSERT_EQ(K_KEYS, myOtherMan.loadKeys());
+		for (size_t myI = 0; myI < K_KEYS; ++myI) {
+			EXPECT_TRUE(myKeyMan.getKey(myI) == myOtherMan.getKey(myI)) << myI;
+			EXPECT_EQ(myKeyMan.getKey(myI).getDescription(), myOtherMan.getKey(myI).getDescription());
+		}
+		YubikoOtpKeyConfig *myKey = myOtherMan.getKeyByPublicId(myPubId);
+		ASSERT_NE(nullptr, myKey);
+		myToken.ctr += 1;
+		myToken.use = 3;
+		ASSERT_TRUE(myKey->advanceCounters(myToken));
+		EXPECT_TRUE(myOtherMan.getKeyStore().saveCounters(*myKey));
+		myOtherMan.getKeyStore().sync();
+	}
+	KeyManager myOtherMan(m_OtherSettings);
+	ASSERT_EQ(K_KEYS, myOtherMan.loadKeys());
+	const YubikoOtpKeyConfig *myKey = myOtherMan.getKeyByPublicId(myPubId);
+	ASSERT_NE(nullptr, myKey);
+	EXPECT_EQ(myToken.ctr, myKey->getCounter());
+	EXPECT_EQ(3, myKey->getUseCounter());
+	EXPECT_EQ(YubikoOtpKeyConfig::computeCrc(myKey->getToken()), myKey->getCrc());
+}
+
+TEST_P(TestKeyStore,readOnly) {
+	KeyManager myKeyMan(m_Settings, KeyManager::EReadOnly);
+	ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+	YubikoOtpKeyConfig myKey { myKeyMan.getKey(0) };
+	EXPECT_THROW(myKey.save(), std::logic_error);
+	EXPECT_THROW(myKeyMan.getKeyStore().erase(myKey), std::logic_error);
+	EXPECT_THROW(myKeyMan.getKeyStore().saveCounters(myKey), std::logic_error);
+}
+
+/// Keys are loaded on first use, the journaled counters survive a reload and end up in the store.
+TEST_P(TestKeyStore,lazyKeys) {
+	const string myPubId { getSyntheticPublicId(7) };
+	{
+		KeyManager myKeyMan(m_Settings);
+		ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+		YubikoOtpKeyConfig myEdited { *myKeyMan.getKeyByPublicId(getSyntheticPublicId(3)) };
+		myEdited.setDescription("edited");
+		myEdited.save();
+	}
+	m_Settings.getLazyKeys() = true;
+	yubikey_token_st myToken;
+	{
+		KeyManager myKeyMan(m_Settings);
+		ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+		const KeyManager::KeyIndexPtr_t myIndex = myKeyMan.getIndex();
+		ASSERT_TRUE(bool(myIndex->m_Lazy));
+		EXPECT_TRUE(myIndex->m_KeyList.empty());
+		EXPECT_EQ(0U, myIndex->m_Lazy->getLoadedCount());
+		EXPECT_EQ(K_KEYS, myKeyMan.getKeyCount());
+		EXPECT_EQ(nullptr, myKeyMan.getKeyByPublicId(getSyntheticPublicId(K_KEYS)));
+		YubikoOtpKeyConfig *myKey = myKeyMan.getKeyByPublicId(myPubId);
+		ASSERT_NE(nullptr, myKey);
+		EXPECT_EQ(myKey, myKeyMan.getKeyByPublicId(myPubId));
+		EXPECT_EQ(1U, myIndex->m_Lazy->getLoadedCount());
+		EXPECT_TRUE(*myKey == *myKeyMan.getKeyStore().get(myPubId));
+		EXPECT_EQ("edited", myKeyMan.getKeyByPublicId(getSyntheticPublicId(3))->getDescription());
+		EXPECT_TRUE(myKeyMan.withLockedKey(myPubId, [&myKeyMan, &myToken](YubikoOtpKeyConfig &pKey) {
+			myToken = pKey.getToken();
+			myToken.ctr += 2;
+			myToken.use = 5;
+			ASSERT_TRUE(pKey.advanceCounters(myToken));
+			myKeyMan.journalCounters(pKey);
+		}));
+		ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+		EXPECT_EQ(myToken.ctr, myKeyMan.getKeyByPublicId(myPubId)->getCounter());
+		const KeyManager::KeyIndexPtr_t myLoaded = myKeyMan.getLoadedIndex();
+		ASSERT_EQ(K_KEYS, myLoaded->m_KeyList.size());
+		for (size_t myI = 1; myI < K_KEYS; ++myI) {
+			EXPECT_LT(myLoaded->m_KeyList[myI - 1]->getPublicId(), myLoaded->m_KeyList[myI]->getPublicId());
+			EXPECT_EQ(myLoaded->m_KeyList[myI].get(), &myKeyMan.getKey(myI));
+		}
+		EXPECT_EQ(myKeyMan.getKeyByPublicId(myPubId), myLoaded->getKeyByPublicId(::trihlav::PublicId(myPubId)));
+		EXPECT_EQ(K_KEYS, myKeyMan.getIndex()->m_Lazy->getLoadedCount());
+	}
+	m_Settings.getLazyKeys() = false;
+	KeyManager myKeyMan(m_Settings);
+	ASSERT_EQ(K_KEYS, myKeyMan.loadKeys());
+	EXPECT_EQ(myToken.ctr, myKeyMan.getKeyByPublicId(myPubId)->getCounter());
+	EXPECT_EQ(5, myKeyMan.getKeyByPublicId(myPubId)->getUseCounter());
+}
+
+/// Only SQLite refuses a second key with the same public ID, the others shadow one of them.
+TEST_P(TestKeyStore,duplicatePublicId) {
+	if (GetParam() != Settings::ESqlite) {
+		return;
+	}
+	KeyManager myKeyMan(m_Settings);
+	YubikoOtpKeyConfig myKey(myKeyMan);
+	::trihlav::setSyntheticKey(myKey, 5);
+	EXPECT_THROW(myKey.save(), std::runtime_error);
+	EXPECT_EQ(K_KEYS, myKeyMan.loadKeys());
+}
+
+/// Many key files on several threads, in subdirectories, with a damaged one and a duplicate.
+TEST(TestJsonDirKeyStore,parallelLoad) {
+	static constexpr size_t K_MANY_KEYS = 1000;
+	Settings mySettings(unique_path("/tmp/trihlav-tst-%%%%-%%%%-%%%%-%%%%"));
+	mySettings.getLoadThreads() = 4;
+	KeyManager myKeyMan(mySettings);
+	::trihlav::createSyntheticKeys(myKeyMan, K_MANY_KEYS);
+	const path mySubDir = mySettings.getConfigDir() / "sub";
+	create_directory(mySubDir);
+	const path myMoved = myKeyMan.getKeyStore().get(getSyntheticPublicId(9))->getFilename();
+	rename(myMoved, mySubDir / myMoved.filename());
+	YubikoOtpKeyConfig myDuplicate(myKeyMan, mySubDir / "zz-zz-zz.trihlav-key.json");
+	::trihlav::setSyntheticKey(myDuplicate, 7);
+	myDuplicate.save();
+	const path myDamaged = mySettings.getConfigDir() / "00-00-00.trihlav-key.json";
+	std::ofstream(myDamaged.string()) << "{ broken";
+	EXPECT_EQ(K_MANY_KEYS + 1, myKeyMan.loadKeys());
+	EXPECT_FALSE(exists(myDamaged));
+	EXPECT_TRUE(exists(mySettings.getConfigDir() / "damaged-00-00-00.trihlav-key.json"));
+	const KeyManager::KeyIndexPtr_t myIndex = myKeyMan.getIndex();
+	for (size_t myI = 1; myI < myIndex->m_KeyList.size(); ++myI) {
+		EXPECT_LE(myIndex->m_KeyList[myI - 1]->getPublicId(), myIndex->m_KeyList[myI]->getPublicId());
+	}
+	for (size_t myNr = 0; myNr < K_MANY_KEYS; ++myNr) {
+		EXPECT_NE(nullptr, myKeyMan.getKeyByPublicId(getSyntheticPublicId(myNr)));
+	}
+	EXPECT_TRUE(JsonDirKeyStore::isKeyFilename(path("/x/0a-b1-zz.trihlav-key.json")));
+	EXPECT_FALSE(JsonDirKeyStore::isKeyFilename(path("0a-b1-zz.trihlav-key.json.tmp")));
+	EXPECT_FALSE(JsonDirKeyStore::isKeyFilename(path("0A-b1-zz.trihlav-key.json")));
+	EXPECT_FALSE(JsonDirKeyStore::isKeyFilename(path("deleted-0a-b1-zz.trihlav-key.json")));
+	remove_all(mySettings.getConfigDir());
+}
+
+/// A lazy key which failed to load is not remembered as unknown, it loads on the next look up.
+TEST(TestJsonDirKeyStore,lazyLoadRetried) {
+	Settings mySettings(unique_path("/tmp/trihlav-tst-%%%%-%%%%-%%%%-%%%%"));
+	const string myPubId { getSyntheticPublicId(4) };
+	path myFilename;
+	{
+		KeyManager myKeyMan(mySettings);
+		::trihlav::createSyntheticKeys(myKeyMan, 8);
+		myFilename = myKeyMan.getKeyStore().get(myPubId)->getFilename();
+	}
+	mySettings.getLazyKeys() = true;
+	KeyManager myKeyMan(mySettings);
+	ASSERT_EQ(8U, myKeyMan.loadKeys());
+	const path myMoved = mySettings.getConfigDir() / "moved.json";
+	rename(myFilename, myMoved);
+	EXPECT_EQ(nullptr, myKeyMan.getKeyByPublicId(myPubId));
+	rename(myMoved, myFilename);
+	const YubikoOtpKeyConfig *myKey = myKeyMan.getKeyByPublicId(myPubId);
+	ASSERT_NE(nullptr, myKey);
+	EXPECT_EQ(myPubId, myKey->getPublicId());
+	EXPECT_EQ(1U, myKeyMan.getIndex()->m_Lazy->getLoadedCount());
+	remove_all(mySettings.getConfigDir());
+}
+
+INSTANTIATE_TEST_CASE_P(AllKeyStores, TestKeyStore,
+		::testing::Values(Settings::EJsonDir, Settings::EMmapFile, Settings::ESqlite));
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
@@ -0,0 +1,138 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <thread>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/attributes.hpp>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"  // Brings in Google Mock.
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavMetrics.hpp"
+
+using std::string;
+using std::vector;
+using ::trihlav::initLog;
+using ::trihlav::Counter;
+using ::trihlav::Gauge;
+using ::trihlav::Histogram;
+using ::trihlav::Metrics;
+
+TEST(TestMetrics,histogramBuckets) {
+	BOOST_LOG_NAMED_SCOPE("TestMetrics::histogramBuckets");
+	for (uint64_t myNs = 0; myNs < 8; ++myNs) {
+		EXPECT_EQ(myNs, Histogram::getBucket(myNs));
+	}
+	// Every bucket starts where the previous one ended, within 12.5%.
+	for (size_t myB = 1; myB < Histogram::K_BUCKETS; ++myB) {
+		const uint64_t myLow = Histogram::getLowerBound(myB);
+		EXPECT_LT(Histogram::getLowerBound(myB - 1), myLow);
+		EXPECT_EQ(myB, Histogram::getBucket(myLow));
+		EXPECT_EQ(myB - 1, Histogram::getBucket(myLow - 1));
+		if (myLow >= 8) {
+			EXPECT_LE((Histogram::getLowerBound(myB + 1) - myLow) * 8, myLow);
+		}
+	}
+	EXPECT_EQ(Histogram::K_BUCKETS - 1, Histogram::getBucket(~uint64_t(0)));
+}
+
+TEST(TestMetrics,histogramQuantiles) {
+	BOOST_LOG_NAMED_SCOPE("TestMetrics::histogramQuantiles");
+	Histogram myHist;
+	for (uint64_t myNs = 1; myNs <= 1000; ++myNs) {
+		myHist.record(myNs * 1000);
+	}
+	const Histogram::Snapshot mySnap = myHist.getSnapshot();
+	EXPECT_EQ(1000U, mySnap.m_Count);
+	EXPECT_EQ(500500000U, mySnap.m_SumNs);
+	const uint64_t myMedian = mySnap.getQuantileNs(0.5);
+	EXPECT_LE(500000U, myMedian);
+	EXPECT_GE(500000U * 9 / 8, myMedian);
+	const uint64_t myP99 = mySnap.getQuantileNs(0.99);
+	EXPECT_LE(990000U, myP99);
+	EXPECT_GE(990000U * 9 / 8, myP99);
+	// 1000 * 1000 ns < 2^20 ns, only 1000 ns < 2^10 ns
+	EXPECT_EQ(1000U, mySnap.getCountBelowPow2(20));
+	EXPECT_EQ(1U, mySnap.getCountBelowPow2(10));
+}
+
+TEST(TestMetrics,shardsMerge) {
+	BOOST_LOG_NAMED_SCOPE("TestMetrics::shardsMerge");
+	const int K_THREADS = 8;
+	Counter myCounter;
+	Histogram myHist;
+	vector<std::thread> myThreads;
+	for (int myT = 0; myT < K_THREADS; ++myT) {
+		myThreads.emplace_back([&myCounter, &myHist]() {
+			for (int myI = 0; myI < 10000; ++myI) {
+				myCounter.inc();
+				myHist.record(uint64_t(myI));
+			}
+		});
+	}
+	for (auto &myThread : myThreads) {
+		myThread.join();
+	}
+	EXPECT_EQ(uint64_t(K_THREADS) * 10000, myCounter.getValue());
+	EXPECT_EQ(uint64_t(K_THREADS) * 10000, myHist.getSnapshot().m_Count);
+}
+
+TEST(TestMetrics,prometheusText) {
+	BOOST_LOG_NAMED_SCOPE("TestMetrics::prometheusText");
+	Metrics myMetrics;
+	myMetrics.getCounter("test_requests_total", "Requests.", "status=\"ok\"").inc(3);
+	myMetrics.getCounter("test_requests_total", "Requests.", "status=\"fail\"").inc();
+	EXPECT_EQ(3U, myMetrics.getCounter("test_requests_total", "Requests.", "status=\"ok\"").getValue());
+	myMetrics.getGauge("test_keys", "Keys.").set(42);
+	myMetrics.getHistogram("test_seconds", "Latency.").record(uint64_t(1500));
+	EXPECT_THROW(myMetrics.getGauge("test_requests_total", "Requests."), std::invalid_argument);
+	std::ostringstream myOut;
+	myMetrics.writePrometheus(myOut);
+	const string myText = myOut.str();
+	EXPECT_NE(string::npos, myText.find("# TYPE test_requests_total counter\n"));
+	EXPECT_NE(string::npos, myText.find("test_requests_total{status=\"ok\"} 3\n"));
+	EXPECT_NE(string::npos, myText.find("test_requests_total{status=\"fail\"} 1\n"));
+	EXPECT_NE(string::npos, myText.find("# TYPE test_keys gauge\ntest_keys 42\n"));
+	EXPECT_NE(string::npos, myText.find("test_seconds_bucket{le=\"1.024e-06\"} 0\n"));
+	EXPECT_NE(string::npos, myText.find("test_seconds_bucket{le=\"2.048e-06\"} 1\n"));
+	EXPECT_NE(string::npos, myText.find("test_seconds_bucket{le=\"+Inf\"} 1\n"));
+	EXPECT_NE(string::npos, myText.find("test_seconds_sum 1.5e-06\n"));
+	EXPECT_NE(string::npos, myText.find("test_seconds_count 1\n"));
+}
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
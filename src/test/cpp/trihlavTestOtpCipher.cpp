@@ -0,0 +1,134 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <random>
+#include <yubikey.h>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/attributes.hpp>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"  // Brings in Google Mock.
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavOtpCipher.hpp"
+#include "trihlavLib/trihlavCrc16.hpp"
+
+using std::string;
+using std::vector;
+using ::trihlav::initLog;
+using ::trihlav::OtpCipher;
+using ::trihlav::crc16;
+
+class TestOtpCipher: public ::testing::Test {
+public:
+	TestOtpCipher() :
+			m_Rnd(4711) {
+	}
+
+	void fillRandom(uint8_t *pBuf, size_t pLen) {
+		for (size_t myI = 0; myI < pLen; ++myI) {
+			pBuf[myI] = static_cast<uint8_t>(m_Rnd());
+		}
+	}
+
+	std::mt19937 m_Rnd;
+};
+
+TEST_F(TestOtpCipher,decryptSameAsLibyubikey) {
+	BOOST_LOG_NAMED_SCOPE("TestOtpCipher::decryptSameAsLibyubikey");
+	BOOST_LOG_TRIVIAL(info) << "AES-NI available: " << OtpCipher::hasAesNi();
+	for (int myRound = 0; myRound < 200; ++myRound) {
+		uint8_t myKey[YUBIKEY_KEY_SIZE];
+		uint8_t myExpected[YUBIKEY_BLOCK_SIZE];
+		fillRandom(myKey, sizeof(myKey));
+		fillRandom(myExpected, sizeof(myExpected));
+		uint8_t myPortable[YUBIKEY_BLOCK_SIZE];
+		uint8_t myAuto[YUBIKEY_BLOCK_SIZE];
+		memcpy(myPortable, myExpected, sizeof(myExpected));
+		memcpy(myAuto, myExpected, sizeof(myExpected));
+		yubikey_aes_decrypt(myExpected, myKey);
+		OtpCipher(myKey, OtpCipher::EPortable).decrypt(myPortable);
+		OtpCipher(myKey).decrypt(myAuto);
+		ASSERT_EQ(0, memcmp(myExpected, myPortable, sizeof(myExpected)));
+		ASSERT_EQ(0, memcmp(myExpected, myAuto, sizeof(myExpected)));
+	}
+}
+
+TEST_F(TestOtpCipher,parseBatchSameAsParse) {
+	BOOST_LOG_NAMED_SCOPE("TestOtpCipher::parseBatchSameAsParse");
+	const size_t K_OTPS = 11;
+	vector<OtpCipher> myCiphers;
+	vector<string> myOtps;
+	vector<yubikey_token_st> myExpected(K_OTPS);
+	for (size_t myI = 0; myI < K_OTPS; ++myI) {
+		uint8_t myKey[YUBIKEY_KEY_SIZE];
+		fillRandom(myKey, sizeof(myKey));
+		// Mix both implementations, the batch has to handle it.
+		myCiphers.emplace_back(myKey, myI == 5 ? OtpCipher::EPortable : OtpCipher::EAuto);
+		yubikey_token_st myTkn;
+		fillRandom(reinterpret_cast<uint8_t *>(&myTkn), sizeof(myTkn));
+		string myOtp(YUBIKEY_OTP_SIZE + 1, '\0');
+		yubikey_generate(&myTkn, myKey, &myOtp[0]);
+		myOtp.resize(YUBIKEY_OTP_SIZE);
+		myOtps.push_back(myOtp);
+		yubikey_parse(reinterpret_cast<const uint8_t *>(myOtp.c_str()), myKey, &myExpected[myI]);
+	}
+	vector<const OtpCipher *> myCipherPtrs;
+	vector<const char *> myOtpPtrs;
+	for (size_t myI = 0; myI < K_OTPS; ++myI) {
+		myCipherPtrs.push_back(&myCiphers[myI]);
+		myOtpPtrs.push_back(myOtps[myI].c_str());
+	}
+	vector<yubikey_token_st> myTokens(K_OTPS);
+	OtpCipher::parseBatch(myCipherPtrs.data(), myOtpPtrs.data(), myTokens.data(), K_OTPS);
+	for (size_t myI = 0; myI < K_OTPS; ++myI) {
+		EXPECT_EQ(0, memcmp(&myExpected[myI], &myTokens[myI], sizeof(yubikey_token_st)));
+		yubikey_token_st mySingle;
+		myCiphers[myI].parse(myOtps[myI].c_str(), mySingle);
+		EXPECT_EQ(0, memcmp(&myExpected[myI], &mySingle, sizeof(yubikey_token_st)));
+	}
+}
+
+TEST_F(TestOtpCipher,crc16SameAsLibyubikey) {
+	BOOST_LOG_NAMED_SCOPE("TestOtpCipher::crc16SameAsLibyubikey");
+	uint8_t myBuf[64];
+	for (size_t myLen = 0; myLen <= sizeof(myBuf); ++myLen) {
+		fillRandom(myBuf, sizeof(myBuf));
+		EXPECT_EQ(yubikey_crc16(myBuf, myLen), crc16(myBuf, myLen));
+	}
+}
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
@@ -0,0 +1,333 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <yubikey.h>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/attributes.hpp>
+#include <boost/log/expressions.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"  // Brings in Google Mock.
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavSettings.hpp"
+#include "trihlavLib/trihlavKeyManager.hpp"
+#include "trihlavLib/trihlavYubikoOtpKeyConfig.hpp"
+#include "trihlavLib/trihlavOtpValidator.hpp"
+#include "trihlavLib/trihlavRecentOtpCache.hpp"
+#include "trihlavLib/trihlavRateLimiter.hpp"
+
+#include "trihlavTestCommonUtils.hpp"
+
+using std::string;
+using std::vector;
+using std::atomic;
+using ::trihlav::initLog;
+using ::trihlav::Settings;
+using ::trihlav::KeyManager;
+using ::trihlav::YubikoOtpKeyConfig;
+using ::trihlav::OtpValidator;
+using ::trihlav::K_TST_PUBL0;
+using ::trihlav::K_TST_PRIV0;
+using ::trihlav::K_TST_SECU0;
+using ::boost::format;
+using ::boost::filesystem::path;
+using ::boost::filesystem::unique_path;
+
+class TestOtpValidator: public ::testing::Test {
+public:
+	TestOtpValidator() :
+			m_Settings(makeSettings()), //
+			m_KeyMan(m_Settings), //
+			m_Validator(m_KeyMan) {
+	}
+
+	virtual void SetUp() {
+		BOOST_LOG_NAMED_SCOPE("TestOtpValidator::SetUp");
+		trihlav::createYubikoOtpKeyConfig(m_KeyMan);
+		EXPECT_EQ(1, m_KeyMan.loadKeys());
+	}
+
+	// Tears down the test fixture.
+	virtual void TearDown() {
+		BOOST_LOG_NAMED_SCOPE("TestOtpValidator::TearDown");
+		remove_all(m_Settings.getConfigDir());
+	}
+
+	/// The throughput tests validate far more passwords than a person would.
+	static Settings makeSettings() {
+		Settings myRetVal(unique_path("/tmp/trihlav-tst-%%%%-%%%%-%%%%-%%%%"));
+		myRetVal.getKeyRatePerMin() = 0;
+		return myRetVal;
+	}
+
+	/// @return next valid OTP with public ID prefix.
+	const string nextOtp() {
+		YubikoOtpKeyConfig* myKey = m_KeyMan.getKeyByPublicId(K_TST_PUBL0);
+		EXPECT_NE(nullptr, myKey);
+		return myKey->getPublicId() + myKey->generateOtp();
+	}
+
+	/// @return OTP with the use counter pUseInc ahead of the stored one.
+	static const string makeOtp(const YubikoOtpKeyConfig &pKey, const int pUseInc) {
+		string myOtp(YUBIKEY_OTP_SIZE + 1, '.');
+		yubikey_token_st myTkn { pKey.getToken() };
+		myTkn.use = uint8_t(myTkn.use + pUseInc);
+		myTkn.tstpl = uint16_t(myTkn.tstpl + pUseInc);
+		myTkn.crc = YubikoOtpKeyConfig::computeCrc(myTkn);
+		yubikey_generate(&myTkn, pKey.getSecretKeyArray().data(), &myOtp[0]);
+		myOtp.resize(YUBIKEY_OTP_SIZE);
+		return pKey.getPublicId() + myOtp;
+	}
+
+	Settings m_Settings;
+	KeyManager m_KeyMan;
+	OtpValidator m_Validator;
+};
+
+TEST_F(TestOtpValidator,acceptOnce) {
+	BOOST_LOG_NAMED_SCOPE("TestOtpValidator::acceptOnce");
+	const string myOtp0 { nextOtp() };
+	EXPECT_EQ(OtpValidator::EOk, m_Validator.validate(myOtp0));
+	EXPECT_EQ(OtpValidator::EReplayed, m_Validator.validate(myOtp0));
+	const string myOtp1 { nextOtp() };
+	EXPECT_NE(myOtp0, myOtp1);
+	EXPECT_EQ(OtpValidator::EOk, m_Validator.validate(myOtp1));
+	EXPECT_EQ(OtpValidator::EReplayed, m_Validator.validate(myOtp0));
+}
+
+TEST_F(TestOtpValidator,rejectMalformed) {
+	BOOST_LOG_NAMED_SCOPE("TestOtpValidator::rejectMalformed");
+	const string myOtp { nextOtp() };
+	const string myToken { myOtp.substr(myOtp.size() - YUBIKEY_OTP_SIZE) };
+	EXPECT_EQ(OtpValidator::ETooShort, m_Validator.validate(""));
+	EXPECT_EQ(OtpValidator::ETooShort, m_Validator.validate(myToken.substr(1)));
+	EXPECT_EQ(OtpValidator::ENoPublicId, m_Validator.validate(myToken));
+	EXPECT_EQ(OtpValidator::EUnknownKey, m_Validator.validate("vvvvvvvvvvvv" + myToken));
+	EXPECT_EQ(OtpValidator::EUnknownKey, m_Validator.validate("vvvvvvvvvvvv" + myToken));
+	EXPECT_EQ(2U, m_KeyMan.getUnknownIds().getMissCount());
+	EXPECT_EQ(1U, m_KeyMan.getUnknownIds().getDistinctCount());
+	string myWrong { myOtp };
+	myWrong[myWrong.size() - 1] = myWrong[myWrong.size() - 1] == 'c' ? 'b' : 'c';
+	EXPECT_EQ(OtpValidator::EInvalid, m_Validator.validate(myWrong));
+	EXPECT_EQ(OtpValidator::EOk, m_Validator.validate(myOtp));
+	EXPECT_EQ("ok", OtpValidator::getStatusStr(OtpValidator::EOk));
+}
+
+TEST_F(TestOtpValidator,checkSysUser) {
+	BOOST_LOG_NAMED_SCOPE("TestOtpValidator::checkSysUser");
+	m_KeyMan.getKeyByPublicId(K_TST_PUBL0)->setSysUser("trihlav_tst_usr0");
+	const string myOtp { nextOtp() };
+	EXPECT_EQ(OtpValidator::EWrongUser, m_Validator.validate(myOtp, "trihlav_tst_usr1"));
+	EXPECT_EQ(OtpValidator::EOk, m_Validator.validate(myOtp, "trihlav_tst_usr0"));
+}
+
+TEST_F(TestOtpValidator,noDoubleAcceptConcurrently) {
+	BOOST_LOG_NAMED_SCOPE("TestOtpValidator::noDoubleAcceptConcurrently");
+	const int K_THREADS = 8;
+	const int K_OTPS = 32;
+	YubikoOtpKeyConfig* myKey = m_KeyMan.getKeyByPublicId(K_TST_PUBL0);
+	ASSERT_NE(nullptr, myKey);
+	vector<string> myOtps;
+	for (int myI = 1; myI <= K_OTPS; ++myI) {
+		myOtps.push_back(makeOtp(*myKey, myI));
+	}
+	vector<atomic<int> > myAccepted(K_OTPS);
+	for (auto &myCnt : myAccepted) {
+		myCnt = 0;
+	}
+	vector<std::thread> myThreads;
+	for (int myT = 0; myT < K_THREADS; ++myT) {
+		myThreads.emplace_back([this, &myOtps, &myAccepted]() {
+			for (size_t myI = 0; myI < myOtps.size(); ++myI) {
+				if (m_Validator.validate(myOtps[myI]) == OtpValidator::EOk) {
+					++myAccepted[myI];
+				}
+			}
+		});
+	}
+	for (auto &myThread : myThreads) {
+		myThread.join();
+	}
+	int myTotal = 0;
+	for (int myI = 0; myI < K_OTPS; ++myI) {
+		EXPECT_GE(1, myAccepted[myI]) << "OTP " << myI << " accepted more than once.";
+		myTotal += myAccepted[myI];
+	}
+	EXPECT_LE(1, myTotal);
+	for (const string &myOtp : myOtps) {
+		EXPECT_EQ(OtpValidator::EReplayed, m_Validator.validate(myOtp));
+	}
+}
+
+TEST_F(TestOtpValidator,independentKeysInParallel) {
+	BOOST_LOG_NAMED_SCOPE("TestOtpValidator::independentKeysInParallel");
+	const int K_KEYS = 8;
+	const int K_OTPS = 32;
+	vector<string> myPubIds;
+	for (int myK = 0; myK < K_KEYS; ++myK) {
+		YubikoOtpKeyConfig myCfg(m_KeyMan);
+		myCfg.setPrivateId(K_TST_PRIV0);
+		myCfg.setPublicId(str(format("vvvvvvvvvv%02d") % myK));
+		myCfg.setSecretKey(K_TST_SECU0);
+		myCfg.save();
+		myPubIds.push_back(myCfg.getPublicId());
+	}
+	EXPECT_EQ(K_KEYS + 1, m_KeyMan.loadKeys());
+	atomic<int> myAccepted(0);
+	vector<std::thread> myThreads;
+	for (const string &myPubId : myPubIds) {
+		const YubikoOtpKeyConfig* myKey = m_KeyMan.getKeyByPublicId(myPubId);
+		ASSERT_NE(nullptr, myKey);
+		vector<string> myOtps;
+		for (int myI = 1; myI <= K_OTPS; ++myI) {
+			myOtps.push_back(makeOtp(*myKey, myI));
+		}
+		myThreads.emplace_back([this, myOtps, &myAccepted]() {
+			for (const string &myOtp : myOtps) {
+				if (m_Validator.validate(myOtp) == OtpValidator::EOk) {
+					++myAccepted;
+				}
+			}
+		});
+	}
+	for (auto &myThread : myThreads) {
+		myThread.join();
+	}
+	EXPECT_EQ(K_KEYS * K_OTPS, myAccepted);
+}
+
+TEST_F(TestOtpValidator,validateWhileReloading) {
+	BOOST_LOG_NAMED_SCOPE("TestOtpValidator::validateWhileReloading");
+	const int K_OTPS = 64;
+	vector<string> myOtps;
+	{
+		YubikoOtpKeyConfig* myKey = m_KeyMan.getKeyByPublicId(K_TST_PUBL0);
+		ASSERT_NE(nullptr, myKey);
+		for (int myI = 1; myI <= K_OTPS; ++myI) {
+			myOtps.push_back(makeOtp(*myKey, myI));
+		}
+	}
+	atomic<bool> myDone(false);
+	std::thread myReloader([this, &myDone]() {
+		while (!myDone) {
+			EXPECT_EQ(1, m_KeyMan.loadKeys());
+		}
+	});
+	for (const string &myOtp : myOtps) {
+		EXPECT_EQ(OtpValidator::EOk, m_Validator.validate(myOtp));
+	}
+	myDone = true;
+	myReloader.join();
+	EXPECT_EQ(1, m_KeyMan.loadKeys());
+	for (const string &myOtp : myOtps) {
+		EXPECT_EQ(OtpValidator::EReplayed, m_Validator.validate(myOtp));
+	}
+}
+
+TEST_F(TestOtpValidator,validateBatch) {
+	BOOST_LOG_NAMED_SCOPE("TestOtpValidator::validateBatch");
+	YubikoOtpKeyConfig* myKey = m_KeyMan.getKeyByPublicId(K_TST_PUBL0);
+	ASSERT_NE(nullptr, myKey);
+	vector<string> myOtps;
+	for (int myI = 1; myI <= 6; ++myI) {
+		myOtps.push_back(makeOtp(*myKey, myI));
+	}
+	myOtps.push_back(myOtps[2]);
+	myOtps.push_back("short");
+	myOtps.push_back("vvvvvvvvvvvv" + myOtps[0].substr(myOtps[0].size() - YUBIKEY_OTP_SIZE));
+	const vector<OtpValidator::EStatus> myStatus = m_Validator.validateBatch(myOtps);
+	ASSERT_EQ(myOtps.size(), myStatus.size());
+	for (int myI = 0; myI < 6; ++myI) {
+		EXPECT_EQ(OtpValidator::EOk, myStatus[myI]);
+	}
+	EXPECT_EQ(OtpValidator::EReplayed, myStatus[6]);
+	EXPECT_EQ(OtpValidator::ETooShort, myStatus[7]);
+	EXPECT_EQ(OtpValidator::EUnknownKey, myStatus[8]);
+	EXPECT_EQ(OtpValidator::EReplayed, m_Validator.validate(myOtps[5]));
+}
+
+TEST_F(TestOtpValidator,retryWithNonce) {
+	BOOST_LOG_NAMED_SCOPE("TestOtpValidator::retryWithNonce");
+	const string myOtp { nextOtp() };
+	EXPECT_EQ(OtpValidator::EOk, m_Validator.validate(myOtp, "", "n0nce", "192.0.2.1"));
+	EXPECT_EQ(OtpValidator::EOk, m_Validator.validate(myOtp, "", "n0nce", "192.0.2.1"));
+	EXPECT_EQ(OtpValidator::EReplayed, m_Validator.validate(myOtp, "", "n0nce", "198.51.100.7"));
+	EXPECT_EQ(OtpValidator::EReplayed, m_Validator.validate(myOtp, "", "other", "192.0.2.1"));
+	EXPECT_EQ(OtpValidator::EReplayed, m_Validator.validate(myOtp));
+	EXPECT_EQ(OtpValidator::EReplayed, m_Validator.validate(myOtp, "somebody", "n0nce", "192.0.2.1"));
+	const vector<OtpValidator::EStatus> myStatus = m_Validator.validateBatch( { myOtp });
+	EXPECT_EQ(OtpValidator::EReplayed, myStatus[0]);
+	EXPECT_EQ(6U, m_Validator.getRecentOtps().getHitCount());
+}
+
+TEST_F(TestOtpValidator,rateLimited) {
+	BOOST_LOG_NAMED_SCOPE("TestOtpValidator::rateLimited");
+	m_Settings.getKeyRatePerMin() = 1;
+	m_Settings.getKeyBurst() = 3;
+	m_Settings.getClientRatePerMin() = 1;
+	m_Settings.getClientBurst() = 2;
+	OtpValidator myValidator(m_KeyMan);
+	YubikoOtpKeyConfig* myKey = m_KeyMan.getKeyByPublicId(K_TST_PUBL0);
+	ASSERT_NE(nullptr, myKey);
+	vector<string> myOtps;
+	for (int myI = 1; myI <= 4; ++myI) {
+		myOtps.push_back(makeOtp(*myKey, myI));
+	}
+	for (int myI = 0; myI < 3; ++myI) {
+		EXPECT_EQ(OtpValidator::EOk, myValidator.validate(myOtps[myI]));
+	}
+	EXPECT_EQ(OtpValidator::ERateLimited, myValidator.validate(myOtps[3]));
+	EXPECT_EQ(OtpValidator::EReplayed, myValidator.validate(myOtps[0]));
+	EXPECT_EQ(OtpValidator::EUnknownKey,
+			myValidator.validate("vvvvvvvvvvvv" + myOtps[3].substr(myOtps[3].size() - YUBIKEY_OTP_SIZE)));
+	EXPECT_EQ(1U, myValidator.getKeyLimiter().getLimitedCount());
+	EXPECT_EQ("rate-limited", OtpValidator::getStatusStr(OtpValidator::ERateLimited));
+
+	EXPECT_TRUE(myValidator.admitClient("192.0.2.1"));
+	EXPECT_TRUE(myValidator.admitClient("192.0.2.1"));
+	EXPECT_FALSE(myValidator.admitClient("192.0.2.1"));
+	EXPECT_TRUE(myValidator.admitClient("192.0.2.2"));
+	EXPECT_EQ(1U, myValidator.getClientLimiter().getLimitedCount());
+}
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
@@ -148,6 +148,7 @@ TEST_F(TestPswdChckPresenter, checkPassword) {
 	myMockFactory.getSettings().setConfigDir(myTestCfgFile);
 	KeyManager& myKeyMan(myMockFactory.getKeyManager());
 	YubikoOtpKeyConfig myCfg0{createYubikoOtpKeyConfig(myKeyMan)};
+	EXPECT_EQ(1, myKeyMan.loadKeys());
 	string myOtp0(YUBIKEY_OTP_SIZE + 1, '\0');
 	yubikey_token_st myTkn { myCfg0.getToken() };
 	myTkn.use++;
@@ -0,0 +1,122 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <boost/format.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/attributes.hpp>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"  // Brings in Google Mock.
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavPublicId.hpp"
+#include "trihlavLib/trihlavPublicIdIndex.hpp"
+
+using std::string;
+using std::vector;
+using boost::format;
+using ::trihlav::initLog;
+using ::trihlav::PublicId;
+using ::trihlav::PublicIdIndex;
+using ::trihlav::HotKey;
+
+/// Only the addresses are used, the keys are never dereferenced.
+static HotKey *fakeKey(size_t pIdx) {
+	return reinterpret_cast<HotKey *>(0x1000 + pIdx * 8);
+}
+
+TEST(TestPublicIdIndex,parsePublicId) {
+	BOOST_LOG_NAMED_SCOPE("TestPublicIdIndex::parsePublicId");
+	const PublicId myModhex("ccddccddccdd");
+	EXPECT_TRUE(myModhex.isValid());
+	EXPECT_EQ("ccddccddccdd", myModhex.toString());
+	EXPECT_EQ(myModhex, PublicId("ccddccddccddvvvv", 12));
+	EXPECT_NE(myModhex, PublicId("ccddccddccde"));
+	const PublicId myRaw("vvvvvvvvvv00");
+	EXPECT_TRUE(myRaw.isValid());
+	EXPECT_EQ("vvvvvvvvvv00", myRaw.toString());
+	EXPECT_NE(PublicId("cc"), PublicId("\0", 1));
+	EXPECT_TRUE(PublicId().isEmpty());
+	EXPECT_TRUE(PublicId(string(32, 'c')).isValid());
+	EXPECT_FALSE(PublicId(string(33, 'c')).isValid());
+	EXPECT_FALSE(PublicId(string(17, 'x')).isValid());
+}
+
+TEST(TestPublicIdIndex,findByOtp) {
+	BOOST_LOG_NAMED_SCOPE("TestPublicIdIndex::findByOtp");
+	PublicIdIndex myIndex;
+	EXPECT_EQ(nullptr, myIndex.findByOtp(string(44, 'c')));
+	EXPECT_TRUE(myIndex.insert(PublicId("ccddccddccdd"), fakeKey(0)));
+	EXPECT_TRUE(myIndex.insert(PublicId("vvcc"), fakeKey(1)));
+	EXPECT_TRUE(myIndex.insert(PublicId("123456"), fakeKey(2)));
+	EXPECT_FALSE(myIndex.insert(PublicId("vvcc"), fakeKey(3)));
+	EXPECT_FALSE(myIndex.insert(PublicId(), fakeKey(3)));
+	const string myOtp(YUBIKEY_OTP_SIZE, 'b');
+	EXPECT_EQ(fakeKey(0), myIndex.findByOtp("ccddccddccdd" + myOtp));
+	EXPECT_EQ(fakeKey(1), myIndex.findByOtp("vvcc" + myOtp));
+	EXPECT_EQ(fakeKey(2), myIndex.findByOtp("123456" + myOtp));
+	EXPECT_EQ(nullptr, myIndex.findByOtp("vvc" + myOtp));
+	EXPECT_EQ(nullptr, myIndex.findByOtp(myOtp));
+	EXPECT_EQ(nullptr, myIndex.findByOtp("ccddccddccdd"));
+}
+
+TEST(TestPublicIdIndex,insertEraseMany) {
+	BOOST_LOG_NAMED_SCOPE("TestPublicIdIndex::insertEraseMany");
+	const size_t K_KEYS = 10000;
+	vector<PublicId> myIds;
+	PublicIdIndex myIndex;
+	for (size_t myI = 0; myI < K_KEYS; ++myI) {
+		myIds.emplace_back(PublicId(str(format("%08x") % myI)));
+		ASSERT_TRUE(myIndex.insert(myIds.back(), fakeKey(myI)));
+	}
+	EXPECT_EQ(K_KEYS, myIndex.size());
+	for (size_t myI = 0; myI < K_KEYS; myI += 3) {
+		EXPECT_TRUE(myIndex.erase(myIds[myI]));
+	}
+	EXPECT_FALSE(myIndex.erase(myIds[0]));
+	for (size_t myI = 0; myI < K_KEYS; ++myI) {
+		EXPECT_EQ(myI % 3 == 0 ? nullptr : fakeKey(myI), myIndex.find(myIds[myI]));
+	}
+	myIndex.assign(myIds[1], fakeKey(0));
+	EXPECT_EQ(fakeKey(0), myIndex.find(myIds[1]));
+	size_t myCount = 0;
+	myIndex.forEach([&myCount](const PublicId &, HotKey *) {
+		++myCount;
+	});
+	EXPECT_EQ(myIndex.size(), myCount);
+}
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
@@ -0,0 +1,165 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/attributes.hpp>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"  // Brings in Google Mock.
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavRateLimiter.hpp"
+
+using std::atomic;
+using std::vector;
+using std::chrono::seconds;
+using std::chrono::milliseconds;
+using ::trihlav::initLog;
+using ::trihlav::RateLimiter;
+
+TEST(TestRateLimiter,burstAndRefill) {
+	BOOST_LOG_NAMED_SCOPE("TestRateLimiter::burstAndRefill");
+	RateLimiter myLimiter(60, 5);
+	const RateLimiter::Clock_t::time_point myT0 = RateLimiter::Clock_t::now();
+	for (int myI = 0; myI < 5; ++myI) {
+		EXPECT_TRUE(myLimiter.tryTake(42, myT0));
+	}
+	EXPECT_FALSE(myLimiter.tryTake(42, myT0));
+	EXPECT_TRUE(myLimiter.tryTake(43, myT0));
+	// One token per second.
+	EXPECT_FALSE(myLimiter.tryTake(42, myT0 + milliseconds(999)));
+	EXPECT_TRUE(myLimiter.tryTake(42, myT0 + seconds(1)));
+	EXPECT_FALSE(myLimiter.tryTake(42, myT0 + seconds(1)));
+	EXPECT_EQ(7U, myLimiter.getAllowedCount());
+	EXPECT_EQ(3U, myLimiter.getLimitedCount());
+
+	RateLimiter myDisabled(0, 5);
+	EXPECT_FALSE(myDisabled.isEnabled());
+	for (int myI = 0; myI < 100; ++myI) {
+		EXPECT_TRUE(myDisabled.tryTake(42));
+	}
+}
+
+TEST(TestRateLimiter,idleBucketsExpire) {
+	BOOST_LOG_NAMED_SCOPE("TestRateLimiter::idleBucketsExpire");
+	RateLimiter myLimiter(60, 2);
+	const RateLimiter::Clock_t::time_point myT0 = RateLimiter::Clock_t::now();
+	for (uint64_t myKey = 1; myKey <= 1000; ++myKey) {
+		EXPECT_TRUE(myLimiter.tryTake(myKey * 0x9e3779b97f4a7c15ULL, myT0));
+	}
+	EXPECT_EQ(1000U, myLimiter.getBucketCount());
+	// The buckets are full again after 2s, a turn of the wheel frees them.
+	for (size_t myTick = 0; myTick <= RateLimiter::K_WHEEL_SPOKES; ++myTick) {
+		myLimiter.tryTake(1, myT0 + seconds(2) + milliseconds(myTick * 100));
+	}
+	EXPECT_GE(1U, myLimiter.getBucketCount());
+	EXPECT_EQ(0U, myLimiter.getOverflowCount());
+}
+
+TEST(TestRateLimiter,fullProbeEvictsIdle) {
+	BOOST_LOG_NAMED_SCOPE("TestRateLimiter::fullProbeEvictsIdle");
+	RateLimiter myLimiter(60, 2, 1, RateLimiter::EFailClosed);
+	EXPECT_EQ(RateLimiter::K_MIN_SLOTS, myLimiter.getSlotCount());
+	const RateLimiter::Clock_t::time_point myT0 = RateLimiter::Clock_t::now();
+	// All keys probe the same slots.
+	const uint64_t K_KEYS = RateLimiter::K_MAX_PROBE;
+	for (uint64_t myKey = 1; myKey <= K_KEYS; ++myKey) {
+		EXPECT_TRUE(myLimiter.tryTake(myKey * RateLimiter::K_MIN_SLOTS, myT0 + milliseconds(myKey)));
+	}
+	EXPECT_EQ(RateLimiter::K_MAX_PROBE, myLimiter.getBucketCount());
+	// No bucket is idle, a new key is rejected instead of taking one over.
+	EXPECT_FALSE(myLimiter.tryTake((K_KEYS + 1) * RateLimiter::K_MIN_SLOTS, myT0 + milliseconds(K_KEYS)));
+	EXPECT_EQ(0U, myLimiter.getEvictedCount());
+	EXPECT_EQ(1U, myLimiter.getOverflowCount());
+	// One token per second, the buckets of the first two keys are full again.
+	const RateLimiter::Clock_t::time_point myT1 = myT0 + milliseconds(1002);
+	EXPECT_TRUE(myLimiter.tryTake((K_KEYS + 1) * RateLimiter::K_MIN_SLOTS, myT1));
+	EXPECT_TRUE(myLimiter.tryTake((K_KEYS + 2) * RateLimiter::K_MIN_SLOTS, myT1));
+	EXPECT_EQ(2U, myLimiter.getEvictedCount());
+	EXPECT_FALSE(myLimiter.tryTake(RateLimiter::K_MIN_SLOTS, myT1));
+	EXPECT_EQ(2U, myLimiter.getOverflowCount());
+	// The newest key kept its bucket.
+	EXPECT_TRUE(myLimiter.tryTake(K_KEYS * RateLimiter::K_MIN_SLOTS, myT1));
+	EXPECT_FALSE(myLimiter.tryTake(K_KEYS * RateLimiter::K_MIN_SLOTS, myT1));
+	EXPECT_EQ(RateLimiter::K_MAX_PROBE, myLimiter.getBucketCount());
+}
+
+TEST(TestRateLimiter,concurrentTakes) {
+	BOOST_LOG_NAMED_SCOPE("TestRateLimiter::concurrentTakes");
+	const int K_THREADS = 8;
+	RateLimiter myLimiter(1, 100);
+	atomic<int> myAllowed(0);
+	vector<std::thread> myThreads;
+	for (int myT = 0; myT < K_THREADS; ++myT) {
+		myThreads.emplace_back([&myLimiter, &myAllowed]() {
+			for (int myI = 0; myI < 1000; ++myI) {
+				if (myLimiter.tryTake(7)) {
+					++myAllowed;
+				}
+			}
+		});
+	}
+	for (auto &myThread : myThreads) {
+		myThread.join();
+	}
+	// At most one token is refilled while the test runs.
+	EXPECT_LE(100, myAllowed);
+	EXPECT_GE(101, myAllowed);
+}
+
+/// Threads placing the same keys at once end up with one bucket per key.
+TEST(TestRateLimiter,concurrentNewKeys) {
+	BOOST_LOG_NAMED_SCOPE("TestRateLimiter::concurrentNewKeys");
+	const int K_THREADS = 8;
+	const uint64_t K_KEYS = 2000;
+	RateLimiter myLimiter(60, 100, 8192);
+	vector<std::thread> myThreads;
+	for (int myT = 0; myT < K_THREADS; ++myT) {
+		myThreads.emplace_back([&myLimiter, K_KEYS]() {
+			for (uint64_t myKey = 1; myKey <= K_KEYS; ++myKey) {
+				myLimiter.tryTake(myKey * 0x9e3779b97f4a7c15ULL);
+			}
+		});
+	}
+	for (auto &myThread : myThreads) {
+		myThread.join();
+	}
+	EXPECT_EQ(K_KEYS, myLimiter.getBucketCount());
+	EXPECT_EQ(K_KEYS * K_THREADS, myLimiter.getAllowedCount());
+}
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
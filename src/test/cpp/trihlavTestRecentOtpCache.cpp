@@ -0,0 +1,139 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/attributes.hpp>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"  // Brings in Google Mock.
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavRecentOtpCache.hpp"
+
+using std::string;
+using std::chrono::seconds;
+using ::trihlav::initLog;
+using ::trihlav::OtpValidator;
+using ::trihlav::RecentOtpCache;
+
+static const string K_OTP0("ccccccccccccdefghijklnrtuvcbdefghijklnrtuv");
+static const string K_OTP1("ccccccccccccvutrnlkjihgfedcbvutrnlkjihgfed");
+static const string K_CLIENT0("192.0.2.1");
+
+TEST(TestRecentOtpCache,nonceAndUser) {
+	BOOST_LOG_NAMED_SCOPE("TestRecentOtpCache::nonceAndUser");
+	RecentOtpCache myCache(100, seconds(60));
+	OtpValidator::EStatus myStatus = OtpValidator::EInvalid;
+	EXPECT_FALSE(myCache.lookup(K_OTP0, "n", "user", K_CLIENT0, myStatus));
+	myCache.insert(K_OTP0, "n", "user", K_CLIENT0, OtpValidator::EOk);
+	EXPECT_TRUE(myCache.lookup(K_OTP0, "n", "user", K_CLIENT0, myStatus));
+	EXPECT_EQ(OtpValidator::EOk, myStatus);
+	EXPECT_TRUE(myCache.lookup(K_OTP0, "m", "user", K_CLIENT0, myStatus));
+	EXPECT_EQ(OtpValidator::EReplayed, myStatus);
+	myStatus = OtpValidator::EOk;
+	EXPECT_TRUE(myCache.lookup(K_OTP0, "n", "other", K_CLIENT0, myStatus));
+	EXPECT_EQ(OtpValidator::EReplayed, myStatus);
+	myStatus = OtpValidator::EOk;
+	EXPECT_TRUE(myCache.lookup(K_OTP0, "", "user", K_CLIENT0, myStatus));
+	EXPECT_EQ(OtpValidator::EReplayed, myStatus);
+	// The first outcome is kept.
+	myCache.insert(K_OTP0, "m", "user", K_CLIENT0, OtpValidator::EReplayed);
+	EXPECT_TRUE(myCache.lookup(K_OTP0, "n", "user", K_CLIENT0, myStatus));
+	EXPECT_EQ(OtpValidator::EOk, myStatus);
+	// An empty nonce never matches.
+	myCache.insert(K_OTP1, "", "", K_CLIENT0, OtpValidator::EOk);
+	EXPECT_TRUE(myCache.lookup(K_OTP1, "", "", K_CLIENT0, myStatus));
+	EXPECT_EQ(OtpValidator::EReplayed, myStatus);
+	EXPECT_EQ(2U, myCache.size());
+	EXPECT_EQ(6U, myCache.getHitCount());
+}
+
+TEST(TestRecentOtpCache,expire) {
+	BOOST_LOG_NAMED_SCOPE("TestRecentOtpCache::expire");
+	RecentOtpCache myCache(100, seconds(60));
+	const RecentOtpCache::Clock_t::time_point myT0 = RecentOtpCache::Clock_t::now();
+	OtpValidator::EStatus myStatus = OtpValidator::EInvalid;
+	myCache.insert(K_OTP0, "n", "", K_CLIENT0, OtpValidator::EOk, myT0);
+	EXPECT_TRUE(myCache.lookup(K_OTP0, "n", "", K_CLIENT0, myStatus, myT0 + seconds(59)));
+	EXPECT_FALSE(myCache.lookup(K_OTP0, "n", "", K_CLIENT0, myStatus, myT0 + seconds(60)));
+	// Expired entries are replaced.
+	myCache.insert(K_OTP0, "m", "", K_CLIENT0, OtpValidator::EReplayed, myT0 + seconds(61));
+	EXPECT_TRUE(myCache.lookup(K_OTP0, "m", "", K_CLIENT0, myStatus, myT0 + seconds(62)));
+	EXPECT_EQ(OtpValidator::EReplayed, myStatus);
+	EXPECT_EQ(1U, myCache.size());
+	myCache.insert(K_OTP1, "", "", K_CLIENT0, OtpValidator::EOk, myT0 + seconds(200));
+	EXPECT_FALSE(myCache.lookup(K_OTP0, "m", "", K_CLIENT0, myStatus, myT0 + seconds(200)));
+}
+
+TEST(TestRecentOtpCache,bounded) {
+	BOOST_LOG_NAMED_SCOPE("TestRecentOtpCache::bounded");
+	RecentOtpCache myCache(10 * RecentOtpCache::K_SHARDS, seconds(60));
+	OtpValidator::EStatus myStatus = OtpValidator::EInvalid;
+	for (int myI = 0; myI < 10000; ++myI) {
+		myCache.insert(K_OTP0 + std::to_string(myI), "", "", K_CLIENT0, OtpValidator::EOk);
+	}
+	EXPECT_GE(10 * RecentOtpCache::K_SHARDS, myCache.size());
+	// The latest ones are remembered.
+	EXPECT_TRUE(myCache.lookup(K_OTP0 + "9999", "", "", K_CLIENT0, myStatus));
+	EXPECT_FALSE(myCache.lookup(K_OTP0 + "0", "", "", K_CLIENT0, myStatus));
+
+	RecentOtpCache myDisabled(0, seconds(60));
+	myDisabled.insert(K_OTP0, "", "", K_CLIENT0, OtpValidator::EOk);
+	EXPECT_FALSE(myDisabled.lookup(K_OTP0, "", "", K_CLIENT0, myStatus));
+	EXPECT_EQ(0U, myDisabled.size());
+}
+
+TEST(TestRecentOtpCache,retries) {
+	BOOST_LOG_NAMED_SCOPE("TestRecentOtpCache::retries");
+	RecentOtpCache myCache(100, seconds(300));
+	const RecentOtpCache::Clock_t::time_point myT0 = RecentOtpCache::Clock_t::now();
+	OtpValidator::EStatus myStatus = OtpValidator::EInvalid;
+	myCache.insert(K_OTP0, "n", "user", K_CLIENT0, OtpValidator::EOk, myT0);
+	myCache.insert(K_OTP1, "n", "user", K_CLIENT0, OtpValidator::EOk, myT0);
+	// A captured request sent from elsewhere is a replay.
+	EXPECT_TRUE(myCache.lookup(K_OTP0, "n", "user", "198.51.100.7", myStatus, myT0 + seconds(1)));
+	EXPECT_EQ(OtpValidator::EReplayed, myStatus);
+	for (unsigned myI = 0; myI < RecentOtpCache::K_MAX_RETRIES; ++myI) {
+		EXPECT_TRUE(myCache.lookup(K_OTP0, "n", "user", K_CLIENT0, myStatus, myT0 + seconds(1)));
+		EXPECT_EQ(OtpValidator::EOk, myStatus);
+	}
+	EXPECT_TRUE(myCache.lookup(K_OTP0, "n", "user", K_CLIENT0, myStatus, myT0 + seconds(1)));
+	EXPECT_EQ(OtpValidator::EReplayed, myStatus);
+	// Too late for a retry, the password is still remembered.
+	EXPECT_TRUE(myCache.lookup(K_OTP1, "n", "user", K_CLIENT0, myStatus, myT0 + RecentOtpCache::K_RETRY_WINDOW));
+	EXPECT_EQ(OtpValidator::EReplayed, myStatus);
+}
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
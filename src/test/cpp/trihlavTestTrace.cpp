@@ -0,0 +1,146 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/attributes.hpp>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"  // Brings in Google Mock.
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavLogApi.hpp"
+#include "trihlavLib/trihlavTrace.hpp"
+
+using std::string;
+using std::vector;
+using ::trihlav::initLog;
+using ::trihlav::Trace;
+
+static size_t countOf(const string &pText, const string &pWhat) {
+	size_t myRetVal = 0;
+	for (size_t myPos = pText.find(pWhat); myPos != string::npos; myPos = pText.find(pWhat, myPos + 1)) {
+		++myRetVal;
+	}
+	return myRetVal;
+}
+
+static string dump() {
+	std::ostringstream myOut;
+	Trace::writeChromeTrace(myOut);
+	return myOut.str();
+}
+
+static void inner() {
+	TRIHLAV_TRACE_SCOPE("TestTrace::inner");
+}
+
+static void outer() {
+	TRIHLAV_TRACE_SCOPE("TestTrace::outer");
+	inner();
+	inner();
+}
+
+class TestTrace: public ::testing::Test {
+public:
+	virtual void SetUp() {
+		Trace::setEnabled(false);
+		Trace::clear();
+	}
+
+	virtual void TearDown() {
+		Trace::setEnabled(false);
+	}
+};
+
+TEST_F(TestTrace,disabled) {
+	outer();
+	EXPECT_EQ(0U, countOf(dump(), "\"ph\":\"X\""));
+}
+
+TEST_F(TestTrace,nestedSpans) {
+	Trace::setEnabled(true);
+	outer();
+	Trace::setEnabled(false);
+	outer();
+	const string myJson = dump();
+	EXPECT_EQ(0U, myJson.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+	EXPECT_EQ(1U, countOf(myJson, "\"name\":\"TestTrace::outer\",\"ph\":\"X\""));
+	EXPECT_EQ(2U, countOf(myJson, "\"name\":\"TestTrace::inner\",\"ph\":\"X\""));
+	// Inner spans end first.
+	EXPECT_LT(myJson.find("TestTrace::inner"), myJson.find("TestTrace::outer"));
+	Trace::clear();
+	EXPECT_EQ(0U, countOf(dump(), "\"ph\":\"X\""));
+}
+
+TEST_F(TestTrace,ringKeepsNewest) {
+	Trace::setEnabled(true);
+	for (size_t myI = 0; myI < Trace::K_RING_SIZE + 100; ++myI) {
+		inner();
+	}
+	outer();
+	const string myJson = dump();
+	EXPECT_EQ(Trace::K_RING_SIZE - 1, countOf(myJson, "\"ph\":\"X\""));
+	EXPECT_EQ(1U, countOf(myJson, "TestTrace::outer"));
+}
+
+TEST_F(TestTrace,threadsAndConcurrentDump) {
+	const int K_THREADS = 4;
+	Trace::setEnabled(true);
+	std::atomic<bool> myStop(false);
+	vector<std::thread> myThreads;
+	for (int myT = 0; myT < K_THREADS; ++myT) {
+		myThreads.emplace_back([&myStop]() {
+			for (size_t myI = 0; myI < Trace::K_RING_SIZE || !myStop; ++myI) {
+				outer();
+			}
+		});
+	}
+	for (int myI = 0; myI < 10; ++myI) {
+		EXPECT_EQ(string::npos, dump().find("\"name\":\"\""));
+	}
+	myStop = true;
+	for (auto &myThread : myThreads) {
+		myThread.join();
+	}
+	const string myJson = dump();
+	// Every thread wrote more spans than its ring holds.
+	EXPECT_EQ(K_THREADS * (Trace::K_RING_SIZE - 1), countOf(myJson, "\"ph\":\"X\""));
+}
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
@@ -0,0 +1,92 @@
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ Dieses Programm ist Freie Software: Sie können es unter den Bedingungen
+ der GNU General Public License, wie von der Free Software Foundation,
+ Version 3 der Lizenz oder (nach Ihrer Wahl) jeder neueren
+ veröffentlichten Version, weiterverbreiten und/oder modifizieren.
+
+ Dieses Programm wird in der Hoffnung, dass es nützlich sein wird, aber
+ OHNE JEDE GEWÄHRLEISTUNG, bereitgestellt; sogar ohne die implizite
+ Gewährleistung der MARKTFÄHIGKEIT oder EIGNUNG FÜR EINEN BESTIMMTEN ZWECK.
+ Siehe die GNU General Public License für weitere Details.
+
+ Sie sollten eine Kopie der GNU General Public License zusammen mit diesem
+ Programm erhalten haben. Wenn nicht, siehe <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <boost/format.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/attributes.hpp>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"  // Brings in Google Mock.
+
+#include "trihlavLib/trihlavLog.hpp"
+#include "trihlavLib/trihlavPublicId.hpp"
+#include "trihlavLib/trihlavUnknownIdCache.hpp"
+
+using std::string;
+using boost::format;
+using ::trihlav::initLog;
+using ::trihlav::PublicId;
+using ::trihlav::UnknownIdCache;
+
+TEST(TestUnknownIdCache,perGeneration) {
+	BOOST_LOG_NAMED_SCOPE("TestUnknownIdCache::perGeneration");
+	UnknownIdCache myCache;
+	const PublicId myId("ccccccccbbbb");
+	EXPECT_FALSE(myCache.isUnknown(myId, 1));
+	myCache.addUnknown(myId, 1);
+	EXPECT_TRUE(myCache.isUnknown(myId, 1));
+	EXPECT_TRUE(myCache.isUnknown(myId, 1));
+	EXPECT_FALSE(myCache.isUnknown(PublicId("ccccccccbbbc"), 1));
+	// A new index generation forgets all unknown IDs.
+	EXPECT_FALSE(myCache.isUnknown(myId, 2));
+	EXPECT_EQ(3U, myCache.getMissCount());
+	EXPECT_EQ(1U, myCache.getDistinctCount());
+}
+
+TEST(TestUnknownIdCache,neverHidesOtherIds) {
+	BOOST_LOG_NAMED_SCOPE("TestUnknownIdCache::neverHidesOtherIds");
+	UnknownIdCache myCache;
+	for (int myI = 0; myI < 4 * int(UnknownIdCache::K_SLOTS); ++myI) {
+		myCache.addUnknown(PublicId((format("ccccccc%05x") % myI).str()), 7);
+	}
+	for (int myI = 0; myI < 4 * int(UnknownIdCache::K_SLOTS); ++myI) {
+		EXPECT_FALSE(myCache.isUnknown(PublicId((format("ddddddd%05x") % myI).str()), 7));
+	}
+	EXPECT_EQ(4 * UnknownIdCache::K_SLOTS, myCache.getDistinctCount());
+}
+
+TEST(TestUnknownIdCache,collidingIds) {
+	BOOST_LOG_NAMED_SCOPE("TestUnknownIdCache::collidingIds");
+	UnknownIdCache myCache;
+	const PublicId myUnknown("ab");
+	const PublicId myLoaded("hchd");
+	ASSERT_EQ(myUnknown.hash(), myLoaded.hash());
+	myCache.addUnknown(myUnknown, 3);
+	EXPECT_TRUE(myCache.isUnknown(myUnknown, 3));
+	EXPECT_FALSE(myCache.isUnknown(myLoaded, 3));
+	EXPECT_FALSE(myCache.isUnknown(myUnknown, 4));
+}
+
+int main(int argc, char **argv) {
+	initLog();
+	::testing::InitGoogleTest(&argc, argv);
+	int ret = RUN_ALL_TESTS();
+	return ret;
+}
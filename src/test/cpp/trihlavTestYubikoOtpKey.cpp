@@ -183,6 +183,53 @@ TEST_F(TestYubikoOtpKey, checkPassword) {
     //EXPECT_TRUE(false);
 }
 
+TEST_F(TestYubikoOtpKey, generateOtpSequence) {
+	path myTestCfgFile(unique_path("/tmp/trihlav-tests-%%%%-%%%%"));
+	EXPECT_TRUE(create_directory(myTestCfgFile));
+	NiceMock<MockFactory> myMockFactory;
+	myMockFactory.getSettings().setConfigDir(myTestCfgFile);
+	KeyManager &myKeyMan(myMockFactory.getKeyManager());
+	YubikoOtpKeyConfig myCfg0{createYubikoOtpKeyConfig(myKeyMan)};
+	yubikey_token_st myTkn{myCfg0.getToken()};
+	const uint16_t myCtr = myTkn.ctr;
+	for (int myI = 0; myI < 600; ++myI) {
+		const string myOtp{YubikoOtpKeyConfig::generateOtp(myTkn, myCfg0.getSecretKeyArray())};
+		EXPECT_EQ(YubikoOtpKeyConfig::EOtpOk, myCfg0.verifyOtp(myOtp)) << "OTP " << myI;
+	}
+	EXPECT_EQ(myCtr + 2, myTkn.ctr);
+	EXPECT_EQ(myTkn.ctr, myCfg0.getToken().ctr);
+	EXPECT_EQ(myTkn.use, myCfg0.getToken().use);
+	remove_all(myTestCfgFile);
+}
+
+TEST_F(TestYubikoOtpKey, hotKeyRecord) {
+	path myTestCfgFile(unique_path("/tmp/trihlav-tests-%%%%-%%%%"));
+	EXPECT_TRUE(create_directory(myTestCfgFile));
+	NiceMock<MockFactory> myMockFactory;
+	myMockFactory.getSettings().setConfigDir(myTestCfgFile);
+	KeyManager &myKeyMan(myMockFactory.getKeyManager());
+	const size_t myHotKeys = getHotKeys().getSize();
+	{
+		YubikoOtpKeyConfig myCfg0{createYubikoOtpKeyConfig(myKeyMan)};
+		myCfg0.setSysUser("trihlav_tst_usr0");
+		YubikoOtpKeyConfig myCfg1{myCfg0};
+		EXPECT_EQ(myHotKeys + 2, getHotKeys().getSize());
+		EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&myCfg0.getHotKey()) % 64);
+		EXPECT_NE(&myCfg0.getHotKey(), &myCfg1.getHotKey());
+		EXPECT_NE(&myCfg0.getCipher(), &myCfg1.getCipher());
+		EXPECT_EQ(&myCfg0, myCfg0.getHotKey().m_Cold);
+		EXPECT_EQ(&myCfg1, myCfg1.getHotKey().m_Cold);
+		EXPECT_TRUE(myCfg0 == myCfg1);
+		EXPECT_EQ(HotKey::hashSysUser("trihlav_tst_usr0"), myCfg1.getHotKey().m_SysUserHash);
+		EXPECT_EQ(0u, HotKey::hashSysUser(""));
+		// Counters advance in the record of the key only.
+		EXPECT_EQ(YubikoOtpKeyConfig::EOtpOk, myCfg0.verifyOtp(myCfg0.generateOtp()));
+		EXPECT_NE(myCfg0.getToken().use, myCfg1.getToken().use);
+	}
+	EXPECT_EQ(myHotKeys, getHotKeys().getSize());
+	remove_all(myTestCfgFile);
+}
+
 const int K_TST_STR_L = 8;
 
 TEST_F(TestYubikoOtpKey, generateHex) {